@@ -36,6 +36,11 @@ struct Camera_t{
     int index;
     int id;
     CamType type;
+    StreamPriority priority = PRIO_NORMAL;
+    int weight = 1;         /* share of batch slots, 1..SCHED_WEIGHT_MAX */
+    int slo_ms = 0;         /* frame latency target, 0 - default of the priority */
+    char roi[48] = "";      /* "x,y,w,h" fractions of the frame, empty - full frame */
+    char roi_mask[256] = "";/* polygon "x,y;x,y;x,y" fractions of the frame, empty - no mask */
 };
 
 
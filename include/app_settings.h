@@ -5,11 +5,13 @@
 #include <vector>
 #include "pscloud.h"
 #include "lot.h"
+#include "threading.h"
 
 #define CONSOLE_ENABLED     true
 #define START_AI_ENGINE     false
 
 #define SETTINGS_JSON_PATH  "settings.json"
+#define AUTOTUNE_JSON_PATH  "autotune.json"  // tuned batch and ort threads per host and model hash
 #define SERVER_TYPE         "ParkAI"
 #define WINDOW_TITLE        "ParkAI Server"
 
@@ -21,7 +23,6 @@
 #define RETRY_UPLOAD_OUTAGES_AFTER_SEC 60 // 1 minute to wait to retry uploading outages
 
 
-#define TICK_INTERVAL_MS   1
 #define MS_IN_DAY          (24*60*60*1000)
 #define MS_IN_HOUR         (60*60*1000)
 #define MS_IN_MINUTE       (60*1000)
@@ -34,6 +35,8 @@ class AppSettings{
         std::vector<Lot> gate_server_lots;
         std::string boottime; // UTC boot time format "%m/%d/%Y %H:%M:%S"
         std::string sys_boot; // UTC system boot time "%m/%d/%Y %H:%M:%S"
+        CpuTopology cpu_topology; // cpus of the runtime threads and gst workers
+        bool cpu_topology_auto = false; // "cpu_topology": "auto", detected on every start
         
 
         AppSettings() = default;
@@ -3,11 +3,70 @@
 
 #include "sqlite3.h"
 #include "CamerasUI.h"
+#include <mutex>
+
+/**
+ * @brief Camera list database kept open for the whole run (WAL mode) with its
+ * statements prepared once. Changes made through this or any other
+ * connection are detected with PRAGMA data_version, so the idle check costs
+ * no disk IO and no parsing.
+ */
+class CameraStore {
+    public:
+        CameraStore(const char *db_path);
+        ~CameraStore();
+        bool is_open(void) const {
+            std::lock_guard<std::mutex> lk(lock);
+            return db != nullptr;
+        }
+        /* opens the database if it is not open, the store stays the same object */
+        bool open(void);
+
+        int insert(const Camera_t &cam);
+        int remove(int cam_id);
+        int remove_all(void);
+        /* replaces the whole list in one transaction */
+        int replace_all(const std::vector<Camera_t> &cams);
+        int load(std::vector<Camera_t> &dst);
+        /**
+         * @brief Loads the camera list only if the database changed since the last load
+         * @return 1 if dst was reloaded, 0 if unchanged, -1 on error
+         */
+        int reload_if_changed(std::vector<Camera_t> &dst);
+
+        CameraStore(const CameraStore &) = delete;
+        CameraStore &operator=(const CameraStore &) = delete;
+
+    private:
+        std::string path;
+        sqlite3 *db = nullptr;
+        sqlite3_stmt *st_insert = nullptr;
+        sqlite3_stmt *st_delete = nullptr;
+        sqlite3_stmt *st_select = nullptr;
+        sqlite3_stmt *st_version = nullptr;
+        mutable std::mutex lock;
+        bool loaded = false;
+        int64_t seen_version = -1;  // data_version at the last load, other connections' commits
+        int seen_changes = -1;      // total_changes at the last load, this connection's commits
+
+        bool open_locked(void);
+        void close_locked(void);
+        bool create_table(void);
+        bool migrate(void);
+        bool prepare(void);
+        bool exec(const char *sql);
+        int insert_locked(const Camera_t &cam);
+        int64_t data_version(void);
+};
+
+/* store of db_path, opened on first use and kept open */
+CameraStore *camera_store(const char *db_path);
 
 sqlite3* open_database(const char* db_path);
 int create_cameras_table(const char* db_path);
 void insert_camera_db(const char* db_path, Camera_t cam);
 int delete_camera_db(const char* db_path, int cam_id);
 int get_all_cameras_db(const char* db_path, std::vector<Camera_t> &dst);
+int reload_cameras_db(const char* db_path, std::vector<Camera_t> &dst);
 int delete_all_cams(const char * db_path);
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,419 @@
+/**
+ * @file    kernels_bench.cpp
+ * @brief   Micro-benchmarks for detector hot paths
+ * @author  Jonas Vaicekauskas
+ * @date    2026-10-19
+ * @details
+ * Runs the model-free kernels of the detection pipeline (preprocess, resize,
+ * HWC->CHW, YOLO decode, NMS, IoU, CTC decode, crop, detection txt write) on
+ * fixed synthetic inputs generated from a constant seed, so numbers are
+ * comparable across commits. Results are written as JSON, one kernel per line,
+ * and can be checked against a baseline file:
+ *
+ *   parkai-kernels-bench --json base.json                       (old build)
+ *   parkai-kernels-bench --compare base.json --tolerance 0.10   (new build)
+ *
+ * Exit code 3 means at least one kernel is slower than baseline * (1 + tolerance).
+ */
+
+#include "detector.h"
+#include "measure_time.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#define KBENCH_SEED 42
+#define KBENCH_REPS 15
+#define KBENCH_MIN_REP_MS 20.0
+#define KBENCH_DEFAULT_TOLERANCE 0.10
+
+/* synthetic input sizes, close to production */
+#define KBENCH_FRAME_W 1920
+#define KBENCH_FRAME_H 1080
+#define KBENCH_YOLO_PREDS 8400
+#define KBENCH_YOLO_CHANNELS 5
+#define KBENCH_NMS_BOXES 300
+#define KBENCH_IOU_PAIRS 4096
+#define KBENCH_LPR_SEQ 18
+#define KBENCH_DETS_PER_FILE 20
+
+/* exit codes */
+#define KBENCH_OK 0
+#define KBENCH_ERR_ARGS 1
+#define KBENCH_REGRESSION 3
+
+
+struct KernelResult{
+    std::string name;
+    uint64_t iters = 0;      // iterations per repetition
+    double median_us = 0.0;  // per iteration
+    double min_us = 0.0;
+    double max_us = 0.0;
+    double checksum = 0.0;   // output digest, changes when results change
+};
+
+struct KernelCase{
+    std::string name;
+    std::function<double(void)> fn; // returns a value folded into the checksum
+};
+
+
+/* keeps the optimizer from dropping kernel results */
+static volatile double g_sink = 0.0;
+
+
+static KernelResult run_kernel(const KernelCase &k, int reps){
+    KernelResult r;
+    r.name = k.name;
+    r.checksum = k.fn(); // warmup, also the reference output digest
+
+    /* calibrate iterations so one repetition lasts at least KBENCH_MIN_REP_MS */
+    uint64_t iters = 1;
+    while (true){
+        StopWatch st;
+        for (uint64_t i = 0; i < iters; i++){
+            g_sink = g_sink + k.fn();
+        }
+        if (st.stop() >= KBENCH_MIN_REP_MS || iters >= (1ull << 30)){
+            break;
+        }
+        iters *= 2;
+    }
+    r.iters = iters;
+
+    std::vector<double> per_iter;
+    for (int rep = 0; rep < reps; rep++){
+        StopWatch st;
+        for (uint64_t i = 0; i < iters; i++){
+            g_sink = g_sink + k.fn();
+        }
+        per_iter.push_back(st.stop() * 1000.0 / iters);
+    }
+    std::sort(per_iter.begin(), per_iter.end());
+    r.median_us = per_iter[per_iter.size() / 2];
+    r.min_us = per_iter.front();
+    r.max_us = per_iter.back();
+    return r;
+}
+
+
+/* ---- synthetic inputs ---- */
+
+static cv::Mat make_frame(std::mt19937 &rng, int w, int h){
+    cv::Mat img(h, w, CV_8UC3);
+    std::uniform_int_distribution<int> d(0, 255);
+    for (int y = 0; y < h; y++){
+        uchar *row = img.ptr(y);
+        for (int x = 0; x < w * 3; x++){
+            row[x] = (uchar)d(rng);
+        }
+    }
+    return img;
+}
+
+/* YOLO output [batch, 5, preds]: a few clusters of overlapping cars, rest noise */
+static std::vector<float> make_yolo_output(std::mt19937 &rng, int batch, int channels, int preds){
+    std::vector<float> out((size_t)batch * channels * preds);
+    std::uniform_real_distribution<float> pos(40.0f, 600.0f);
+    std::uniform_real_distribution<float> size(30.0f, 200.0f);
+    std::uniform_real_distribution<float> jitter(-6.0f, 6.0f);
+    std::uniform_real_distribution<float> noise(0.0f, 0.2f);
+    std::uniform_real_distribution<float> hi(0.5f, 0.95f);
+    for (int b = 0; b < batch; b++){
+        float *o = out.data() + (size_t)b * channels * preds;
+        float cx = pos(rng), cy = pos(rng), w = size(rng), h = size(rng);
+        for (int p = 0; p < preds; p++){
+            bool car = (p % 100) < 3; // 3% of anchors fire
+            if (car && p % 1000 == 0){
+                cx = pos(rng); cy = pos(rng); w = size(rng); h = size(rng);
+            }
+            o[0 * preds + p] = car ? cx + jitter(rng) : pos(rng);
+            o[1 * preds + p] = car ? cy + jitter(rng) : pos(rng);
+            o[2 * preds + p] = car ? w + jitter(rng) : size(rng);
+            o[3 * preds + p] = car ? h + jitter(rng) : size(rng);
+            o[4 * preds + p] = car ? hi(rng) : noise(rng);
+        }
+    }
+    return out;
+}
+
+static std::vector<bbox> make_boxes(std::mt19937 &rng, int n){
+    std::vector<bbox> boxes(n);
+    std::uniform_real_distribution<float> pos(0.0f, 1800.0f);
+    std::uniform_real_distribution<float> size(40.0f, 300.0f);
+    std::uniform_real_distribution<float> jitter(-15.0f, 15.0f);
+    std::uniform_real_distribution<float> conf(0.3f, 1.0f);
+    float x = 0, y = 0, w = 0, h = 0;
+    for (int i = 0; i < n; i++){
+        if (i % 10 == 0){ // clusters of 10 overlapping boxes
+            x = pos(rng); y = pos(rng); w = size(rng); h = size(rng);
+        }
+        bbox &b = boxes[i];
+        b.x1 = x + jitter(rng);
+        b.y1 = y + jitter(rng);
+        b.x2 = b.x1 + w + jitter(rng);
+        b.y2 = b.y1 + h + jitter(rng);
+        b.conf = conf(rng);
+        b.cid = 0;
+    }
+    return boxes;
+}
+
+static std::vector<parknetDet> make_dets(std::mt19937 &rng, int n){
+    std::vector<bbox> boxes = make_boxes(rng, n);
+    std::vector<parknetDet> dets;
+    for (int i = 0; i < n; i++){
+        parknetDet d;
+        d.car = boxes[i];
+        d.lplate = {boxes[i].x1 + 10, boxes[i].x1 + 60, boxes[i].y1 + 10, boxes[i].y1 + 30, 0.9f, 0};
+        d.lpr_found = (i % 2) == 0;
+        d.plText = d.lpr_found ? "ABC" + std::to_string(1000 + i) : "";
+        dets.push_back(d);
+    }
+    return dets;
+}
+
+
+/* ---- baseline compare ---- */
+
+/* reads files written by write_json: one {"name": ..., "median_us": ...} per line */
+static int load_baseline(const std::string &path, std::map<std::string, double> &base){
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == nullptr){
+        perror("baseline");
+        return 0;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), f)){
+        char name[128];
+        double median = 0.0;
+        const char *p = strstr(line, "\"name\": \"");
+        const char *m = strstr(line, "\"median_us\": ");
+        if (p == nullptr || m == nullptr){
+            continue;
+        }
+        if (sscanf(p, "\"name\": \"%127[^\"]\"", name) == 1 && sscanf(m, "\"median_us\": %lf", &median) == 1){
+            base[name] = median;
+        }
+    }
+    fclose(f);
+    return !base.empty();
+}
+
+static void write_json(FILE *f, const std::vector<KernelResult> &results){
+    fprintf(f, "{\n  \"bench\": \"parkai-kernels-bench\",\n  \"seed\": %d,\n  \"kernels\": [\n", KBENCH_SEED);
+    for (size_t i = 0; i < results.size(); i++){
+        const KernelResult &r = results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"iters\": %lu, \"median_us\": %.3f, \"min_us\": %.3f, \"max_us\": %.3f, \"checksum\": %.6g}%s\n",
+                r.name.c_str(), r.iters, r.median_us, r.min_us, r.max_us, r.checksum,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+
+static void print_usage(const char *prog){
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --json FILE         write results to FILE (default stdout)\n"
+        "  --filter STR        run kernels whose name contains STR\n"
+        "  --reps N            measured repetitions per kernel (default %d)\n"
+        "  --compare FILE      baseline results to compare against\n"
+        "  --tolerance F       allowed slowdown vs baseline median (default %.2f)\n"
+        "Exit code: 0 ok, 1 bad arguments, 3 regression against baseline\n",
+        prog, KBENCH_REPS, KBENCH_DEFAULT_TOLERANCE);
+}
+
+
+int main(int argc, char **argv){
+    std::string json_fn, filter, baseline_fn;
+    int reps = KBENCH_REPS;
+    double tolerance = KBENCH_DEFAULT_TOLERANCE;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if (i + 1 >= argc){
+            print_usage(argv[0]);
+            return KBENCH_ERR_ARGS;
+        }
+        const char *val = argv[++i];
+        if (arg == "--json")            json_fn = val;
+        else if (arg == "--filter")     filter = val;
+        else if (arg == "--reps")       reps = atoi(val);
+        else if (arg == "--compare")    baseline_fn = val;
+        else if (arg == "--tolerance")  tolerance = atof(val);
+        else{
+            print_usage(argv[0]);
+            return KBENCH_ERR_ARGS;
+        }
+    }
+    if (reps <= 0 || tolerance < 0.0){
+        print_usage(argv[0]);
+        return KBENCH_ERR_ARGS;
+    }
+
+    std::mt19937 rng(KBENCH_SEED);
+
+    /* inputs are generated once, kernels only read them */
+    cv::Mat frame = make_frame(rng, KBENCH_FRAME_W, KBENCH_FRAME_H);
+    std::vector<unsigned char> nv12(pix_fmt_nbytes(PIX_FMT_NV12, KBENCH_FRAME_W, KBENCH_FRAME_H));
+    {
+        std::uniform_int_distribution<int> d(0, 255);
+        for (auto &p : nv12){
+            p = (unsigned char)d(rng);
+        }
+    }
+    ImgUtils::FrameView frame_nv12 = ImgUtils::frame_view(nv12.data(), KBENCH_FRAME_W, KBENCH_FRAME_H, PIX_FMT_NV12);
+    cv::Mat frame_f = ImgUtils::preprocess_image(frame);
+    cv::Mat fit_f = ImgUtils::resize_image(frame_f, YOLO_INPUT_W, YOLO_INPUT_H);
+    std::vector<float> chw((size_t)BATCH_SIZE * 3 * YOLO_INPUT_H * YOLO_INPUT_W);
+    std::vector<float> yolo_out = make_yolo_output(rng, BATCH_SIZE, KBENCH_YOLO_CHANNELS, KBENCH_YOLO_PREDS);
+    std::vector<ImgMeta> meta(BATCH_SIZE, ImgMeta{KBENCH_FRAME_W, KBENCH_FRAME_H});
+    std::vector<bbox> nms_boxes = make_boxes(rng, KBENCH_NMS_BOXES);
+    std::vector<bbox> iou_boxes = make_boxes(rng, KBENCH_IOU_PAIRS * 2);
+    std::vector<parknetDet> dets = make_dets(rng, KBENCH_DETS_PER_FILE);
+    std::string det_fn = "/tmp/parkai-kernels-bench.txt";
+
+    const std::vector<std::string> alphabet = {
+        "0","1","2","3","4","5","6","7","8","9",
+        "A","B","C","D","E","F","G","H","I","J","K","L","M","N","P","Q","R","S","T","U","V","W","X","Y","Z",
+        ""};
+    std::vector<int> ctc_seq(KBENCH_LPR_SEQ);
+    {
+        std::uniform_int_distribution<int> d(0, LPRNET_BLANK_CLASS);
+        for (auto &c : ctc_seq){
+            c = d(rng);
+        }
+    }
+
+    std::vector<KernelCase> cases = {
+        {"preprocess_image_1080p", [&](){
+            cv::Mat out = ImgUtils::preprocess_image(frame);
+            return (double)out.rows;
+        }},
+        {"resize_image_1080p_to_640", [&](){
+            cv::Mat out = ImgUtils::resize_image(frame_f, YOLO_INPUT_W, YOLO_INPUT_H);
+            return (double)out.cols;
+        }},
+        {"hwc_to_chw_640_batch", [&](){
+            const size_t img_size = 3 * YOLO_INPUT_H * YOLO_INPUT_W;
+            for (int b = 0; b < BATCH_SIZE; b++){
+                ImgUtils::hwc_to_chw(fit_f, 3, YOLO_INPUT_H, YOLO_INPUT_W, chw.data() + b * img_size);
+            }
+            return (double)chw[img_size / 2];
+        }},
+        {"resize_normalize_chw_1080p_to_640_batch", [&](){
+            /* the path the engine takes now, uint8 frame straight into the tensor */
+            const size_t img_size = 3 * YOLO_INPUT_H * YOLO_INPUT_W;
+            for (int b = 0; b < BATCH_SIZE; b++){
+                ImgUtils::resize_normalize_chw(frame, YOLO_INPUT_W, YOLO_INPUT_H, chw.data() + b * img_size);
+            }
+            return (double)chw[img_size / 2];
+        }},
+        {"resize_normalize_chw_nv12_1080p_to_640_batch", [&](){
+            /* frames as the workers publish them with FRAME_TRANSPORT_YUV */
+            const size_t img_size = 3 * YOLO_INPUT_H * YOLO_INPUT_W;
+            for (int b = 0; b < BATCH_SIZE; b++){
+                ImgUtils::resize_normalize_chw(frame_nv12, YOLO_INPUT_W, YOLO_INPUT_H, chw.data() + b * img_size);
+            }
+            return (double)chw[img_size / 2];
+        }},
+        {"resize_normalize_chw_plate_crops", [&](){
+            std::vector<cv::Mat> plates(LPR_BATCH_SIZE, frame(cv::Rect(800, 500, 240, 80)));
+            std::vector<float> lpr_in;
+            ImgUtils::load_chw_batch(plates.data(), plates.size(), plates.size(),
+                                     LPRNET_INPUT_W, LPRNET_INPUT_H, lpr_in);
+            return (double)lpr_in[lpr_in.size() / 2];
+        }},
+        {"decode_yolo_output_batch", [&](){
+            auto out = detector::decode_yolo_output(yolo_out.data(), BATCH_SIZE, KBENCH_YOLO_CHANNELS,
+                KBENCH_YOLO_PREDS, meta, VEHICLE_DET_CONFIDENCE_THRESHOLD);
+            double n = 0;
+            for (const auto &v : out){
+                n += v.size();
+            }
+            return n;
+        }},
+        {"non_max_suppression", [&](){
+            std::vector<bbox> boxes = nms_boxes; // NMS sorts in place
+            return (double)non_max_suppression(boxes).size();
+        }},
+        {"iou_pairs", [&](){
+            double acc = 0.0;
+            for (int i = 0; i < KBENCH_IOU_PAIRS; i++){
+                acc += IoU(iou_boxes[2 * i], iou_boxes[2 * i + 1]);
+            }
+            return acc;
+        }},
+        {"ctc_decode", [&](){
+            return (double)detector::ctc_decode(ctc_seq.data(), KBENCH_LPR_SEQ, alphabet, LPRNET_BLANK_CLASS).size();
+        }},
+        {"crop_image", [&](){
+            double acc = 0.0;
+            for (int i = 0; i < 32; i++){
+                const bbox &b = nms_boxes[i];
+                cv::Mat c = ImgUtils::crop_image(frame_f, (int)b.x1, (int)b.y1, (int)b.x2, (int)b.y2);
+                acc += c.cols;
+            }
+            return acc;
+        }},
+        {"write_detection_info", [&](){
+            return (double)wdet::WriteDetectionInfo(dets, det_fn);
+        }},
+    };
+
+    std::vector<KernelResult> results;
+    for (const auto &k : cases){
+        if (!filter.empty() && k.name.find(filter) == std::string::npos){
+            continue;
+        }
+        KernelResult r = run_kernel(k, reps);
+        fprintf(stderr, "%-28s %10.3f us  (min %.3f, max %.3f, %lu iters)\n",
+                r.name.c_str(), r.median_us, r.min_us, r.max_us, r.iters);
+        results.push_back(r);
+    }
+    remove(det_fn.c_str());
+
+    FILE *f = stdout;
+    if (!json_fn.empty()){
+        f = fopen(json_fn.c_str(), "w");
+        if (f == nullptr){
+            perror("json");
+            f = stdout;
+        }
+    }
+    write_json(f, results);
+    if (f != stdout){
+        fclose(f);
+    }
+
+    if (baseline_fn.empty()){
+        return KBENCH_OK;
+    }
+    std::map<std::string, double> base;
+    if (!load_baseline(baseline_fn, base)){
+        fprintf(stderr, "Could not read baseline %s\n", baseline_fn.c_str());
+        return KBENCH_ERR_ARGS;
+    }
+    int nregress = 0;
+    for (const auto &r : results){
+        auto it = base.find(r.name);
+        if (it == base.end() || it->second <= 0.0){
+            fprintf(stderr, "%-28s no baseline\n", r.name.c_str());
+            continue;
+        }
+        double ratio = r.median_us / it->second;
+        bool slow = ratio > 1.0 + tolerance;
+        fprintf(stderr, "%-28s %8.3f -> %8.3f us  x%.2f%s\n", r.name.c_str(),
+                it->second, r.median_us, ratio, slow ? "  REGRESSION" : "");
+        if (slow){
+            nregress++;
+        }
+    }
+    return nregress ? KBENCH_REGRESSION : KBENCH_OK;
+}
@@ -0,0 +1,559 @@
+/**
+ * @file    parkai_bench.cpp
+ * @brief   Offline replay benchmark for the StreamMuxer -> Engine pipeline
+ * @author  Jonas Vaicekauskas
+ * @date    2026-10-19
+ * @details
+ * Replays recorded frames (image directory, raw RGB dumps or a video file) as
+ * N virtual cameras at a fixed rate through the same muxer and engine path the
+ * server uses, without cameras or gst_worker children. Reports throughput,
+ * per-stage latency, CPU time and RSS as JSON so builds can be compared.
+ *
+ * With --url the cameras are real gst_worker children instead (rtsp://,
+ * file:// or test:// sources), e.g. a 256 stream soak test of the muxer:
+ *   parkai-bench --url test://320x240@5 --cams 256 --muxer-only
+ *
+ * Run from the build root (gst_worker path) holding the .onnx models.
+ */
+
+#include "detector.h"
+#include "streammuxer.h"
+#include "measure_time.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#define BENCH_DEFAULT_CAMS 4
+#define BENCH_DEFAULT_FPS 5
+#define BENCH_DEFAULT_DURATION_S 30
+#define BENCH_DEFAULT_WARMUP_S 5
+#define BENCH_DEFAULT_MAX_FRAMES 100
+#define BENCH_DEFAULT_WORKDIR "/tmp/parkai-bench/"
+#define BENCH_DEFAULT_JSON "parkai-bench.json"
+#define BENCH_DEFAULT_SPAWN_MS 20
+
+/* exit codes */
+#define BENCH_OK 0
+#define BENCH_ERR_ARGS 1
+#define BENCH_ERR_NO_BATCHES 2
+
+
+struct BenchArgs{
+    std::string input;
+    std::string url;
+    std::string workdir = BENCH_DEFAULT_WORKDIR;
+    std::string json = BENCH_DEFAULT_JSON;
+    int cams = BENCH_DEFAULT_CAMS;
+    double fps = BENCH_DEFAULT_FPS;
+    int batch = BATCH_SIZE;
+    int duration_s = BENCH_DEFAULT_DURATION_S;
+    int warmup_s = BENCH_DEFAULT_WARMUP_S;
+    int max_frames = BENCH_DEFAULT_MAX_FRAMES;
+    int spawn_ms = BENCH_DEFAULT_SPAWN_MS;
+    bool muxer_only = false;
+    uint32_t raw_w = 0;
+    uint32_t raw_h = 0;
+};
+
+struct ReplayFrame{
+    std::vector<uchar> data;
+    uint32_t w = 0;
+    uint32_t h = 0;
+};
+
+/* per-batch samples of every stage, in ms */
+struct StageSamples{
+    std::vector<double> queue, preprocess, car_det, secondary, save, write, total;
+
+    void add(const StageTimes &t){
+        queue.push_back(t.queue);
+        preprocess.push_back(t.preprocess);
+        car_det.push_back(t.car_det);
+        secondary.push_back(t.secondary);
+        save.push_back(t.save);
+        write.push_back(t.write);
+        total.push_back(t.total);
+    }
+};
+
+
+static void print_usage(const char *prog){
+    fprintf(stderr,
+        "Usage: %s --input <dir|video|file.rgb> | --url <url> [options]\n"
+        "  --input PATH      image directory (png/jpg/bmp/rgb), raw RGB file or video file\n"
+        "  --url URL         gst_worker sources instead of replay, %%d is replaced by the cam index\n"
+        "                    rtsp://..., file:///v.h264[?fps=N&loop=0|1], test://WxH@fps[?frames=N]\n"
+        "  --spawn-ms MS     delay between gst_worker starts (default %d)\n"
+        "  --muxer-only      pull and release batches without inference\n"
+        "  --size WxH        frame size for raw .rgb/.raw inputs\n"
+        "  --cams N          virtual cameras (default %d)\n"
+        "  --fps R           frames per second per camera (default %d)\n"
+        "  --batch B         engine batch size, <= cams (default %d)\n"
+        "  --duration S      measured seconds (default %d)\n"
+        "  --warmup S        seconds discarded before measuring (default %d)\n"
+        "  --max-frames N    frames loaded from a video (default %d)\n"
+        "  --workdir DIR     engine output dir (default %s)\n"
+        "  --json FILE       result file (default %s)\n"
+        "Exit code: 0 ok, 1 bad arguments/input, 2 no batches processed\n",
+        prog, BENCH_DEFAULT_SPAWN_MS, BENCH_DEFAULT_CAMS, BENCH_DEFAULT_FPS, BATCH_SIZE, BENCH_DEFAULT_DURATION_S,
+        BENCH_DEFAULT_WARMUP_S, BENCH_DEFAULT_MAX_FRAMES, BENCH_DEFAULT_WORKDIR, BENCH_DEFAULT_JSON);
+}
+
+
+static int parse_args(int argc, char **argv, BenchArgs &a){
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help"){
+            return 0;
+        }
+        if (arg == "--muxer-only"){
+            a.muxer_only = true;
+            continue;
+        }
+        if (i + 1 >= argc){
+            fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return 0;
+        }
+        const char *val = argv[++i];
+        if (arg == "--input")            a.input = val;
+        else if (arg == "--url")         a.url = val;
+        else if (arg == "--spawn-ms")    a.spawn_ms = atoi(val);
+        else if (arg == "--workdir")     a.workdir = val;
+        else if (arg == "--json")        a.json = val;
+        else if (arg == "--cams")        a.cams = atoi(val);
+        else if (arg == "--fps")         a.fps = atof(val);
+        else if (arg == "--batch")       a.batch = atoi(val);
+        else if (arg == "--duration")    a.duration_s = atoi(val);
+        else if (arg == "--warmup")      a.warmup_s = atoi(val);
+        else if (arg == "--max-frames")  a.max_frames = atoi(val);
+        else if (arg == "--size"){
+            if (sscanf(val, "%ux%u", &a.raw_w, &a.raw_h) != 2){
+                fprintf(stderr, "Invalid --size %s, expected WxH\n", val);
+                return 0;
+            }
+        }
+        else{
+            fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return 0;
+        }
+    }
+    if (a.input.empty() == a.url.empty()){
+        fprintf(stderr, "Exactly one of --input or --url is required\n");
+        return 0;
+    }
+    if (a.cams <= 0 || a.fps <= 0.0 || a.batch <= 0 || a.duration_s <= 0 || a.warmup_s < 0){
+        fprintf(stderr, "cams, fps, batch and duration must be positive\n");
+        return 0;
+    }
+    if (a.batch > a.cams){
+        fprintf(stderr, "Batch size can't be bigger than cams, setting batch to %d\n", a.cams);
+        a.batch = a.cams;
+    }
+    if (a.workdir.back() != '/'){
+        a.workdir += "/";
+    }
+    return 1;
+}
+
+
+static bool has_ext(const std::string &path, std::initializer_list<const char *> exts){
+    std::string ext = std::filesystem::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    for (const char *e : exts){
+        if (ext == e){
+            return true;
+        }
+    }
+    return false;
+}
+
+/* frames are kept RGB, same as the gst_worker capsfilter output */
+static int push_mat(std::vector<ReplayFrame> &frames, const cv::Mat &bgr){
+    if (bgr.empty()){
+        return 0;
+    }
+    cv::Mat rgb;
+    cv::cvtColor(bgr, rgb, cv::COLOR_BGR2RGB);
+    ReplayFrame f;
+    f.w = rgb.cols;
+    f.h = rgb.rows;
+    f.data.resize((size_t)f.w * f.h * 3);
+    for (int r = 0; r < rgb.rows; r++){
+        memcpy(f.data.data() + (size_t)r * f.w * 3, rgb.ptr(r), (size_t)f.w * 3);
+    }
+    frames.push_back(std::move(f));
+    return 1;
+}
+
+static int load_raw(std::vector<ReplayFrame> &frames, const std::string &path, uint32_t w, uint32_t h, int max_frames){
+    if (w == 0 || h == 0){
+        fprintf(stderr, "[%s] raw input needs --size WxH\n", path.c_str());
+        return 0;
+    }
+    std::ifstream f(path, std::ios::binary);
+    if (!f){
+        return 0;
+    }
+    size_t fsize = (size_t)w * h * 3;
+    int n = 0;
+    /* a raw file may hold several back-to-back frames */
+    while (n < max_frames){
+        ReplayFrame fr;
+        fr.w = w;
+        fr.h = h;
+        fr.data.resize(fsize);
+        if (!f.read((char *)fr.data.data(), fsize)){
+            break;
+        }
+        frames.push_back(std::move(fr));
+        n++;
+    }
+    return n;
+}
+
+static int load_frames(const BenchArgs &a, std::vector<ReplayFrame> &frames){
+    namespace fs = std::filesystem;
+    if (fs::is_directory(a.input)){
+        std::vector<std::string> files;
+        for (const auto &entry : fs::directory_iterator(a.input)){
+            if (entry.is_regular_file()){
+                files.push_back(entry.path().string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        for (const auto &fn : files){
+            if ((int)frames.size() >= a.max_frames){
+                break;
+            }
+            if (has_ext(fn, {".rgb", ".raw"})){
+                load_raw(frames, fn, a.raw_w, a.raw_h, a.max_frames - (int)frames.size());
+            }
+            else if (has_ext(fn, {".png", ".jpg", ".jpeg", ".bmp"})){
+                push_mat(frames, cv::imread(fn, cv::IMREAD_COLOR));
+            }
+        }
+    }
+    else if (has_ext(a.input, {".rgb", ".raw"})){
+        load_raw(frames, a.input, a.raw_w, a.raw_h, a.max_frames);
+    }
+    else if (has_ext(a.input, {".png", ".jpg", ".jpeg", ".bmp"})){
+        push_mat(frames, cv::imread(a.input, cv::IMREAD_COLOR));
+    }
+    else{
+        cv::VideoCapture cap(a.input);
+        if (!cap.isOpened()){
+            fprintf(stderr, "Could not open video %s\n", a.input.c_str());
+            return 0;
+        }
+        cv::Mat img;
+        while ((int)frames.size() < a.max_frames && cap.read(img)){
+            push_mat(frames, img);
+        }
+        cap.release();
+    }
+    return !frames.empty();
+}
+
+
+/* "%d" in the url template is replaced by the camera index */
+static std::string make_url(const std::string &tmpl, int index){
+    std::string url = tmpl;
+    size_t pos = url.find("%d");
+    if (pos != std::string::npos){
+        url.replace(pos, 2, std::to_string(index));
+    }
+    return url;
+}
+
+/* every gst_worker holds a socket, an eventfd and a shm fd in the parent */
+static void raise_nofile_limit(void){
+    rlimit rl{};
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max){
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) != 0){
+            perror("setrlimit");
+        }
+    }
+}
+
+static double percentile(std::vector<double> v, double p){
+    if (v.empty()){
+        return 0.0;
+    }
+    std::sort(v.begin(), v.end());
+    size_t rank = (size_t)(p / 100.0 * (v.size() - 1) + 0.5);
+    return v[std::min(rank, v.size() - 1)];
+}
+
+static double mean(const std::vector<double> &v){
+    if (v.empty()){
+        return 0.0;
+    }
+    double sum = 0.0;
+    for (double x : v){
+        sum += x;
+    }
+    return sum / v.size();
+}
+
+static double tv_sec(const timeval &tv){
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* JSON string body of s, quotes, backslashes and control characters escaped */
+static std::string json_escape(const std::string &s){
+    std::string out;
+    out.reserve(s.size() + 8);
+    for (unsigned char c : s){
+        switch (c){
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20){
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                }
+                else {
+                    out += (char)c;
+                }
+        }
+    }
+    return out;
+}
+
+static void write_stage(FILE *f, const char *name, const std::vector<double> &v, bool last){
+    fprintf(f, "    \"%s\": {\"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f}%s\n",
+            name, mean(v), percentile(v, 50), percentile(v, 95), percentile(v, 99),
+            v.empty() ? 0.0 : *std::max_element(v.begin(), v.end()), last ? "" : ",");
+}
+
+
+int main(int argc, char **argv){
+    BenchArgs args;
+    if (!parse_args(argc, argv, args)){
+        print_usage(argv[0]);
+        return BENCH_ERR_ARGS;
+    }
+
+    bool replay = args.url.empty();
+    std::vector<ReplayFrame> frames;
+    if (replay){
+        if (!load_frames(args, frames)){
+            fprintf(stderr, "No frames loaded from %s\n", args.input.c_str());
+            return BENCH_ERR_ARGS;
+        }
+        fprintf(stderr, "Loaded %zu frames (%ux%u) from %s\n", frames.size(), frames[0].w, frames[0].h, args.input.c_str());
+    }
+    else{
+        raise_nofile_limit();
+    }
+
+    std::filesystem::create_directories(args.workdir);
+
+    StreamMuxer muxer(args.cams);
+    std::vector<uint32_t> src_ids;
+    for (int i = 0; i < args.cams; i++){
+        if (replay){
+            uint32_t sid = muxer.create_replay_source(i, "replay-" + std::to_string(i));
+            if (sid == STREAMMUX_RET_ERROR){
+                fprintf(stderr, "Failed to create replay source %d\n", i);
+                return BENCH_ERR_ARGS;
+            }
+            src_ids.push_back(sid);
+        }
+        else{
+            if (!muxer.create_source(i, make_url(args.url, i))){
+                fprintf(stderr, "Failed to create source %d\n", i);
+                return BENCH_ERR_ARGS;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(args.spawn_ms));
+        }
+    }
+
+    std::unique_ptr<Engine> engine;
+    if (!args.muxer_only){
+        engine = std::make_unique<Engine>(0, args.workdir.c_str(), args.batch);
+        engine->connectSource(&muxer);
+    }
+
+    /* feeder: every camera gets a frame each period, offset so cameras differ */
+    std::atomic<bool> feeding{replay};
+    std::atomic<uint64_t> pushed{0}, dropped{0};
+    std::thread feeder([&](){
+        auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / args.fps));
+        auto next = std::chrono::steady_clock::now();
+        uint64_t tick = 0;
+        while (feeding){
+            for (int i = 0; i < args.cams; i++){
+                const ReplayFrame &f = frames[(tick + i) % frames.size()];
+                if (muxer.push_frame(src_ids[i], f.data.data(), f.data.size(), f.w, f.h)){
+                    pushed++;
+                }
+                else{
+                    dropped++;
+                }
+            }
+            tick++;
+            next += period;
+            std::this_thread::sleep_until(next);
+        }
+    });
+
+    /* muxer-only mode: pull and release batches, no inference */
+    uint64_t mux_batches = 0, mux_frames = 0;
+    StageTimes mux_times;
+    auto run_batch = [&](){
+        if (engine){
+            engine->runn(false);
+            return;
+        }
+        std::vector<ImgData> batch;
+        StopWatch st_total;
+        if (!muxer.pull_frames_batch(batch, args.batch)){
+            return;
+        }
+        uint64_t now_ms = steady_ms();
+        mux_times = StageTimes{};
+        for (const auto & im:batch){
+            if (im.ready_ms != 0 && now_ms - im.ready_ms > mux_times.queue){
+                mux_times.queue = (double)(now_ms - im.ready_ms);
+            }
+            muxer.reset_frame(im.id);
+        }
+        mux_times.nframes = batch.size();
+        mux_times.total = st_total.stop();
+        mux_frames += batch.size();
+        mux_batches++;
+    };
+    auto n_batches = [&](){ return engine ? engine->get_nbatches() : mux_batches; };
+    auto n_frames = [&](){ return engine ? engine->get_nframes() : mux_frames; };
+    auto last_times = [&]() -> const StageTimes & { return engine ? engine->get_stage_times() : mux_times; };
+
+    StageSamples samples;
+    bool measuring = false;
+    uint64_t last_batches = 0;
+    uint64_t m_batches0 = 0, m_frames0 = 0, m_pushed0 = 0, m_dropped0 = 0, m_restarts0 = 0;
+    rusage ru0{}, ru1{};
+    size_t rss_start = 0;
+    StopWatch st_measure;
+
+    auto t_start = std::chrono::steady_clock::now();
+    auto t_measure = t_start + std::chrono::seconds(args.warmup_s);
+    auto t_end = t_measure + std::chrono::seconds(args.duration_s);
+
+    fprintf(stderr, "Warmup %d s, measuring %d s with %d cams @ %.1f fps, batch %d\n",
+            args.warmup_s, args.duration_s, args.cams, args.fps, args.batch);
+
+    while (true){
+        auto now = std::chrono::steady_clock::now();
+        if (now >= t_end){
+            break;
+        }
+        if (!measuring && now >= t_measure){
+            measuring = true;
+            m_batches0 = n_batches();
+            m_frames0 = n_frames();
+            m_restarts0 = muxer.get_restarts();
+            m_pushed0 = pushed;
+            m_dropped0 = dropped;
+            rss_start = current_rss_kb();
+            getrusage(RUSAGE_SELF, &ru0);
+            st_measure.start();
+        }
+        run_batch();
+        uint64_t nb = n_batches();
+        if (nb != last_batches){
+            last_batches = nb;
+            if (measuring){
+                samples.add(last_times());
+            }
+        }
+        else{
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    double elapsed_s = st_measure.stop() / 1000.0;
+    getrusage(RUSAGE_SELF, &ru1);
+    size_t rss_end = current_rss_kb();
+    uint64_t restarts = muxer.get_restarts() - m_restarts0;
+    int alive = replay ? args.cams : muxer.count_sources(ALIVE);
+
+    feeding = false;
+    feeder.join();
+    uint64_t batches = n_batches() - m_batches0;
+    uint64_t nproc = n_frames() - m_frames0;
+    muxer.stop();
+
+    uint64_t npushed = pushed - m_pushed0;
+    uint64_t ndropped = dropped - m_dropped0;
+    std::string source = replay ? args.input : args.url;
+    double user_s = tv_sec(ru1.ru_utime) - tv_sec(ru0.ru_utime);
+    double sys_s = tv_sec(ru1.ru_stime) - tv_sec(ru0.ru_stime);
+    double throughput = elapsed_s > 0.0 ? nproc / elapsed_s : 0.0;
+
+    FILE *f = fopen(args.json.c_str(), "w");
+    if (f == nullptr){
+        perror("fopen json");
+        f = stdout;
+    }
+    fprintf(f, "{\n");
+    fprintf(f, "  \"bench\": \"parkai-bench\",\n");
+    fprintf(f, "  \"mode\": \"%s\",\n", replay ? "replay" : "gst_worker");
+    fprintf(f, "  \"muxer_only\": %s,\n", args.muxer_only ? "true" : "false");
+    fprintf(f, "  \"input\": \"%s\",\n", json_escape(source).c_str());
+    fprintf(f, "  \"frames_loaded\": %zu,\n", frames.size());
+    fprintf(f, "  \"frame_w\": %u,\n  \"frame_h\": %u,\n", replay ? frames[0].w : 0, replay ? frames[0].h : 0);
+    fprintf(f, "  \"sources_alive\": %d,\n  \"restarts\": %lu,\n", alive, restarts);
+    fprintf(f, "  \"cams\": %d,\n  \"fps_per_cam\": %.3f,\n  \"batch\": %d,\n", args.cams, args.fps, args.batch);
+    fprintf(f, "  \"warmup_s\": %d,\n  \"duration_s\": %.3f,\n", args.warmup_s, elapsed_s);
+    fprintf(f, "  \"frames_pushed\": %lu,\n  \"frames_dropped\": %lu,\n", npushed, ndropped);
+    fprintf(f, "  \"frames_processed\": %lu,\n  \"batches\": %lu,\n", nproc, batches);
+    fprintf(f, "  \"offered_fps\": %.3f,\n", args.cams * args.fps);
+    fprintf(f, "  \"throughput_fps\": %.3f,\n", throughput);
+    fprintf(f, "  \"latency_ms\": {\n");
+    write_stage(f, "queue", samples.queue, false);
+    write_stage(f, "preprocess", samples.preprocess, false);
+    write_stage(f, "car_det", samples.car_det, false);
+    write_stage(f, "secondary", samples.secondary, false);
+    write_stage(f, "save", samples.save, false);
+    write_stage(f, "write", samples.write, false);
+    write_stage(f, "total", samples.total, true);
+    fprintf(f, "  },\n");
+    fprintf(f, "  \"cpu\": {\"user_s\": %.3f, \"sys_s\": %.3f, \"cores_used\": %.3f},\n",
+            user_s, sys_s, elapsed_s > 0.0 ? (user_s + sys_s) / elapsed_s : 0.0);
+    fprintf(f, "  \"rss_kb\": {\"start\": %zu, \"end\": %zu, \"peak\": %ld}\n", rss_start, rss_end, ru1.ru_maxrss);
+    fprintf(f, "}\n");
+    if (f != stdout){
+        fclose(f);
+    }
+
+    if (!replay){
+        fprintf(stderr, "Sources alive %d/%d, restarts %lu\n", alive, args.cams, restarts);
+    }
+    fprintf(stderr, "Processed %lu frames in %lu batches over %.1f s: %.2f fps (offered %.2f, dropped %lu)\n",
+            nproc, batches, elapsed_s, throughput, args.cams * args.fps, ndropped);
+    fprintf(stderr, "Batch total p50 %.2f ms, p99 %.2f ms; CPU %.2f cores; RSS %zu kB\n",
+            percentile(samples.total, 50), percentile(samples.total, 99),
+            elapsed_s > 0.0 ? (user_s + sys_s) / elapsed_s : 0.0, rss_end);
+    fprintf(stderr, "Results written to %s\n", args.json.c_str());
+
+    return batches > 0 ? BENCH_OK : BENCH_ERR_NO_BATCHES;
+}
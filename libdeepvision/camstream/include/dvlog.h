@@ -0,0 +1,107 @@
+#ifndef DVLOG_H
+#define DVLOG_H
+
+#include <atomic>
+#include <cstdint>
+
+#define DVLOG_QUEUE_SIZE 4096               /* records in flight, power of two */
+#define DVLOG_MSG_MAX 240                   /* longer messages are cut */
+#define DVLOG_FLUSH_MS 20                   /* writer thread sleep when the queue is empty */
+#define DVLOG_SITE_BURST 10                 /* messages per call site per window, the rest are counted */
+#define DVLOG_SITE_WINDOW_MS 1000
+#define DVLOG_FILE_MAX_BYTES (16ULL << 20)  /* a file sink rotates at this size */
+#define DVLOG_FILE_KEEP 3                   /* rotated files kept, name.1 .. name.N */
+
+
+enum DvLogLevel{
+    DV_DEBUG = 0,
+    DV_INFO,
+    DV_WARN,
+    DV_ERROR,
+    DV_NLEVELS
+};
+
+const char *dvlog_level_name(DvLogLevel level);
+
+/* structured fields of a message, -1 is not set */
+struct LogFields{
+    int cam;    /* camera index */
+    int pid;    /* gst_worker pid */
+    int fd;     /* evfd, socket or shm fd the message is about */
+    constexpr LogFields(int cam = -1, int pid = -1, int fd = -1) : cam(cam), pid(pid), fd(fd){}
+};
+
+/* rate limit state of one call site, a static in every DVLOG expansion */
+struct DvLogSite{
+    const char *file;
+    int line;
+    std::atomic<int64_t> window_ms;
+    std::atomic<uint32_t> count;
+    std::atomic<uint32_t> suppressed;
+    constexpr DvLogSite(const char *file, int line)
+        : file(file), line(line), window_ms(0), count(0), suppressed(0){}
+};
+
+struct DvLogStats{
+    uint64_t written = 0;       /* lines handed to the sink */
+    uint64_t dropped = 0;       /* queue was full */
+    uint64_t suppressed = 0;    /* over the call site rate */
+    uint64_t rotations = 0;
+};
+
+/**
+ * Asynchronous logger. Callers format into a slot of a lock-free ring and
+ * return, a single writer thread drains the ring into the sink, stdout or a
+ * rotating file. Until start() and after stop() lines are written
+ * synchronously to stdout, which is also what a forked child that did not
+ * call start() gets. Never log between fork() and exec() of a multithreaded
+ * process.
+ */
+namespace dvlog {
+
+    /**
+     * @brief Starts the writer thread, later calls are ignored
+     * @param path file sink, rotated at DVLOG_FILE_MAX_BYTES, nullptr - stdout
+     * @param capture_std also point stdout and stderr at the file, so output
+     * that does not go through the logger (gstreamer, perror) lands there too
+     * @return 1 - running, 0 - the file could not be opened, stdout is used
+     */
+    int start(const char *path = nullptr, bool capture_std = false);
+
+    /* drains the queue and stops the writer thread */
+    void stop(void);
+
+    /* writes everything queued so far, from any thread */
+    void flush(void);
+
+    void set_level(DvLogLevel level);
+    bool enabled(DvLogLevel level);
+
+    /**
+     * @brief Rate limit of a call site, DVLOG_SITE_BURST per window
+     * @param suppressed set to the messages dropped in the previous window
+     * when this call opens a new one
+     */
+    bool site_allow(DvLogSite &site, uint32_t *suppressed);
+
+    void write(DvLogLevel level, const DvLogSite &site, const LogFields &fields, uint32_t suppressed,
+               const char *fmt, ...) __attribute__((format(printf, 5, 6)));
+
+    void get_stats(DvLogStats &st);
+}
+
+/* DVLOG(DV_INFO, LogFields(cam, pid, fd), "fmt", ...), the trailing newline is added */
+#define DVLOG(level, fields, ...) do { \
+        static DvLogSite dvlog_site_(__FILE__, __LINE__); \
+        uint32_t dvlog_supp_ = 0; \
+        if (dvlog::enabled(level) && dvlog::site_allow(dvlog_site_, &dvlog_supp_)){ \
+            dvlog::write(level, dvlog_site_, fields, dvlog_supp_, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define DVLOG_DEBUG(fields, ...) DVLOG(DV_DEBUG, fields, __VA_ARGS__)
+#define DVLOG_INFO(fields, ...)  DVLOG(DV_INFO, fields, __VA_ARGS__)
+#define DVLOG_WARN(fields, ...)  DVLOG(DV_WARN, fields, __VA_ARGS__)
+#define DVLOG_ERROR(fields, ...) DVLOG(DV_ERROR, fields, __VA_ARGS__)
+
+#endif
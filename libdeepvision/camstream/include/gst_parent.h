@@ -2,7 +2,11 @@
 #define GST_PARENT_H
 
 #include "camstream.h"
+#include "dvlog.h"
 #include "gst_worker.h"
+#include "gst_zygote.h"
+#include "stream_health.h"
+#include "threading.h"
 
 #include <csignal>
 #include <cstring>
@@ -14,26 +18,41 @@
 #include <sys/eventfd.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <time.h>
 
-#define GST_WORKER_PATH "./libdeepvision/camstream/gst_worker"
-#define STREAM_IS_OFF_AFTER 300  /* seconds */
-#define MINUTES_5_IN_SECONDS 300
+#define STREAM_FIRST_FRAME_SEC 30    /* a new worker must deliver its first frame within this */
+#define STREAM_HEALTHY_SEC 60        /* delivered frames this long, the next restart is fast */
+#define RESTART_BACKOFF_BASE_MS 1000 /* first retry, doubles with each failed start */
+#define RESTART_BACKOFF_MAX_MS 300000
+#define RESTARTS_MAX_CONCURRENT 8    /* workers restarted but without a first frame yet */
 
 
 int recv_fd(int sock);
 uint64_t signal_parser(uint64_t val);
+int64_t restart_backoff_ms(int nfails);
+
+
+/* process and fds of a started gst_worker, not yet owned by a GstChildWorker */
+struct WorkerProc{
+    pid_t pid = -1;
+    int pidfd = -1;     /* workers forked by the zygote only */
+    int sockfd = -1;
+    int evfd = -1;
+};
 
 
 enum ChildState{
-    CREATION = 0,
+    CREATION = 0, /* claimed, its worker is being spawned without the muxer lock */
     ALIVE = 1,
     INFECTED,
     ZOMBIE,
     PURGED,
-    BURIED
+    BURIED,
+    REPLAY, /* no child process, frames are pushed by the parent */
+    RETIRED /* source removed, the muxer slot is free for reuse */
 };
 
 class GstChildWorker{
@@ -41,6 +60,7 @@ private:
     static const int STRING_SIZE = 254; 
     int id;
     pid_t pid_;
+    int pidfd_ = -1; /* set for workers forked by the zygote, they are not our children */
 
     uint64_t n_read=0;
     char fn[STRING_SIZE];
@@ -48,7 +68,11 @@ private:
 
     bool frame_waiting = false;
     time_t f_ts_ = 0;
-    time_t closed_ts = 0;
+    time_t started_ts = 0;
+    int64_t restart_at_ms = 0; /* monotonic, 0 - never restart */
+    int nfails = 0;            /* workers in a row that died without a healthy run */
+    uint32_t start_gen = 0;    /* bumped by every claim, see prepare() */
+    StreamHealth health;
     bool epoll_registered = false;
 
     /* private shmfd variables*/
@@ -72,83 +96,207 @@ public:
     pid_(-1), shmfd_(-1), evfd_(-1)
     {
     }
-    uint32_t start_child(void){
+    /**
+     * @brief Starts a gst_worker for a stream, forked by the zygote or by
+     * fork/exec. Touches no worker state, so it runs without the muxer lock.
+     * @return 1 - wp set, 0 - failed
+     */
+    static uint32_t spawn_proc(int id, const char *url, WorkerProc &wp){
+        if (GstZygote::instance().spawn(id, url, &wp.pid, &wp.sockfd, &wp.evfd, &wp.pidfd)){
+            DVLOG_INFO(LogFields(id, wp.pid, wp.evfd), "[src-%s] worker forked by zygote sv_={ %d }", url, wp.sockfd);
+            return 1;
+        }
+        return fork_exec_proc(id, url, wp);
+    }
+
+    /* slow path, a new gst_worker process that loads gstreamer on its own */
+    static uint32_t fork_exec_proc(int id, const char *url, WorkerProc &wp){
         /* Create socket pair */
-        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv_) != 0) {
-            printf(" [child-%d] socket pair error\n", id);
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+            DVLOG_ERROR(LogFields(id), "[src-%s] socket pair error: %s", url, strerror(errno));
             return 0;
         }
-        printf("[src-%s] socket pair created sv_={ %d, %d }\n", rtsp_url_, sv_[0], sv_[1]);
+        DVLOG_DEBUG(LogFields(id), "[src-%s] socket pair created sv_={ %d, %d }", url, sv[0], sv[1]);
 
         /* Create event file-descriptor */
-        evfd_ = eventfd(0, EFD_CLOEXEC);
-        if (evfd_ < 0) {
-            printf(" [child-%d] eventfd error\n", id);
+        int evfd = eventfd(0, EFD_CLOEXEC);
+        if (evfd < 0) {
+            DVLOG_ERROR(LogFields(id), "[src-%s] eventfd error: %s", url, strerror(errno));
+            close(sv[0]);
+            close(sv[1]);
             return 0;
         }
-        printf("[src-%s] evfd created evfd={ %d }\n", rtsp_url_, evfd_);
+        DVLOG_DEBUG(LogFields(id, -1, evfd), "[src-%s] evfd created", url);
         /* Create Child Process */
-        pid_ = fork();
+        pid_t pid = fork();
 
-        if (pid_ < 0) {
-            std::cerr << "[parent] fork failed: " << std::strerror(errno) << "\n";
+        if (pid < 0) {
+            DVLOG_ERROR(LogFields(id), "[parent] fork failed: %s", strerror(errno));
+            close(sv[0]);
+            close(sv[1]);
+            close(evfd);
             return 0;
         }
         /* Child code begin */
-        if (pid_ == 0) {
+        if (pid == 0) {
+            // the parent may block stop signals for sigwait, the mask survives exec
+            sigset_t none;
+            sigemptyset(&none);
+            sigprocmask(SIG_SETMASK, &none, nullptr);
+            // decode cpus, nice and SCHED_BATCH survive exec
+            apply_decode_policy();
             // remove CLOEXEC flags from fds that are passed to the child
-            fcntl(sv_[1], F_SETFD, fcntl(sv_[1], F_GETFD) & ~FD_CLOEXEC);
-            fcntl(evfd_, F_SETFD, fcntl(evfd_, F_GETFD) & ~FD_CLOEXEC);
+            fcntl(sv[1], F_SETFD, fcntl(sv[1], F_GETFD) & ~FD_CLOEXEC);
+            fcntl(evfd, F_SETFD, fcntl(evfd, F_GETFD) & ~FD_CLOEXEC);
 
-            close(sv_[0]);// parent end
-            if (sv_[1] != 3) {
-                dup2(sv_[1], 3);// move to fd 3
-                close(sv_[1]);
+            close(sv[0]);// parent end
+            if (sv[1] != 3) {
+                dup2(sv[1], 3);// move to fd 3
+                close(sv[1]);
             }
 
             // map eventfd to FD 4
-            if (evfd_ != 4) {
-                dup2(evfd_, 4);
-                close(evfd_);
+            if (evfd != 4) {
+                dup2(evfd, 4);
+                close(evfd);
             }
             // child branch: replace process image
-            execl(GST_WORKER_PATH, GST_WORKER_PATH, rtsp_url_, (char*)nullptr);
-            // only reached if exec fails
+            char id_str[16];
+            snprintf(id_str, sizeof(id_str), "%d", id);
+            execl(GST_WORKER_PATH, GST_WORKER_PATH, url, id_str, (char*)nullptr);
+            // only reached if exec fails, the logger of the parent is not usable in the child
             std::cerr << "[parent->child] exec failed: " << std::strerror(errno) << "\n";
-            return 0;
+            _exit(127); // never fall back into the parent code path
         }
         /* Parent Code Continue */
-        close(sv_[1]);
+        close(sv[1]);
+        wp.pid = pid;
+        wp.pidfd = -1;
+        wp.sockfd = sv[0];
+        wp.evfd = evfd;
+        return 1;
+    }
+
+    /* kills a spawned worker whose source went away while it was started */
+    static void discard_proc(WorkerProc &wp){
+        if (wp.pid > 0){
+            if (wp.pidfd >= 0){
+#ifdef SYS_pidfd_send_signal
+                syscall(SYS_pidfd_send_signal, wp.pidfd, SIGKILL, nullptr, 0);
+#endif
+                struct pollfd pfd{wp.pidfd, POLLIN, 0};
+                poll(&pfd, 1, -1);
+            }
+            else{
+                kill(wp.pid, SIGKILL);
+                waitpid(wp.pid, nullptr, 0);
+            }
+        }
+        for (int fd : {wp.pidfd, wp.sockfd, wp.evfd}){
+            if (fd >= 0){
+                close(fd);
+            }
+        }
+        wp = WorkerProc{};
+    }
+
+    /* takes over a spawned worker, the source is ALIVE. A restart of the
+       same camera keeps the learned frame interval. */
+    uint32_t attach(const WorkerProc &wp){
+        pid_ = wp.pid;
+        pidfd_ = wp.pidfd;
+        sv_[0] = wp.sockfd;
+        sv_[1] = -1;
+        evfd_ = wp.evfd;
         snprintf(fn, STRING_SIZE, "image-%d.jpeg", id);
 
         epoll_registered = false;
-        closed_ts = 0;
+        restart_at_ms = 0;
         f_ts_= 0;
+        time(&started_ts);
+        health.reset();
         shm_mapped = false;
         state = ALIVE;
-        printf("[src-%s] init complete\n", rtsp_url_);
+        DVLOG_INFO(log_fields(), "[src-%s] init complete", rtsp_url_);
         return 1;
     }
 
-    uint32_t init(int id, const char *rtsp_url){
+    /**
+     * @brief Claims the worker for a camera, its process is then started by
+     * spawn_proc() without the muxer lock and taken over by attach(). A
+     * reused slot forgets the cadence and failures of its previous camera.
+     * @return generation of this start, see is_start_current()
+     */
+    uint32_t prepare(int id, const char *rtsp_url){
+        this->id = id;
+        snprintf(rtsp_url_, STRING_SIZE, "%s", rtsp_url);
+        health = StreamHealth{};
+        nfails = 0;
+        restart_at_ms = 0;
+        state = CREATION;
+        return ++start_gen;
+    }
+
+    /* claims a due restart of the same camera */
+    uint32_t prepare_restart(void){
+        state = CREATION;
+        return ++start_gen;
+    }
+
+    /* the claim of gen still holds, the source was not removed or reused meanwhile */
+    bool is_start_current(uint32_t gen) const {
+        return state == CREATION && start_gen == gen;
+    }
+
+    /* spawning the restarted worker failed, the next try is scheduled */
+    void restart_failed(void){
+        f_ts_ = 0;
+        state = BURIED;
+        schedule_restart();
+    }
+
+    /**
+     * @brief Init a source without a gst_worker child. Frames for this
+     * source are supplied by the parent (offline replay, benchmarks).
+     */
+    uint32_t init_replay(int id, const char *name){
         this->id = id;
-        snprintf(rtsp_url_, STRING_SIZE, "%s", rtsp_url); 
-        start_child();
+        snprintf(rtsp_url_, STRING_SIZE, "%s", name);
+        pid_ = -1;
+        f_ts_ = 0;
+        restart_at_ms = 0;
+        state = REPLAY;
         return 1;
     }
 
-    int reinit(void){
-        if (is_past_timeout()){
-            start_child();
-            return 1;
-        }
-        return 0;
+    /**
+     * @brief Sets the next start time. A worker that delivered frames for
+     * STREAM_HEALTHY_SEC is retried after RESTART_BACKOFF_BASE_MS, each
+     * worker in a row that did not doubles the wait up to RESTART_BACKOFF_MAX_MS.
+     */
+    void schedule_restart(void){
+        bool healthy = f_ts_ != 0 && f_ts_ - started_ts >= STREAM_HEALTHY_SEC;
+        nfails = healthy ? 0 : nfails + 1;
+        /* the first failure waits the base delay, each further one doubles it */
+        int64_t delay = restart_backoff_ms(nfails > 0 ? nfails - 1 : 0);
+        restart_at_ms = monotonic_ms() + delay;
+        DVLOG_INFO(LogFields(id), "[%s] restart in %ld ms, failures in a row %d", rtsp_url_, (long)delay, nfails);
+    }
+
+    bool is_restart_due(int64_t now_ms) const {
+        return restart_at_ms != 0 && now_ms >= restart_at_ms;
+    }
+
+    /* started and still waiting for the first frame */
+    bool is_starting(time_t now) const {
+        return state == ALIVE && f_ts_ == 0 && !frame_waiting && now - started_ts <= STREAM_FIRST_FRAME_SEC;
     }
 
     int init_shm(void){
         shmfd_ = recv_fd(sv_[0]);
         if (shmfd_ < 0) {
-            printf(" [%s] shared mem error\n", rtsp_url_);
+            DVLOG_ERROR(log_fields(), "[%s] shared mem error", rtsp_url_);
             return 0;
         }
         int flags = fcntl(shmfd_, F_GETFD);
@@ -161,12 +309,12 @@ public:
         shm_bytes_ = st.st_size;
         shm_ = mmap(nullptr, shm_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd_, 0);
         if (shm_ == MAP_FAILED) {
-            printf(" [child-%s] memorymap error\n", rtsp_url_);
+            DVLOG_ERROR(LogFields(id, pid_, shmfd_), "[%s] memorymap error: %s", rtsp_url_, strerror(errno));
             return 0;
         }
         hdr_ = reinterpret_cast<DataHeader*>(shm_);
         shm_mapped = true;
-        printf("[%s] - mapped shared buffer, size %lu", rtsp_url_, shm_bytes_);
+        DVLOG_INFO(LogFields(id, pid_, shmfd_), "[%s] mapped shared buffer, size %lu", rtsp_url_, shm_bytes_);
         return 1;
     }
 
@@ -184,7 +332,7 @@ public:
     uint32_t close_sockfd(void){
         if(sv_[0] >= 0){
             close(sv_[0]);
-            printf("[%s] socketfd (%d) closed successfully\n", rtsp_url_, sv_[0]);
+            DVLOG_DEBUG(LogFields(id, pid_, sv_[0]), "[%s] socketfd closed", rtsp_url_);
             sv_[0] = -1;
             return 1;
         }
@@ -194,7 +342,7 @@ public:
     uint32_t close_shmfd(void){
         if (shmfd_ >= 0) {
             close(shmfd_);
-            printf("[%s] shared mem fd (%d) closed successfully\n", rtsp_url_, shmfd_);
+            DVLOG_DEBUG(LogFields(id, pid_, shmfd_), "[%s] shared mem fd closed", rtsp_url_);
             shmfd_ = -1;
             return 1;
         }
@@ -204,7 +352,7 @@ public:
     uint32_t bury(void){
         if (shmfd_ == -1 && evfd_ == -1 && sv_[0] == -1 && !shm_mapped){
             state = BURIED;
-            time(&closed_ts);
+            schedule_restart();
         }
         return 1;
     }
@@ -219,12 +367,12 @@ public:
                 shm_bytes_ = 0;
                 if(close_shmfd()){
                     shm_ready = false;
-                    printf("[%s] - memory unmaped\n", rtsp_url_);
+                    DVLOG_DEBUG(LogFields(id, pid_), "[%s] memory unmapped", rtsp_url_);
                     return 1;
                 }
             }
             else{
-                printf(" [%s] - Error Unmapping Shared Memory\n", rtsp_url_);
+                DVLOG_ERROR(LogFields(id, pid_), "[%s] error unmapping shared memory: %s", rtsp_url_, strerror(errno));
             }
         }
         else{
@@ -237,15 +385,37 @@ public:
     }
 
 
+    void send_kill(void){
+#ifdef SYS_pidfd_send_signal
+        if (pidfd_ >= 0){
+            syscall(SYS_pidfd_send_signal, pidfd_, SIGKILL, nullptr, 0);
+            return;
+        }
+#endif
+        kill(pid_, SIGKILL);
+    }
+
+    bool pidfd_exited(int timeout_ms){
+        struct pollfd pfd{pidfd_, POLLIN, 0};
+        return poll(&pfd, 1, timeout_ms) > 0;
+    }
+
+    void close_pidfd(void){
+        if (pidfd_ >= 0){
+            close(pidfd_);
+            pidfd_ = -1;
+        }
+    }
+
     uint32_t killit(void){
-        std::cout << "[parent] Killing child with pid= "<< pid_ << std::endl;
+        DVLOG_INFO(log_fields(), "[%s] killing child", rtsp_url_);
         if (pid_ > 0) {
-            kill(pid_, SIGKILL);
+            send_kill();
             //kill(pid_, SIGTERM);
             state = ZOMBIE;
         }
         else{
-            printf("[parent] can't kill child [%s] pid is invalid\n", rtsp_url_);
+            DVLOG_WARN(LogFields(id), "[%s] can't kill child, pid is invalid", rtsp_url_);
             return 0;
         }
         return 1;
@@ -253,33 +423,72 @@ public:
 
 
     uint32_t reap(void){
-        if (pid_ > 0){
+        if (pid_ > 0 && pidfd_ >= 0){
+            /* the zygote waits for its workers, the pidfd turns readable on exit */
+            if (!pidfd_exited(0)){
+                DVLOG_DEBUG(log_fields(), "[%s] could not reap", rtsp_url_);
+                return 0;
+            }
+            DVLOG_INFO(log_fields(), "[%s] reaped", rtsp_url_);
+            close_pidfd();
+            pid_ = -1;
+            state = PURGED;
+            return 1;
+        }
+        else if (pid_ > 0){
             int status;
             pid_t result = waitpid(pid_, &status, WNOHANG);
             if (result == 0) {
-                printf("[%s] - could not reap\n", rtsp_url_);
+                DVLOG_DEBUG(log_fields(), "[%s] could not reap", rtsp_url_);
                 return 0; // still running, must check later
             }
             else if (result == pid_){
                 // child exited, handle status
-                printf("[%s] - reaped succesfully\n", rtsp_url_);
+                DVLOG_INFO(log_fields(), "[%s] reaped", rtsp_url_);
                 pid_ = -1;
                 state = PURGED;
                 return 1;
             }
             else {
                 // error
-                std::cout << "Error reaping children\n";
+                DVLOG_ERROR(log_fields(), "[%s] error reaping child: %s", rtsp_url_, strerror(errno));
                 return 0;
             }
         }
         else{
-            printf("Eror reaping child [%s] not zombie or pid is invalid\n", rtsp_url_);
+            DVLOG_WARN(LogFields(id), "[%s] error reaping child, not zombie or pid is invalid", rtsp_url_);
             return 0;
         }
     }
 
 
+    /**
+     * @brief Kills the child if it is still running, waits for it to exit
+     * and releases all fds and shared memory. Blocking, used on shutdown.
+     */
+    uint32_t shutdown(void){
+        if (pid_ > 0){
+            send_kill();
+            if (pidfd_ >= 0){
+                pidfd_exited(-1);
+                close_pidfd();
+            }
+            else{
+                waitpid(pid_, nullptr, 0);
+            }
+            DVLOG_INFO(log_fields(), "[%s] child stopped", rtsp_url_);
+            pid_ = -1;
+        }
+        close_sockfd();
+        close_evfd();
+        release_mem();
+        close_shmfd();
+        restart_at_ms = 0; /* never reinit after shutdown */
+        state = BURIED;
+        return 1;
+    }
+
+
     bool check_for_signal(uint64_t &out_val){
         struct pollfd pfd{};
         pfd.fd = evfd_;
@@ -291,54 +500,44 @@ public:
     }
 
 
-    int read_frame(unsigned char **img_buf, uint64_t *size){
-        /* first check if data exists*/
+    /* size of the frame waiting in shm, 0 - none or its size does not
+       match its format and resolution */
+    uint64_t frame_nbytes(void){
         DataHeader *d = header();
-        if (d == nullptr){
+        if (d == nullptr || state != ALIVE || d->state != SHM_READY){
             return 0;
         }
-        if( state != ALIVE || d->state != SHM_READY){
+        if (d->nbytes != pix_fmt_nbytes(d->format, d->w, d->h) ||
+            d->nbytes + sizeof(DataHeader) > shm_size()){
             return 0;
         }
-        /* allocate destination buffer if does not exist*/
-        if (*img_buf == nullptr){
-            *img_buf = (unsigned char*)malloc(d->nbytes);
-        }
-        else{
-            if (*size != d->nbytes){
-                free(*img_buf);
-                *img_buf = (unsigned char*)malloc(d->nbytes);
-            }
+        return d->nbytes;
+    }
+
+    /**
+     * @brief Copies the waiting frame into dst
+     * @param size capacity of dst, must be frame_nbytes()
+     */
+    int read_frame(unsigned char *dst, uint64_t size){
+        uint64_t nbytes = frame_nbytes();
+        if (nbytes == 0 || nbytes != size){
+            return 0;
         }
-        *size = d->nbytes;
-        memcpy(*img_buf, data_ptr(), d->nbytes);
+        memcpy(dst, data_ptr(), nbytes);
         /* set buffer to read */
         time(&f_ts_);
         return 1;
     }
 
-    time_t is_past_timeout(void){
-        if (closed_ts == 0){
-            return false;
-        }
-        time_t now;
-        time(&now);
-
-        if (now - closed_ts > STREAM_IS_OFF_AFTER){
-            return true;
-        }
-        return false;
-    }
-
     void handle_event(uint64_t evt) {
         switch (evt) {
             case EVT_MMSH_COMPLETE:
-            std::cout << "Init SHM Blocks\n";
+                DVLOG_DEBUG(log_fields(), "[%s] init shm blocks", rtsp_url_);
                 shm_ready = init_shm();
                 break;
 
             case EVT_PIPELINE_EXIT:
-                printf("[%s] adding to infected\n", rtsp_url_);
+                DVLOG_INFO(log_fields(), "[%s] adding to infected", rtsp_url_);
                 state = INFECTED;
                 break;
         }
@@ -348,9 +547,13 @@ public:
     void* shm_ptr() const { return shm_; }
     uint8_t* data_ptr() const {return (uint8_t*)shm_ + sizeof(DataHeader);}
     size_t shm_size() const { return shm_bytes_; }
+    bool is_shm_mapped() const { return shm_mapped; }
     pid_t pid() const { return pid_; }
+    /* camera, worker pid and evfd for the logger */
+    LogFields log_fields(void) const { return LogFields(id, pid_, evfd_); }
     int get_id() const { return id; }
     time_t get_ts() const {return f_ts_;}
+    void touch_ts(void){time(&f_ts_);}
     int get_evfd() const {return evfd_;}
     bool is_frame_waiting() const {return frame_waiting;}
     void set_frame_waiting(bool val){frame_waiting = val;}
@@ -365,17 +568,63 @@ public:
     bool is_registered(void) const {return epoll_registered;}
     void set_epoll_flag(bool val){ epoll_registered = val;}
 
+    /* stalled or dead by the health model, or no first frame since the start */
     bool is_infected(void){
-        time_t now;
-        time(&now);
-        if (f_ts_ != 0 && now - f_ts_ > MINUTES_5_IN_SECONDS){
+        bool restart;
+        switch (health.state()){
+            case HEALTH_STARTING:
+                restart = time(nullptr) - started_ts > STREAM_FIRST_FRAME_SEC;
+                break;
+            case HEALTH_STALLED:
+            case HEALTH_DEAD:
+                restart = true;
+                break;
+            default:
+                restart = false;
+                break;
+        }
+        if (restart){
+            DVLOG_WARN(log_fields(), "[%s] %s, restarting", rtsp_url_, health_name(health.state()));
             state = INFECTED;
-            return true;
         }
-        else{
+        return restart;
+    }
+
+    /* the worker process has not exited, it is not reaped here */
+    bool worker_running(void){
+        if (pid_ <= 0){
+            return false;
+        }
+        if (pidfd_ >= 0){
+            return !pidfd_exited(0);
+        }
+        siginfo_t info{};
+        if (waitid(P_PID, pid_, &info, WEXITED | WNOHANG | WNOWAIT) != 0){
             return false;
         }
+        return info.si_pid == 0;
+    }
+
+    /**
+     * @brief Evaluates the stream health, once per state machine tick
+     * @param prev state before this update
+     * @return true if the health state changed
+     */
+    bool update_health(int64_t now_ms, HealthState *prev){
+        *prev = health.state();
+        switch (state){
+            case ALIVE:
+                return health.update(now_ms, shm_mapped ? hdr_ : nullptr, worker_running());
+            case INFECTED:
+            case ZOMBIE:
+            case PURGED:
+            case BURIED:
+                return health.mark_dead();
+            default:
+                return false;
+        }
     }
+    StreamHealthInfo health_info(void) const {return health.info();}
 };
 
 
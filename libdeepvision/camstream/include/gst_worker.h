@@ -5,6 +5,8 @@
 #include <atomic>
 #include <cstdint>
 
+#define GST_WORKER_PATH "./libdeepvision/camstream/gst_worker"   /* exec'd by the parent and the zygote */
+
 static constexpr uint32_t SHM_MAGIC = 0x4652414D; // 'FRAM'
 
 constexpr uint64_t EVT_CHILD_STARTED  = 1ull << 0;
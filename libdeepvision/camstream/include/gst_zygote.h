@@ -0,0 +1,80 @@
+#ifndef GST_ZYGOTE_H
+#define GST_ZYGOTE_H
+
+#include <cstdint>
+#include <mutex>
+#include <sys/types.h>
+#include <time.h>
+
+#define GST_ZYGOTE_ENABLED true
+#define GST_ZYGOTE_ARG "--zygote"
+#define GST_ZYGOTE_MAGIC 0x5A594754u     /* 'ZYGT' */
+#define GST_ZYGOTE_REPLY_TIMEOUT_MS 5000
+#define GST_ZYGOTE_RETRY_SEC 10          /* restart a dead zygote at most this often */
+#define GST_ZYGOTE_URL_SIZE 254
+
+/* parent -> zygote, one SEQPACKET message per worker */
+struct ZygoteSpawnReq {
+    uint32_t magic;
+    int32_t id;
+    char url[GST_ZYGOTE_URL_SIZE];
+};
+
+/* zygote -> parent, on success carries socket, eventfd and pidfd of the worker */
+struct ZygoteSpawnResp {
+    uint32_t magic;
+    int32_t id;
+    int32_t pid;
+    int32_t err;    /* errno of the failed step, 0 on success */
+};
+
+/* worker body, runs in the forked child with the socket and eventfd to the parent */
+typedef int (*gst_worker_fn)(int ctrl_fd, int evfd, const char *url, const char *stream_id);
+
+/**
+ * @brief Zygote loop, run by "gst_worker --zygote" after gst_init(). Serves
+ * spawn requests on ctrl_fd until the parent closes it. Workers are forked
+ * from this small, already initialized process instead of fork+exec of the
+ * parent, so they skip exec, dynamic linking, gst_init and plugin loading.
+ */
+int zygote_main(int ctrl_fd, gst_worker_fn worker);
+
+/**
+ * @brief Parent side of the zygote. Starts "gst_worker --zygote" on first use
+ * and asks it for workers. Workers are children of the zygote, the parent
+ * kills and waits for them through their pidfd. Workers keep running when
+ * the zygote dies, it is restarted on a later spawn.
+ */
+class GstZygote {
+    public:
+        static GstZygote &instance(void);
+
+        /* starts the zygote without waiting for it, lets it load plugins early */
+        int prestart(void);
+
+        /**
+         * @brief Spawns a worker for a stream
+         * @return 1 - fds and pid set, 0 - zygote unavailable, caller falls back to fork/exec
+         */
+        int spawn(int id, const char *url, pid_t *pid, int *sockfd, int *evfd, int *pidfd);
+        void stop(void);
+
+        GstZygote(const GstZygote &) = delete;
+        GstZygote &operator=(const GstZygote &) = delete;
+
+    private:
+        std::mutex lock;
+        int ctrl = -1;
+        pid_t zpid = -1;
+        time_t last_start = 0;
+        bool disabled = false;
+        bool ready = false;
+
+        GstZygote() = default;
+        ~GstZygote() { stop(); }
+        int start(void);
+        int poll_ready(void);
+        void fail(const char *what);
+};
+
+#endif
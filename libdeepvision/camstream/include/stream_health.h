@@ -0,0 +1,152 @@
+#ifndef STREAM_HEALTH_H
+#define STREAM_HEALTH_H
+
+#include "camstream.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+
+#define HEALTH_STALL_FACTOR 10       /* stalled after this many learned frame intervals without a frame */
+#define HEALTH_STALL_MIN_MS 3000     /* floor, gop and network jitter of fast streams */
+#define HEALTH_STALL_MAX_MS 30000    /* ceiling, also used until the interval is learned */
+#define HEALTH_BEAT_TIMEOUT_MS 5000  /* worker loop beats every 100 ms, stale beat = hung worker */
+#define HEALTH_EWMA_ALPHA 0.1
+
+
+enum HealthState{
+    HEALTH_STARTING = 0, /* worker runs, no frame shared yet */
+    HEALTH_OK,           /* source frames arrive at the learned cadence */
+    HEALTH_STALLED,      /* worker alive, source sends no frames */
+    HEALTH_DEAD,         /* worker exited or its loop hangs */
+};
+
+inline const char *health_name(HealthState s){
+    switch (s){
+        case HEALTH_STARTING: return "starting";
+        case HEALTH_OK:       return "ok";
+        case HEALTH_STALLED:  return "stalled";
+        case HEALTH_DEAD:     return "dead";
+    }
+    return "unknown";
+}
+
+/* one health transition of a stream */
+struct HealthEvent{
+    int index;              /* camera index */
+    HealthState from;
+    HealthState to;
+    int64_t ts_ms;          /* monotonic_ms() of the transition */
+    double interval_ms;     /* learned frame interval, 0 if not learned yet */
+    int64_t silent_ms;      /* time since the last source frame */
+};
+
+typedef std::function<void(const HealthEvent &)> HealthCallback;
+
+struct StreamHealthInfo{
+    HealthState state = HEALTH_STARTING;
+    double interval_ms = 0;
+    int64_t silent_ms = 0;
+    uint32_t nstalls = 0;
+    uint32_t ndeaths = 0;
+};
+
+/**
+ * @brief Health of one camera stream from the frame cadence the worker
+ * publishes in the shared DataHeader. The expected frame interval is learned
+ * with an EWMA, the stream is stalled after HEALTH_STALL_FACTOR intervals
+ * without a source frame. Source frames are counted before the valve, so a
+ * slow consumer does not look like a stalled camera.
+ */
+class StreamHealth{
+    HealthState state_ = HEALTH_STARTING;
+    double interval_ = 0;       /* kept across restarts, the camera cadence does not change */
+    int64_t silent_ = 0;
+    uint64_t last_rx_frames = 0;
+    uint64_t last_rx_ms = 0;
+    uint32_t nstalls = 0;
+    uint32_t ndeaths = 0;
+
+    bool set(HealthState next){
+        if (next == state_){
+            return false;
+        }
+        nstalls += next == HEALTH_STALLED;
+        ndeaths += next == HEALTH_DEAD;
+        state_ = next;
+        return true;
+    }
+
+    void learn(const DataHeader *hdr){
+        if (hdr->rx_frames == last_rx_frames){
+            return;
+        }
+        if (last_rx_frames != 0 && hdr->rx_frames > last_rx_frames && hdr->rx_ms > last_rx_ms){
+            double sample = double(hdr->rx_ms - last_rx_ms) / double(hdr->rx_frames - last_rx_frames);
+            /* the gap of an outage is not a frame interval */
+            if (sample <= stall_after_ms()){
+                interval_ = interval_ == 0 ? sample : interval_ + HEALTH_EWMA_ALPHA * (sample - interval_);
+            }
+        }
+        last_rx_frames = hdr->rx_frames;
+        last_rx_ms = hdr->rx_ms;
+    }
+
+public:
+    /* new worker, the learned interval stays */
+    bool reset(void){
+        last_rx_frames = 0;
+        last_rx_ms = 0;
+        silent_ = 0;
+        return set(HEALTH_STARTING);
+    }
+
+    bool mark_dead(void){
+        return set(HEALTH_DEAD);
+    }
+
+    /**
+     * @brief Evaluates the stream once, called every state machine tick
+     * @param hdr shared header of the worker, nullptr until the first frame
+     * @param worker_running the worker process has not exited
+     * @return true if the state changed
+     */
+    bool update(int64_t now_ms, const DataHeader *hdr, bool worker_running){
+        if (!worker_running){
+            return set(HEALTH_DEAD);
+        }
+        if (hdr == nullptr || hdr->rx_frames == 0){
+            return set(HEALTH_STARTING);
+        }
+        if (now_ms - (int64_t)hdr->beat_ms > HEALTH_BEAT_TIMEOUT_MS){
+            return set(HEALTH_DEAD);
+        }
+        learn(hdr);
+        silent_ = std::max<int64_t>(0, now_ms - (int64_t)hdr->rx_ms);
+        return set(silent_ > stall_after_ms() ? HEALTH_STALLED : HEALTH_OK);
+    }
+
+    int64_t stall_after_ms(void) const {
+        if (interval_ == 0){
+            return HEALTH_STALL_MAX_MS;
+        }
+        return std::min<int64_t>(std::max<int64_t>((int64_t)(interval_ * HEALTH_STALL_FACTOR), HEALTH_STALL_MIN_MS),
+                                 HEALTH_STALL_MAX_MS);
+    }
+
+    HealthState state(void) const {return state_;}
+    double interval_ms(void) const {return interval_;}
+    int64_t silent_ms(void) const {return silent_;}
+
+    StreamHealthInfo info(void) const {
+        StreamHealthInfo i;
+        i.state = state_;
+        i.interval_ms = interval_;
+        i.silent_ms = silent_;
+        i.nstalls = nstalls;
+        i.ndeaths = ndeaths;
+        return i;
+    }
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef THREADING_H
+#define THREADING_H
+
+#include <sched.h>
+#include <string>
+
+#define DECODE_NICE 10               /* gst_worker nice, decoding yields the cpu to inference */
+#define DECODE_SCHED_BATCH true      /* gst_workers run SCHED_BATCH, no wakeup preemption of inference */
+#define THREAD_NAME_MAX 15           /* linux thread name length without the terminator */
+
+
+/* what a thread does, every role can have its own cpus */
+enum ThreadRole{
+    THREAD_ROLE_CONTROL = 0,  /* main/gui, heartbeat, uploads */
+    THREAD_ROLE_INFERENCE,    /* detection task, calls the ort sessions */
+    THREAD_ROLE_ORT,          /* ort intra op pool threads */
+    THREAD_ROLE_IO,           /* muxer epoll, frame reader, state machine, image writer */
+    THREAD_ROLE_DECODE,       /* gst_worker processes */
+    THREAD_ROLE_NROLES
+};
+
+const char *thread_role_name(ThreadRole role);
+
+/**
+ * @brief Cpu list of every thread role in taskset syntax, "0-7,16-23". An
+ * empty list leaves the role on all cpus the process was started with.
+ */
+struct CpuTopology{
+    std::string cpus[THREAD_ROLE_NROLES];
+    int decode_nice = DECODE_NICE;
+    bool decode_batch = DECODE_SCHED_BATCH;
+
+    /**
+     * @brief Layout for multi socket hosts: inference and ort on the first
+     * socket, io and control on the first two cpus of the last socket, decode
+     * on the rest. Single socket hosts are not pinned.
+     */
+    static CpuTopology detect(void);
+};
+
+/* parses a taskset cpu list, 0 on syntax errors */
+int parse_cpu_list(const std::string &list, cpu_set_t *set);
+std::string format_cpu_list(const cpu_set_t *set);
+
+/**
+ * @brief Sets the process wide topology. Called once at startup, before the
+ * threads and workers that use it are started.
+ * @return 1 - all lists valid, 0 - roles with invalid lists are not pinned
+ */
+int set_cpu_topology(const CpuTopology &topo);
+
+/* cpus of a role, 0 if the role is not pinned */
+int role_cpus(ThreadRole role, cpu_set_t *set);
+
+/* names the calling thread for top -H, perf and gdb, cut to THREAD_NAME_MAX */
+void set_thread_name(const char *name);
+
+/**
+ * @brief Names the calling thread and moves it to the cpus of its role.
+ * Threads of an unpinned role go back to the process cpus, so they do not
+ * keep the cpus of the thread that started them.
+ */
+int set_thread_role(ThreadRole role, const char *name);
+
+/* decode cpus, nice and SCHED_BATCH for a forked gst_worker or zygote, only syscalls, safe after fork */
+void apply_decode_policy(void);
+
+#endif
@@ -1,6 +1,7 @@
 
 /*File Includes*/
 #include "camstream.h"
+#include "dvlog.h"
 #include <stdio.h>
 #include <jpeglib.h>
 #include <png.h>
@@ -8,8 +9,10 @@
 #include <iostream>
 #include <fstream>
 #include <gst/app/gstappsink.h>  // add if not included
+#include <gst/video/video.h>
 #include <gst/rtsp/rtsp.h>
 #include <malloc.h>
+#include <unistd.h>
 /*File Includes End*/
 
 /* Definitions Start*/
@@ -35,6 +38,11 @@ std::thread func;
 std::vector<unsigned char> latest_frame;
 /* Global Variables End*/
 
+/* camera index and worker pid for the logger */
+static LogFields ctl_fields(const StreamCtrl *ctl){
+    return LogFields(ctl->index, getpid());
+}
+
 uint32_t reset_stream_control(StreamCtrl *ctrl){
     if(ctrl->lock == nullptr){
         return 0;
@@ -57,7 +65,7 @@ uint32_t reset_stream_control(StreamCtrl *ctrl){
 void save_jpeg_to_file(const std::vector<unsigned char>& jpeg_data, const std::string& filename) {
     std::ofstream outfile(filename, std::ios::binary);
     if (!outfile) {
-        std::cerr << "Failed to open file for writing: " << filename << std::endl;
+        DVLOG_ERROR(LogFields(-1, getpid()), "Failed to open file for writing: %s", filename.c_str());
         return;
     }
     outfile.write(reinterpret_cast<const char*>(jpeg_data.data()), jpeg_data.size());
@@ -68,7 +76,7 @@ void save_jpeg_to_file(const std::vector<unsigned char>& jpeg_data, const std::s
 void save_jpeg_to_file_new(const unsigned char * jpeg_data, const size_t size, const std::string& filename) {
     std::ofstream outfile(filename, std::ios::binary);
     if (!outfile) {
-        std::cerr << "Failed to open file for writing: " << filename << std::endl;
+        DVLOG_ERROR(LogFields(-1, getpid()), "Failed to open file for writing: %s", filename.c_str());
         return;
     }
     outfile.write(reinterpret_cast<const char*>(jpeg_data), std::streamsize(size));
@@ -129,11 +137,11 @@ size_t encode_jpeg_to_buffer(unsigned char *raw_data, int width, int height, uns
     struct jpeg_error_mgr jerr;
     
     if (!raw_data || !output_buffer) {
-        std::cerr << "raw_data or output_buffer is NULL in encode_jpeg_to_buffer\n";
+        DVLOG_ERROR(LogFields(-1, getpid()), "raw_data or output_buffer is NULL in encode_jpeg_to_buffer");
         return 0;
     }
     if (width <= 0 || height <= 0) {
-        std::cerr << "Invalid dimensions in encode_jpeg_to_buffer: " << width << "x" << height << "\n";
+        DVLOG_ERROR(LogFields(-1, getpid()), "Invalid dimensions in encode_jpeg_to_buffer: %dx%d", width, height);
         return 0;
     }
 
@@ -172,7 +180,7 @@ size_t encode_jpeg_to_buffer(unsigned char *raw_data, int width, int height, uns
     if (actual_size <= max_size) {
         memcpy(output_buffer, temp_buffer, actual_size);
     } else {
-        std::cerr << "Output buffer too small: need " << actual_size << " bytes, have " << max_size << "\n";
+        DVLOG_ERROR(LogFields(-1, getpid()), "Output buffer too small: need %zu bytes, have %zu", (size_t)actual_size, (size_t)max_size);
         actual_size = 0;
     }
     
@@ -191,11 +199,11 @@ std::vector<unsigned char> encode_jpeg(unsigned char *raw_data, int width, int h
     struct jpeg_compress_struct cinfo;
     struct jpeg_error_mgr jerr;
     if (!raw_data) {
-        std::cerr << "raw_data is NULL in encode_jpeg\n";
+        DVLOG_ERROR(LogFields(-1, getpid()), "raw_data is NULL in encode_jpeg");
         return {};
     }
     if (width <= 0 || height <= 0) {
-        std::cerr << "Invalid dimensions in encode_jpeg: " << width << "x" << height << "\n";
+        DVLOG_ERROR(LogFields(-1, getpid()), "Invalid dimensions in encode_jpeg: %dx%d", width, height);
         return {};
     }
 
@@ -264,7 +272,7 @@ static gboolean stop_pipeline_idle(gpointer user_data){
     //gst_element_get_state(ctl->pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
     //gst_element_get_state(ctl->pipeline, NULL, NULL, GST_SECOND * 5);
     if(!ctl->loop) {
-        std::cout << "NOT LOOP\n";
+        DVLOG_WARN(ctl_fields(ctl), "%s stop: no main loop", ctl->stream_ip.c_str());
         return G_SOURCE_REMOVE;
     };
         
@@ -276,19 +284,18 @@ static gboolean stop_pipeline_idle(gpointer user_data){
 
 
 int quit_pipeline(StreamCtrl *ctrl){
-    std::cout << ctrl->stream_ip <<" Stopping and Quitting the pipeline\n";
     if (!ctrl) {
-        std::cout << ctrl->stream_ip << " quit_pipeline: no loop for index " << ctrl->index << "\n";
+        DVLOG_WARN(LogFields(-1, getpid()), "quit_pipeline: no stream control");
         return 0;
     }
+    DVLOG_INFO(ctl_fields(ctrl), "%s Stopping and Quitting the pipeline", ctrl->stream_ip.c_str());
     if (!ctrl->pipeline){
-        std::cout << ctrl->stream_ip << " Not Pipeline\n";
+        DVLOG_WARN(ctl_fields(ctrl), "%s Not Pipeline", ctrl->stream_ip.c_str());
         return 0;
     }
     g_object_set(ctrl->valve, "drop", FALSE, NULL);
-    std::cout << ctrl->stream_ip <<" Valve Set to drop=TRUE\n";
     gboolean sent = gst_element_send_event(ctrl->pipeline, gst_event_new_eos());
-    std::cout << ctrl->stream_ip <<" - Main Loop Quit\n";
+    DVLOG_INFO(ctl_fields(ctrl), "%s eos sent", ctrl->stream_ip.c_str());
     return 1;
 }
 
@@ -370,7 +377,7 @@ GstFlowReturn sample_ready_callback(GstAppSink *appsink, gpointer user_data) {
         }
         else{
             if (width != ctl->imgW || height != ctl->imgH){
-                std::cout << ctl->stream_ip << " Image Resolution Changed. Reallocating..\n";
+                DVLOG_INFO(ctl_fields(ctl), "%s Image Resolution Changed. Reallocating..", ctl->stream_ip.c_str());
                 free(ctl->image);
                 ctl->image = (unsigned char *) malloc(max_size);
                 ctl->imgW = width;
@@ -414,7 +421,7 @@ uint32_t pull_gst_frame(StreamCtrl *ctl, unsigned char **img_buf, uint64_t *max_
     }
     else{
         if (*max_size != buf_size){
-            std::cout << "Reallocating\n";
+            DVLOG_INFO(ctl_fields(ctl), "%s Reallocating", ctl->stream_ip.c_str());
             free(*img_buf);
             *img_buf = (unsigned char*)malloc(buf_size);
         }
@@ -524,6 +531,40 @@ uint32_t pull_image(StreamCtrl *ctrl, ImgFormat format, unsigned char **img_buf,
 }
 
 
+/* copies the planes of a mapped frame into dst without row padding, the
+   layout of PixFormat */
+static void copy_packed_planes(GstVideoFrame *vframe, uint32_t format, int width, int height, unsigned char *dst){
+    int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    int nplanes = 1;
+    int row_bytes[3] = {width * 3, 0, 0};
+    int rows[3] = {height, 0, 0};
+    if (format == PIX_FMT_I420){
+        nplanes = 3;
+        row_bytes[0] = width;
+        row_bytes[1] = row_bytes[2] = cw;
+        rows[1] = rows[2] = ch;
+    }
+    else if (format == PIX_FMT_NV12){
+        nplanes = 2;
+        row_bytes[0] = width;
+        row_bytes[1] = cw * 2;
+        rows[1] = ch;
+    }
+    for (int p = 0; p < nplanes; p++){
+        const unsigned char *src = (const unsigned char *)GST_VIDEO_FRAME_PLANE_DATA(vframe, p);
+        int stride = GST_VIDEO_FRAME_PLANE_STRIDE(vframe, p);
+        if (stride == row_bytes[p]){
+            memcpy(dst, src, (size_t)row_bytes[p] * rows[p]);
+            dst += (size_t)row_bytes[p] * rows[p];
+            continue;
+        }
+        for (int y = 0; y < rows[p]; y++){
+            memcpy(dst, src + (size_t)y * stride, row_bytes[p]);
+            dst += row_bytes[p];
+        }
+    }
+}
+
 static GstPadProbeReturn frame_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
     static int let_pass=0;
     if (let_pass < 5){
@@ -560,37 +601,62 @@ static GstPadProbeReturn frame_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpoi
     //if (!ctl->lock->try_lock()) return GST_PAD_PROBE_OK;
     //std::lock_guard<std::mutex> lock(*ctl->lock, std::adopt_lock);
     //std::cout << ctl->stream_ip << " Reading the new frame\n";
-    GstMapInfo map;
-    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) return GST_PAD_PROBE_OK;
-
-    int width = ctl->imgW;
-    int height = ctl->imgH;
+    GstVideoInfo vinfo;
     GstCaps *caps = gst_pad_get_current_caps(pad);
-    if (caps) {
-        GstStructure *s = gst_caps_get_structure(caps, 0);
-        gst_structure_get_int(s, "width", &width);
-        gst_structure_get_int(s, "height", &height);
-        gst_caps_unref(caps);
+    if (!caps){
+        return GST_PAD_PROBE_OK;
     }
-
-    
-    if ( !ctl->image || ctl->im_size < map.size ) {
+    gboolean have_info = gst_video_info_from_caps(&vinfo, caps);
+    gst_caps_unref(caps);
+    if (!have_info){
+        return GST_PAD_PROBE_OK;
+    }
+    uint32_t format;
+    switch (GST_VIDEO_INFO_FORMAT(&vinfo)){
+        case GST_VIDEO_FORMAT_RGB: format = PIX_FMT_RGB; break;
+        case GST_VIDEO_FORMAT_I420: format = PIX_FMT_I420; break;
+        case GST_VIDEO_FORMAT_NV12: format = PIX_FMT_NV12; break;
+        default: return GST_PAD_PROBE_OK;
+    }
+    /* the caps colorimetry, gstreamer fills in the default of the
+       resolution when the decoder does not signal one */
+    const GstVideoColorimetry &cinfo = GST_VIDEO_INFO_COLORIMETRY(&vinfo);
+    uint32_t matrix;
+    switch (cinfo.matrix){
+        case GST_VIDEO_COLOR_MATRIX_BT709:
+        case GST_VIDEO_COLOR_MATRIX_SMPTE240M: matrix = PIX_MATRIX_BT709; break;
+        case GST_VIDEO_COLOR_MATRIX_BT2020: matrix = PIX_MATRIX_BT2020; break;
+        default: matrix = PIX_MATRIX_BT601; break;
+    }
+    uint32_t range = cinfo.range == GST_VIDEO_COLOR_RANGE_0_255 ? PIX_RANGE_FULL : PIX_RANGE_LIMITED;
+    int width = GST_VIDEO_INFO_WIDTH(&vinfo);
+    int height = GST_VIDEO_INFO_HEIGHT(&vinfo);
+    uint64_t nbytes = pix_fmt_nbytes(format, width, height);
+
+    /* maps with the video meta, decoders may pad rows and planes */
+    GstVideoFrame vframe;
+    if (!gst_video_frame_map(&vframe, &vinfo, buffer, GST_MAP_READ)) return GST_PAD_PROBE_OK;
+
+    if ( !ctl->image || ctl->im_size != nbytes ) {
         if(ctl->image){
-            printf("[child - %s] reallocating memory \n", ctl->stream_ip.c_str());
+            DVLOG_INFO(ctl_fields(ctl), "[child - %s] reallocating memory, %lu bytes", ctl->stream_ip.c_str(), nbytes);
             free(ctl->image);
         }
-        ctl->image = (unsigned char *)malloc(map.size);
-        ctl->im_size = map.size;
-        ctl->imgW = width;
-        ctl->imgH = height;
+        ctl->image = (unsigned char *)malloc(nbytes);
+        ctl->im_size = nbytes;
     }
-    
-    memcpy(ctl->image, map.data, map.size);
+    ctl->imgW = width;
+    ctl->imgH = height;
+    ctl->imgFormat = format;
+    ctl->imgMatrix = matrix;
+    ctl->imgRange = range;
+
+    copy_packed_planes(&vframe, format, width, height, ctl->image);
     ctl->frame_rd = true;
     ctl->timestamp = std::time(nullptr);
     ctl->state = VSTREAM_RUNNING;
 
-    gst_buffer_unmap(buffer, &map);
+    gst_video_frame_unmap(&vframe);
     if(GST_IS_OBJECT(ctl->valve))
         g_object_set(ctl->valve, "drop", TRUE, NULL);
 
@@ -598,6 +664,22 @@ static GstPadProbeReturn frame_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpoi
 }
 
 // Bus message handler
+/* counts every encoded frame from the source, also while the valve drops them */
+static GstPadProbeReturn rx_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    StreamCtrl* ctl = static_cast<StreamCtrl*>(user_data);
+    ctl->rx_ms = monotonic_ms();
+    ctl->rx_frames++;
+    return GST_PAD_PROBE_OK;
+}
+
+static void add_rx_probe(StreamPipeline &p, StreamCtrl *ctrl){
+    GstPad *pad = gst_element_get_static_pad(p.parser, "src");
+    if (pad){
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, rx_probe_cb, ctrl, NULL);
+        gst_object_unref(pad);
+    }
+}
+
 static gboolean bus_call(GstBus *bus, GstMessage *msg, gpointer user_data) {
     StreamCtrl *ctrl = static_cast<StreamCtrl*> (user_data);
     switch (GST_MESSAGE_TYPE(msg)) {
@@ -648,12 +730,152 @@ void init_camstream(void){
     gst_init(NULL, NULL);
 }
 
+/* CLOCK_MONOTONIC in ms, comparable between the parent and its workers */
+int64_t monotonic_ms(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Loads the plugins of every element create_gst_pipeline() can make,
+ * so processes forked afterwards share them instead of loading their own.
+ * @return number of element factories loaded
+ */
+int preload_gst_plugins(void){
+    static const char *elements[] = {
+        "rtspsrc", "rtph264depay", "filesrc", "identity", "videotestsrc", "x264enc",
+        "h264parse", "queue", "valve", "avdec_h264", "videoconvert", "capsfilter", "fakesink",
+    };
+    GstRegistry *registry = gst_registry_get();
+    int nloaded = 0;
+    for (const char *name : elements){
+        GstPluginFeature *feature = gst_registry_find_feature(registry, name, GST_TYPE_ELEMENT_FACTORY);
+        if (feature == nullptr){
+            DVLOG_WARN(LogFields(-1, getpid()), "[camstream] element %s not found", name);
+            continue;
+        }
+        GstPluginFeature *loaded = gst_plugin_feature_load(feature);
+        if (loaded != nullptr){
+            nloaded++;
+            gst_object_unref(loaded);
+        }
+        gst_object_unref(feature);
+    }
+    return nloaded;
+}
+
+static std::string url_query_value(const std::string &query, const std::string &key){
+    size_t pos = 0;
+    while (pos < query.size()){
+        size_t end = query.find('&', pos);
+        if (end == std::string::npos){
+            end = query.size();
+        }
+        std::string kv = query.substr(pos, end - pos);
+        size_t eq = kv.find('=');
+        if (eq != std::string::npos && kv.substr(0, eq) == key){
+            return kv.substr(eq + 1);
+        }
+        pos = end + 1;
+    }
+    return "";
+}
+
+/**
+ * @brief Parses stream url into a source spec. Scheme selects the source:
+ *  rtsp://...                               camera stream
+ *  file:///path/video.h264[?fps=N&loop=0|1] H.264 Annex-B file, looped on EOS by default
+ *  test://WxH@fps[?frames=N]                videotestsrc encoded with x264enc
+ * @return 1 on success, 0 if url is malformed
+ */
+uint32_t parse_source_url(const std::string &url, SourceSpec *spec){
+    *spec = SourceSpec{};
+    std::string body, query;
+    size_t qpos;
+    if (url.rfind("file://", 0) == 0){
+        body = url.substr(7);
+        qpos = body.find('?');
+        if (qpos != std::string::npos){
+            query = body.substr(qpos + 1);
+            body = body.substr(0, qpos);
+        }
+        if (body.empty()){
+            return 0;
+        }
+        spec->kind = SRC_FILE;
+        spec->location = body;
+        spec->fps = SRC_FILE_DEFAULT_FPS;
+        std::string v = url_query_value(query, "fps");
+        if (!v.empty() && atoi(v.c_str()) > 0){
+            spec->fps = atoi(v.c_str());
+        }
+        v = url_query_value(query, "loop");
+        if (!v.empty()){
+            spec->loop = atoi(v.c_str()) != 0;
+        }
+        return 1;
+    }
+    if (url.rfind("test://", 0) == 0){
+        body = url.substr(7);
+        qpos = body.find('?');
+        if (qpos != std::string::npos){
+            query = body.substr(qpos + 1);
+            body = body.substr(0, qpos);
+        }
+        spec->kind = SRC_TEST;
+        spec->location = url;
+        if (!body.empty()){
+            int w = 0, h = 0, fps = 0;
+            int n = sscanf(body.c_str(), "%dx%d@%d", &w, &h, &fps);
+            if (n < 2 || w <= 0 || h <= 0){
+                return 0;
+            }
+            spec->width = w;
+            spec->height = h;
+            if (n == 3 && fps > 0){
+                spec->fps = fps;
+            }
+        }
+        std::string v = url_query_value(query, "frames");
+        if (!v.empty()){
+            spec->frames = atoi(v.c_str());
+        }
+        return 1;
+    }
+    spec->kind = SRC_RTSP;
+    spec->location = url;
+    return 1;
+}
+
 uint32_t create_gst_pipeline(uint32_t id, std::string url, StreamPipeline *p){
     //std::cout << url << " Creating Streamer Pipeline\n";
+    if (!parse_source_url(url, &p->spec)){
+        DVLOG_ERROR(LogFields(id, getpid()), "Invalid source url - %s", url.c_str());
+        return 0;
+    }
     std::string name = "rtsp-" + url;
     p->pipeline     = gst_pipeline_new(name.c_str());
-    p->rtspsrc      = gst_element_factory_make("rtspsrc", "src");
-    p->depay        = gst_element_factory_make("rtph264depay", nullptr);
+    p->depay        = nullptr;
+    p->srccaps      = nullptr;
+    p->encoder      = nullptr;
+    p->pacer        = nullptr;
+    switch (p->spec.kind){
+        case SRC_RTSP:
+            p->rtspsrc  = gst_element_factory_make("rtspsrc", "src");
+            p->depay    = gst_element_factory_make("rtph264depay", nullptr);
+            break;
+        case SRC_FILE:
+            p->rtspsrc  = gst_element_factory_make("filesrc", "src");
+            p->srccaps  = gst_element_factory_make("capsfilter", nullptr);
+            p->pacer    = gst_element_factory_make("identity", nullptr);
+            break;
+        case SRC_TEST:
+            p->rtspsrc  = gst_element_factory_make("videotestsrc", "src");
+            p->srccaps  = gst_element_factory_make("capsfilter", nullptr);
+            p->encoder  = gst_element_factory_make("x264enc", nullptr);
+            break;
+    }
     p->parser       = gst_element_factory_make("h264parse", nullptr);
     p->queue1       = gst_element_factory_make("queue", nullptr);
     p->valve        = gst_element_factory_make("valve", "valve");
@@ -666,53 +888,94 @@ uint32_t create_gst_pipeline(uint32_t id, std::string url, StreamPipeline *p){
     p->appsink      = gst_element_factory_make("fakesink", "sink");
 
     if(!p->pipeline){
-        std::cout << "Could not Create pipeline for - " << url << std::endl;
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not Create pipeline for - %s", url.c_str());
         return 0;
     }
     if(!p->rtspsrc){
-        std::cout << "Could not Create rtspsrc for - " << url << std::endl;
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not Create source for - %s", url.c_str());
+        return 0;
+    }
+    if(p->spec.kind == SRC_RTSP && !p->depay){
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not Create depay for - %s", url.c_str());
         return 0;
     }
-    if(!p->depay){
-        std::cout << "Could not Create depay for - " << url << std::endl;
+    if(p->spec.kind != SRC_RTSP && !p->srccaps){
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not Create source caps for - %s", url.c_str());
+        return 0;
+    }
+    if(p->spec.kind == SRC_FILE && !p->pacer){
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not Create identity for - %s", url.c_str());
+        return 0;
+    }
+    if(p->spec.kind == SRC_TEST && !p->encoder){
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not Create x264enc for - %s", url.c_str());
         return 0;
     }
     if(!p->parser){
-        std::cout << "Could not Create parser for - " << url << std::endl;
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not Create parser for - %s", url.c_str());
         return 0;
     }
     if(!p->queue1){
-        std::cout << "Could not Create queue1 for - " << url << std::endl;
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not Create queue1 for - %s", url.c_str());
         return 0;
     }
     if(!p->valve){
-        std::cout << "Could not Create valve for - " << url << std::endl;
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not Create valve for - %s", url.c_str());
         return 0;
     }
     if(!p->decodebin){
-        std::cout << "Could not Create decodebin for - " << url << std::endl;
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not Create decodebin for - %s", url.c_str());
         return 0;
     }
     if(!p->videoconvert){
-        std::cout << "Could not Create videoconvert for - " << url << std::endl;
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not Create videoconvert for - %s", url.c_str());
         return 0;
     }
     if(!p->capsfilter){
-        std::cout << "Could not Create capsfilter for - " << url << std::endl;
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not Create capsfilter for - %s", url.c_str());
         return 0;
     }
     if(!p->queue2){
-        std::cout << "Could not Create queue2 for - " << url << std::endl;
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not Create queue2 for - %s", url.c_str());
         return 0;
     }
     if(!p->appsink){
-        std::cout << "Could not Create appsink for - " << url << std::endl;
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not Create appsink for - %s", url.c_str());
         return 0;
     }
 
-    g_object_set(p->rtspsrc, "location", url.c_str(), "protocols", GST_RTSP_LOWER_TRANS_TCP,
-        "latency", 200, NULL);
-    g_object_set(p->rtspsrc, "drop-on-latency", TRUE, NULL);
+    GstCaps *src_caps = nullptr;
+    switch (p->spec.kind){
+        case SRC_RTSP:
+            g_object_set(p->rtspsrc, "location", url.c_str(), "protocols", GST_RTSP_LOWER_TRANS_TCP,
+                "latency", 200, NULL);
+            g_object_set(p->rtspsrc, "drop-on-latency", TRUE, NULL);
+            break;
+        case SRC_FILE:
+            g_object_set(p->rtspsrc, "location", p->spec.location.c_str(), NULL);
+            /* framerate lets h264parse timestamp a raw stream, identity paces it on the clock */
+            src_caps = gst_caps_new_simple("video/x-h264",
+                "stream-format", G_TYPE_STRING, "byte-stream",
+                "framerate", GST_TYPE_FRACTION, p->spec.fps, 1, NULL);
+            g_object_set(p->pacer, "sync", TRUE, NULL);
+            break;
+        case SRC_TEST:
+            g_object_set(p->rtspsrc, "is-live", TRUE, "num-buffers", p->spec.frames, NULL);
+            gst_util_set_object_arg(G_OBJECT(p->rtspsrc), "pattern", "ball");
+            src_caps = gst_caps_new_simple("video/x-raw",
+                "width", G_TYPE_INT, p->spec.width,
+                "height", G_TYPE_INT, p->spec.height,
+                "framerate", GST_TYPE_FRACTION, p->spec.fps, 1, NULL);
+            /* ultrafast + zerolatency, single thread so 256 encoders do not oversubscribe */
+            gst_util_set_object_arg(G_OBJECT(p->encoder), "speed-preset", "ultrafast");
+            gst_util_set_object_arg(G_OBJECT(p->encoder), "tune", "zerolatency");
+            g_object_set(p->encoder, "threads", 1, "key-int-max", p->spec.fps * 2, "bitrate", 512, NULL);
+            break;
+    }
+    if (src_caps){
+        g_object_set(p->srccaps, "caps", src_caps, NULL);
+        gst_caps_unref(src_caps);
+    }
 
     g_object_set(p->queue1, "leaky", 2, "max-size-buffers", 1, "max-size-time", 
         (guint64)0, "max-size-bytes", (guint)0, NULL);
@@ -721,19 +984,44 @@ uint32_t create_gst_pipeline(uint32_t id, std::string url, StreamPipeline *p){
 
     g_object_set(p->valve, "drop", FALSE, NULL);
 
-    GstCaps *caps = gst_caps_from_string("video/x-raw,format=RGB");
+    /* with YUV, videoconvert passes the decoder output through and only
+       converts formats other than I420/NV12 */
+    GstCaps *caps = gst_caps_from_string(FRAME_TRANSPORT_YUV ? "video/x-raw,format={ I420, NV12 }"
+                                                             : "video/x-raw,format=RGB");
     g_object_set(p->capsfilter, "caps", caps, NULL);
     gst_caps_unref(caps);
     
     g_object_set(p->appsink, "sync", FALSE, "qos", TRUE, "enable-last-sample", FALSE, NULL);
     
-    gst_bin_add_many(GST_BIN(p->pipeline), p->rtspsrc, p->depay, p->parser,
+    gst_bin_add_many(GST_BIN(p->pipeline), p->rtspsrc, p->parser,
         p->queue1, p->valve, p->decodebin, p->videoconvert, p->capsfilter,
         p->queue2, p->appsink, NULL);
-    
-    gst_element_link_many( p->depay, p->parser,
-            p->queue1, p->valve, p->decodebin, p->videoconvert, p->capsfilter,
-        p->queue2, p->appsink, NULL);
+
+    gboolean linked = FALSE;
+    switch (p->spec.kind){
+        case SRC_RTSP:
+            /* rtspsrc is linked to depay on pad-added */
+            gst_bin_add(GST_BIN(p->pipeline), p->depay);
+            linked = gst_element_link(p->depay, p->parser);
+            break;
+        case SRC_FILE:
+            gst_bin_add_many(GST_BIN(p->pipeline), p->srccaps, p->pacer, NULL);
+            linked = gst_element_link_many(p->rtspsrc, p->srccaps, p->parser, p->pacer, p->queue1, NULL);
+            break;
+        case SRC_TEST:
+            gst_bin_add_many(GST_BIN(p->pipeline), p->srccaps, p->encoder, NULL);
+            linked = gst_element_link_many(p->rtspsrc, p->srccaps, p->encoder, p->parser, NULL);
+            break;
+    }
+    if (p->spec.kind != SRC_FILE){
+        linked = linked && gst_element_link(p->parser, p->queue1);
+    }
+    linked = linked && gst_element_link_many(p->queue1, p->valve, p->decodebin, p->videoconvert,
+        p->capsfilter, p->queue2, p->appsink, NULL);
+    if (!linked){
+        DVLOG_ERROR(LogFields(id, getpid()), "Could not link pipeline for - %s", url.c_str());
+        return 0;
+    }
 
     return 1;
 }
@@ -776,7 +1064,7 @@ static gboolean bus_cb(GstBus *bus, GstMessage *msg, gpointer user_data) {
         gchar *dbg;
         gst_message_parse_error(msg, &err, &dbg);
 
-        g_printerr("GST ERROR: %s\n", err->message);
+        DVLOG_ERROR(ctl_fields(p), "%s GST ERROR: %s", p->stream_ip.c_str(), err->message);
 
         g_error_free(err);
         g_free(dbg);
@@ -844,6 +1132,12 @@ int bus_listener(GstBus *bus, GstElement *pipeline, StreamCtrl *ctrl){
           break;
         case GST_MESSAGE_EOS:
           //g_print ("End-Of-Stream reached.\n");
+          /* looping file sources restart from the beginning instead of exiting */
+          if (ctrl->rewind_on_eos &&
+              gst_element_seek_simple(pipeline, GST_FORMAT_TIME,
+                  (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT), 0)){
+              break;
+          }
           terminate = TRUE;
           break;
         case GST_MESSAGE_STATE_CHANGED:
@@ -881,17 +1175,22 @@ uint32_t start_manual_pipeline(int id, std::string rtsp_url, StreamCtrl *ctrl){
     ctrl->pipeline = p.pipeline;
     ctrl->valve = p.valve;
 
-    guint padadd_sig_1 = g_signal_connect(p.rtspsrc, "pad-added", G_CALLBACK(on_rtsp_pad_added), p.depay);
+    guint padadd_sig_1 = 0;
+    if (p.spec.kind == SRC_RTSP){
+        padadd_sig_1 = g_signal_connect(p.rtspsrc, "pad-added", G_CALLBACK(on_rtsp_pad_added), p.depay);
+    }
 
     GstPad *probe_pad = gst_element_get_static_pad(p.capsfilter, "src");
     ctrl->probe_id = gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, frame_probe_cb, ctrl, NULL);
     gst_object_unref(probe_pad);
+    add_rx_probe(p, ctrl);
 
 
     // reset the stream control
     std::mutex *mutex = (ctrl->lock);
     mutex->lock();
     reset_stream_control(ctrl);
+    ctrl->rewind_on_eos = (p.spec.kind == SRC_FILE && p.spec.loop);
     mutex->unlock();
 
     /* Start playing */
@@ -919,22 +1218,22 @@ uint32_t start_manual_pipeline(int id, std::string rtsp_url, StreamCtrl *ctrl){
         ctrl->imgW = 0;
     }
     
-    std::cout << ctrl->stream_ip << "Removing pad probe\n";
+    DVLOG_DEBUG(ctl_fields(ctrl), "%s Removing pad probe", ctrl->stream_ip.c_str());
     probe_pad = gst_element_get_static_pad(p.capsfilter, "src");
     if (probe_pad && ctrl->probe_id) {
         gst_pad_remove_probe(probe_pad, ctrl->probe_id);
         ctrl->probe_id = 0;
-        std::cout << ctrl->stream_ip << " probe-pad disconnected\n";
+        DVLOG_DEBUG(ctl_fields(ctrl), "%s probe-pad disconnected", ctrl->stream_ip.c_str());
     }
     if (probe_pad){
         gst_object_unref(probe_pad);
-        std::cout << ctrl->stream_ip << " probe-pad unrefferenced\n";
+        DVLOG_DEBUG(ctl_fields(ctrl), "%s probe-pad unreferenced", ctrl->stream_ip.c_str());
     }
         
     if (p.rtspsrc && padadd_sig_1) {
         g_signal_handler_disconnect(p.rtspsrc, padadd_sig_1);
         padadd_sig_1 = 0;
-        std::cout << ctrl->stream_ip << " pad-added signal removed\n";
+        DVLOG_DEBUG(ctl_fields(ctrl), "%s pad-added signal removed", ctrl->stream_ip.c_str());
     }
 
     gst_element_set_state (ctrl->pipeline, GST_STATE_NULL);
@@ -942,12 +1241,15 @@ uint32_t start_manual_pipeline(int id, std::string rtsp_url, StreamCtrl *ctrl){
 
     if (ctrl->pipeline){
         gst_object_unref (ctrl->pipeline);
-        std::cout << ctrl->stream_ip << " Pipeline Aufiderzein\n";
+        DVLOG_INFO(ctl_fields(ctrl), "%s pipeline released", ctrl->stream_ip.c_str());
         ctrl->pipeline = nullptr;
         ctrl->appsink = nullptr;
         ctrl->valve = nullptr;
     }
     SAFE_UNREF(p.rtspsrc);
+    SAFE_UNREF(p.srccaps);
+    SAFE_UNREF(p.encoder);
+    SAFE_UNREF(p.pacer);
     SAFE_UNREF(p.depay);
     SAFE_UNREF(p.parser);
     SAFE_UNREF(p.queue1);
@@ -972,16 +1274,21 @@ uint32_t new_simple_pipeline(int id, const char * rtsp_url, StreamCtrl *ctrl){
     }
     ctrl->valve = p.valve;
     ctrl->pipeline = p.pipeline;
-    guint padadd_sig = g_signal_connect(p.rtspsrc, "pad-added", G_CALLBACK(on_rtsp_pad_added), p.depay);
+    guint padadd_sig = 0;
+    if (p.spec.kind == SRC_RTSP){
+        padadd_sig = g_signal_connect(p.rtspsrc, "pad-added", G_CALLBACK(on_rtsp_pad_added), p.depay);
+    }
 
     GstPad *probe_pad = gst_element_get_static_pad(p.capsfilter, "src");
     ctrl->probe_id = gst_pad_add_probe(probe_pad, GST_PAD_PROBE_TYPE_BUFFER, frame_probe_cb, ctrl, NULL);
     gst_object_unref(probe_pad);
+    add_rx_probe(p, ctrl);
 
     ret = reset_stream_control(ctrl);
     if(!ret){
         return 0;
     }
+    ctrl->rewind_on_eos = (p.spec.kind == SRC_FILE && p.spec.loop);
 
     /* Start playing */
     GstStateChangeReturn g_ret = gst_element_set_state (p.pipeline, GST_STATE_PLAYING);
@@ -1020,6 +1327,9 @@ uint32_t new_simple_pipeline(int id, const char * rtsp_url, StreamCtrl *ctrl){
         ctrl->pipeline = nullptr;
     }
     SAFE_UNREF(p.rtspsrc);
+    SAFE_UNREF(p.srccaps);
+    SAFE_UNREF(p.encoder);
+    SAFE_UNREF(p.pacer);
     SAFE_UNREF(p.depay);
     SAFE_UNREF(p.parser);
     SAFE_UNREF(p.queue1);
@@ -1042,7 +1352,7 @@ int pipeline_manual(int id, const char *rtsp_url, StreamCtrl *ctrl){
     while(ctrl->run){
         //create_pipeline_multi_frame_manual(rtsp_url, ctrl);
         start_manual_pipeline(id ,rtsp_url, ctrl);
-        std::cout << "Playback ended. Closing...\n";
+        DVLOG_INFO(ctl_fields(ctrl), "%s Playback ended. Closing...", ctrl->stream_ip.c_str());
         std::this_thread::sleep_for(std::chrono::seconds(60));
         //break;
     }
@@ -1061,6 +1371,7 @@ int stream_thread(int id, const char *rtsp_url, StreamCtrl *ctrl){
 }
 
 vstream load_video_stream(int id, const char *rtsp_url, StreamCtrl *ctrl){
+    ctrl->index = id;
     return vstream(stream_thread, id, rtsp_url, ctrl);
 }
 
@@ -1071,5 +1382,6 @@ vstream load_video_stream(int id, const char *rtsp_url, StreamCtrl *ctrl){
  * @return vstream thread
  */
 vstream load_manual_stream(int id, const char *rtsp_url, StreamCtrl *ctrl){
+    ctrl->index = id;
     return vstream(pipeline_manual, id, rtsp_url, ctrl);
 }
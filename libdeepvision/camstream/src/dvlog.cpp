@@ -0,0 +1,380 @@
+#include "dvlog.h"
+#include "threading.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+#define DVLOG_LINE_MAX (DVLOG_MSG_MAX + 128)
+#define DVLOG_WRITE_CHUNK (64 * 1024)   /* lines are batched into writes of about this size */
+
+static_assert((DVLOG_QUEUE_SIZE & (DVLOG_QUEUE_SIZE - 1)) == 0, "DVLOG_QUEUE_SIZE must be a power of two");
+
+/* one queued message, seq is the slot's turn in the bounded mpsc ring */
+struct LogRecord{
+    std::atomic<uint64_t> seq;
+    int level;
+    int tid;
+    timespec ts;
+    LogFields fields;
+    const char *file;
+    int line;
+    uint32_t suppressed;
+    char msg[DVLOG_MSG_MAX];
+};
+
+static LogRecord ring[DVLOG_QUEUE_SIZE];
+static std::atomic<uint64_t> head{0};   /* next slot claimed by a producer */
+static uint64_t tail = 0;               /* next slot read by the writer, drain_lock */
+
+static std::atomic<bool> running{false};
+static std::atomic<int> min_level{DV_INFO};
+static std::mutex drain_lock;           /* writer side only, producers never take it */
+static std::mutex start_lock;
+static std::thread *writer = nullptr;
+
+static std::atomic<uint64_t> n_written{0};
+static std::atomic<uint64_t> n_dropped{0};
+static std::atomic<uint64_t> n_suppressed{0};
+static std::atomic<uint64_t> n_rotations{0};
+
+/* sink, touched by the writer under drain_lock */
+static int sink_fd = STDOUT_FILENO;
+static std::string sink_path;
+static bool sink_capture = false;
+static uint64_t sink_bytes = 0;
+
+
+const char *dvlog_level_name(DvLogLevel level){
+    switch (level){
+        case DV_DEBUG: return "DEBUG";
+        case DV_INFO:  return "INFO";
+        case DV_WARN:  return "WARN";
+        case DV_ERROR: return "ERROR";
+        default:       break;
+    }
+    return "?";
+}
+
+static int64_t now_ms(void){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int thread_tid(void){
+    static thread_local int tid = 0;
+    if (tid == 0){
+        tid = (int)syscall(SYS_gettid);
+    }
+    return tid;
+}
+
+static const char *base_name(const char *path){
+    const char *s = strrchr(path, '/');
+    return s ? s + 1 : path;
+}
+
+/* snprintf at out + *n that never runs past size, long lines are cut */
+static void append(char *out, size_t size, int *n, const char *fmt, ...){
+    va_list ap;
+    va_start(ap, fmt);
+    int w = vsnprintf(out + *n, size - *n, fmt, ap);
+    va_end(ap);
+    if (w > 0){
+        *n = std::min(*n + w, (int)size - 1);
+    }
+}
+
+/* "2026-10-19 12:00:00.123 INFO  [tid] file.cpp:42 cam=3 pid=120 fd=17: msg" */
+static int format_line(char *out, size_t size, const LogRecord &r){
+    tm lt;
+    localtime_r(&r.ts.tv_sec, &lt);
+    int n = strftime(out, size, "%Y-%m-%d %H:%M:%S", &lt);
+    append(out, size, &n, ".%03ld %-5s [%d] %s:%d", r.ts.tv_nsec / 1000000,
+           dvlog_level_name((DvLogLevel)r.level), r.tid, base_name(r.file), r.line);
+    if (r.fields.cam >= 0){
+        append(out, size, &n, " cam=%d", r.fields.cam);
+    }
+    if (r.fields.pid > 0){
+        append(out, size, &n, " pid=%d", r.fields.pid);
+    }
+    if (r.fields.fd >= 0){
+        append(out, size, &n, " fd=%d", r.fields.fd);
+    }
+    append(out, size, &n, ": %s", r.msg);
+    if (r.suppressed){
+        append(out, size, &n, " (%u suppressed)", r.suppressed);
+    }
+    /* the newline survives a cut */
+    if (n == (int)size - 1){
+        n--;
+    }
+    out[n++] = '\n';
+    out[n] = '\0';
+    return n;
+}
+
+static int open_sink_file(void){
+    int fd = open(sink_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0){
+        return 0;
+    }
+    struct stat st;
+    sink_bytes = fstat(fd, &st) == 0 ? st.st_size : 0;
+    if (sink_capture){
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+    }
+    sink_fd = fd;
+    return 1;
+}
+
+/* name -> name.1 -> ... -> name.DVLOG_FILE_KEEP, the oldest is overwritten */
+static void rotate_sink(void){
+    close(sink_fd);
+    for (int i = DVLOG_FILE_KEEP - 1; i >= 1; i--){
+        std::string from = sink_path + "." + std::to_string(i);
+        std::string to = sink_path + "." + std::to_string(i + 1);
+        rename(from.c_str(), to.c_str());
+    }
+    rename(sink_path.c_str(), (sink_path + ".1").c_str());
+    n_rotations++;
+    if (!open_sink_file()){
+        sink_fd = STDOUT_FILENO;
+        sink_path.clear();
+    }
+}
+
+static void sink_write(const char *p, size_t n){
+    sink_bytes += n;
+    while (n > 0){
+        ssize_t w = ::write(sink_fd, p, n);
+        if (w < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            return;
+        }
+        p += w;
+        n -= w;
+    }
+    if (!sink_path.empty() && sink_bytes >= DVLOG_FILE_MAX_BYTES){
+        rotate_sink();
+    }
+}
+
+/* moves everything queued to the sink, drain_lock held */
+static size_t drain(void){
+    static char buf[DVLOG_WRITE_CHUNK + DVLOG_LINE_MAX];
+    size_t len = 0;
+    size_t n = 0;
+    for (;;){
+        LogRecord &r = ring[tail & (DVLOG_QUEUE_SIZE - 1)];
+        if (r.seq.load(std::memory_order_acquire) != tail + 1){
+            /* empty, or the producer of this slot has not finished */
+            break;
+        }
+        len += format_line(buf + len, DVLOG_LINE_MAX, r);
+        r.seq.store(tail + DVLOG_QUEUE_SIZE, std::memory_order_release);
+        tail++;
+        n++;
+        if (len >= DVLOG_WRITE_CHUNK){
+            sink_write(buf, len);
+            len = 0;
+        }
+    }
+    if (len > 0){
+        sink_write(buf, len);
+    }
+    n_written += n;
+    return n;
+}
+
+static void writer_main(void){
+    set_thread_role(THREAD_ROLE_IO, "dv-log");
+    while (running.load(std::memory_order_relaxed)){
+        size_t n;
+        {
+            std::lock_guard<std::mutex> lk(drain_lock);
+            n = drain();
+        }
+        if (n == 0){
+            std::this_thread::sleep_for(std::chrono::milliseconds(DVLOG_FLUSH_MS));
+        }
+    }
+}
+
+static void flush_at_exit(void){
+    /* exit() from a signal handler may run on the writer while it drains */
+    if (drain_lock.try_lock()){
+        drain();
+        drain_lock.unlock();
+    }
+}
+
+int dvlog::start(const char *path, bool capture_std){
+    std::lock_guard<std::mutex> lk(start_lock);
+    if (writer != nullptr){
+        return 1;
+    }
+    int ret = 1;
+    {
+        std::lock_guard<std::mutex> dl(drain_lock);
+        for (uint64_t i = 0; i < DVLOG_QUEUE_SIZE; i++){
+            ring[i].seq.store(i, std::memory_order_relaxed);
+        }
+        head.store(0);
+        tail = 0;
+        if (path != nullptr){
+            sink_path = path;
+            sink_capture = capture_std;
+            if (!open_sink_file()){
+                fprintf(stderr, "[dvlog] could not open %s: %s, logging to stdout\n", path, strerror(errno));
+                sink_path.clear();
+                ret = 0;
+            }
+        }
+    }
+    fflush(stdout);
+    running.store(true);
+    /* on the heap, a joinable std::thread destroyed at exit terminates */
+    writer = new std::thread(writer_main);
+    static bool registered = false;
+    if (!registered){
+        atexit(flush_at_exit);
+        registered = true;
+    }
+    return ret;
+}
+
+void dvlog::stop(void){
+    std::lock_guard<std::mutex> lk(start_lock);
+    if (writer == nullptr){
+        return;
+    }
+    running.store(false);
+    writer->join();
+    delete writer;
+    writer = nullptr;
+    std::lock_guard<std::mutex> dl(drain_lock);
+    drain();
+}
+
+void dvlog::flush(void){
+    std::lock_guard<std::mutex> lk(drain_lock);
+    drain();
+}
+
+void dvlog::set_level(DvLogLevel level){
+    min_level.store(level, std::memory_order_relaxed);
+}
+
+bool dvlog::enabled(DvLogLevel level){
+    return level >= min_level.load(std::memory_order_relaxed);
+}
+
+bool dvlog::site_allow(DvLogSite &site, uint32_t *suppressed){
+    int64_t now = now_ms();
+    int64_t w = site.window_ms.load(std::memory_order_relaxed);
+    if (now - w >= DVLOG_SITE_WINDOW_MS &&
+        site.window_ms.compare_exchange_strong(w, now, std::memory_order_relaxed)){
+        /* a racing caller may still count into the old window, off by a message */
+        site.count.store(1, std::memory_order_relaxed);
+        *suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    if (site.count.fetch_add(1, std::memory_order_relaxed) < DVLOG_SITE_BURST){
+        return true;
+    }
+    site.suppressed.fetch_add(1, std::memory_order_relaxed);
+    n_suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+static void format_msg(char *msg, const char *fmt, va_list ap){
+    int n = vsnprintf(msg, DVLOG_MSG_MAX, fmt, ap);
+    if (n >= DVLOG_MSG_MAX){
+        n = DVLOG_MSG_MAX - 1;
+    }
+    /* callers converted from printf may still end with a newline */
+    while (n > 0 && msg[n - 1] == '\n'){
+        msg[--n] = '\0';
+    }
+}
+
+void dvlog::write(DvLogLevel level, const DvLogSite &site, const LogFields &fields, uint32_t suppressed,
+                  const char *fmt, ...){
+    va_list ap;
+    if (!running.load(std::memory_order_acquire)){
+        /* no writer thread, straight to stdout like printf did */
+        LogRecord r;
+        r.level = level;
+        r.tid = thread_tid();
+        clock_gettime(CLOCK_REALTIME, &r.ts);
+        r.fields = fields;
+        r.file = site.file;
+        r.line = site.line;
+        r.suppressed = suppressed;
+        va_start(ap, fmt);
+        format_msg(r.msg, fmt, ap);
+        va_end(ap);
+        char line[DVLOG_LINE_MAX];
+        fwrite(line, 1, format_line(line, sizeof(line), r), stdout);
+        return;
+    }
+
+    /* claim a slot, bounded mpsc ring with per slot sequence numbers */
+    uint64_t pos = head.load(std::memory_order_relaxed);
+    LogRecord *r;
+    for (;;){
+        r = &ring[pos & (DVLOG_QUEUE_SIZE - 1)];
+        uint64_t seq = r->seq.load(std::memory_order_acquire);
+        int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0){
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                break;
+            }
+        }
+        else if (diff < 0){
+            /* full, the writer is behind, never block the caller */
+            n_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else{
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+    r->level = level;
+    r->tid = thread_tid();
+    clock_gettime(CLOCK_REALTIME, &r->ts);
+    r->fields = fields;
+    r->file = site.file;
+    r->line = site.line;
+    r->suppressed = suppressed;
+    va_start(ap, fmt);
+    format_msg(r->msg, fmt, ap);
+    va_end(ap);
+    r->seq.store(pos + 1, std::memory_order_release);
+}
+
+void dvlog::get_stats(DvLogStats &st){
+    st.written = n_written.load();
+    st.dropped = n_dropped.load();
+    st.suppressed = n_suppressed.load();
+    st.rotations = n_rotations.load();
+}
@@ -2,6 +2,8 @@
 
 #include "gst_parent.h"
 #include "gst_worker.h"
+#include <algorithm>
+#include <random>
 
 
 
@@ -31,7 +33,6 @@ int recv_fd(int sock) {
 
 
 uint64_t signal_parser(uint64_t val){
-    printf(" [sig-parser] received: %lu\n", val);
     if((val & EVT_PIPELINE_EXIT) == EVT_PIPELINE_EXIT){
         return EVT_PIPELINE_EXIT;
     }
@@ -45,4 +46,21 @@ uint64_t signal_parser(uint64_t val){
         return EVT_FRAME_WAITING;
     }
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Exponential backoff with jitter, RESTART_BACKOFF_BASE_MS * 2^nfails
+ * capped at RESTART_BACKOFF_MAX_MS, then a random point in its upper half so
+ * streams that died together do not restart together.
+ * @param nfails failures before the last one, 0 - base delay
+ */
+int64_t restart_backoff_ms(int nfails){
+    static thread_local std::minstd_rand rng(std::random_device{}());
+    int64_t delay = RESTART_BACKOFF_BASE_MS;
+    for (int i = 0; i < nfails && delay < RESTART_BACKOFF_MAX_MS; i++){
+        delay *= 2;
+    }
+    delay = std::min<int64_t>(delay, RESTART_BACKOFF_MAX_MS);
+    std::uniform_int_distribution<int64_t> jitter(0, delay / 2);
+    return delay - delay / 2 + jitter(rng);
+}
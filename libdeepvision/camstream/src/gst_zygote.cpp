@@ -0,0 +1,331 @@
+#include "gst_zygote.h"
+#include "camstream.h"
+#include "dvlog.h"
+#include "gst_worker.h"
+#include "threading.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define ZYGOTE_NFDS 3   /* socket, eventfd, pidfd */
+
+
+static int pidfd_open_compat(pid_t pid){
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int send_resp(int sock, const ZygoteSpawnResp &resp, const int *fds, int nfds){
+    struct iovec iov{ (void*)&resp, sizeof(resp) };
+    char cmsgbuf[CMSG_SPACE(sizeof(int) * ZYGOTE_NFDS)];
+    std::memset(cmsgbuf, 0, sizeof(cmsgbuf));
+
+    struct msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds > 0){
+        msg.msg_control = cmsgbuf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(int) * nfds);
+        std::memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+    }
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(resp) ? 1 : 0;
+}
+
+/* reaps exited workers, the parent sees their exit on the pidfd */
+static void reap_workers(void){
+    while (waitpid(-1, nullptr, WNOHANG) > 0){
+    }
+}
+
+static void spawn_worker(int ctrl_fd, const ZygoteSpawnReq &req, gst_worker_fn worker){
+    ZygoteSpawnResp resp{GST_ZYGOTE_MAGIC, req.id, -1, 0};
+    int sv[2] = {-1, -1};
+    int evfd = -1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0 ||
+        (evfd = eventfd(0, EFD_CLOEXEC)) < 0){
+        resp.err = errno;
+        send_resp(ctrl_fd, resp, nullptr, 0);
+        if (sv[0] >= 0){
+            close(sv[0]);
+            close(sv[1]);
+        }
+        return;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0){
+        /* worker, runs the stream with gst and all plugins already loaded */
+        close(ctrl_fd);
+        close(sv[0]);
+        char url[GST_ZYGOTE_URL_SIZE];
+        char id_str[16];
+        snprintf(url, sizeof(url), "%.*s", (int)sizeof(req.url), req.url);
+        snprintf(id_str, sizeof(id_str), "%d", req.id);
+        _exit(worker(sv[1], evfd, url, id_str));
+    }
+    close(sv[1]);
+    int fds[ZYGOTE_NFDS] = {sv[0], evfd, -1};
+    if (pid < 0){
+        resp.err = errno;
+    }
+    else if ((fds[2] = pidfd_open_compat(pid)) < 0){
+        // without a pidfd the parent can not reap a worker it did not fork
+        resp.err = errno;
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+    }
+    else{
+        resp.pid = pid;
+    }
+    if (!send_resp(ctrl_fd, resp, fds, resp.err == 0 ? ZYGOTE_NFDS : 0) && resp.err == 0){
+        kill(pid, SIGKILL);
+    }
+    for (int fd : fds){
+        if (fd >= 0){
+            close(fd);
+        }
+    }
+    if (resp.err == 0){
+        DVLOG_INFO(LogFields(req.id, pid), "[zygote] worker spawned");
+    }
+    else{
+        DVLOG_ERROR(LogFields(req.id), "[zygote] failed to spawn worker: %s", strerror(resp.err));
+    }
+}
+
+int zygote_main(int ctrl_fd, gst_worker_fn worker){
+    int nloaded = preload_gst_plugins();
+    ZygoteSpawnResp ready{GST_ZYGOTE_MAGIC, -1, getpid(), 0};
+    if (!send_resp(ctrl_fd, ready, nullptr, 0)){
+        return 1;
+    }
+    DVLOG_INFO(LogFields(-1, getpid()), "[zygote] ready, %d elements preloaded", nloaded);
+
+    while (true){
+        struct pollfd pfd{ctrl_fd, POLLIN, 0};
+        int r = poll(&pfd, 1, 500);
+        reap_workers();
+        if (r < 0 && errno != EINTR){
+            DVLOG_ERROR(LogFields(-1, getpid(), ctrl_fd), "[zygote] poll: %s", strerror(errno));
+            break;
+        }
+        if (r <= 0){
+            continue;
+        }
+        ZygoteSpawnReq req;
+        ssize_t n = recv(ctrl_fd, &req, sizeof(req), 0);
+        if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN)){
+            break; // parent closed the control socket
+        }
+        if (n != (ssize_t)sizeof(req) || req.magic != GST_ZYGOTE_MAGIC){
+            continue;
+        }
+        spawn_worker(ctrl_fd, req, worker);
+    }
+    DVLOG_INFO(LogFields(-1, getpid()), "[zygote] exiting");
+    return 0;
+}
+
+
+GstZygote &GstZygote::instance(void){
+    static GstZygote zygote;
+    return zygote;
+}
+
+int GstZygote::start(void){
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0){
+        DVLOG_ERROR(LogFields(), "[parent] zygote socketpair: %s", strerror(errno));
+        return 0;
+    }
+    pid_t pid = fork();
+    if (pid < 0){
+        DVLOG_ERROR(LogFields(), "[parent] zygote fork: %s", strerror(errno));
+        close(sv[0]);
+        close(sv[1]);
+        return 0;
+    }
+    if (pid == 0){
+        // the parent may block stop signals for sigwait, the mask survives exec
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, nullptr);
+        // forked workers inherit the decode cpus, nice and policy of the zygote
+        apply_decode_policy();
+        if (sv[1] != 3){
+            dup2(sv[1], 3);  // dup2 clears CLOEXEC
+        }
+        else{
+            fcntl(3, F_SETFD, 0);
+        }
+        execl(GST_WORKER_PATH, GST_WORKER_PATH, GST_ZYGOTE_ARG, (char*)nullptr);
+        std::cerr << "[parent->zygote] exec failed: " << std::strerror(errno) << "\n";
+        _exit(127);
+    }
+    close(sv[1]);
+    ctrl = sv[0];
+    zpid = pid;
+    ready = false;
+    struct timeval tv{GST_ZYGOTE_REPLY_TIMEOUT_MS / 1000, (GST_ZYGOTE_REPLY_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(ctrl, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    DVLOG_INFO(LogFields(-1, zpid), "[parent] gst zygote started");
+    return 1;
+}
+
+/* true once the zygote announced it finished gst_init and plugin loading */
+int GstZygote::poll_ready(void){
+    if (ready){
+        return 1;
+    }
+    struct pollfd pfd{ctrl, POLLIN, 0};
+    if (poll(&pfd, 1, 0) <= 0){
+        return 0;
+    }
+    ZygoteSpawnResp resp{};
+    ssize_t n = recv(ctrl, &resp, sizeof(resp), 0);
+    if (n != (ssize_t)sizeof(resp) || resp.magic != GST_ZYGOTE_MAGIC || resp.id != -1){
+        if (n == 0){
+            errno = EPIPE;
+        }
+        fail("start");
+        return 0;
+    }
+    ready = true;
+    return 1;
+}
+
+int GstZygote::prestart(void){
+    if (!GST_ZYGOTE_ENABLED){
+        return 0;
+    }
+    std::lock_guard<std::mutex> lk(lock);
+    if (ctrl >= 0){
+        return 1;
+    }
+    if (disabled || time(nullptr) - last_start < GST_ZYGOTE_RETRY_SEC){
+        return 0;
+    }
+    last_start = time(nullptr);
+    return start();
+}
+
+/* the zygote is unusable, drop it and fall back to fork/exec until the next retry */
+void GstZygote::fail(const char *what){
+    DVLOG_WARN(LogFields(), "[parent] gst zygote %s: %s, using fork/exec", what, strerror(errno));
+    if (ctrl >= 0){
+        close(ctrl);
+        ctrl = -1;
+    }
+    if (zpid > 0){
+        kill(zpid, SIGKILL);
+        waitpid(zpid, nullptr, 0);
+        zpid = -1;
+    }
+}
+
+int GstZygote::spawn(int id, const char *url, pid_t *pid, int *sockfd, int *evfd, int *pidfd){
+    if (!GST_ZYGOTE_ENABLED){
+        return 0;
+    }
+    std::lock_guard<std::mutex> lk(lock);
+    if (disabled){
+        return 0;
+    }
+    if (ctrl < 0){
+        time_t now = time(nullptr);
+        if (now - last_start < GST_ZYGOTE_RETRY_SEC){
+            return 0;
+        }
+        last_start = now;
+        if (!start()){
+            return 0;
+        }
+    }
+    // never wait for a starting zygote, fork/exec until it is ready
+    if (!poll_ready()){
+        return 0;
+    }
+
+    ZygoteSpawnReq req{};
+    req.magic = GST_ZYGOTE_MAGIC;
+    req.id = id;
+    snprintf(req.url, sizeof(req.url), "%s", url);
+    if (send(ctrl, &req, sizeof(req), MSG_NOSIGNAL) != (ssize_t)sizeof(req)){
+        fail("send");
+        return 0;
+    }
+
+    ZygoteSpawnResp resp{};
+    struct iovec iov{ &resp, sizeof(resp) };
+    char cmsgbuf[CMSG_SPACE(sizeof(int) * ZYGOTE_NFDS)];
+    std::memset(cmsgbuf, 0, sizeof(cmsgbuf));
+    struct msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgbuf;
+    msg.msg_controllen = sizeof(cmsgbuf);
+    ssize_t n = recvmsg(ctrl, &msg, MSG_CMSG_CLOEXEC);
+    if (n != (ssize_t)sizeof(resp) || resp.magic != GST_ZYGOTE_MAGIC || resp.id != id){
+        if (n == 0){
+            errno = EPIPE;
+        }
+        fail("reply");
+        return 0;
+    }
+
+    int fds[ZYGOTE_NFDS] = {-1, -1, -1};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(int) * ZYGOTE_NFDS)){
+        std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    }
+    if (resp.err != 0 || fds[2] < 0){
+        for (int fd : fds){
+            if (fd >= 0){
+                close(fd);
+            }
+        }
+        errno = resp.err;
+        fail("spawn");
+        // without pidfd_open (linux < 5.3) the parent can not reap zygote workers
+        disabled = resp.err == ENOSYS;
+        return 0;
+    }
+    *pid = resp.pid;
+    *sockfd = fds[0];
+    *evfd = fds[1];
+    *pidfd = fds[2];
+    return 1;
+}
+
+void GstZygote::stop(void){
+    std::lock_guard<std::mutex> lk(lock);
+    if (ctrl >= 0){
+        close(ctrl);  // the zygote exits on EOF
+        ctrl = -1;
+    }
+    if (zpid > 0){
+        waitpid(zpid, nullptr, 0);
+        zpid = -1;
+    }
+}
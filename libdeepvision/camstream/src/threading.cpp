@@ -0,0 +1,232 @@
+#include "threading.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/resource.h>
+
+
+/* set once by set_cpu_topology() at startup, read by threads and forked workers */
+static bool topology_set = false;
+static cpu_set_t proc_cpus;
+static cpu_set_t role_sets[THREAD_ROLE_NROLES];
+static bool role_pinned[THREAD_ROLE_NROLES] = {};
+static int decode_nice = DECODE_NICE;
+static bool decode_batch = DECODE_SCHED_BATCH;
+
+
+const char *thread_role_name(ThreadRole role){
+    switch (role){
+        case THREAD_ROLE_CONTROL:   return "control";
+        case THREAD_ROLE_INFERENCE: return "inference";
+        case THREAD_ROLE_ORT:       return "ort";
+        case THREAD_ROLE_IO:        return "io";
+        case THREAD_ROLE_DECODE:    return "decode";
+        default:                    return "unknown";
+    }
+}
+
+int parse_cpu_list(const std::string &list, cpu_set_t *set){
+    CPU_ZERO(set);
+    const char *p = list.c_str();
+    int n = 0;
+    while (*p){
+        while (*p == ' ' || *p == ','){
+            p++;
+        }
+        if (*p == '\0'){
+            break;
+        }
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0){
+            return 0;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-'){
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first){
+                return 0;
+            }
+            p = end;
+        }
+        if (last >= CPU_SETSIZE || (*p != '\0' && *p != ',' && *p != ' ')){
+            return 0;
+        }
+        for (long c = first; c <= last; c++){
+            CPU_SET(c, set);
+        }
+        n++;
+    }
+    return n > 0;
+}
+
+std::string format_cpu_list(const cpu_set_t *set){
+    std::string s;
+    for (int c = 0; c < CPU_SETSIZE; c++){
+        if (!CPU_ISSET(c, set)){
+            continue;
+        }
+        int last = c;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set)){
+            last++;
+        }
+        if (!s.empty()){
+            s += ",";
+        }
+        s += std::to_string(c);
+        if (last > c){
+            s += "-" + std::to_string(last);
+        }
+        c = last;
+    }
+    return s;
+}
+
+static int cpu_package(int cpu){
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    FILE *f = fopen(path, "r");
+    if (f == nullptr){
+        return -1;
+    }
+    int id = -1;
+    if (fscanf(f, "%d", &id) != 1){
+        id = -1;
+    }
+    fclose(f);
+    return id;
+}
+
+static std::string join_cpus(const std::vector<int> &cpus){
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus){
+        CPU_SET(c, &set);
+    }
+    return format_cpu_list(&set);
+}
+
+CpuTopology CpuTopology::detect(void){
+    CpuTopology topo;
+    cpu_set_t avail;
+    if (sched_getaffinity(0, sizeof(avail), &avail) != 0){
+        return topo;
+    }
+    std::map<int, std::vector<int>> packages;
+    for (int c = 0; c < CPU_SETSIZE; c++){
+        if (CPU_ISSET(c, &avail)){
+            packages[cpu_package(c)].push_back(c);
+        }
+    }
+    if (packages.size() < 2 || packages.count(-1)){
+        return topo;
+    }
+    /* inference and the ort pool share the first socket, the inference
+       thread waits while the pool runs */
+    const std::vector<int> &first = packages.begin()->second;
+    topo.cpus[THREAD_ROLE_INFERENCE] = join_cpus(first);
+    topo.cpus[THREAD_ROLE_ORT] = join_cpus(first);
+
+    std::vector<int> last = packages.rbegin()->second;
+    size_t nio = last.size() > 2 ? 2 : last.size();
+    std::vector<int> io(last.begin(), last.begin() + nio);
+    topo.cpus[THREAD_ROLE_IO] = join_cpus(io);
+    topo.cpus[THREAD_ROLE_CONTROL] = join_cpus(io);
+
+    std::vector<int> decode;
+    for (auto it = std::next(packages.begin()); it != packages.end(); ++it){
+        for (int c : it->second){
+            if (nio == last.size() || std::find(io.begin(), io.end(), c) == io.end()){
+                decode.push_back(c);
+            }
+        }
+    }
+    topo.cpus[THREAD_ROLE_DECODE] = join_cpus(decode);
+    return topo;
+}
+
+int set_cpu_topology(const CpuTopology &topo){
+    if (!topology_set && sched_getaffinity(0, sizeof(proc_cpus), &proc_cpus) != 0){
+        perror("[threading] sched_getaffinity");
+        return 0;
+    }
+    int ret = 1;
+    for (int r = 0; r < THREAD_ROLE_NROLES; r++){
+        const char *name = thread_role_name((ThreadRole)r);
+        role_pinned[r] = false;
+        if (topo.cpus[r].empty()){
+            printf("[threading] %s: all cpus\n", name);
+            continue;
+        }
+        cpu_set_t set;
+        if (!parse_cpu_list(topo.cpus[r], &set)){
+            printf("[threading] %s: invalid cpu list \"%s\", not pinned\n", name, topo.cpus[r].c_str());
+            ret = 0;
+            continue;
+        }
+        CPU_AND(&role_sets[r], &set, &proc_cpus);
+        if (CPU_COUNT(&role_sets[r]) == 0){
+            printf("[threading] %s: cpus \"%s\" are not available, not pinned\n", name, topo.cpus[r].c_str());
+            ret = 0;
+            continue;
+        }
+        if (!CPU_EQUAL(&role_sets[r], &set)){
+            printf("[threading] %s: cpus outside the process set dropped\n", name);
+        }
+        role_pinned[r] = true;
+        printf("[threading] %s: cpus %s\n", name, format_cpu_list(&role_sets[r]).c_str());
+    }
+    decode_nice = topo.decode_nice;
+    decode_batch = topo.decode_batch;
+    topology_set = true;
+    return ret;
+}
+
+int role_cpus(ThreadRole role, cpu_set_t *set){
+    if (!topology_set || role < 0 || role >= THREAD_ROLE_NROLES || !role_pinned[role]){
+        return 0;
+    }
+    *set = role_sets[role];
+    return 1;
+}
+
+void set_thread_name(const char *name){
+    char buf[THREAD_NAME_MAX + 1];
+    snprintf(buf, sizeof(buf), "%s", name);
+    pthread_setname_np(pthread_self(), buf);
+}
+
+int set_thread_role(ThreadRole role, const char *name){
+    set_thread_name(name);
+    if (!topology_set || role < 0 || role >= THREAD_ROLE_NROLES){
+        return 1;
+    }
+    const cpu_set_t *set = role_pinned[role] ? &role_sets[role] : &proc_cpus;
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), set);
+    if (err != 0){
+        printf("[threading] %s: failed to set %s cpus: %s\n", name, thread_role_name(role), strerror(err));
+        return 0;
+    }
+    return 1;
+}
+
+void apply_decode_policy(void){
+    if (topology_set){
+        sched_setaffinity(0, sizeof(cpu_set_t), role_pinned[THREAD_ROLE_DECODE] ? &role_sets[THREAD_ROLE_DECODE] : &proc_cpus);
+    }
+    if (decode_batch){
+        struct sched_param sp{};
+        sched_setscheduler(0, SCHED_BATCH, &sp);
+    }
+    if (decode_nice > 0){
+        setpriority(PRIO_PROCESS, 0, decode_nice);
+    }
+}
@@ -0,0 +1,79 @@
+/**
+ * @file autotune.h
+ * @brief Batch size and ORT thread count tuning on the host hardware
+ * @author Jonas Vaicekauskas
+ * @date 2026-10-19
+ * @details Runs the real models on synthetic frames through the muxer and
+ * engine for every point of a batch size x intra-op threads grid, and
+ * measures throughput and p99 batch latency. The best point is the highest
+ * throughput whose p99 fits AUTOTUNE_P99_MAX_MS. The application stores it
+ * per host and model hash and applies it at startup.
+ */
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define AUTOTUNE_BATCH_MAX 16
+#define AUTOTUNE_THREADS_MAX 16         /* intra-op threads per session */
+#define AUTOTUNE_WARMUP_S 3
+#define AUTOTUNE_MEASURE_S 10           /* at least, until AUTOTUNE_MIN_BATCHES are in */
+#define AUTOTUNE_MIN_BATCHES 50         /* batches behind a p99, fewer is the slowest few */
+#define AUTOTUNE_MEASURE_MAX_S 300      /* a point without AUTOTUNE_MIN_BATCHES by then is skipped */
+#define AUTOTUNE_FRAME_W 1920
+#define AUTOTUNE_FRAME_H 1080
+#define AUTOTUNE_P99_MAX_MS 350         /* half the gate SLO, a frame can wait one batch before its own */
+#define AUTOTUNE_TIE_PCT 5              /* within this much throughput, fewer threads and then a smaller batch win */
+#define AUTOTUNE_WORKDIR "/tmp/parkai-autotune/"
+
+
+struct TuneConfig{
+    int batch = 0;
+    int intra_threads = 0;      /* per ORT session, 0 - CPU topology default */
+};
+
+struct TuneResult{
+    TuneConfig cfg;
+    double throughput_fps = 0;
+    double p50_ms = 0;          /* batch pull to detections written */
+    double p99_ms = 0;
+    uint64_t batches = 0;
+};
+
+struct TuneGrid{
+    std::vector<int> batches;
+    std::vector<int> threads;
+    int warmup_s = AUTOTUNE_WARMUP_S;
+    int measure_s = AUTOTUNE_MEASURE_S;
+    int min_batches = AUTOTUNE_MIN_BATCHES;
+    std::string workdir = AUTOTUNE_WORKDIR;
+};
+
+/**
+ * @brief Powers of two up to AUTOTUNE_BATCH_MAX batches, and up to the ort
+ * cpus of the topology (half the cpus without one) or AUTOTUNE_THREADS_MAX
+ * intra-op threads
+ */
+TuneGrid default_tune_grid(void);
+
+/**
+ * @brief Measures every grid point, prints one line per point
+ * @param best the chosen point
+ * @return number of points measured, 0 - none
+ */
+int autotune(const TuneGrid &grid, std::vector<TuneResult> &results, TuneResult &best);
+
+/* picks the best result, see the file comment */
+int pick_best(const std::vector<TuneResult> &results, TuneResult &best);
+
+/**
+ * @brief FNV-1a 64 over the three model files, as hex. A tuned config is only
+ * applied to the models it was measured with.
+ * @return empty if a model file can't be read
+ */
+std::string model_hash(void);
+
+#endif
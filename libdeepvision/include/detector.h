@@ -11,6 +11,8 @@
 #define DETECTOR_H
 
 #include "onnxruntime_cxx_api.h"
+#include "onnxruntime_session_options_config_keys.h"
+#include "onnxruntime_run_options_config_keys.h"
 #include <opencv2/opencv.hpp>
 #include <iostream>
 #include <fstream>
@@ -18,11 +20,17 @@
 #include <sys/stat.h>
 #include <filesystem>
 #include <deque>
+#include <functional>
+#include <future>
+#include <memory>
 #include "measure_time.h"
 
 #include "camstream.h"
 #include "streammuxer.h"
+#include "memstats.h"
 #include "gst_parent.h"
+#include "threading.h"
+#include "model_registry.h"
 
 #define USE_CUDA true
 #define YOLO_INPUT_W 640
@@ -30,6 +38,7 @@
 
 #define LPRNET_INPUT_W 96
 #define LPRNET_INPUT_H 48
+#define LPRNET_BLANK_CLASS 35
 
 #define VERBOSE true
 
@@ -46,9 +55,10 @@
 #define VEHICLE_MODEL_PATH "yolo11_indoor_s.onnx"
 #define VEHICLE_DET_CONFIDENCE_THRESHOLD 0.3
 #define LPD_MODEL_PATH "license_plate_detector.onnx"
-#define LPD_BATCH_SIZE 1
+#define LPD_BATCH_SIZE 4    /* car crops per LPD run, used when the model has a dynamic batch */
 #define LPLATE_DET_CONFIDENCE_THRESHOLD 0.5
 #define LPR_MODEL_PATH "us_lprnet_baseline18_deployable.onnx"
+#define LPR_BATCH_SIZE 8    /* plates per LPRNet run, used when the model has a dynamic batch */
 
 #define DETECT_LPD true
 
@@ -56,8 +66,19 @@
 
 #define BATCH_SIZE 4
 
+/* Shared ORT CPU arena, registered once in the env and used by all sessions */
+#define ORT_ARENA_MAX_MB 1024              /* 0 lets ORT choose (unbounded) */
+#define ORT_ARENA_EXTEND_STRATEGY 1        /* 0 = next power of two, 1 = same as requested */
+#define ORT_ARENA_SHRINK_PERIOD_SEC 60     /* 0 disables periodic arena shrink */
+#define ORT_INTRA_OP_THREADS_MAX 8         /* per session, when the topology has ort cpus */
+
 #define ONDT_MILLISECOND std::chrono::milliseconds(1)
 
+/* Stream bring-up: at most STREAM_START_PARALLEL workers wait for their first
+   frame at a time, a worker stops counting after STREAM_START_TIMEOUT_MS */
+#define STREAM_START_PARALLEL 16
+#define STREAM_START_TIMEOUT_MS 5000
+
 
 
 class ImgReader;
@@ -95,11 +116,8 @@ struct parknetDet{
     int shutter = 0;
 };
 
-typedef enum {
-    VEHICLE_MODEL = 0,
-    LP_MODEL,
-    OCR_MODEL
-}model_t;
+/* Receives the detections of one frame, index is the camera index */
+typedef std::function<void(uint32_t index, const std::vector<parknetDet> &dets)> DetectionCallback;
 
 struct ImgMeta{
     int width;
@@ -112,6 +130,10 @@ struct stream_info{
     time_t ts;
     int index;
     int id;
+    bool ready = false;     /* first frame received since (re)start */
+    StreamHealthInfo health;
+    StreamSched sched;      /* priority class, weight and latency SLO from the camera config */
+    StreamRoi roi;          /* part of the frame the vehicle detector sees, empty - full frame */
 };
 
 void print_detections(std::string imgfn, std::vector<parknetDet> &dets);
@@ -167,6 +189,83 @@ namespace ImgUtils {/* Private function to load the image file*/
         return ret;
     }
 
+    /**
+     * @brief Copies an interleaved CV_32FC3 image (HWC) into planar CHW layout
+     * @param img source image, must be at least h x w
+     * @param dst destination, ch*h*w floats
+     */
+    inline void hwc_to_chw(const cv::Mat &img, int ch, int h, int w, float *dst){
+        size_t idx = 0;
+        for (int c = 0; c < ch; ++c)
+            for (int y = 0; y < h; ++y)
+                for (int x = 0; x < w; ++x)
+                    dst[idx++] = img.at<cv::Vec3f>(y, x)[c];
+    }
+
+    /**
+     * @brief Bilinear resize, 1/255 scaling and HWC to CHW of a CV_8UC3 image
+     * in one pass, written straight into a model input tensor. Sampling
+     * matches cv::resize INTER_LINEAR, channel order is kept.
+     * @param src uint8 image or a ROI view of a frame, any row step
+     * @param dst destination, 3*dst_h*dst_w floats
+     */
+    void resize_normalize_chw(const cv::Mat &src, int dst_w, int dst_h, float *dst);
+
+    /**
+     * @brief Fills a [n,3,dst_h,dst_w] input tensor from count uint8 images with
+     * resize_normalize_chw, entries past count (padding of a fixed batch) are zeros
+     */
+    void load_chw_batch(const cv::Mat *imgs, size_t count, size_t n, int dst_w, int dst_h, std::vector<float> &dst);
+
+    /**
+     * @brief A frame from the muxer, or the part of it a model sees. RGB frames
+     * are a cv::Mat view. YUV 4:2:0 frames (PixFormat) stay in their planes
+     * and are converted only where they are sampled or cropped.
+     */
+    struct FrameView{
+        cv::Mat rgb;                    /* CV_8UC3, used when set */
+        const uchar *yuv = nullptr;     /* packed planes of the whole frame */
+        int width = 0;                  /* of the whole yuv frame */
+        int height = 0;
+        uint32_t format = PIX_FMT_RGB;
+        uint32_t matrix = PIX_MATRIX_BT601;     /* PixMatrix and PixRange of the yuv frame */
+        uint32_t range = PIX_RANGE_LIMITED;
+        cv::Rect rect;                  /* part of the yuv frame */
+
+        FrameView() = default;
+        FrameView(const cv::Mat &rgb) : rgb(rgb) {}
+
+        bool is_yuv(void) const {return rgb.empty() && yuv != nullptr;}
+        bool empty(void) const {return is_yuv() ? rect.area() <= 0 : rgb.empty();}
+        int cols(void) const {return is_yuv() ? rect.width : rgb.cols;}
+        int rows(void) const {return is_yuv() ? rect.height : rgb.rows;}
+    };
+
+    /* whole frame of a muxer buffer, empty if the format is unknown */
+    FrameView frame_view(const uchar *data, int width, int height, uint32_t format,
+                         uint32_t matrix = PIX_MATRIX_BT601, uint32_t range = PIX_RANGE_LIMITED);
+
+    /* rect of a view, in view coordinates, must lie inside it */
+    FrameView sub_view(const FrameView &v, const cv::Rect &rect);
+
+    /**
+     * @brief RGB pixels of a view, a view of the frame for RGB frames and a
+     * converted copy for YUV ones, with the matrix and range of the frame.
+     * BT.601 limited range matches cv::cvtColor COLOR_YUV2RGB_I420/NV12.
+     */
+    cv::Mat to_rgb(const FrameView &v);
+
+    /* crop_image() of a frame view, converted to RGB */
+    cv::Mat crop_rgb(const FrameView &v, int x0, int y0, int x1, int y1);
+
+    /**
+     * @brief resize_normalize_chw() of a frame view. For YUV frames the
+     * 4 taps of every destination pixel are converted to RGB, nothing else.
+     */
+    void resize_normalize_chw(const FrameView &src, int dst_w, int dst_h, float *dst);
+
+    void load_chw_batch(const FrameView *imgs, size_t count, size_t n, int dst_w, int dst_h, std::vector<float> &dst);
+
     inline std::vector<std::string> get_files_in_directory(const std::string& directory_path) {
         std::vector<std::string> files;
         
@@ -195,7 +294,19 @@ namespace ImgUtils {/* Private function to load the image file*/
     }
 };
 
+float IoU(const bbox& a, const bbox& b);
+std::vector<bbox> non_max_suppression(std::vector<bbox>& boxes, float iou_thresh = 0.45f);
+
 namespace detector {
+    /* moves a box from ROI crop to full frame coordinates */
+    inline bbox offset_bbox(bbox b, float dx, float dy){
+        b.x1 += dx;
+        b.x2 += dx;
+        b.y1 += dy;
+        b.y2 += dy;
+        return b;
+    }
+
     inline bbox max_bbox(std::vector<bbox> bboxes){
         float max = 0.0;
         bbox ret;
@@ -206,7 +317,90 @@ namespace detector {
             }
         }
         return ret;
-    }  
+    }
+
+    /**
+     * @brief Greedy CTC decode: merges repeated classes and drops blanks
+     * @param output class index per time step
+     * @param blank index of the blank class
+     */
+    inline std::string ctc_decode(const int *output, int seq_len,
+                                  const std::vector<std::string> &alphabet, int blank){
+        std::string text;
+        int prev_class = -1;
+        for (int i = 0; i < seq_len; ++i) {
+            if (output[i] != prev_class && output[i] != blank) {
+                text += alphabet[output[i]];
+            }
+            prev_class = output[i];
+        }
+        return text;
+    }
+
+    /**
+     * @brief Decodes YOLO output [batch, channels, num_preds] into boxes scaled
+     * to the original image sizes, followed by NMS.
+     */
+    std::vector<std::vector<bbox>> decode_yolo_output(const float *output, int batch, int channels,
+        int num_preds, const std::vector<ImgMeta> &batch_meta, float threshold);
+
+    /**
+     * @brief Process wide ORT environment with the shared CPU arena registered.
+     * Sessions opt in with session.use_env_allocators=1.
+     */
+    Ort::Env &shared_env(void);
+
+    /**
+     * @brief Run options for Session::Run. Every ORT_ARENA_SHRINK_PERIOD_SEC one
+     * run also asks ORT to shrink the CPU arena back after it completes.
+     */
+    Ort::RunOptions make_run_options(void);
+
+    /* adds env allocator opt-in to the session options */
+    inline void use_shared_arena(Ort::SessionOptions &options){
+        options.AddConfigEntry(kOrtSessionOptionsConfigUseEnvAllocators, "1");
+    }
+
+    /**
+     * @brief Intra op threads of a session. Without ort cpus in the topology
+     * the session runs on the calling thread only, otherwise its pool gets
+     * one thread pinned to each ort cpu, up to ORT_INTRA_OP_THREADS_MAX.
+     * A limit set with set_intra_op_limit() replaces ORT_INTRA_OP_THREADS_MAX,
+     * and without ort cpus gives the session that many unpinned threads.
+     */
+    void set_intra_op_threads(Ort::SessionOptions &options);
+
+    /* intra op threads of sessions created from now on, 0 - default */
+    void set_intra_op_limit(int n);
+    int get_intra_op_limit(void);
+
+    /**
+     * @brief Batch dimension the model was exported with
+     * @return 0 - dynamic batch, otherwise the fixed batch size
+     */
+    int model_batch(Ort::Session &session);
+
+    /**
+     * @brief Output checks of a warm-up run: rank, element type and no NaN or
+     * Inf in a float output
+     * @param dims expected dims, -1 - any
+     * @return 1 - ok, 0 - err is set
+     */
+    int check_output(Ort::Value &out, const std::vector<int64_t> &dims,
+                     ONNXTensorElementDataType type, std::string &err);
+
+    /**
+     * @brief Images per run of a second stage model: the configured batch for
+     * a dynamic batch model, the exported batch for a fixed one
+     */
+    inline int run_batch(int model_batch, int configured){
+        if (model_batch > 0){
+            return model_batch;
+        }
+        return configured > 0 ? configured : 1;
+    }
+
+    int shared_arena_stats(SessionMemStats &st);
 };
 
 
@@ -230,7 +424,7 @@ class LPRNetDetector{
             "A","B","C","D","E","F","G","H","I","J","K","L","M","N","P","Q","R","S","T","U","V","W","X","Y","Z",
             ""};
 
-        Ort::Env env;
+        Ort::Env &env;
         Ort::SessionOptions session_options;
         Ort::Session session;
 
@@ -245,6 +439,9 @@ class LPRNetDetector{
         std::vector<float> input_tensor_values;
         std::array<int64_t, 4> input_shape{1, 3, INPUT_H, INPUT_W};
         std::vector<Ort::Value> output_tensors;
+
+        int batch_size;         // configured plates per run
+        int fixed_batch = 0;    // batch dimension of the model, 0 - dynamic
     
         static Ort::SessionOptions create_session_options() {
             Ort::SessionOptions options;
@@ -261,7 +458,8 @@ class LPRNetDetector{
             //options.SetExecutionMode(ORT_PARALLEL);
             //options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
             //options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
-            options.SetIntraOpNumThreads(1);
+            detector::set_intra_op_threads(options);
+            detector::use_shared_arena(options);
             return options;
         }
 
@@ -276,19 +474,14 @@ class LPRNetDetector{
         input_names_raw = {input_names.c_str()};
         output_names_raw = {output_names.c_str()};
         //std::cout << "Output Names: " << output_names << std::endl;
-        
+        fixed_batch = detector::model_batch(session);
+        batch_size = detector::run_batch(fixed_batch, batch_size);
     }
 
     Ort::Value load_input_tensor(cv::Mat img){
         input_tensor_values.clear();
         input_tensor_values.resize(INPUT_CH*INPUT_H*INPUT_W);
-        // Convert HWC to CHW
-        size_t idx = 0;
-        for (int c = 0; c < INPUT_CH; ++c)
-            for (int y = 0; y < INPUT_H; ++y)
-                for (int x = 0; x < INPUT_W; ++x)
-                    input_tensor_values[idx++] = img.at<cv::Vec3f>(y, x)[c];
-                    //input_tensor_values.push_back(img.at<cv::Vec3f>(y, x)[c]);
+        ImgUtils::hwc_to_chw(img, INPUT_CH, INPUT_H, INPUT_W, input_tensor_values.data());
         Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
             memory_info, input_tensor_values.data(), input_tensor_values.size(), 
             input_shape.data(), input_shape.size());
@@ -296,14 +489,16 @@ class LPRNetDetector{
     }
 
     void run(Ort::Value &input_tensor){
-        output_tensors = session.Run(Ort::RunOptions{nullptr}, input_names_raw.data(),
+        output_tensors = session.Run(detector::make_run_options(), input_names_raw.data(),
                     &input_tensor, 1, output_names_raw.data(), 1);
     }
 
-    std::string postprocess(void){
+    /* text of batch entry b, output is [batch, seq_len] */
+    std::string postprocess(int b = 0){
         int* output = output_tensors.front().GetTensorMutableData<int>();
         auto tensor_info = output_tensors.front().GetTensorTypeAndShapeInfo();
         auto shape = tensor_info.GetShape();
+        output += b * (tensor_info.GetElementCount() / shape[0]);
         // Print output shape
         // std::cout << "LPRNet output shape: (";
         // for (size_t i = 0; i < shape.size(); ++i) {
@@ -312,15 +507,7 @@ class LPRNetDetector{
         // }
         // std::cout << ")" << std::endl;
         int seq_len = shape[1];      // e.g., 18
-        std::string plate;
-        int prev_class = -1;
-        for (int i = 0; i < seq_len; ++i) {
-            //std::cout << (float)output[i] << std::endl;
-            if (output[i] != prev_class && output[i] != 35) { 
-                plate += ALPHABET[output[i]];
-            }
-            prev_class = output[i];
-        }
+        std::string plate = detector::ctc_decode(output, seq_len, ALPHABET, LPRNET_BLANK_CLASS);
         //std::cout << "Predicted plate: " << plate << std::endl;
         return plate;
     }
@@ -329,11 +516,12 @@ class LPRNetDetector{
         output_tensors.clear();
     }
     public:
-    LPRNetDetector(const char * name, const char * model_path)
+    LPRNetDetector(const char * name, const char * model_path, int batch_size = LPR_BATCH_SIZE)
         : name(name), 
-        env(ORT_LOGGING_LEVEL_ERROR, name), 
+        env(detector::shared_env()),
         session_options(create_session_options()),
-        session(env, model_path, session_options)
+        session(env, model_path, session_options),
+        batch_size(batch_size)
         {
             std::cout << "Initializing LPRNet Engine\n";
             std::cout << "Loading model " << model_path << std::endl;
@@ -369,6 +557,49 @@ class LPRNetDetector{
         return ret;
     }
 
+    /**
+     * @brief One run on a gray plate, checks the output is [batch, seq_len] int
+     * @return 1 - ok, 0 - err is set
+     */
+    int warmup(std::string &err){
+        std::vector<cv::Mat> gray(1, cv::Mat(INPUT_H, INPUT_W, CV_8UC3, cv::Scalar(114, 114, 114)));
+        size_t nrun = fixed_batch > 0 ? (size_t)fixed_batch : 1;
+        ImgUtils::load_chw_batch(gray.data(), 1, nrun, INPUT_W, INPUT_H, input_tensor_values);
+        std::array<int64_t, 4> shape{(int64_t)nrun, INPUT_CH, INPUT_H, INPUT_W};
+        Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
+            memory_info, input_tensor_values.data(), input_tensor_values.size(),
+            shape.data(), shape.size());
+        run(input_tensor);
+        int ret = detector::check_output(output_tensors.front(), {(int64_t)nrun, -1},
+                                         ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32, err);
+        clear_tensors();
+        return ret;
+    }
+
+    /**
+     * @brief Reads a list of plates, batch_size plates per run
+     * @param plates uint8 plate crops, views into the frame are fine
+     * @return text per plate
+     */
+    std::vector<std::string> detect_batch(const std::vector<cv::Mat> &plates){
+        std::vector<std::string> ret(plates.size());
+        for (size_t first = 0; first < plates.size(); first += batch_size){
+            size_t n = std::min(plates.size() - first, (size_t)batch_size);
+            size_t nrun = fixed_batch > 0 ? (size_t)fixed_batch : n;
+            ImgUtils::load_chw_batch(&plates[first], n, nrun, INPUT_W, INPUT_H, input_tensor_values);
+            std::array<int64_t, 4> shape{(int64_t)nrun, INPUT_CH, INPUT_H, INPUT_W};
+            Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
+                memory_info, input_tensor_values.data(), input_tensor_values.size(),
+                shape.data(), shape.size());
+            run(input_tensor);
+            for (size_t i = 0; i < n; i++){
+                ret[first + i] = postprocess(i);
+            }
+            clear_tensors();
+        }
+        return ret;
+    }
+
 };
 
 
@@ -382,7 +613,7 @@ class OnnxDetector{
     const std::vector<std::string> COCO80C = {
         "person", "bycicle", "car", "motorcycle", "airplane", "bus", "train", "truck"
     };
-    Ort::Env env;
+    Ort::Env &env;
     Ort::SessionOptions session_options;
     Ort::Session session;
 
@@ -390,6 +621,8 @@ class OnnxDetector{
     std::vector<Ort::Value> output_tensors;
 
     float threshold;
+    int batch_size;         // configured crops per run
+    int fixed_batch = 0;    // batch dimension of the model, 0 - dynamic
 
     std::array<int64_t, 4> input_shape{1, 3, INPUT_H, INPUT_W};
     Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
@@ -411,7 +644,8 @@ class OnnxDetector{
                 std::cout << "Failed to add CUDA provider: " << e.what() << std::endl;
             }
         }
-        options.SetIntraOpNumThreads(1);
+        detector::set_intra_op_threads(options);
+        detector::use_shared_arena(options);
         return options;
     }
 
@@ -425,6 +659,8 @@ class OnnxDetector{
 
         input_names_raw = {input_names.c_str()};
         output_names_raw = {output_names.c_str()};
+        fixed_batch = detector::model_batch(session);
+        batch_size = detector::run_batch(fixed_batch, batch_size);
         //std::cout << "Output Names: " << output_names << std::endl;
         // After session creation, check providers
     std::vector<std::string> providers =  Ort::GetAvailableProviders();
@@ -439,13 +675,7 @@ class OnnxDetector{
     Ort::Value load_input_tensor(cv::Mat src_img){
         input_tensor_values.clear();
         input_tensor_values.resize(INPUT_CH*INPUT_H*INPUT_W);
-        // Convert HWC to CHW
-        size_t idx=0;
-        for (int c = 0; c < INPUT_CH; ++c)
-            for (int y = 0; y < INPUT_H; ++y)
-                for (int x = 0; x < INPUT_W; ++x)
-                    input_tensor_values[idx++] = src_img.at<cv::Vec3f>(y, x)[c];
-                    //input_tensor_values.push_back(src_img.at<cv::Vec3f>(y, x)[c]);
+        ImgUtils::hwc_to_chw(src_img, INPUT_CH, INPUT_H, INPUT_W, input_tensor_values.data());
         Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
             memory_info, input_tensor_values.data(), input_tensor_values.size(), 
             input_shape.data(), input_shape.size());
@@ -453,16 +683,18 @@ class OnnxDetector{
     }
 
     void run(Ort::Value &input_tensor){
-        output_tensors = session.Run(Ort::RunOptions{nullptr}, input_names_raw.data(),
+        output_tensors = session.Run(detector::make_run_options(), input_names_raw.data(),
                     &input_tensor, 1, output_names_raw.data(), 1);
     }
 
-    std::vector<bbox> postprocess(cv::Mat img){
+    /* boxes of batch entry b in img coordinates, output is [batch, N, 6] */
+    std::vector<bbox> postprocess(cv::Mat img, int b = 0){
         float *output = output_tensors.front().GetTensorMutableData<float>();
         auto tensor_info = output_tensors.front().GetTensorTypeAndShapeInfo();
         auto shape = tensor_info.GetShape();
-        size_t num_elements = output_tensors.front().GetTensorTypeAndShapeInfo().GetElementCount();
+        size_t num_elements = output_tensors.front().GetTensorTypeAndShapeInfo().GetElementCount() / shape[0];
         int num_detections = num_elements / shape[2];
+        output += b * num_elements;
         // Display detections
         std::vector<bbox> detections;
         int iw = img.cols;
@@ -513,10 +745,11 @@ class OnnxDetector{
 
     OnnxDetector(const char * name, const char * model_path, int batch_size ,float threshold)
         : name(name), 
-        env(ORT_LOGGING_LEVEL_ERROR, name), 
+        env(detector::shared_env()),
         session_options(create_session_options()),
         session(env, model_path, session_options), 
-        threshold(threshold)
+        threshold(threshold),
+        batch_size(batch_size)
     {
             init();
             std::cout << "Loading model " << model_path << std::endl;
@@ -573,13 +806,56 @@ class OnnxDetector{
         }
         return dets;
     }
+
+    /**
+     * @brief One run on a gray image, checks the output is [batch, N, 6] float
+     * @return 1 - ok, 0 - err is set
+     */
+    int warmup(std::string &err){
+        std::vector<cv::Mat> gray(1, cv::Mat(INPUT_H, INPUT_W, CV_8UC3, cv::Scalar(114, 114, 114)));
+        size_t nrun = fixed_batch > 0 ? (size_t)fixed_batch : 1;
+        ImgUtils::load_chw_batch(gray.data(), 1, nrun, INPUT_W, INPUT_H, input_tensor_values);
+        std::array<int64_t, 4> shape{(int64_t)nrun, INPUT_CH, INPUT_H, INPUT_W};
+        Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
+            memory_info, input_tensor_values.data(), input_tensor_values.size(),
+            shape.data(), shape.size());
+        run(input_tensor);
+        int ret = detector::check_output(output_tensors.front(), {(int64_t)nrun, -1, 6},
+                                         ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT, err);
+        clear_tensors();
+        return ret;
+    }
+
+    /**
+     * @brief Runs a list of images through the model, batch_size per run
+     * @param imgs uint8 images, views into the frame are fine
+     * @return bboxes per image, relative to that image
+     */
+    std::vector<std::vector<bbox>> detect_batch(const std::vector<cv::Mat> &imgs){
+        std::vector<std::vector<bbox>> dets(imgs.size());
+        for (size_t first = 0; first < imgs.size(); first += batch_size){
+            size_t n = std::min(imgs.size() - first, (size_t)batch_size);
+            size_t nrun = fixed_batch > 0 ? (size_t)fixed_batch : n;
+            ImgUtils::load_chw_batch(&imgs[first], n, nrun, INPUT_W, INPUT_H, input_tensor_values);
+            std::array<int64_t, 4> shape{(int64_t)nrun, INPUT_CH, INPUT_H, INPUT_W};
+            Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
+                memory_info, input_tensor_values.data(), input_tensor_values.size(),
+                shape.data(), shape.size());
+            run(input_tensor);
+            for (size_t i = 0; i < n; i++){
+                dets[first + i] = postprocess(imgs[first + i], i);
+            }
+            clear_tensors();
+        }
+        return dets;
+    }
 };
 
 /* Onnx Runtime Detector With Dynamic Batch Input*/
 class OnnxRTDetector{
     private:
     /* onnx-runtime classes*/
-    Ort::Env env;
+    Ort::Env &env;
     Ort::SessionOptions session_options;
     Ort::Session session;
     Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
@@ -605,7 +881,7 @@ class OnnxRTDetector{
     /* Private Class Methods */
     static Ort::SessionOptions create_session_options();
     void init();
-    Ort::Value load_input_tensor(std::vector<cv::Mat> img_batch);
+    Ort::Value load_input_tensor(const std::vector<ImgUtils::FrameView> &img_batch);
     void run(Ort::Value &input_tensor);
     std::vector<std::vector<bbox>> post_process(std::vector<ImgMeta> batch_meta_data);
     void clear_tensors(void);
@@ -617,14 +893,22 @@ class OnnxRTDetector{
     OnnxRTDetector(const char * name, const char * model_path, float threshold, int batchsize);
 #endif
     /**
-     * @brief Run preprocessed (must be RGB and normalized to 1.0/255) image
-     * through the model
-     * @param src_i preprocessed image
+     * @brief Run a batch of uint8 frames through the model, resize and
+     * normalization to 1.0/255 are fused into the input tensor fill
+     * @param im_batch RGB or YUV frames or ROI views of them
      * @param visualize save visualization of the detection
-     * @return vector of detected bboxes
+     * @return vector of detected bboxes per frame, in view coordinates
      */
-    std::vector<std::vector<bbox>> detect(std::vector<cv::Mat> im_batch, bool visualize = false);
+    std::vector<std::vector<bbox>> detect(const std::vector<ImgUtils::FrameView> &im_batch, bool visualize = false);
+    std::vector<std::vector<bbox>> detect(const std::vector<cv::Mat> &im_batch, bool visualize = false){
+        return detect(std::vector<ImgUtils::FrameView>(im_batch.begin(), im_batch.end()), visualize);
+    }
 
+    /**
+     * @brief One run on a gray frame, checks the output is [1, 4 + classes, preds] float
+     * @return 1 - ok, 0 - err is set
+     */
+    int warmup(std::string &err);
 };
 
 
@@ -1026,6 +1310,20 @@ class ImageDetector{
         bool is_running(void) {return running;}
 };
 
+/**
+ * @brief Wall time (ms) spent in each stage of the last batch run by Engine::runn
+ */
+struct StageTimes{
+    double queue = 0.0;       // oldest frame wait in the muxer before pull
+    double preprocess = 0.0;
+    double car_det = 0.0;
+    double secondary = 0.0;   // LPD + LPR over the whole batch
+    double save = 0.0;        // input image hand-off to the writer
+    double write = 0.0;       // detection txt files
+    double total = 0.0;       // pull to write done
+    uint32_t nframes = 0;
+};
+
 /* Class for advanced vehicle detections*/
 class Engine{
     private:
@@ -1040,19 +1338,20 @@ class Engine{
         const char * save_dir;
         std::thread thr;
 
-        OnnxRTDetector *car_det = nullptr, car_e;
-        OnnxDetector *lp_det = nullptr, lpd_e;
-        LPRNetDetector *ocr_eng = nullptr, lpr_e;
+        ModelRegistry models;
 
         ImgReader *input_str = nullptr;
         StreamMuxer *muxer = nullptr;
 
         uint64_t nframes = 0;
+        uint64_t nbatches = 0;
+        StageTimes times;
+        DetectionCallback on_detections;
 
         static std::string make_name(std::string txt, int id){
             return txt + "-" + std::to_string(id);
         }
-        int process(std::vector <ImgData> &img_batch, std::vector<std::vector<parknetDet>> &detl);
+        int process(const ModelSet &m, std::vector <ImgData> &img_batch, std::vector<std::vector<parknetDet>> &detl);
         int pipeline_run(uchar *imgbuf, uint64_t nbytes, uint32_t img_uid, std::vector<parknetDet> &detl);
 
         int init(void){
@@ -1089,46 +1388,25 @@ class Engine{
         Engine(int id, const char * work_dir, int batch_size)
             :id(id),
             work_dir(work_dir),
-            car_e(get_name("car", id).c_str(), VEHICLE_MODEL_PATH, VEHICLE_DET_CONFIDENCE_THRESHOLD, batch_size),
-            lpd_e(get_name("lpd", id).c_str(), LPD_MODEL_PATH, LPD_BATCH_SIZE, LPLATE_DET_CONFIDENCE_THRESHOLD),
-            lpr_e(get_name("lpr", id).c_str(), LPR_MODEL_PATH),
-            batch_size(batch_size)
+            batch_size(batch_size),
+            models(id, batch_size)
             {
-                linkModel(car_e);
-                connectModel(lpd_e, LP_MODEL);
-                connectModel(lpr_e, OCR_MODEL);
+                models.load_all();
+                models.start_watch();
                 int ret = init();
             }
-        
-        void linkModel(OnnxRTDetector &dt){
-            car_det = &dt;
-        }
-        
-        void connectModel(OnnxDetector &detector, model_t mod_type){
-            if(mod_type == LP_MODEL){
-                if (lp_det != nullptr){
-                    std::cout << "License plate model is already connected\n";
-                    return;
-                }
-            lp_det = &detector;
-            }
-        }
-
-        void connectModel(LPRNetDetector &detector, model_t mod_type){
-            if(mod_type == OCR_MODEL){
-                if(ocr_eng != nullptr){
-                    std::cout << "LP OCR model is already connected\n";
-                    return;
-                }
-                ocr_eng = &detector;
-            }
-        }
 
         void connectSource(StreamMuxer *src){
             muxer = src;
         }
         int pull_batch(std::vector <ImgData> &input_batch, uint32_t timeout);
         void runn(bool visualize);
+        uint64_t get_nbatches(void) const {return nbatches;}
+        uint64_t get_nframes(void) const {return nframes;}
+        const StageTimes &get_stage_times(void) const {return times;}
+        ModelRegistry &get_models(void){return models;}
+        /* called from the inference thread for every frame with detections, must not block */
+        void set_detection_callback(DetectionCallback cb){on_detections = std::move(cb);}
 
         void run(bool visualize){
             static int nfailed = 0;
@@ -1136,16 +1414,8 @@ class Engine{
             uchar *img = nullptr;
             uint64_t nbytes = 0;
             uint32_t id;
-            if (car_det == nullptr){
-                std::cerr << "Car Detector Model is missing\n";
-                return;
-            }
-            if(lp_det == nullptr){
-                std::cerr << "LP Detector Model is missing\n";
-                return;
-            }
-            if(ocr_eng == nullptr){
-                std::cerr << "LPR Model is missing\n";
+            if (!models.current().complete()){
+                std::cerr << "Models are missing\n";
                 return;
             }
 
@@ -1265,6 +1535,8 @@ class Inference{
         engine.connectSource(mux);
         return 1;
     }
+
+    Engine *get_engine(void){return &engine;}
 };
 
 
@@ -1283,26 +1555,83 @@ class Detector{
     //std::vector <GstChildWorker> workers;
 
     std::string WORKDIR;
+    /* muxer and engine live on the detection_task stack, rt_lock is held
+       across every use from other threads and while they are set or cleared */
+    std::mutex rt_lock;
     StreamMuxer *pmuxer = nullptr;
+    Engine *pengine = nullptr;
+    DetectionCallback on_detections;
+    HealthCallback on_health;
+
+    /* camera list requested by apply_camera_list(), applied by detection_task */
+    std::mutex pending_lock;
+    std::vector <stream_info> pending_streams;
+    bool streams_changed = false;
+    int apply_pending_streams(StreamMuxer &muxer);
+
+    /* staggered bring-up, streams waiting to start and started ones waiting for a first frame */
+    std::deque <stream_info> start_queue;
+    std::vector <std::pair<int, uint64_t>> starting;
+    std::atomic<bool> models_ready{false};
+    int start_streams(StreamMuxer &muxer);
 
     void detection_task(bool *run, int nthreads, bool visualize){
-        //init_camstream();
-        //workers.reserve(streams.size());
+        set_thread_role(THREAD_ROLE_INFERENCE, "dv-infer");
+        uint64_t t0 = steady_ms();
+        /* models load on their own threads while the streams come up */
+        auto loading = std::async(std::launch::async, [this, nthreads, visualize]{
+            set_thread_name("dv-load");
+            return std::unique_ptr<Inference>(new Inference(nthreads, visualize, WORKDIR));
+        });
         StreamMuxer muxer(streams.size());
-        pmuxer = &muxer;
-        for (int i=0; i<streams.size(); i++){
-            std::cout << "Creating srcbin "<< streams[i].index << " - " << streams[i].url << std::endl;
-            //workers.emplace_back(streams[i].index, "./libdeepvision/camstream/gst_worker", streams[i].url.c_str());
-            //muxer.link_stream(&workers[i]);
-            muxer.create_source(streams[i].index, streams[i].url);
-            std::this_thread::sleep_for(std::chrono::milliseconds(50)); // add streams with a delay
+        muxer.set_health_callback(on_health);
+        {
+            std::lock_guard<std::mutex> lock(rt_lock);
+            pmuxer = &muxer;
+        }
+        std::unique_ptr<Inference> inference;
+        Engine *engine = nullptr;
+        start_queue.assign(streams.begin(), streams.end());
+        uint64_t last_snapshot = steady_ms();
+        while (*run){
+            start_streams(muxer);
+            apply_pending_streams(muxer);
+            if (!inference){
+                if (loading.wait_for(ONDT_MILLISECOND * 10) != std::future_status::ready){
+                    continue;
+                }
+                inference = loading.get();
+                inference->link_muxer(&muxer);
+                engine = inference->get_engine();
+                engine->set_detection_callback(on_detections);
+                {
+                    std::lock_guard<std::mutex> lock(rt_lock);
+                    pengine = engine;
+                }
+                models_ready = true;
+                std::cout << "Models ready after " << steady_ms() - t0 << " ms\n";
+            }
+            uint64_t nbatches = engine->get_nbatches();
+            inference->run(0);
+            if (engine->get_nbatches() == nbatches){
+                /* no full batch ready, don't spin on the muxer lock */
+                std::this_thread::sleep_for(ONDT_MILLISECOND);
+            }
+            if (steady_ms() - last_snapshot >= MEMSTATS_SNAPSHOT_PERIOD_SEC * 1000){
+                last_snapshot = steady_ms();
+                MemStats ms;
+                get_mem_stats(ms);
+                memstats::write_snapshot(ms, WORKDIR);
+            }
         }
-        Inference inference (nthreads, visualize, WORKDIR);
-        inference.link_muxer(&muxer);
-        int i = 0;
-        while (true){
-            inference.run(0);
+        models_ready = false;
+        {
+            std::lock_guard<std::mutex> lock(rt_lock);
+            pengine = nullptr;
+            pmuxer = nullptr;
         }
+        /* engine first, it points at the muxer, then the muxer kills the gst workers */
+        inference.reset();
     };
 
     public:
@@ -1313,20 +1642,20 @@ class Detector{
         WORKDIR(work_dir)
         {
             start_t = std::time(nullptr);
-            int nsrc = streams.size();
-            if (nsrc == 0){
-                std::cout << "No Sources. Failed to create Detector\n";
-                return;
+            /* cameras can be added later, the muxer returns partial batches
+               while fewer sources than the batch size are live */
+            if (streams.size() == 0){
+                std::cout << "No Sources yet, waiting for cameras\n";
             }
-            if (nthreads > nsrc){
-                std::cout << "Batch Size can't be bigger than n_sources\n";
-                std::cout << "Setting Batch Size to n_sources " << nsrc << std::endl;
-                this->nthreads = nsrc;
-            }
-            
         }
 
         uint64_t get_perf_data(void){return perf_fps;}
+        /* must be set before start() */
+        void set_detection_callback(DetectionCallback cb){on_detections = std::move(cb);}
+        /* stream health transitions, must be set before start() and must not block */
+        void set_health_callback(HealthCallback cb){on_health = std::move(cb);}
+        int apply_camera_list(const std::vector<stream_info> &list);
+        bool is_models_ready(void) const {return models_ready;}
         
 
         void start(void){
@@ -1354,6 +1683,11 @@ class Detector{
         bool is_running(void);
         time_t get_stream_ts(int index);
         int read_timestamps(std::vector<stream_info> &streams);
+        int get_mem_stats(MemStats &ms);
+        int get_sched_stats(std::vector<SchedClassStats> &stats);
+        int reload_model(model_t kind, const std::string &path = "");
+        int reload_models(void);
+        int get_model_status(std::vector<ModelStatus> &st);
 };
 
 
@@ -0,0 +1,65 @@
+/**
+ * @file frame_pool.h
+ * @brief Recycled frame buffers for the muxer
+ * @author Jonas Vaicekauskas
+ * @date 2026-10-19
+ * @details Frames are copied out of the camera shm into buffers taken from
+ * the pool and given back once the engine is done with them. Free buffers are
+ * kept per size, which is per resolution, and handed to whichever camera reads
+ * a frame of that size next. Buffers are never zeroed. Large buffers start on
+ * a huge page boundary and are advised for transparent huge pages.
+ */
+
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#define FRAME_POOL_ALIGN 64                         /* cache line */
+#define FRAME_POOL_HUGE_ALIGN (2ULL << 20)          /* buffers at least this large are huge page aligned */
+#define FRAME_POOL_IDLE_MAX_BYTES (512ULL << 20)    /* free buffers beyond this go back to the system */
+
+
+struct FramePoolStats{
+    uint64_t hits = 0;              /* acquires served from a free buffer */
+    uint64_t misses = 0;            /* acquires that allocated */
+    uint64_t outstanding_bytes = 0; /* held by frames */
+    uint64_t outstanding = 0;
+    uint64_t idle_bytes = 0;        /* free, kept for reuse */
+    uint64_t idle = 0;
+    uint64_t trimmed = 0;           /* released buffers freed, the pool was full */
+};
+
+class FramePool{
+    public:
+        FramePool() = default;
+        ~FramePool();
+        FramePool(const FramePool &) = delete;
+        FramePool &operator=(const FramePool &) = delete;
+
+        /**
+         * @brief Buffer of at least nbytes, contents undefined
+         * @return nullptr if the allocation failed
+         */
+        unsigned char *acquire(uint64_t nbytes);
+
+        /* gives back a buffer from acquire(nbytes), nullptr is ignored */
+        void release(unsigned char *buf, uint64_t nbytes);
+
+        /* frees all free buffers */
+        void trim(void);
+
+        void get_stats(FramePoolStats &st) const;
+
+    private:
+        mutable std::mutex lock;
+        std::unordered_map<uint64_t, std::vector<unsigned char *>> free_bufs;   /* by slab size */
+        FramePoolStats stats;
+
+        static uint64_t slab_size(uint64_t nbytes);
+};
+
+#endif
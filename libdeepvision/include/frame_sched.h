@@ -0,0 +1,112 @@
+/**
+ * @file frame_sched.h
+ * @brief Priority-aware frame scheduling across cameras
+ * @author Jonas Vaicekauskas
+ * @date 2026-10-19
+ * @details Orders the ready frames of the muxer for the next batch. Frames
+ * that would miss their latency SLO within the next batch cycle go first,
+ * earliest deadline first. The remaining batch slots are shared by weighted
+ * fair queueing on per-camera virtual time. Queueing delay and SLO misses are
+ * accounted per priority class.
+ */
+
+#ifndef FRAME_SCHED_H
+#define FRAME_SCHED_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define SCHED_SLO_GATE_MS 700           /* default SLO of gate/LPR lane cameras */
+#define SCHED_SLO_NORMAL_MS 2000
+#define SCHED_SLO_OVERVIEW_MS 5000
+#define SCHED_MIN_HORIZON_MS 50         /* urgency horizon before the batch cycle is measured */
+#define SCHED_EWMA_ALPHA 0.1
+#define SCHED_WEIGHT_MAX 100
+
+
+enum StreamPriority{
+    PRIO_GATE = 0,      /* entry/exit lanes, plate reads must be sub-second */
+    PRIO_NORMAL = 1,
+    PRIO_OVERVIEW = 2,  /* occupancy views, seconds of delay are fine */
+    PRIO_NCLASSES
+};
+
+const char *priority_name(StreamPriority p);
+StreamPriority priority_by_val(int val);
+
+/* scheduling parameters of one camera, from the camera config */
+struct StreamSched{
+    StreamPriority priority = PRIO_NORMAL;
+    uint32_t weight = 1;        /* share of batch slots when no SLO is at risk */
+    uint32_t slo_ms = 0;        /* frame ready to batched, 0 - class default */
+
+    uint32_t get_slo_ms(void) const;
+    bool operator==(const StreamSched &o) const {
+        return priority == o.priority && weight == o.weight && slo_ms == o.slo_ms;
+    }
+    bool operator!=(const StreamSched &o) const {return !(*this == o);}
+};
+
+struct SchedClassStats{
+    std::string name;
+    uint32_t slo_ms = 0;        /* class default */
+    uint64_t frames = 0;        /* frames batched */
+    uint64_t slo_misses = 0;    /* frames batched after their deadline */
+    double queue_ms_avg = 0;    /* EWMA of frame ready to batched */
+    uint64_t queue_ms_max = 0;  /* since the last get_stats() */
+};
+
+/* a ready frame offered to the scheduler */
+struct SchedFrame{
+    uint32_t slot;
+    uint64_t ready_ms;          /* steady_ms() when the frame became ready */
+    uint64_t fid;               /* muxer sequence, older first on ties */
+};
+
+class FrameScheduler{
+    public:
+        /* a new camera in a slot, starts at the current virtual time */
+        void reset_slot(uint32_t slot, const StreamSched &s);
+        void set_sched(uint32_t slot, const StreamSched &s);
+
+        /**
+         * @brief Orders frames for the next batch, urgent ones by deadline,
+         * then the rest by weighted virtual time
+         * @return number of urgent frames, a partial batch is worth sending
+         * when it is not 0
+         */
+        uint32_t order(std::vector<SchedFrame> &frames, uint64_t now_ms);
+
+        /* accounts a batch that was handed to the engine */
+        void on_batch(const std::vector<SchedFrame> &batch, uint64_t now_ms);
+
+        /* fair share and queueing stats of frames pulled outside of a batch,
+           the batch cycle time is left alone */
+        void on_frames(const std::vector<SchedFrame> &frames, uint64_t now_ms);
+
+        void get_stats(std::vector<SchedClassStats> &stats);
+
+    private:
+        struct SlotState{
+            StreamSched sched;
+            double vtime = 0;       /* virtual finish time of its last batched frame */
+        };
+        struct ClassAcc{
+            uint64_t frames = 0;
+            uint64_t slo_misses = 0;
+            double queue_ms_avg = 0;
+            uint64_t queue_ms_max = 0;
+        };
+        std::vector<SlotState> slots;
+        std::array<ClassAcc, PRIO_NCLASSES> classes;
+        double vclock = 0;          /* start tag of the last batched frame */
+        double cycle_ms = 0;        /* EWMA of the time between batches */
+        uint64_t last_batch_ms = 0;
+
+        SlotState &slot(uint32_t i);
+        uint64_t deadline(const SchedFrame &f);
+};
+
+#endif
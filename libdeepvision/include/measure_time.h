@@ -2,8 +2,18 @@
 #define MEASURE_TIME_H
 
 #include <chrono>
+#include <cstdint>
 
 
+/**
+ * @brief Monotonic time in milliseconds. Used for frame age and latency
+ * accounting where wall-clock jumps must not matter.
+ */
+inline uint64_t steady_ms(void){
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 class StopWatch{
     private:
     using clock = std::chrono::high_resolution_clock;
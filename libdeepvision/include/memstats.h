@@ -0,0 +1,86 @@
+/**
+ * @file memstats.h
+ * @brief Per-subsystem memory accounting
+ * @author Jonas Vaicekauskas
+ * @date 2026-10-19
+ * @details Collects memory usage of the parent process by owner (camera shm,
+ * muxer frame buffers and their pool, ORT arenas, image writer queue, heap) and RSS of every
+ * gst_worker child, so RSS growth over long uptimes can be attributed.
+ */
+
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include "onnxruntime_cxx_api.h"
+#include "frame_pool.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#define MEMSTATS_SNAPSHOT_FILE "memstats.json"
+#define MEMSTATS_HISTORY_FILE "memstats.log"
+#define MEMSTATS_HISTORY_MAX_BYTES (1ULL << 20)  /* then rolled to memstats.log.1, the older one is dropped */
+#define MEMSTATS_SNAPSHOT_PERIOD_SEC 300
+
+
+struct CameraMemStats{
+    int index = -1;
+    pid_t pid = -1;
+    uint64_t shm_bytes = 0;     /* shared frame buffer mapped from the child */
+    uint64_t frame_bytes = 0;   /* parent copy in FrameInfo */
+    uint64_t child_rss_kb = 0;  /* gst_worker RSS, /proc/<pid>/statm */
+};
+
+struct SessionMemStats{
+    std::string name;
+    uint64_t in_use = 0;        /* bytes handed out by the arena */
+    uint64_t reserved = 0;      /* bytes the arena holds from the system */
+    uint64_t max_in_use = 0;
+    uint64_t num_allocs = 0;
+};
+
+struct MemStats{
+    time_t ts = 0;
+    /* parent process, /proc/self/status */
+    uint64_t rss_kb = 0;
+    uint64_t hwm_kb = 0;
+    uint64_t rss_anon_kb = 0;
+    uint64_t rss_file_kb = 0;
+    uint64_t rss_shmem_kb = 0;
+    /* malloc heap */
+    uint64_t heap_in_use = 0;
+    uint64_t heap_free = 0;
+    /* image writer queue */
+    uint64_t writer_pending = 0;
+    uint64_t writer_bytes = 0;
+    /* totals over cams and sessions */
+    uint64_t shm_bytes = 0;
+    uint64_t frame_bytes = 0;
+    uint64_t child_rss_kb = 0;
+    uint64_t ort_in_use = 0;
+    uint64_t ort_reserved = 0;
+    /* muxer frame buffers, held and free */
+    FramePoolStats frame_pool;
+
+    std::vector<CameraMemStats> cams;
+    std::vector<SessionMemStats> sessions;
+};
+
+
+namespace memstats{
+    /* image writer queue accounting, called around every async image write */
+    void writer_enqueue(uint64_t nbytes);
+    void writer_done(uint64_t nbytes);
+
+    uint64_t proc_status_kb(const char *key);
+    uint64_t child_rss_kb(pid_t pid);
+    int session_stats(const Ort::Session &session, const std::string &name, SessionMemStats &st);
+    int allocator_stats(const Ort::KeyValuePairs &kv, SessionMemStats &st);
+
+    /* fills process wide fields and the totals from cams/sessions */
+    void collect_process(MemStats &ms);
+    int write_snapshot(const MemStats &ms, const std::string &dir);
+};
+
+#endif
@@ -0,0 +1,136 @@
+/**
+ * @file model_registry.h
+ * @brief Hot swap of the ONNX models without stopping the streams
+ * @author Jonas Vaicekauskas
+ * @date 2026-10-19
+ * @details The registry owns the vehicle, plate and plate reader sessions.
+ * A new model file, or a reload command, builds the new session on a
+ * background thread and warms it up with one run. If the run checks out it
+ * is swapped in for the next batch. A batch holds the sessions it started
+ * with, so in-flight work finishes on the old one. A model that fails a
+ * batch while on probation is rolled back to the previous session.
+ */
+
+#ifndef MODEL_REGISTRY_H
+#define MODEL_REGISTRY_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+
+#define MODEL_WATCH_PERIOD_MS 2000      /* model file poll */
+#define MODEL_SETTLE_MS 5000            /* a changed file must be left alone this long, copy in progress */
+#define MODEL_PROBATION_BATCHES 50      /* a swapped in model failing within this many batches is rolled back */
+
+typedef enum {
+    VEHICLE_MODEL = 0,
+    LP_MODEL,
+    OCR_MODEL,
+    NMODELS
+}model_t;
+
+const char *model_name(model_t kind);
+
+class OnnxRTDetector;
+class OnnxDetector;
+class LPRNetDetector;
+
+/* sessions a batch runs on, a copy keeps them alive until the batch is done */
+struct ModelSet{
+    std::shared_ptr<OnnxRTDetector> car;
+    std::shared_ptr<OnnxDetector> lpd;
+    std::shared_ptr<LPRNetDetector> lpr;
+    uint32_t version[NMODELS] = {0, 0, 0};
+
+    bool complete(void) const {return car && lpd && lpr;}
+};
+
+struct ModelStatus{
+    std::string name;
+    std::string path;
+    uint32_t version = 0;       /* 1 - loaded at start, +1 per swap, a rollback returns to the previous one */
+    time_t loaded_ts = 0;
+    bool probation = false;     /* the previous session is still kept for a rollback */
+    uint32_t swaps = 0;
+    uint32_t failures = 0;      /* rejected reloads and rollbacks */
+    std::string last_error;
+};
+
+class ModelRegistry{
+    public:
+        ModelRegistry(int id, int batch_size);
+        ~ModelRegistry();
+
+        /**
+         * @brief Loads all models from their default paths, in parallel
+         * @throws Ort::Exception if a model can't be loaded
+         */
+        void load_all(void);
+
+        /* models for the next batch */
+        ModelSet current(void) const;
+
+        /**
+         * @brief Queues a reload, done by the watcher thread
+         * @param path new model file, empty - reload the current one
+         */
+        int request_reload(model_t kind, const std::string &path = "");
+        int request_reload_all(void);
+
+        /**
+         * @brief Outcome of a batch run on used. A failure rolls back the
+         * models of used that are still on probation.
+         */
+        void report_batch(const ModelSet &used, bool ok);
+
+        int get_status(std::vector<ModelStatus> &st) const;
+
+        /* watcher thread, polls the model files and runs the reloads */
+        void start_watch(void);
+        void stop_watch(void);
+
+    private:
+        struct Slot{
+            std::string name;           /* session name, "lpd-0" */
+            std::string path;
+            std::string pending_path;
+            bool pending = false;
+            uint32_t version = 0;
+            uint32_t prev_version = 0;
+            std::string prev_path;
+            time_t loaded_ts = 0;
+            uint32_t probation = 0;     /* batches left */
+            uint32_t swaps = 0;
+            uint32_t failures = 0;
+            std::string last_error;
+            /* file watch, last loaded and last seen state */
+            time_t mtime = 0;
+            off_t size = 0;
+            time_t seen_mtime = 0;
+            off_t seen_size = 0;
+            uint64_t seen_ms = 0;
+        };
+
+        int batch_size;
+        Slot slots[NMODELS];
+        ModelSet cur;
+        ModelSet prev;      /* sessions replaced while on probation */
+
+        mutable std::mutex lock;
+        std::condition_variable cv;
+        std::thread worker;
+        bool running = false;
+
+        ModelSet build(model_t kind, const std::string &path, std::string &err);
+        int reload(model_t kind, const std::string &path);
+        void check_files(void);
+        void watch_task(void);
+};
+
+#endif
@@ -0,0 +1,60 @@
+/**
+ * @file roi.h
+ * @brief Per-camera region of interest for vehicle detection
+ * @author Jonas Vaicekauskas
+ * @date 2026-10-19
+ * @details A camera watching one lane only needs part of its frame. The
+ * engine crops the frame to the ROI rectangle before preprocessing, so the
+ * model input resolution goes to the lane instead of walls and ceiling.
+ * Detections are mapped back to full frame coordinates. An optional polygon
+ * blacks out what is inside the rectangle but outside the lane.
+ */
+
+#ifndef ROI_H
+#define ROI_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+#define ROI_MIN_PIXELS 32        /* a smaller crop falls back to the full frame */
+#define ROI_POLYGON_MAX 32       /* polygon vertices */
+
+
+/* ROI of a camera in fractions of the frame size, so it survives resolution changes */
+struct StreamRoi{
+    float x = 0, y = 0, w = 0, h = 0;   /* rectangle, w or h 0 - bounds of the polygon or full frame */
+    std::vector<cv::Point2f> polygon;   /* empty - no mask */
+
+    bool empty(void) const {return (w <= 0 || h <= 0) && polygon.empty();}
+
+    /**
+     * @brief Crop rectangle in pixels, clamped to the frame
+     * @return the full frame if the ROI is empty or smaller than ROI_MIN_PIXELS
+     */
+    cv::Rect crop_rect(int frame_w, int frame_h) const;
+
+    bool operator==(const StreamRoi &o) const {
+        return x == o.x && y == o.y && w == o.w && h == o.h && polygon == o.polygon;
+    }
+    bool operator!=(const StreamRoi &o) const {return !(*this == o);}
+};
+
+/**
+ * @brief Parses the camera config, rect "x,y,w,h" and polygon "x,y;x,y;x,y",
+ * all in fractions 0..1. Empty strings are no rectangle and no polygon.
+ * @return 1 - ok, 0 - invalid, roi is left empty
+ */
+int parse_roi(const char *rect, const char *polygon, StreamRoi &roi);
+
+/* "x,y,w,h", empty for no rectangle */
+std::string format_roi_rect(const StreamRoi &roi);
+
+/**
+ * @brief Zeroes the pixels of a cropped image outside the ROI polygon
+ * @param img crop of the frame at rect
+ * @param rect crop_rect() of the frame the polygon is relative to
+ */
+void mask_roi_polygon(cv::Mat &img, const StreamRoi &roi, const cv::Rect &rect, int frame_w, int frame_h);
+
+#endif
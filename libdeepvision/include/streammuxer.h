@@ -12,9 +12,19 @@
 #include "camstream.h"
 #include <iostream>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
 #include <opencv2/opencv.hpp>
 #include "time.h"
 #include "gst_parent.h"
+#include "dvlog.h"
+#include "threading.h"
+#include "measure_time.h"
+#include "memstats.h"
+#include "frame_pool.h"
+#include "frame_sched.h"
+#include "roi.h"
 
 #include <poll.h>
 #include <sys/epoll.h>
@@ -26,7 +36,7 @@ typedef unsigned char uchar;
 
 
 
-#define STREAMMUX_MS 1
+#define STREAMMUX_MS 1000            /* tick period, fd usage is sampled once per tick */
 #define FRAME_NOT_RECEIVED_THRESHOLD_MS 10000
 
 #define RECONNECT_TIME_SECONDS 3 * 60
@@ -44,6 +54,11 @@ struct ImgData{
     uint32_t height = 0;
     uint32_t id = STREAMMUX_RET_ERROR;
     uint32_t index = STREAMMUX_RET_ERROR;
+    uint64_t ready_ms = 0;  /* steady_ms() when the frame became ready */
+    uint32_t format = PIX_FMT_RGB;  /* PixFormat, YUV frames are packed 4:2:0 planes */
+    uint32_t matrix = PIX_MATRIX_BT601;     /* PixMatrix and PixRange of YUV frames */
+    uint32_t range = PIX_RANGE_LIMITED;
+    std::shared_ptr<const StreamRoi> roi;  /* crop of the camera, nullptr - full frame */
 };
 
 
@@ -52,12 +67,17 @@ struct FrameInfo {
     uint64_t fid = (uint64_t)-1;
     uint32_t width = 0;
     uint32_t height = 0;
+    uint32_t format = PIX_FMT_RGB;
+    uint32_t matrix = PIX_MATRIX_BT601;
+    uint32_t range = PIX_RANGE_LIMITED;
     uint32_t age = 0;
     uint32_t nfailed = 0;
+    uint64_t ready_ms = 0;
     uchar *idata = nullptr;
     bool allocated = false;
     bool ready = false;
     bool read=true;
+    bool in_use = false;    /* pulled into a batch, until reset_frame() */
 };
 
 
@@ -72,10 +92,23 @@ class StreamMuxer{
     std::mutex mlock;
     std::thread mux_thread;
     std::thread tick_thread;
+    std::mutex tick_lock;
+    std::condition_variable tick_cv;    /* wakes the tick thread on stop() */
     std::thread state_machine_th;
     std::thread th_frame_reader;
     uint64_t frames_returned = 0;
-    bool run=true;
+    uint64_t nfr = 0; /* frame sequence counter, oldest frames are batched first */
+    std::atomic<uint64_t> n_restarts{0};
+    std::atomic<uint64_t> n_stalls{0};
+    std::atomic<uint64_t> n_deaths{0};
+    HealthCallback health_cb;
+    FrameScheduler sched;
+    std::shared_ptr<const StreamRoi> rois[MAX_STREAMS];  /* per slot, shared with the pulled frames */
+    FramePool pool;     /* frame buffers, taken on read and given back by reset_frame() */
+    void on_health_change(GstChildWorker *src, HealthState prev, int64_t now_ms);
+    int attach_worker(GstChildWorker *src, uint32_t spawned, const WorkerProc &wp);
+    void restart_source(GstChildWorker *src, uint32_t gen);
+    std::atomic<bool> run{true};
 
     int fd[10] = {0,0,0,0,0,0,0,0,0,0};
 
@@ -97,8 +130,7 @@ class StreamMuxer{
     int init_epoll(void){
         epfd = epoll_create1(0);
         if (epfd == -1) {
-            perror("epoll_create1");
-            std::cout << "****!!!!****!!!!EXITING HERE when creating\n";
+            DVLOG_ERROR(LogFields(), "epoll_create1 failed: %s, exiting", strerror(errno));
             exit(1);
         }
         return 1;
@@ -106,55 +138,108 @@ class StreamMuxer{
 
     bool pending_epoll_reg = false;
 
+    /* buffer of nbytes for a slot, the old one goes back to the pool if the size changed */
+    uchar *frame_buffer(FrameInfo &f, uint64_t nbytes){
+        if (f.idata != nullptr && f.nbytes == nbytes){
+            return f.idata;
+        }
+        pool.release(f.idata, f.nbytes);
+        f.idata = pool.acquire(nbytes);
+        f.nbytes = f.idata != nullptr ? nbytes : 0;
+        return f.idata;
+    }
+
+    void release_frame_buffer(FrameInfo &f){
+        pool.release(f.idata, f.nbytes);
+        f.idata = nullptr;
+        f.nbytes = 0;
+    }
+
+    void set_slot_roi(uint32_t slot, const StreamRoi &roi){
+        rois[slot] = roi.empty() ? nullptr : std::make_shared<const StreamRoi>(roi);
+    }
+
     public:
     StreamMuxer(int num_sources)
     :num_sources(num_sources)
     {   
-        sources.reserve(num_sources);
-        frames.reserve(num_sources);
+        /* full capacity, slots never move while the engine holds a frame */
+        sources.reserve(MAX_STREAMS);
+        frames.reserve(MAX_STREAMS);
         //workers.reserve(num_sources);
+        /* muxer threads and workers log on latency critical paths, never to stdout directly */
+        dvlog::start();
+        /* gst_init and plugin loading in the zygote overlap with our own startup */
+        GstZygote::instance().prestart();
         init_epoll();
         //mux_thread = std::thread([this](){muxer_thread();});
-        th_frame_reader = std::thread([this](){frame_reader();});
-        mux_thread = std::thread([this](){child_epoller();});
-        state_machine_th = std::thread([this](){state_machine();});
-        tick_thread =std::thread([this](){periodic_tick(STREAMMUX_MS);});
+        th_frame_reader = std::thread([this](){
+            set_thread_role(THREAD_ROLE_IO, "mux-reader");
+            frame_reader();
+        });
+        mux_thread = std::thread([this](){
+            set_thread_role(THREAD_ROLE_IO, "mux-epoll");
+            child_epoller();
+        });
+        state_machine_th = std::thread([this](){
+            set_thread_role(THREAD_ROLE_IO, "mux-state");
+            state_machine();
+        });
+        tick_thread =std::thread([this](){
+            set_thread_role(THREAD_ROLE_IO, "mux-tick");
+            periodic_tick(STREAMMUX_MS);
+        });
 
     };
+    ~StreamMuxer(){
+        stop();
+    }
     int state_machine(void);
+    void stop(void);
 
     int create_source(int index, std::string rtsp){
+        return add_source(index, rtsp) != STREAMMUX_RET_ERROR;
+    }
+
+    uint32_t add_source(int index, std::string rtsp, const StreamSched &s = StreamSched(),
+                        const StreamRoi &roi = StreamRoi());
+    int set_source_sched(int index, const StreamSched &s);
+    int set_source_roi(int index, const StreamRoi &roi);
+    int get_sched_stats(std::vector<SchedClassStats> &stats);
+    int remove_source(int index);
+    int active_sources(void);
+    bool is_streaming(int index);
+
+    /**
+     * @brief Creates a source without a gst_worker child process.
+     * Frames are supplied with push_frame(), used for offline replay.
+     * @return source id for push_frame(), STREAMMUX_RET_ERROR on failure
+     */
+    uint32_t create_replay_source(int index, std::string name, const StreamSched &s = StreamSched(),
+                                  const StreamRoi &roi = StreamRoi()){
+        std::lock_guard<std::mutex> lock(mlock);
         if(sources.size() >= MAX_STREAMS){
-            std::cerr << "Maximal amount of streams reached\n";
-            return 0;
+            DVLOG_ERROR(LogFields(index), "Maximal amount of streams reached");
+            return STREAMMUX_RET_ERROR;
         }
-        printf("Creating source with index- %d", index);
-        mlock.lock();
-        //workers.emplace_back(index, "./libdeepvision/camstream/gst_worker", rtsp.c_str());
-        childs[sources.size()].init(index, rtsp.c_str());
-        GstChildWorker * src = &childs[sources.size()];
+        uint32_t src_id = sources.size();
+        sched.reset_slot(src_id, s);
+        set_slot_roi(src_id, roi);
+        childs[src_id].init_replay(index, name.c_str());
         frames.push_back(FrameInfo{});
-        sources.push_back(src);
-        epoll_event ev{};
-        ev.events = EPOLLIN;
-        ev.data.ptr = src;
-        if (epoll_ctl(epfd, EPOLL_CTL_ADD, src->get_evfd(), &ev) == -1) {
-            perror("epoll_ctl");
-            std::cout << "****!!!!****!!!!EXITING HERE when linking\n";
-            exit(1);
-        }
-        src->set_epoll_flag(true);
-        mlock.unlock();
-        return 1;
+        sources.push_back(&childs[src_id]);
+        return src_id;
     }
 
+    int push_frame(uint32_t src_id, const uchar *data, uint64_t nbytes, uint32_t w, uint32_t h,
+                   uint32_t format = PIX_FMT_RGB);
+
     int link_stream(GstChildWorker * source){
-        
+        std::lock_guard<std::mutex> lock(mlock);
         if(sources.size() >= MAX_STREAMS){
-            std::cerr << "Maximal amount of streams reached\n";
+            DVLOG_ERROR(source->log_fields(), "Maximal amount of streams reached");
             return 0;
         }
-        mlock.lock();
         frames.push_back(FrameInfo{});
         sources.push_back(source);
         // register evfd for epoll
@@ -163,12 +248,10 @@ class StreamMuxer{
         //ev.data.fd = source->get_evfd();   // store source index
         ev.data.ptr = source;
         if (epoll_ctl(epfd, EPOLL_CTL_ADD, source->get_evfd(), &ev) == -1) {
-            perror("epoll_ctl");
-            std::cout << "****!!!!****!!!!EXITING HERE when linking\n";
+            DVLOG_ERROR(source->log_fields(), "epoll_ctl failed: %s, exiting", strerror(errno));
             exit(1);
         }
         source->set_epoll_flag(true);
-        mlock.unlock();
         return 1;
     }
 
@@ -177,7 +260,7 @@ class StreamMuxer{
         ev.events = EPOLLIN;
         ev.data.ptr = source;
         if (epoll_ctl(epfd, EPOLL_CTL_ADD, source->get_evfd(), &ev) == -1) {
-            std::cout << "****!!!!****!!!!Could not add evfd:"<< source->get_evfd() << "to epoll \n";
+            DVLOG_ERROR(source->log_fields(), "[%s] could not add evfd to epoll: %s", source->rtsp_url_, strerror(errno));
             return 0;
         }
         source->set_epoll_flag(true);
@@ -186,27 +269,26 @@ class StreamMuxer{
 
 
     uint32_t pull_valid_frame(uchar **data, uint64_t *nbytes){
-        uint32_t id=STREAMMUX_RET_ERROR;
-        //priority for oldest frames
-        uint32_t age = 0;
+        /* same scheduler and frame slots as pull_frames_batch() */
+        std::lock_guard<std::mutex> lock(mlock);
+        std::vector<SchedFrame> ready;
         for (int i = 0; i < frames.size(); i++){
             if (frames[i].ready == true && frames[i].read == false){
-                if (frames[i].age > age){
-                    id = i;
-                    age = frames[i].age;
-                }
-                frames[i].age++; //Increment the age
+                ready.push_back(SchedFrame{(uint32_t)i, frames[i].ready_ms, frames[i].fid});
             }
         }
-        if (id >= frames.size()){
+        if (ready.empty()){
             return STREAMMUX_RET_ERROR;
         }
+        uint64_t now = steady_ms();
+        sched.order(ready, now);
+        ready.resize(1);
+        sched.on_frames(ready, now);
+        uint32_t id = ready[0].slot;
         //logic to return frames
         *data = frames[id].idata;
         *nbytes = frames[id].nbytes;
         frames_returned++;
-        //ret_i = src_handles[id]->index;
-        //frames[id].read = true;
         return id;
     }
 
@@ -217,24 +299,13 @@ class StreamMuxer{
     //int copy_frame(int id, cv::Mat &img, uint64_t *size);
     int copy_frame(int id, uchar **data, uint64_t *nbytes, uint32_t *w, uint32_t *h);
 
-    int reset_frame(uint32_t id){
-        //std::cout << "*** CLearing buffers\n";
-        frames[id].fid = (uint64_t)-1;
-        frames[id].ready = false;
-        frames[id].read = true;
-        sources[id]->allow_new_frame();
-        //set buffer to 0??
-        memset(frames[id].idata, 0, frames[id].nbytes);
-        return 1;
-    }
+    int reset_frame(uint32_t id);
 
     int clear_frame_buffers(uint32_t id){
         if (frames[id].idata != nullptr){
             // std::cout << "Clearing buffers - " << id << std::endl;
             //std::cout << "ID = "<< id<< " Clearing Buffers\n";
-            free(frames[id].idata);
-            frames[id].idata = nullptr;
-            frames[id].nbytes = 0;
+            release_frame_buffer(frames[id]);
             frames[id].fid = (uint64_t)-1;
             frames[id].ready = false;
             frames[id].read = true;
@@ -242,7 +313,7 @@ class StreamMuxer{
             return 1;
         }
         else{
-            std::cout <<id << " - Buffers not empty\n";
+            DVLOG_WARN(LogFields(get_src_index(id)), "%u - Buffers not empty", id);
             frames[id].fid = (uint64_t)-1;
             frames[id].ready = false;
             frames[id].read = true;
@@ -260,6 +331,19 @@ class StreamMuxer{
         }
     }
     
+    uint64_t get_restarts(void) const {return n_restarts;}
+    uint64_t get_stalls(void) const {return n_stalls;}
+    uint64_t get_deaths(void) const {return n_deaths;}
+    /* called from the state machine thread with the muxer locked, must not block */
+    void set_health_callback(HealthCallback cb){
+        std::lock_guard<std::mutex> lock(mlock);
+        health_cb = std::move(cb);
+    }
+    int get_stream_health(int index, StreamHealthInfo &info);
+    int count_sources(ChildState state);
+    int get_mem_stats(std::vector<CameraMemStats> &cams);
+    void get_frame_pool_stats(FramePoolStats &st) const {pool.get_stats(st);}
+
     float get_fps(void);
     time_t get_stream_ts(int index);
     time_t get_stream_td(int index);
@@ -267,6 +351,7 @@ class StreamMuxer{
 };
 
 
+size_t current_rss_kb();
 void log_mem(const char* tag);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,265 @@
+#include "autotune.h"
+#include "detector.h"
+#include "streammuxer.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <pthread.h>
+#include <memory>
+#include <random>
+#include <thread>
+
+static double percentile(std::vector<double> v, double p){
+    if (v.empty()){
+        return 0.0;
+    }
+    std::sort(v.begin(), v.end());
+    size_t rank = (size_t)(p / 100.0 * (v.size() - 1) + 0.5);
+    return v[std::min(rank, v.size() - 1)];
+}
+
+/* gradient with noise, RGB like the gst_worker output */
+static std::vector<uchar> make_frame(int w, int h){
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> noise(-20, 20);
+    std::vector<uchar> f((size_t)w * h * 3);
+    for (int y = 0; y < h; y++){
+        for (int x = 0; x < w; x++){
+            uchar *p = f.data() + ((size_t)y * w + x) * 3;
+            int v = (x * 255 / w + y * 255 / h) / 2;
+            for (int c = 0; c < 3; c++){
+                p[c] = (uchar)std::min(std::max(v + noise(rng), 0), 255);
+            }
+        }
+    }
+    return f;
+}
+
+TuneGrid default_tune_grid(void){
+    TuneGrid g;
+    for (int b = 1; b <= AUTOTUNE_BATCH_MAX; b *= 2){
+        g.batches.push_back(b);
+    }
+    cpu_set_t cpus;
+    int ncpu;
+    if (role_cpus(THREAD_ROLE_ORT, &cpus)){
+        ncpu = CPU_COUNT(&cpus);
+    }
+    else{
+        /* the other half is left to decoding and io */
+        ncpu = std::max(1, (int)std::thread::hardware_concurrency() / 2);
+    }
+    for (int t = 1; t <= std::min(ncpu, AUTOTUNE_THREADS_MAX); t *= 2){
+        g.threads.push_back(t);
+    }
+    return g;
+}
+
+/* io cpus for the feeder, never the ort ones the measured sessions run on */
+static void pin_feeder(void){
+    set_thread_role(THREAD_ROLE_IO, "dv-tune-feed");
+    cpu_set_t ort, cur;
+    if (!role_cpus(THREAD_ROLE_ORT, &ort) || sched_getaffinity(0, sizeof(cur), &cur) != 0){
+        return;
+    }
+    for (int c = 0; c < CPU_SETSIZE; c++){
+        if (CPU_ISSET(c, &ort)){
+            CPU_CLR(c, &cur);
+        }
+    }
+    if (CPU_COUNT(&cur) > 0){
+        pthread_setaffinity_np(pthread_self(), sizeof(cur), &cur);
+    }
+}
+
+/**
+ * @brief Runs one grid point: replay sources refilled after every batch, so
+ * the engine is never waiting for one. Measures for at least measure_s and
+ * min_batches batches, at most AUTOTUNE_MEASURE_MAX_S.
+ * @return 1 - measured, 0 - the engine could not be built
+ */
+static int measure(const TuneConfig &cfg, const TuneGrid &grid, const std::vector<uchar> &frame, TuneResult &res){
+    detector::set_intra_op_limit(cfg.intra_threads);
+    /* twice the batch so a full batch is ready while the last one is refilled */
+    int cams = cfg.batch * 2;
+    StreamMuxer muxer(cams);
+    std::vector<uint32_t> ids;
+    for (int i = 0; i < cams; i++){
+        uint32_t sid = muxer.create_replay_source(i, "tune-" + std::to_string(i));
+        if (sid == STREAMMUX_RET_ERROR){
+            printf("Autotune: failed to create replay source %d\n", i);
+            return 0;
+        }
+        ids.push_back(sid);
+    }
+    std::unique_ptr<Engine> engine;
+    try{
+        engine.reset(new Engine(0, grid.workdir.c_str(), cfg.batch));
+    } catch (const std::exception &e){
+        printf("Autotune: engine with %d threads failed: %s\n", cfg.intra_threads, e.what());
+        muxer.stop();
+        return 0;
+    }
+    engine->connectSource(&muxer);
+
+    /* bumped after every batch, the feeder only copies frames into the
+       sources the batch took, the others are still ready and get dropped
+       by push_frame before the copy */
+    std::atomic<uint64_t> taken{1};
+    std::atomic<bool> feeding{true};
+    std::thread feeder([&](){
+        pin_feeder();
+        uint64_t seen = 0;
+        while (feeding){
+            uint64_t t = taken;
+            if (t == seen){
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            seen = t;
+            for (uint32_t sid : ids){
+                muxer.push_frame(sid, frame.data(), frame.size(), AUTOTUNE_FRAME_W, AUTOTUNE_FRAME_H);
+            }
+        }
+    });
+
+    std::vector<double> totals;
+    uint64_t t_measure = steady_ms() + grid.warmup_s * 1000ULL;
+    uint64_t t_end = t_measure + grid.measure_s * 1000ULL;
+    uint64_t t_max = t_measure + std::max(grid.measure_s, AUTOTUNE_MEASURE_MAX_S) * 1000ULL;
+    uint64_t frames0 = 0, batches0 = 0, last = 0;
+    bool measuring = false;
+    StopWatch st;
+    for (;;){
+        uint64_t now = steady_ms();
+        if (now >= t_max || (now >= t_end && totals.size() >= (size_t)grid.min_batches)){
+            break;
+        }
+        if (!measuring && now >= t_measure){
+            measuring = true;
+            frames0 = engine->get_nframes();
+            batches0 = engine->get_nbatches();
+            st.start();
+        }
+        engine->runn(false);
+        uint64_t nb = engine->get_nbatches();
+        if (nb == last){
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        last = nb;
+        taken++;
+        if (measuring){
+            totals.push_back(engine->get_stage_times().total);
+        }
+    }
+    double elapsed_s = st.stop() / 1000.0;
+    feeding = false;
+    feeder.join();
+    res.cfg = cfg;
+    res.batches = engine->get_nbatches() - batches0;
+    res.throughput_fps = elapsed_s > 0 ? (engine->get_nframes() - frames0) / elapsed_s : 0;
+    res.p50_ms = percentile(totals, 50);
+    res.p99_ms = percentile(totals, 99);
+    engine.reset();
+    muxer.stop();
+    if (totals.size() < (size_t)grid.min_batches){
+        printf("Autotune: batch %2d threads %2d - only %zu batches in %d s, skipped\n",
+               cfg.batch, cfg.intra_threads, totals.size(), std::max(grid.measure_s, AUTOTUNE_MEASURE_MAX_S));
+        return 0;
+    }
+    return 1;
+}
+
+int pick_best(const std::vector<TuneResult> &results, TuneResult &best){
+    std::vector<const TuneResult *> fit, all;
+    for (const auto &r : results){
+        if (r.batches == 0){
+            continue;
+        }
+        all.push_back(&r);
+        if (r.p99_ms <= AUTOTUNE_P99_MAX_MS){
+            fit.push_back(&r);
+        }
+    }
+    if (all.empty()){
+        return 0;
+    }
+    if (fit.empty()){
+        /* nothing meets the latency target, the fastest responding one */
+        best = **std::min_element(all.begin(), all.end(), [](const TuneResult *a, const TuneResult *b){
+            return a->p99_ms < b->p99_ms;
+        });
+        return 1;
+    }
+    double top = 0;
+    for (const auto *r : fit){
+        top = std::max(top, r->throughput_fps);
+    }
+    const TuneResult *pick = nullptr;
+    for (const auto *r : fit){
+        if (r->throughput_fps < top * (100 - AUTOTUNE_TIE_PCT) / 100.0){
+            continue;
+        }
+        if (pick == nullptr || r->cfg.intra_threads < pick->cfg.intra_threads ||
+            (r->cfg.intra_threads == pick->cfg.intra_threads && r->cfg.batch < pick->cfg.batch)){
+            pick = r;
+        }
+    }
+    best = *pick;
+    return 1;
+}
+
+int autotune(const TuneGrid &grid, std::vector<TuneResult> &results, TuneResult &best){
+    std::filesystem::create_directories(grid.workdir);
+    std::vector<uchar> frame = make_frame(AUTOTUNE_FRAME_W, AUTOTUNE_FRAME_H);
+    int prev_limit = detector::get_intra_op_limit();
+    results.clear();
+    printf("Autotune: %zu batch sizes x %zu thread counts, %d s and %d batches per point\n",
+           grid.batches.size(), grid.threads.size(), grid.warmup_s + grid.measure_s, grid.min_batches);
+    for (int threads : grid.threads){
+        for (int batch : grid.batches){
+            TuneConfig cfg;
+            cfg.batch = batch;
+            cfg.intra_threads = threads;
+            TuneResult r;
+            if (!measure(cfg, grid, frame, r)){
+                continue;
+            }
+            printf("Autotune: batch %2d threads %2d - %7.2f fps, p50 %7.1f ms, p99 %7.1f ms\n",
+                   batch, threads, r.throughput_fps, r.p50_ms, r.p99_ms);
+            results.push_back(r);
+        }
+    }
+    detector::set_intra_op_limit(prev_limit);
+    if (!pick_best(results, best)){
+        return 0;
+    }
+    printf("Autotune: best batch %d threads %d - %.2f fps, p99 %.1f ms\n",
+           best.cfg.batch, best.cfg.intra_threads, best.throughput_fps, best.p99_ms);
+    return results.size();
+}
+
+std::string model_hash(void){
+    const char *paths[] = {VEHICLE_MODEL_PATH, LPD_MODEL_PATH, LPR_MODEL_PATH};
+    uint64_t h = 1469598103934665603ULL;
+    std::vector<char> buf(1 << 20);
+    for (const char *p : paths){
+        FILE *f = fopen(p, "rb");
+        if (f == nullptr){
+            return "";
+        }
+        size_t n;
+        while ((n = fread(buf.data(), 1, buf.size(), f)) > 0){
+            for (size_t i = 0; i < n; i++){
+                h ^= (uchar)buf[i];
+                h *= 1099511628211ULL;
+            }
+        }
+        fclose(f);
+    }
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)h);
+    return hex;
+}
@@ -7,12 +7,17 @@
  */
 
 #include "detector.h"
+#include "dvlog.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <iostream>
 #include <string>
 #include <filesystem>
 #include <thread>
 #include <chrono>
 #include <mutex>
+#include <atomic>
 
 
 
@@ -110,7 +115,7 @@ float IoU(const bbox& a, const bbox& b) {
     return inter_area / (union_area + 1e-6f);
 }
 
-std::vector<bbox> non_max_suppression(std::vector<bbox>& boxes, float iou_thresh = 0.45f){
+std::vector<bbox> non_max_suppression(std::vector<bbox>& boxes, float iou_thresh){
     std::vector<bbox> result;
     std::sort(boxes.begin(), boxes.end(),[](const bbox& a, const bbox& b) { return a.conf > b.conf; });
 
@@ -144,8 +149,12 @@ void imwrite_async(const std::string &filename, const cv::Mat &image,
     cv::Mat img_copy = image.clone();
     cv::Mat bgr;
     cv::cvtColor(img_copy, bgr, cv::COLOR_RGB2BGR, 0);
-    std::thread([filename, bgr, params]() {
+    uint64_t nbytes = bgr.total() * bgr.elemSize();
+    memstats::writer_enqueue(nbytes);
+    std::thread([filename, bgr, params, nbytes]() {
+        set_thread_role(THREAD_ROLE_IO, "dv-imwrite");
         cv::imwrite(filename, bgr, params);
+        memstats::writer_done(nbytes);
     }).detach(); // detached thread (fire-and-forget)
 }
 
@@ -166,7 +175,7 @@ int save_visualize_img(uint32_t id, cv::Mat &img, std::string dir){
     std::string f_ext = ".png";
     std::string name = std::to_string(id);
     std::string outname = dir + name + "-vis" + ".png";
-    std::cout << "Saving visualize image " << outname << std::endl;
+    DVLOG_DEBUG(LogFields(id), "Saving visualize image %s", outname.c_str());
     cv::imwrite(outname, img);
     return 1;
 }
@@ -185,6 +194,295 @@ int print_batch_detections(std::vector<std::vector<bbox>> &batch_dets){
     return 1;
 }
 
+/* source index of the first tap and weight of the second per destination pixel,
+   pixel centers aligned like cv::resize INTER_LINEAR */
+static void linear_taps(int src_len, int dst_len, int *idx, float *w){
+    const float scale = (float)src_len / dst_len;
+    for (int d = 0; d < dst_len; d++){
+        float s = (d + 0.5f) * scale - 0.5f;
+        int i = (int)std::floor(s);
+        float f = s - i;
+        if (i < 0){
+            i = 0;
+            f = 0.0f;
+        }
+        if (i >= src_len - 1){
+            i = src_len - 1;
+            f = 0.0f;
+        }
+        idx[d] = i;
+        w[d] = f;
+    }
+}
+
+static inline float bilerp(float a, float b, float c, float d, float fx, float fy){
+    float top = a + (b - a) * fx;
+    float bot = c + (d - c) * fx;
+    return top + (bot - top) * fy;
+}
+
+void ImgUtils::resize_normalize_chw(const cv::Mat &src, int dst_w, int dst_h, float *dst){
+    const size_t plane = (size_t)dst_w * dst_h;
+    if (src.empty() || src.type() != CV_8UC3){
+        std::fill(dst, dst + 3 * plane, 0.0f);
+        return;
+    }
+    const float scale = 1.0f / 255;
+    std::vector<int> xi(dst_w), yi(dst_h);
+    std::vector<float> xw(dst_w), yw(dst_h);
+    linear_taps(src.cols, dst_w, xi.data(), xw.data());
+    linear_taps(src.rows, dst_h, yi.data(), yw.data());
+    /* byte offsets of the left and right taps, the right one stays on the
+       last column at the edge */
+    std::vector<int> x0(dst_w), x1(dst_w);
+    for (int x = 0; x < dst_w; x++){
+        x0[x] = xi[x] * 3;
+        x1[x] = std::min(xi[x] + 1, src.cols - 1) * 3;
+    }
+    float *d0 = dst;
+    float *d1 = dst + plane;
+    float *d2 = dst + 2 * plane;
+    for (int y = 0; y < dst_h; y++){
+        const uchar *r0 = src.ptr<uchar>(yi[y]);
+        const uchar *r1 = src.ptr<uchar>(std::min(yi[y] + 1, src.rows - 1));
+        const float fy = yw[y];
+        const size_t row = (size_t)y * dst_w;
+        for (int x = 0; x < dst_w; x++){
+            const uchar *a = r0 + x0[x], *b = r0 + x1[x];
+            const uchar *c = r1 + x0[x], *e = r1 + x1[x];
+            const float fx = xw[x];
+            d0[row + x] = bilerp(a[0], b[0], c[0], e[0], fx, fy) * scale;
+            d1[row + x] = bilerp(a[1], b[1], c[1], e[1], fx, fy) * scale;
+            d2[row + x] = bilerp(a[2], b[2], c[2], e[2], fx, fy) * scale;
+        }
+    }
+}
+
+void ImgUtils::load_chw_batch(const cv::Mat *imgs, size_t count, size_t n, int dst_w, int dst_h, std::vector<float> &dst){
+    const size_t img_size = (size_t)3 * dst_w * dst_h;
+    dst.resize(n * img_size);
+    for (size_t i = 0; i < n; i++){
+        float *p = dst.data() + i * img_size;
+        if (i < count){
+            resize_normalize_chw(imgs[i], dst_w, dst_h, p);
+        }
+        else{
+            std::fill(p, p + img_size, 0.0f);
+        }
+    }
+}
+
+/* YUV to RGB in 20 bit fixed point: R = cy*(Y-yoff) + cvr*V, G = cy*(Y-yoff)
+   + cvg*V + cug*U, B = cy*(Y-yoff) + cub*U, U and V centred on 128 */
+struct YuvCoeffs{
+    int yoff, cy, cub, cug, cvg, cvr;
+};
+
+/* [PixMatrix][PixRange], BT.601 limited are the rounded constants of cv::cvtColor */
+static const YuvCoeffs yuv_coeffs[3][2] = {
+    {{16, 1220542, 2116026, -409993, -852492, 1673527}, {0, 1048576, 1858077, -360853, -748826, 1470104}},
+    {{16, 1220945, 2215014, -223607, -558796, 1879825}, {0, 1048576, 1945738, -196424, -490864, 1651297}},
+    {{16, 1220945, 2245811, -196426, -682019, 1760217}, {0, 1048576, 1972791, -172546, -599107, 1546230}},
+};
+
+/* planes of a packed 4:2:0 frame, see PixFormat */
+struct YuvPlanes{
+    const uchar *y;
+    const uchar *u;
+    const uchar *v;
+    int ystride;
+    int cstride;
+    int cstep;      /* 1 - I420, 2 - interleaved NV12 */
+    YuvCoeffs k;
+};
+
+static YuvPlanes yuv_planes(const ImgUtils::FrameView &f){
+    const int cw = (f.width + 1) / 2, ch = (f.height + 1) / 2;
+    YuvPlanes p;
+    p.y = f.yuv;
+    p.ystride = f.width;
+    if (f.format == PIX_FMT_NV12){
+        p.u = f.yuv + (size_t)f.width * f.height;
+        p.v = p.u + 1;
+        p.cstride = cw * 2;
+        p.cstep = 2;
+    }
+    else{
+        p.u = f.yuv + (size_t)f.width * f.height;
+        p.v = p.u + (size_t)cw * ch;
+        p.cstride = cw;
+        p.cstep = 1;
+    }
+    p.k = yuv_coeffs[f.matrix][f.range];
+    return p;
+}
+
+static inline void yuv_rgb(const YuvPlanes &p, int x, int y, uchar *rgb){
+    const YuvCoeffs &k = p.k;
+    const int half = 1 << 19;
+    const size_t c = (size_t)(y >> 1) * p.cstride + (size_t)(x >> 1) * p.cstep;
+    const int u = p.u[c] - 128, v = p.v[c] - 128;
+    const int yy = std::max(0, p.y[(size_t)y * p.ystride + x] - k.yoff) * k.cy;
+    auto sat = [](int a){return (uchar)std::min(std::max(a >> 20, 0), 255);};
+    rgb[0] = sat(yy + half + k.cvr * v);
+    rgb[1] = sat(yy + half + k.cvg * v + k.cug * u);
+    rgb[2] = sat(yy + half + k.cub * u);
+}
+
+ImgUtils::FrameView ImgUtils::frame_view(const uchar *data, int width, int height, uint32_t format,
+                                         uint32_t matrix, uint32_t range){
+    FrameView v;
+    if (data == nullptr || width <= 0 || height <= 0){
+        return v;
+    }
+    if (format == PIX_FMT_RGB){
+        v.rgb = cv::Mat(height, width, CV_8UC3, (void *)data);
+        return v;
+    }
+    if (format != PIX_FMT_I420 && format != PIX_FMT_NV12){
+        return v;
+    }
+    v.yuv = data;
+    v.width = width;
+    v.height = height;
+    v.format = format;
+    /* an unknown matrix or range from a newer worker falls back to the default */
+    v.matrix = matrix <= PIX_MATRIX_BT2020 ? matrix : PIX_MATRIX_BT601;
+    v.range = range <= PIX_RANGE_FULL ? range : PIX_RANGE_LIMITED;
+    v.rect = cv::Rect(0, 0, width, height);
+    return v;
+}
+
+ImgUtils::FrameView ImgUtils::sub_view(const FrameView &v, const cv::Rect &rect){
+    if (!v.is_yuv()){
+        return FrameView(v.rgb(rect));
+    }
+    FrameView s = v;
+    s.rect = cv::Rect(v.rect.x + rect.x, v.rect.y + rect.y, rect.width, rect.height);
+    return s;
+}
+
+cv::Mat ImgUtils::to_rgb(const FrameView &v){
+    if (!v.is_yuv()){
+        return v.rgb;
+    }
+    cv::Mat out;
+    if (v.empty()){
+        return out;
+    }
+    if (v.rect == cv::Rect(0, 0, v.width, v.height) && v.width % 2 == 0 && v.height % 2 == 0 &&
+        v.matrix == PIX_MATRIX_BT601 && v.range == PIX_RANGE_LIMITED){
+        /* whole frame, the planes are laid out as cvtColor expects and it
+           only converts BT.601 limited range */
+        cv::Mat planes(v.height * 3 / 2, v.width, CV_8UC1, (void *)v.yuv);
+        cv::cvtColor(planes, out, v.format == PIX_FMT_NV12 ? cv::COLOR_YUV2RGB_NV12 : cv::COLOR_YUV2RGB_I420);
+        return out;
+    }
+    const YuvPlanes p = yuv_planes(v);
+    out.create(v.rect.height, v.rect.width, CV_8UC3);
+    for (int y = 0; y < v.rect.height; y++){
+        uchar *row = out.ptr<uchar>(y);
+        for (int x = 0; x < v.rect.width; x++){
+            yuv_rgb(p, v.rect.x + x, v.rect.y + y, row + x * 3);
+        }
+    }
+    return out;
+}
+
+cv::Mat ImgUtils::crop_rgb(const FrameView &v, int x0, int y0, int x1, int y1){
+    if (!v.is_yuv()){
+        return crop_image(v.rgb, x0, y0, x1, y1);
+    }
+    /* same clamping as crop_image */
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    if (x1 > v.cols())
+        x1 = v.cols() - 1;
+    if (y1 > v.rows())
+        y1 = v.rows() - 1;
+    if (x1 - x0 <= 0 || y1 - y0 <= 0){
+        return cv::Mat();
+    }
+    return to_rgb(sub_view(v, cv::Rect(x0, y0, x1 - x0, y1 - y0)));
+}
+
+void ImgUtils::resize_normalize_chw(const FrameView &src, int dst_w, int dst_h, float *dst){
+    if (!src.is_yuv()){
+        resize_normalize_chw(src.rgb, dst_w, dst_h, dst);
+        return;
+    }
+    const size_t plane = (size_t)dst_w * dst_h;
+    if (src.empty()){
+        std::fill(dst, dst + 3 * plane, 0.0f);
+        return;
+    }
+    const float scale = 1.0f / 255;
+    const cv::Rect &r = src.rect;
+    const YuvPlanes p = yuv_planes(src);
+    std::vector<int> xi(dst_w), yi(dst_h);
+    std::vector<float> xw(dst_w), yw(dst_h);
+    linear_taps(r.width, dst_w, xi.data(), xw.data());
+    linear_taps(r.height, dst_h, yi.data(), yw.data());
+    std::vector<int> x0(dst_w), x1(dst_w);
+    for (int x = 0; x < dst_w; x++){
+        x0[x] = r.x + xi[x];
+        x1[x] = r.x + std::min(xi[x] + 1, r.width - 1);
+    }
+    /* RGB of the left and right tap of every destination column, per source
+       row; the bottom row of one destination row is often the top of the next */
+    std::vector<uchar> taps[2] = {std::vector<uchar>((size_t)dst_w * 6), std::vector<uchar>((size_t)dst_w * 6)};
+    int tap_row[2] = {-1, -1};
+    auto row_taps = [&](int sy, const uchar *keep) -> const uchar * {
+        for (int k = 0; k < 2; k++){
+            if (tap_row[k] == sy){
+                return taps[k].data();
+            }
+        }
+        /* replace the row that is not the other tap of this destination row */
+        int k = taps[0].data() == keep ? 1 : 0;
+        uchar *t = taps[k].data();
+        for (int x = 0; x < dst_w; x++){
+            yuv_rgb(p, x0[x], sy, t + x * 6);
+            yuv_rgb(p, x1[x], sy, t + x * 6 + 3);
+        }
+        tap_row[k] = sy;
+        return t;
+    };
+    float *d0 = dst;
+    float *d1 = dst + plane;
+    float *d2 = dst + 2 * plane;
+    for (int y = 0; y < dst_h; y++){
+        const int sy0 = r.y + yi[y];
+        const int sy1 = r.y + std::min(yi[y] + 1, r.height - 1);
+        const uchar *t0 = row_taps(sy0, nullptr);
+        const uchar *t1 = row_taps(sy1, t0);
+        const float fy = yw[y];
+        const size_t row = (size_t)y * dst_w;
+        for (int x = 0; x < dst_w; x++){
+            const uchar *a = t0 + x * 6, *b = a + 3;
+            const uchar *c = t1 + x * 6, *e = c + 3;
+            const float fx = xw[x];
+            d0[row + x] = bilerp(a[0], b[0], c[0], e[0], fx, fy) * scale;
+            d1[row + x] = bilerp(a[1], b[1], c[1], e[1], fx, fy) * scale;
+            d2[row + x] = bilerp(a[2], b[2], c[2], e[2], fx, fy) * scale;
+        }
+    }
+}
+
+void ImgUtils::load_chw_batch(const FrameView *imgs, size_t count, size_t n, int dst_w, int dst_h, std::vector<float> &dst){
+    const size_t img_size = (size_t)3 * dst_w * dst_h;
+    dst.resize(n * img_size);
+    for (size_t i = 0; i < n; i++){
+        float *p = dst.data() + i * img_size;
+        if (i < count){
+            resize_normalize_chw(imgs[i], dst_w, dst_h, p);
+        }
+        else{
+            std::fill(p, p + img_size, 0.0f);
+        }
+    }
+}
+
 /* Helpers End*/
 
 /* OnnxRTDetector Methods Begin */
@@ -194,7 +492,7 @@ OnnxRTDetector::OnnxRTDetector(const char * name, const wchar_t * model_path, fl
 #elif __linux__
 OnnxRTDetector::OnnxRTDetector(const char * name, const char * model_path, float threshold, int batchsize)
 #endif
-        : env(ORT_LOGGING_LEVEL_WARNING, name), 
+        : env(detector::shared_env()),
         session_options(create_session_options()),
         session(env, model_path, session_options), 
         threshold(threshold),
@@ -302,30 +600,16 @@ Ort::SessionOptions OnnxRTDetector::create_session_options() {
             std::cout << "Failed to add CUDA provider: " << e.what() << std::endl;
         }
     }
-    options.SetIntraOpNumThreads(1);
+    detector::set_intra_op_threads(options);
+    detector::use_shared_arena(options);
     return options;
 }
 
 
-Ort::Value OnnxRTDetector::load_input_tensor(std::vector<cv::Mat> img_batch){
-    int size = img_batch.size();
-    input_tensor_values.clear();
-    input_tensor_values.resize(size * IN_CH * INPUT_H * INPUT_W);
-    //input_tensor_values.clear(); // Clear previous data
-    // For each image in batch
-    size_t idx=0;
-    for(int i=0; i< size; i++){
-    //for (const auto& src_img : img_batch) {
-        // Convert HWC to CHW for this image
-        for (int c = 0; c < IN_CH; ++c) {
-            for (int y = 0; y < INPUT_H; ++y) {
-                for (int x = 0; x < INPUT_W; ++x) {
-                    //input_tensor_values.push_back(src_img.at<cv::Vec3f>(y, x)[c]);
-                    input_tensor_values[idx++]=img_batch[i].at<cv::Vec3f>(y, x)[c];
-                }
-            }
-        }
-    }
+Ort::Value OnnxRTDetector::load_input_tensor(const std::vector<ImgUtils::FrameView> &img_batch){
+    // Resize, normalize and convert HWC to CHW of each image in one pass
+    ImgUtils::load_chw_batch(img_batch.data(), img_batch.size(), img_batch.size(),
+                             INPUT_W, INPUT_H, input_tensor_values);
     // Update input shape for current batch size
     std::array<int64_t, 4> current_input_shape{(int64_t)img_batch.size(), IN_CH, INPUT_H, INPUT_W};
     
@@ -336,21 +620,153 @@ Ort::Value OnnxRTDetector::load_input_tensor(std::vector<cv::Mat> img_batch){
 }
 
 void OnnxRTDetector::run(Ort::Value &input_tensor){
-    output_tensors = session.Run(Ort::RunOptions{nullptr}, input_names_raw.data(),
+    output_tensors = session.Run(detector::make_run_options(), input_names_raw.data(),
                 &input_tensor, 1, output_names_raw.data(), 1);
 }
 
 
-std::vector<std::vector<bbox>> OnnxRTDetector::post_process(std::vector<ImgMeta> batch_meta_data){
-    std::vector<std::vector<bbox>> ret;
+Ort::Env &detector::shared_env(void){
+    static Ort::Env env = [](){
+        Ort::Env e(ORT_LOGGING_LEVEL_WARNING, "parkai");
+        try{
+            Ort::MemoryInfo mi = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+            Ort::ArenaCfg cfg((size_t)ORT_ARENA_MAX_MB << 20, ORT_ARENA_EXTEND_STRATEGY, -1, -1);
+            e.CreateAndRegisterAllocator(mi, cfg);
+            std::cout << "Shared ORT CPU arena registered, max " << ORT_ARENA_MAX_MB << " MB\n";
+        } catch (const Ort::Exception &ex){
+            /* sessions fall back to their own arenas */
+            std::cout << "Failed to register shared ORT arena: " << ex.what() << std::endl;
+        }
+        return e;
+    }();
+    return env;
+}
 
-    auto shape = output_tensors.front().GetTensorTypeAndShapeInfo().GetShape(); // [2, 5, 8400]
-    const int batch = shape[0];
-    const int channels = shape[1];
-    const int num_preds = shape[2];
-    float transposed[batch*channels*num_preds*sizeof(float)];
-    //transposed = (float *)malloc(batch*channels*num_preds*sizeof(float));
-    float* output = output_tensors.front().GetTensorMutableData<float>();
+static std::atomic<int> intra_op_limit{0};
+
+void detector::set_intra_op_limit(int n){
+    intra_op_limit = n > 0 ? n : 0;
+}
+
+int detector::get_intra_op_limit(void){
+    return intra_op_limit;
+}
+
+void detector::set_intra_op_threads(Ort::SessionOptions &options){
+    int limit = intra_op_limit;
+    cpu_set_t cpus;
+    if (!role_cpus(THREAD_ROLE_ORT, &cpus)){
+        options.SetIntraOpNumThreads(limit > 0 ? limit : 1);
+        if (limit > 1){
+            options.AddConfigEntry(kOrtSessionOptionsConfigAllowIntraOpSpinning, "0");
+        }
+        return;
+    }
+    /* the calling inference thread is the first intra op thread, ort pins
+       the others, processors are numbered from 1 */
+    std::string affinities;
+    int n = 1;
+    int max = limit > 0 ? limit : ORT_INTRA_OP_THREADS_MAX;
+    for (int c = 0; c < CPU_SETSIZE && n < max; c++){
+        if (CPU_ISSET(c, &cpus)){
+            affinities += (affinities.empty() ? "" : ";") + std::to_string(c + 1);
+            n++;
+        }
+    }
+    options.SetIntraOpNumThreads(n);
+    if (n > 1){
+        options.AddConfigEntry(kOrtSessionOptionsConfigIntraOpThreadAffinities, affinities.c_str());
+        /* the pools of all sessions share the ort cpus, idle ones must not spin */
+        options.AddConfigEntry(kOrtSessionOptionsConfigAllowIntraOpSpinning, "0");
+    }
+}
+
+int detector::model_batch(Ort::Session &session){
+    auto shape = session.GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+    if (shape.empty() || shape[0] <= 0){
+        return 0;
+    }
+    return (int)shape[0];
+}
+
+int detector::check_output(Ort::Value &out, const std::vector<int64_t> &dims,
+                           ONNXTensorElementDataType type, std::string &err){
+    auto info = out.GetTensorTypeAndShapeInfo();
+    auto shape = info.GetShape();
+    std::string got = "[";
+    for (size_t i = 0; i < shape.size(); i++){
+        got += (i ? "," : "") + std::to_string(shape[i]);
+    }
+    got += "]";
+    bool ok = shape.size() == dims.size();
+    for (size_t i = 0; ok && i < dims.size(); i++){
+        ok = dims[i] < 0 || dims[i] == shape[i];
+    }
+    if (!ok){
+        err = "unexpected output shape " + got;
+        return 0;
+    }
+    if (info.GetElementType() != type){
+        err = "unexpected output type " + std::to_string((int)info.GetElementType());
+        return 0;
+    }
+    if (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT){
+        const float *v = out.GetTensorMutableData<float>();
+        size_t n = info.GetElementCount();
+        for (size_t i = 0; i < n; i++){
+            if (!std::isfinite(v[i])){
+                err = "NaN or Inf in output " + got;
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+Ort::RunOptions detector::make_run_options(void){
+    Ort::RunOptions ro;
+    if (ORT_ARENA_SHRINK_PERIOD_SEC > 0){
+        static std::atomic<uint64_t> last_shrink{steady_ms()};
+        uint64_t now = steady_ms();
+        uint64_t last = last_shrink;
+        if (now - last >= ORT_ARENA_SHRINK_PERIOD_SEC * 1000ULL &&
+            last_shrink.compare_exchange_strong(last, now)){
+            ro.AddConfigEntry(kOrtRunOptionsConfigEnableMemoryArenaShrinkage, "cpu:0");
+        }
+    }
+    return ro;
+}
+
+int detector::shared_arena_stats(SessionMemStats &st){
+    st.name = "cpu-arena";
+    try{
+        Ort::MemoryInfo mi = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+        Ort::UnownedAllocator alloc = shared_env().GetSharedAllocator(mi);
+        if (alloc == nullptr){
+            return 0;
+        }
+        return memstats::allocator_stats(alloc.GetStats(), st);
+    } catch (const Ort::Exception &e){
+        std::cout << "Shared arena stats not available: " << e.what() << std::endl;
+        return 0;
+    }
+}
+
+/**
+ * @brief Decodes YOLO output [batch, channels, num_preds] into boxes scaled
+ * to the original image sizes, followed by NMS.
+ * @param output raw model output
+ * @param batch_meta original image size of every batch entry
+ * @param threshold minimal box confidence
+ */
+std::vector<std::vector<bbox>> detector::decode_yolo_output(const float *output, int batch, int channels,
+        int num_preds, const std::vector<ImgMeta> &batch_meta, float threshold){
+    std::vector<std::vector<bbox>> ret;
+    /* 168 KB per batch entry at 5x8400, too big for the stack at larger
+       batches; reused by the calling thread, every element is written below */
+    static thread_local std::vector<float> scratch;
+    scratch.resize((size_t)batch * channels * num_preds);
+    float *transposed = scratch.data();
 
     bool has_classes = (channels > 5);
     /* Transpose Array to [2 8400 5]*/
@@ -369,8 +785,8 @@ std::vector<std::vector<bbox>> OnnxRTDetector::post_process(std::vector<ImgMeta>
     for(int b=0; b< batch; b++){
         std::vector<sdet> boxes;
         std::vector <bbox> bboxes;
-        int img_w = batch_meta_data[b].width;
-        int img_h = batch_meta_data[b].height;
+        int img_w = batch_meta[b].width;
+        int img_h = batch_meta[b].height;
         float sw = (float)img_w/YOLO_INPUT_W;
         float sh = (float)img_h/YOLO_INPUT_H;
 
@@ -416,28 +832,29 @@ std::vector<std::vector<bbox>> OnnxRTDetector::post_process(std::vector<ImgMeta>
     return ret;
 }
 
+std::vector<std::vector<bbox>> OnnxRTDetector::post_process(std::vector<ImgMeta> batch_meta_data){
+    auto shape = output_tensors.front().GetTensorTypeAndShapeInfo().GetShape(); // [2, 5, 8400]
+    const float* output = output_tensors.front().GetTensorMutableData<float>();
+    return detector::decode_yolo_output(output, shape[0], shape[1], shape[2], batch_meta_data, threshold);
+}
+
 void OnnxRTDetector::clear_tensors(void){
     input_tensor_values.clear();
     output_tensors.clear();
 }
 
 
-std::vector<std::vector<bbox>> OnnxRTDetector::detect(std::vector<cv::Mat> im_batch, bool visualize){
+std::vector<std::vector<bbox>> OnnxRTDetector::detect(const std::vector<ImgUtils::FrameView> &im_batch, bool visualize){
     StopWatch st_load_input;
     std::vector<ImgMeta> batch_meta;
     batch_meta.resize(im_batch.size());
     std::vector<std::vector<bbox>> dets;
-    std::vector <cv::Mat> ri_batch;
     for (int i = 0; i < im_batch.size(); i++){
-        cv::Mat fit_img = ImgUtils::resize_image(im_batch[i], INPUT_W, INPUT_H);
-        ri_batch.push_back(fit_img);
-
-        batch_meta[i].height = im_batch[i].rows;
-        batch_meta[i].width = im_batch[i].cols;
+        batch_meta[i].height = im_batch[i].rows();
+        batch_meta[i].width = im_batch[i].cols();
         //std::cout << "Image Size Here " << batch_meta[i].width << " x " << batch_meta[i].height << std::endl;
     }
-    //std::cout <<"batch ready. Size: " << ri_batch.size() << std::endl;
-    Ort::Value input_tensor = load_input_tensor(ri_batch);
+    Ort::Value input_tensor = load_input_tensor(im_batch);
     //std::cout << "LOAD INPUT TENSOR: " << st_load_input.stop() << std::endl;
     StopWatch st_run;
     run(input_tensor);
@@ -450,6 +867,20 @@ std::vector<std::vector<bbox>> OnnxRTDetector::detect(std::vector<cv::Mat> im_ba
     return dets;
 }
 
+int OnnxRTDetector::warmup(std::string &err){
+    std::vector<ImgUtils::FrameView> gray(1, cv::Mat(INPUT_H, INPUT_W, CV_8UC3, cv::Scalar(114, 114, 114)));
+    Ort::Value input_tensor = load_input_tensor(gray);
+    run(input_tensor);
+    int ret = detector::check_output(output_tensors.front(), {1, -1, -1},
+                                     ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT, err);
+    if (ret && output_tensors.front().GetTensorTypeAndShapeInfo().GetShape()[1] < 5){
+        err = "no class scores in the output";
+        ret = 0;
+    }
+    clear_tensors();
+    return ret;
+}
+
 /* OnnxRTDetector Methods End*/
 
 
@@ -458,113 +889,173 @@ std::vector<std::vector<bbox>> OnnxRTDetector::detect(std::vector<cv::Mat> im_ba
 int Engine::pull_batch(std::vector <ImgData> &input_batch, uint32_t timeout){
 
     if(!muxer){
-        std::cout << "Muxer not initialized\n";
+        DVLOG_ERROR(LogFields(), "Muxer not initialized");
         return 0;
     }
     int ret = muxer->pull_frames_batch(input_batch, batch_size);
     if (!ret)
         return 0;
     
-    if(input_batch.size() == batch_size)
+    /* partial batches while fewer cameras than batch_size are live */
+    if(!input_batch.empty() && input_batch.size() <= batch_size)
         return 1;
     else
         return 0;
 }
 
-int Engine::process(std::vector <ImgData> &img_batch, std::vector<std::vector<parknetDet>> &detl){
+int Engine::process(const ModelSet &m, std::vector <ImgData> &img_batch, std::vector<std::vector<parknetDet>> &detl){
 
     StopWatch st_prep_img;
-    std::vector <cv::Mat> input_batch;
-    std::vector <cv::Mat> org_images;
+    std::vector <ImgUtils::FrameView> input_batch;
+    std::vector <ImgUtils::FrameView> org_images;
+    std::vector <cv::Rect> crops;
     for (const auto & im:img_batch){
         //std::cout << "Processing: " << im.index << std::endl;
         //cv::Mat imbuf(1, im.nbytes, CV_8UC1, im.data);
         //cv::Mat img = cv::imdecode(imbuf, cv::IMREAD_COLOR);
         
-        cv::Mat img(im.height, im.width, CV_8UC3, im.data);
+        ImgUtils::FrameView img = ImgUtils::frame_view(im.data, im.width, im.height, im.format, im.matrix, im.range);
 
         org_images.push_back(img);
 
         if (img.empty()){
-            std::cout << im.id <<" - Image not loaded! Skipping..\n";
+            DVLOG_WARN(LogFields(im.index), "%u - Image not loaded! Skipping..", im.id);
             return 0;
         }
 
-        cv::Mat prep_img = ImgUtils::preprocess_image(img);
-        if(prep_img.empty()){
-            return 0;
+        /* the detector reads the uint8 ROI view directly, YUV frames are
+           converted only at the sampled pixels, boxes are mapped back below */
+        cv::Rect rect(0, 0, img.cols(), img.rows());
+        if (im.roi){
+            rect = im.roi->crop_rect(img.cols(), img.rows());
+        }
+        ImgUtils::FrameView view = ImgUtils::sub_view(img, rect);
+        if (im.roi && !im.roi->polygon.empty()){
+            /* plates are cropped from and the input image saved from the frame, mask a copy */
+            cv::Mat masked = view.is_yuv() ? ImgUtils::to_rgb(view) : view.rgb.clone();
+            mask_roi_polygon(masked, *im.roi, rect, img.cols(), img.rows());
+            view = ImgUtils::FrameView(masked);
         }
 
-        input_batch.push_back(prep_img);
+        input_batch.push_back(view);
+        crops.push_back(rect);
     }
-    //std::cout << "PREP IMAGE TOOK: " << st_prep_img.stop() << std::endl;
+    times.preprocess = st_prep_img.stop();
 
     StopWatch st_total_car_det;
-    std::vector<std::vector<bbox>> batch_dets = car_det->detect(input_batch);
-    //std::cout << "TOTAL CAR DETECT TOOK: " << st_total_car_det.stop() <<std::endl;
-    detl.resize(batch_size);
+    std::vector<std::vector<bbox>> batch_dets = m.car->detect(input_batch);
+    times.car_det = st_total_car_det.stop();
+    detl.assign(img_batch.size(), std::vector<parknetDet>());
+    times.save = 0.0;
 
     // print_batch_detections(batch_dets);
 
-    for (int b=0; b < batch_size; b++){
-        //std::cout << "b = " << b << std::endl;
-        StopWatch st_secondary;
-        for(const auto & car : batch_dets[b]){
-            //std::cout << "Processing car\n";
-            std::string plate_text;
-            bool pl_found = false;
-            bbox fplate, plate;
+    /* second stage over the whole batch: car crops of all frames go through
+       LPD in batches, then all found plates through LPRNet. Crops are uint8
+       views of RGB frames, so nothing is drawn on them before both ran, and
+       RGB copies of the crop only for YUV frames. */
+    StopWatch st_secondary;
+    std::vector<cv::Mat> car_imgs;
+    std::vector<cv::Point> car_org;
+    std::vector<std::pair<int, size_t>> car_ref;   // frame, detection index
+    for (int b=0; b < img_batch.size(); b++){
+        const float dx = crops[b].x, dy = crops[b].y;
+        for(const auto & c : batch_dets[b]){
+            bbox car = detector::offset_bbox(c, dx, dy);
+            cv::Mat car_img;
             if(DETECT_LPD){
-                cv::Mat car_img = ImgUtils::crop_image(input_batch[b], (int)car.x1,(int) car.y1,
-                                                            (int)car.x2, (int)car.y2);
+                car_img = ImgUtils::crop_rgb(org_images[b], (int)car.x1,(int) car.y1,
+                                                          (int)car.x2, (int)car.y2);
                 if (car_img.cols == 0 || car_img.rows == 0){
                     continue;
                 }
-                if (visualize){
-                    draw_boxes(org_images[b], car);
-                }
-                //std::cout << "Looking for license plates\n";
-                std::vector<bbox> plates = lp_det->detect_preproc(car_img);
-                
-
-                if (!plates.empty()){
-                    fplate = detector::max_bbox(plates);
-                    int x0 = (int)car.x1 + (int)fplate.x1;
-                    int y0 = (int) car.y1 + (int)fplate.y1;
-                    int x1 = (int)car.x1 + (int)fplate.x2;
-                    int y1 = (int)car.y1 + (int)fplate.y2;
-                    pl_found = true;
-                    plate = {(float)x0, (float)x1, (float)y0, (float)y1, fplate.conf, fplate.cid};
-                    cv::Mat lp_img = ImgUtils::crop_image(input_batch[b], x0, y0, x1, y1);
-                    //std::cout << "Reading License Plate\n";
-                    plate_text = ocr_eng->detect_preproc(lp_img);
-                    //std::cout << "Plate Read\n";
-                    if (visualize){
-                        cv::rectangle(org_images[b], cv::Point(x0, y0), cv::Point(x1, y1), cv::Scalar(255, 255, 0), 3);
-                        cv::putText(org_images[b], plate_text, cv::Point(x0 + (x1-x0)/2, y0 -10), cv::FONT_HERSHEY_SIMPLEX, 1.5, cv::Scalar(0, 255, 255), 2);
-                    }
-                }
             }
-            parknetDet det = {car, plate, plate_text};
-            det.lpr_found = pl_found;
+            parknetDet det = {car, bbox(), ""};
             detl[b].push_back(det);
-            
+            if(DETECT_LPD){
+                car_imgs.push_back(car_img);
+                car_org.emplace_back(std::max(0, (int)car.x1), std::max(0, (int)car.y1));
+                car_ref.emplace_back(b, detl[b].size() - 1);
+            }
+        }
+    }
+
+    std::vector<cv::Mat> lp_imgs;
+    std::vector<parknetDet *> lp_dets;    // detl is complete, pointers stay valid
+    if (!car_imgs.empty()){
+        std::vector<std::vector<bbox>> plates = m.lpd->detect_batch(car_imgs);
+        for (size_t k = 0; k < plates.size(); k++){
+            if (plates[k].empty()){
+                continue;
+            }
+            const int b = car_ref[k].first;
+            parknetDet &det = detl[b][car_ref[k].second];
+            bbox fplate = detector::max_bbox(plates[k]);
+            int x0 = car_org[k].x + (int)fplate.x1;
+            int y0 = car_org[k].y + (int)fplate.y1;
+            int x1 = car_org[k].x + (int)fplate.x2;
+            int y1 = car_org[k].y + (int)fplate.y2;
+            det.lpr_found = true;
+            det.lplate = {(float)x0, (float)x1, (float)y0, (float)y1, fplate.conf, fplate.cid};
+            cv::Mat lp_img = ImgUtils::crop_rgb(org_images[b], x0, y0, x1, y1);
+            if (lp_img.cols == 0 || lp_img.rows == 0){
+                continue;
+            }
+            lp_imgs.push_back(lp_img);
+            lp_dets.push_back(&det);
+        }
+    }
+    if (!lp_imgs.empty()){
+        std::vector<std::string> texts = m.lpr->detect_batch(lp_imgs);
+        for (size_t k = 0; k < texts.size(); k++){
+            lp_dets[k]->plText = texts[k];
+        }
+    }
+    times.secondary = st_secondary.stop();
+
+    for (int b=0; b < img_batch.size(); b++){
+        if (!visualize && !SAVE_INPUT_IMAGES){
+            break;
+        }
+        /* the only full frame conversion of a YUV frame */
+        cv::Mat org = ImgUtils::to_rgb(org_images[b]);
+        if (visualize){
+            for (const auto & det : detl[b]){
+                draw_boxes(org, det.car);
+                if (det.lpr_found){
+                    const bbox &plate = det.lplate;
+                    cv::rectangle(org, cv::Point(plate.x1, plate.y1), cv::Point(plate.x2, plate.y2), cv::Scalar(255, 255, 0), 3);
+                    cv::putText(org, det.plText, cv::Point((plate.x1 + plate.x2)/2, plate.y1 -10), cv::FONT_HERSHEY_SIMPLEX, 1.5, cv::Scalar(0, 255, 255), 2);
+                }
+            }
         }
-        //std::cout << "SECONDARY DET TOOK: " << st_secondary.stop() << std::endl;
-        //std::cout << "Detections done\n";
         if (SAVE_INPUT_IMAGES){
             StopWatch st_save_img;
-            save_input_image(img_batch[b].index, org_images[b], IMG_DIR);
-            //std::cout << "SAVE INPUT IMG TOOK: " << st_save_img.stop() << std::endl;
+            save_input_image(img_batch[b].index, org, IMG_DIR);
+            times.save += st_save_img.stop();
         }
         if (visualize){
-            save_visualize_img(img_batch[b].index, org_images[b], visualize_dir);
+            save_visualize_img(img_batch[b].index, org, visualize_dir);
         }
     }
     return 1;
 }
 
 
+/**
+ * @brief An arena or heap allocation ORT could not make, e.g. at the
+ * ORT_ARENA_MAX_MB cap. It says nothing about the model that ran.
+ */
+static bool is_alloc_error(const Ort::Exception &e){
+    if (e.GetOrtErrorCode() != ORT_FAIL && e.GetOrtErrorCode() != ORT_RUNTIME_EXCEPTION){
+        return false;
+    }
+    std::string msg = e.what();
+    std::transform(msg.begin(), msg.end(), msg.begin(), [](unsigned char c){return (char)std::tolower(c);});
+    return msg.find("allocate") != std::string::npos || msg.find("available memory") != std::string::npos ||
+           msg.find("out of memory") != std::string::npos;
+}
+
 void Engine::runn(bool visualize){
 
     this->visualize = visualize;
@@ -572,47 +1063,97 @@ void Engine::runn(bool visualize){
 
     std::vector<std::vector<parknetDet>> b_dets;
 
-    if (car_det == nullptr){
-        std::cerr << "Car Detector Model is missing\n";
-        return;
-    }
-    if(lp_det == nullptr){
-        std::cerr << "LP Detector Model is missing\n";
-        return;
-    }
-    if(ocr_eng == nullptr){
-        std::cerr << "LPR Model is missing\n";
+    /* the batch runs on the models current now, a swap meanwhile only
+       affects the next batch */
+    ModelSet m = models.current();
+    if (!m.complete()){
+        DVLOG_ERROR(LogFields(), "Models are missing");
         return;
     }
     int ret = 0;
+    StopWatch st_total;
     ret = pull_batch(img_batch, 50);
     
     if(!ret){
         return;
     }
+    /* pulled frames go back to the muxer on every way out of this batch */
+    struct FrameReturn{
+        StreamMuxer *muxer;
+        const std::vector<ImgData> *batch;
+        void release(void){
+            if (batch == nullptr){
+                return;
+            }
+            for (const auto & im:*batch){
+                muxer->reset_frame(im.id);
+            }
+            batch = nullptr;
+        }
+        ~FrameReturn(){release();}
+    } frame_return{muxer, &img_batch};
+
+    uint64_t now_ms = steady_ms();
+    times.queue = 0.0;
+    for (const auto & im:img_batch){
+        if (im.ready_ms != 0 && now_ms - im.ready_ms > times.queue){
+            times.queue = (double)(now_ms - im.ready_ms);
+        }
+    }
     // std::cout << "Pulled Batch Size : "<<img_batch.size() <<  std::endl;
     // for(const auto & b:img_batch){
     //     std::cout << "id - " << b.id << ", img_size: " << b.nbytes << std::endl;
     // }
 
-    ret = process(img_batch, b_dets);
-
-    for (int b=0; b< batch_size; b++){
-        //muxer->clear_frame_buffers(img_batch[b].id);
-        muxer->reset_frame(img_batch[b].id);
+    bool model_ok = true;
+    bool counted = true;    /* out of memory batches neither pass nor fail probation */
+    try{
+        ret = process(m, img_batch, b_dets);
+    } catch (const Ort::Exception &e){
+        if (is_alloc_error(e)){
+            DVLOG_WARN(LogFields(), "Inference out of memory: %s", e.what());
+            counted = false;
+        }
+        else{
+            DVLOG_ERROR(LogFields(), "Inference failed: %s", e.what());
+            model_ok = false;
+        }
+        ret = 0;
+    } catch (const std::bad_alloc &e){
+        DVLOG_WARN(LogFields(), "Batch out of memory: %s", e.what());
+        counted = false;
+        ret = 0;
+    } catch (const std::exception &e){
+        /* bad output shapes of a swapped in model end up here too */
+        DVLOG_ERROR(LogFields(), "Batch failed: %s", e.what());
+        model_ok = false;
+        ret = 0;
     }
-    
+    if (counted){
+        models.report_batch(m, model_ok);
+    }
+    frame_return.release();
+
 
+    StopWatch st_write;
     if (ret){
-        for (int b=0; b<batch_size; b++){
+        for (int b=0; b<img_batch.size(); b++){
             char fn[16];
             sprintf(fn, "%05d.txt", img_batch[b].index);
             wdet::WriteDetectionInfo(b_dets[b], wdet::get_filename(fn, detai_dir));
+            if (on_detections && !b_dets[b].empty()){
+                on_detections(img_batch[b].index, b_dets[b]);
+            }
         }
     }
     else{
-        std::cout << "Failed to do inference" << std::endl; 
+        DVLOG_ERROR(LogFields(), "Failed to do inference");
     }
+    times.write = st_write.stop();
+    times.total = st_total.stop();
+    times.nframes = img_batch.size();
+    nframes += img_batch.size();
+    nbatches++;
 }
 
 
@@ -659,6 +1200,7 @@ int Engine::pipeline_run(uchar *imgbuf, uint64_t nbytes, uint32_t img_uid, std::
 
 /* Detector Methods Begin */
 float Detector::get_fps(void){
+    std::lock_guard<std::mutex> lock(rt_lock);
     if(pmuxer)
         return pmuxer->get_fps();
     else
@@ -674,6 +1216,7 @@ bool Detector::is_running(void){
 };
 
 time_t Detector::get_stream_ts(int index){
+    std::lock_guard<std::mutex> lock(rt_lock);
     if (pmuxer)
         return pmuxer->get_stream_ts(index);
     else
@@ -682,10 +1225,208 @@ time_t Detector::get_stream_ts(int index){
 
 
 
+/**
+ * @brief Collects memory usage of the muxer, engine sessions and the process
+ * @return 1 when muxer and engine are running, 0 if only process stats are set
+ */
+int Detector::get_mem_stats(MemStats &ms){
+    int ret = 1;
+    std::unique_lock<std::mutex> lock(rt_lock);
+    if (pmuxer){
+        pmuxer->get_mem_stats(ms.cams);
+        pmuxer->get_frame_pool_stats(ms.frame_pool);
+    }
+    else
+        ret = 0;
+    /* all sessions allocate from the one shared env arena, it is reported
+       once here instead of per engine or session */
+    if (pengine){
+        SessionMemStats st;
+        if (detector::shared_arena_stats(st))
+            ms.sessions.push_back(st);
+    }
+    else
+        ret = 0;
+    lock.unlock();
+    memstats::collect_process(ms);
+    return ret;
+}
+
+/**
+ * @brief Queueing delay and SLO misses per camera priority class
+ * @return 0 while no muxer runs
+ */
+int Detector::get_sched_stats(std::vector<SchedClassStats> &stats){
+    std::lock_guard<std::mutex> lock(rt_lock);
+    if (pmuxer){
+        return pmuxer->get_sched_stats(stats);
+    }
+    stats.clear();
+    return 0;
+}
+
+/**
+ * @brief Hot swaps a model: the new session is built and checked in the
+ * background while batches keep running on the current one
+ * @param path new model file, empty - reload the current file
+ * @return 0 while the models are still loading
+ */
+int Detector::reload_model(model_t kind, const std::string &path){
+    std::lock_guard<std::mutex> lock(rt_lock);
+    if (!models_ready || !pengine){
+        return 0;
+    }
+    return pengine->get_models().request_reload(kind, path);
+}
+
+int Detector::reload_models(void){
+    std::lock_guard<std::mutex> lock(rt_lock);
+    if (!models_ready || !pengine){
+        return 0;
+    }
+    return pengine->get_models().request_reload_all();
+}
+
+int Detector::get_model_status(std::vector<ModelStatus> &st){
+    std::lock_guard<std::mutex> lock(rt_lock);
+    if (!models_ready || !pengine){
+        st.clear();
+        return 0;
+    }
+    return pengine->get_models().get_status(st);
+}
+
+/**
+ * @brief Requests a new camera list. The running detector diffs it against
+ * its sources between batches: removed cameras are stopped, new ones started
+ * and cameras with a changed url restarted. Models and other streams keep
+ * running.
+ */
+int Detector::apply_camera_list(const std::vector<stream_info> &list){
+    std::lock_guard<std::mutex> lock(pending_lock);
+    pending_streams = list;
+    streams_changed = true;
+    return 1;
+}
+
+/**
+ * @brief Applies a camera list from apply_camera_list() to the muxer,
+ * called from detection_task only
+ * @return number of sources added or removed
+ */
+int Detector::apply_pending_streams(StreamMuxer &muxer){
+    std::vector<stream_info> next;
+    {
+        std::lock_guard<std::mutex> lock(pending_lock);
+        if (!streams_changed){
+            return 0;
+        }
+        next.swap(pending_streams);
+        streams_changed = false;
+    }
+    auto find = [](const std::vector<stream_info> &v, int index){
+        for (const auto & s:v){
+            if (s.index == index)
+                return &s;
+        }
+        return (const stream_info*)nullptr;
+    };
+    int nchanged = 0;
+    for (const auto & s:streams){
+        const stream_info *n = find(next, s.index);
+        if (n == nullptr || n->url != s.url){
+            DVLOG_INFO(LogFields(s.index), "Removing source %d - %s", s.index, s.url.c_str());
+            /* may not have been started yet */
+            auto queued = std::remove_if(start_queue.begin(), start_queue.end(),
+                                         [&](const stream_info &q){return q.index == s.index;});
+            nchanged += queued != start_queue.end();
+            start_queue.erase(queued, start_queue.end());
+            starting.erase(std::remove_if(starting.begin(), starting.end(),
+                                          [&](const std::pair<int, uint64_t> &st){return st.first == s.index;}),
+                           starting.end());
+            nchanged += muxer.remove_source(s.index);
+        }
+    }
+    for (const auto & n:next){
+        const stream_info *s = find(streams, n.index);
+        if (s == nullptr || s->url != n.url){
+            DVLOG_INFO(LogFields(n.index), "Adding source %d - %s", n.index, n.url.c_str());
+            start_queue.push_back(n);
+            nchanged++;
+            continue;
+        }
+        if (s->sched != n.sched || s->roi != n.roi){
+            for (auto & q:start_queue){
+                if (q.index == n.index){
+                    q.sched = n.sched;
+                    q.roi = n.roi;
+                }
+            }
+        }
+        if (s->sched != n.sched){
+            DVLOG_INFO(LogFields(n.index), "Rescheduling source %d as %s", n.index, priority_name(n.sched.priority));
+            muxer.set_source_sched(n.index, n.sched);
+            nchanged++;
+        }
+        if (s->roi != n.roi){
+            DVLOG_INFO(LogFields(n.index), "Source %d ROI %s", n.index, n.roi.empty() ? "full frame" : format_roi_rect(n.roi).c_str());
+            muxer.set_source_roi(n.index, n.roi);
+            nchanged++;
+        }
+    }
+    streams = next;
+    return nchanged;
+}
+
+/**
+ * @brief Starts queued streams, at most STREAM_START_PARALLEL of them wait for
+ * their first frame at a time. A stream leaves the starting set when it is
+ * ready or after STREAM_START_TIMEOUT_MS, a dead camera then keeps retrying
+ * through the muxer state machine without holding up the others.
+ * @return number of streams started
+ */
+int Detector::start_streams(StreamMuxer &muxer){
+    if (start_queue.empty() && starting.empty()){
+        return 0;
+    }
+    uint64_t now = steady_ms();
+    for (auto it = starting.begin(); it != starting.end();){
+        if (muxer.is_streaming(it->first)){
+            DVLOG_INFO(LogFields(it->first), "Camera %d ready after %lu ms", it->first, now - it->second);
+            it = starting.erase(it);
+        }
+        else if (now - it->second >= STREAM_START_TIMEOUT_MS){
+            DVLOG_WARN(LogFields(it->first), "Camera %d no frame after %d ms", it->first, (int)STREAM_START_TIMEOUT_MS);
+            it = starting.erase(it);
+        }
+        else{
+            it++;
+        }
+    }
+    int nstarted = 0;
+    while (!start_queue.empty() && starting.size() < STREAM_START_PARALLEL){
+        const stream_info s = start_queue.front();
+        start_queue.pop_front();
+        DVLOG_INFO(LogFields(s.index), "Creating srcbin %d - %s", s.index, s.url.c_str());
+        if (muxer.add_source(s.index, s.url, s.sched, s.roi) != STREAMMUX_RET_ERROR){
+            starting.emplace_back(s.index, now);
+            nstarted++;
+        }
+    }
+    if (nstarted > 0 && start_queue.empty()){
+        DVLOG_INFO(LogFields(), "All streams started");
+    }
+    return nstarted;
+}
+
 int Detector::read_timestamps(std::vector<stream_info> &streams){
+    std::lock_guard<std::mutex> lock(rt_lock);
     for (auto & s:streams){
-        if (pmuxer)
+        if (pmuxer){
             s.ts = pmuxer->get_stream_ts(s.index);
+            s.ready = pmuxer->is_streaming(s.index);
+            pmuxer->get_stream_health(s.index, s.health);
+        }
         //std::cout << "s.ts = " << s.ts << std::endl;
     }
     return 1;
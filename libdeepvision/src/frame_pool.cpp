@@ -0,0 +1,88 @@
+#include "frame_pool.h"
+#include <cstdlib>
+#include <sys/mman.h>
+
+FramePool::~FramePool(){
+    trim();
+}
+
+/* sizes are rounded up to the alignment so a slab is reusable for any
+   frame that rounds to it */
+uint64_t FramePool::slab_size(uint64_t nbytes){
+    uint64_t align = nbytes >= FRAME_POOL_HUGE_ALIGN ? FRAME_POOL_HUGE_ALIGN : FRAME_POOL_ALIGN;
+    return (nbytes + align - 1) / align * align;
+}
+
+unsigned char *FramePool::acquire(uint64_t nbytes){
+    if (nbytes == 0){
+        return nullptr;
+    }
+    uint64_t size = slab_size(nbytes);
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        auto it = free_bufs.find(size);
+        if (it != free_bufs.end() && !it->second.empty()){
+            unsigned char *buf = it->second.back();
+            it->second.pop_back();
+            stats.hits++;
+            stats.idle--;
+            stats.idle_bytes -= size;
+            stats.outstanding++;
+            stats.outstanding_bytes += size;
+            return buf;
+        }
+    }
+    bool huge = size >= FRAME_POOL_HUGE_ALIGN;
+    void *p = nullptr;
+    if (posix_memalign(&p, huge ? FRAME_POOL_HUGE_ALIGN : FRAME_POOL_ALIGN, size) != 0){
+        return nullptr;
+    }
+#ifdef MADV_HUGEPAGE
+    if (huge){
+        /* advisory only, fine if THP is off */
+        madvise(p, size, MADV_HUGEPAGE);
+    }
+#endif
+    std::lock_guard<std::mutex> lk(lock);
+    stats.misses++;
+    stats.outstanding++;
+    stats.outstanding_bytes += size;
+    return (unsigned char *)p;
+}
+
+void FramePool::release(unsigned char *buf, uint64_t nbytes){
+    if (buf == nullptr){
+        return;
+    }
+    uint64_t size = slab_size(nbytes);
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        stats.outstanding--;
+        stats.outstanding_bytes -= size;
+        if (stats.idle_bytes + size <= FRAME_POOL_IDLE_MAX_BYTES){
+            free_bufs[size].push_back(buf);
+            stats.idle++;
+            stats.idle_bytes += size;
+            return;
+        }
+        stats.trimmed++;
+    }
+    free(buf);
+}
+
+void FramePool::trim(void){
+    std::lock_guard<std::mutex> lk(lock);
+    for (auto &kv : free_bufs){
+        for (unsigned char *buf : kv.second){
+            free(buf);
+        }
+    }
+    free_bufs.clear();
+    stats.idle = 0;
+    stats.idle_bytes = 0;
+}
+
+void FramePool::get_stats(FramePoolStats &st) const {
+    std::lock_guard<std::mutex> lk(lock);
+    st = stats;
+}
@@ -0,0 +1,117 @@
+#include "frame_sched.h"
+#include <algorithm>
+
+const char *priority_name(StreamPriority p){
+    switch (p){
+        case PRIO_GATE:     return "gate";
+        case PRIO_NORMAL:   return "normal";
+        case PRIO_OVERVIEW: return "overview";
+        default:            return "unknown";
+    }
+}
+
+StreamPriority priority_by_val(int val){
+    if (val < PRIO_GATE || val >= PRIO_NCLASSES){
+        return PRIO_NORMAL;
+    }
+    return (StreamPriority)val;
+}
+
+static uint32_t class_slo_ms(StreamPriority p){
+    switch (p){
+        case PRIO_GATE:     return SCHED_SLO_GATE_MS;
+        case PRIO_OVERVIEW: return SCHED_SLO_OVERVIEW_MS;
+        default:            return SCHED_SLO_NORMAL_MS;
+    }
+}
+
+uint32_t StreamSched::get_slo_ms(void) const {
+    return slo_ms != 0 ? slo_ms : class_slo_ms(priority);
+}
+
+
+FrameScheduler::SlotState &FrameScheduler::slot(uint32_t i){
+    if (i >= slots.size()){
+        slots.resize(i + 1);
+    }
+    return slots[i];
+}
+
+void FrameScheduler::reset_slot(uint32_t i, const StreamSched &s){
+    SlotState &st = slot(i);
+    st.sched = s;
+    st.vtime = vclock;
+}
+
+void FrameScheduler::set_sched(uint32_t i, const StreamSched &s){
+    slot(i).sched = s;
+}
+
+uint64_t FrameScheduler::deadline(const SchedFrame &f){
+    return f.ready_ms + slot(f.slot).sched.get_slo_ms();
+}
+
+uint32_t FrameScheduler::order(std::vector<SchedFrame> &frames, uint64_t now_ms){
+    const uint64_t horizon = now_ms + (uint64_t)std::max(cycle_ms, (double)SCHED_MIN_HORIZON_MS);
+    /* frames that miss their SLO unless they go in this batch */
+    auto mid = std::partition(frames.begin(), frames.end(),
+                              [&](const SchedFrame &f){return deadline(f) <= horizon;});
+    std::sort(frames.begin(), mid, [&](const SchedFrame &a, const SchedFrame &b){
+        uint64_t da = deadline(a), db = deadline(b);
+        return da != db ? da < db : a.fid < b.fid;
+    });
+    /* the rest by virtual finish time, a camera with weight w gets w slots
+       for every slot of a weight 1 camera */
+    auto finish = [&](const SchedFrame &f){
+        const SlotState &st = slot(f.slot);
+        return std::max(st.vtime, vclock) + 1.0 / std::max<uint32_t>(st.sched.weight, 1);
+    };
+    std::sort(mid, frames.end(), [&](const SchedFrame &a, const SchedFrame &b){
+        double fa = finish(a), fb = finish(b);
+        return fa != fb ? fa < fb : a.fid < b.fid;
+    });
+    return mid - frames.begin();
+}
+
+void FrameScheduler::on_batch(const std::vector<SchedFrame> &batch, uint64_t now_ms){
+    if (last_batch_ms != 0){
+        double sample = (double)(now_ms - last_batch_ms);
+        cycle_ms = cycle_ms == 0 ? sample : cycle_ms + SCHED_EWMA_ALPHA * (sample - cycle_ms);
+    }
+    last_batch_ms = now_ms;
+    on_frames(batch, now_ms);
+}
+
+void FrameScheduler::on_frames(const std::vector<SchedFrame> &frames, uint64_t now_ms){
+    double vnext = vclock;
+    for (const SchedFrame &f : frames){
+        SlotState &st = slot(f.slot);
+        double start = std::max(st.vtime, vclock);
+        st.vtime = start + 1.0 / std::max<uint32_t>(st.sched.weight, 1);
+        vnext = std::max(vnext, start);
+
+        ClassAcc &c = classes[st.sched.priority];
+        uint64_t queue_ms = now_ms > f.ready_ms ? now_ms - f.ready_ms : 0;
+        c.queue_ms_avg = c.frames == 0 ? queue_ms : c.queue_ms_avg + SCHED_EWMA_ALPHA * (queue_ms - c.queue_ms_avg);
+        c.queue_ms_max = std::max(c.queue_ms_max, queue_ms);
+        c.slo_misses += queue_ms > st.sched.get_slo_ms();
+        c.frames++;
+    }
+    vclock = vnext;
+}
+
+void FrameScheduler::get_stats(std::vector<SchedClassStats> &stats){
+    stats.clear();
+    for (int p = 0; p < PRIO_NCLASSES; p++){
+        ClassAcc &c = classes[p];
+        SchedClassStats s;
+        s.name = priority_name((StreamPriority)p);
+        s.slo_ms = class_slo_ms((StreamPriority)p);
+        s.frames = c.frames;
+        s.slo_misses = c.slo_misses;
+        s.queue_ms_avg = c.queue_ms_avg;
+        s.queue_ms_max = c.queue_ms_max;
+        c.queue_ms_max = 0;
+        stats.push_back(s);
+    }
+}
@@ -0,0 +1,201 @@
+#include "memstats.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <malloc.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/* Image Writer Queue Accounting Begin */
+static std::atomic<uint64_t> g_writer_pending{0};
+static std::atomic<uint64_t> g_writer_bytes{0};
+
+void memstats::writer_enqueue(uint64_t nbytes){
+    g_writer_pending++;
+    g_writer_bytes += nbytes;
+}
+
+void memstats::writer_done(uint64_t nbytes){
+    g_writer_pending--;
+    g_writer_bytes -= nbytes;
+}
+/* Image Writer Queue Accounting End */
+
+
+/**
+ * @brief Reads a "<key>: <n> kB" line from /proc/self/status
+ * @return value in kB, 0 if not found
+ */
+uint64_t memstats::proc_status_kb(const char *key){
+    std::ifstream f("/proc/self/status");
+    std::string line;
+    size_t klen = strlen(key);
+    while (std::getline(f, line)) {
+        if (line.compare(0, klen, key) == 0 && line.size() > klen && line[klen] == ':') {
+            uint64_t kb = 0;
+            std::sscanf(line.c_str() + klen + 1, " %lu", &kb);
+            return kb;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Resident set size of another process from /proc/<pid>/statm
+ * @return RSS in kB, 0 if the process does not exist
+ */
+uint64_t memstats::child_rss_kb(pid_t pid){
+    if (pid <= 0){
+        return 0;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/statm", pid);
+    FILE *f = fopen(path, "r");
+    if (f == nullptr){
+        return 0;
+    }
+    unsigned long size = 0, resident = 0;
+    int n = fscanf(f, "%lu %lu", &size, &resident);
+    fclose(f);
+    if (n != 2){
+        return 0;
+    }
+    return (uint64_t)resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * @brief CPU arena statistics of an ORT session
+ * @return 1 on success, 0 if the session allocator has no stats
+ */
+int memstats::session_stats(const Ort::Session &session, const std::string &name, SessionMemStats &st){
+    st.name = name;
+    try{
+        Ort::MemoryInfo mi = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+        Ort::Allocator alloc(session, mi);
+        return allocator_stats(alloc.GetStats(), st);
+    } catch (const Ort::Exception &e){
+        std::cout << "[" << name << "] allocator stats not available: " << e.what() << std::endl;
+        return 0;
+    }
+}
+
+/**
+ * @brief Fills arena fields from OrtAllocator::GetStats() key/value pairs
+ * @return 0 if the allocator is not an arena (no stats)
+ */
+int memstats::allocator_stats(const Ort::KeyValuePairs &kv, SessionMemStats &st){
+    auto get = [&kv](const char *key) -> uint64_t {
+        const char *v = kv.GetValue(key);
+        return v ? strtoull(v, nullptr, 10) : 0;
+    };
+    if (kv.GetValue("InUse") == nullptr){
+        return 0;
+    }
+    st.in_use = get("InUse");
+    st.reserved = get("TotalAllocated");
+    st.max_in_use = get("MaxInUse");
+    st.num_allocs = get("NumAllocs");
+    return 1;
+}
+
+void memstats::collect_process(MemStats &ms){
+    ms.ts = std::time(nullptr);
+    ms.rss_kb = proc_status_kb("VmRSS");
+    ms.hwm_kb = proc_status_kb("VmHWM");
+    ms.rss_anon_kb = proc_status_kb("RssAnon");
+    ms.rss_file_kb = proc_status_kb("RssFile");
+    ms.rss_shmem_kb = proc_status_kb("RssShmem");
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 mi = mallinfo2();
+#else
+    struct mallinfo mi = mallinfo();
+#endif
+    ms.heap_in_use = (uint64_t)mi.uordblks + (uint64_t)mi.hblkhd;
+    ms.heap_free = (uint64_t)mi.fordblks;
+
+    ms.writer_pending = g_writer_pending;
+    ms.writer_bytes = g_writer_bytes;
+
+    ms.shm_bytes = ms.frame_bytes = ms.child_rss_kb = 0;
+    for (const auto & c:ms.cams){
+        ms.shm_bytes += c.shm_bytes;
+        ms.frame_bytes += c.frame_bytes;
+        ms.child_rss_kb += c.child_rss_kb;
+    }
+    ms.ort_in_use = ms.ort_reserved = 0;
+    for (const auto & s:ms.sessions){
+        ms.ort_in_use += s.in_use;
+        ms.ort_reserved += s.reserved;
+    }
+}
+
+/**
+ * @brief Overwrites <dir>/memstats.json with the full snapshot and appends
+ * the totals as one line to <dir>/memstats.log, which is rolled over to
+ * memstats.log.1 at MEMSTATS_HISTORY_MAX_BYTES
+ */
+int memstats::write_snapshot(const MemStats &ms, const std::string &dir){
+    std::string snap_fn = dir + MEMSTATS_SNAPSHOT_FILE;
+    std::string tmp_fn = snap_fn + ".tmp";
+    FILE *f = fopen(tmp_fn.c_str(), "w");
+    if (f == nullptr){
+        perror("memstats snapshot");
+        return 0;
+    }
+    fprintf(f, "{\n  \"ts\": %ld,\n", (long)ms.ts);
+    fprintf(f, "  \"rss_kb\": %lu, \"hwm_kb\": %lu, \"rss_anon_kb\": %lu, \"rss_file_kb\": %lu, \"rss_shmem_kb\": %lu,\n",
+            ms.rss_kb, ms.hwm_kb, ms.rss_anon_kb, ms.rss_file_kb, ms.rss_shmem_kb);
+    fprintf(f, "  \"heap_in_use\": %lu, \"heap_free\": %lu,\n", ms.heap_in_use, ms.heap_free);
+    fprintf(f, "  \"writer_pending\": %lu, \"writer_bytes\": %lu,\n", ms.writer_pending, ms.writer_bytes);
+    fprintf(f, "  \"shm_bytes\": %lu, \"frame_bytes\": %lu, \"child_rss_kb\": %lu,\n",
+            ms.shm_bytes, ms.frame_bytes, ms.child_rss_kb);
+    fprintf(f, "  \"ort_in_use\": %lu, \"ort_reserved\": %lu,\n", ms.ort_in_use, ms.ort_reserved);
+    const FramePoolStats &fp = ms.frame_pool;
+    fprintf(f, "  \"frame_pool\": {\"hits\": %lu, \"misses\": %lu, \"outstanding_bytes\": %lu, \"idle_bytes\": %lu, \"trimmed\": %lu},\n",
+            fp.hits, fp.misses, fp.outstanding_bytes, fp.idle_bytes, fp.trimmed);
+    fprintf(f, "  \"sessions\": [\n");
+    for (size_t i = 0; i < ms.sessions.size(); i++){
+        const auto &s = ms.sessions[i];
+        fprintf(f, "    {\"name\": \"%s\", \"in_use\": %lu, \"reserved\": %lu, \"max_in_use\": %lu, \"num_allocs\": %lu}%s\n",
+                s.name.c_str(), s.in_use, s.reserved, s.max_in_use, s.num_allocs,
+                i + 1 < ms.sessions.size() ? "," : "");
+    }
+    fprintf(f, "  ],\n  \"cams\": [\n");
+    for (size_t i = 0; i < ms.cams.size(); i++){
+        const auto &c = ms.cams[i];
+        fprintf(f, "    {\"index\": %d, \"pid\": %d, \"shm_bytes\": %lu, \"frame_bytes\": %lu, \"child_rss_kb\": %lu}%s\n",
+                c.index, (int)c.pid, c.shm_bytes, c.frame_bytes, c.child_rss_kb,
+                i + 1 < ms.cams.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    /* readers never see a half written snapshot */
+    if (rename(tmp_fn.c_str(), snap_fn.c_str()) != 0){
+        perror("memstats rename");
+        return 0;
+    }
+
+    std::string hist_fn = dir + MEMSTATS_HISTORY_FILE;
+    struct stat hs;
+    if (stat(hist_fn.c_str(), &hs) == 0 && (uint64_t)hs.st_size >= MEMSTATS_HISTORY_MAX_BYTES){
+        rename(hist_fn.c_str(), (hist_fn + ".1").c_str());
+    }
+    f = fopen(hist_fn.c_str(), "a");
+    if (f == nullptr){
+        perror("memstats history");
+        return 0;
+    }
+    fprintf(f, "%ld rss_kb=%lu anon_kb=%lu shmem_kb=%lu heap_in_use=%lu heap_free=%lu shm=%lu frames=%lu "
+               "pool_held=%lu pool_idle=%lu ort_in_use=%lu ort_reserved=%lu writer_bytes=%lu children_kb=%lu cams=%zu\n",
+            (long)ms.ts, ms.rss_kb, ms.rss_anon_kb, ms.rss_shmem_kb, ms.heap_in_use, ms.heap_free,
+            ms.shm_bytes, ms.frame_bytes, ms.frame_pool.outstanding_bytes, ms.frame_pool.idle_bytes,
+            ms.ort_in_use, ms.ort_reserved, ms.writer_bytes, ms.child_rss_kb, ms.cams.size());
+    fclose(f);
+    return 1;
+}
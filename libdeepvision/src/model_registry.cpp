@@ -0,0 +1,331 @@
+#include "model_registry.h"
+#include "detector.h"
+#include <sys/stat.h>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+
+const char *model_name(model_t kind){
+    switch (kind){
+        case VEHICLE_MODEL: return "vehicle";
+        case LP_MODEL: return "lpd";
+        case OCR_MODEL: return "lpr";
+        default: return "unknown";
+    }
+}
+
+/* copies the session of one kind from src to dst */
+static void set_model(ModelSet &dst, const ModelSet &src, model_t kind){
+    switch (kind){
+        case VEHICLE_MODEL: dst.car = src.car; break;
+        case LP_MODEL: dst.lpd = src.lpd; break;
+        case OCR_MODEL: dst.lpr = src.lpr; break;
+        default: break;
+    }
+}
+
+static bool has_model(const ModelSet &set, model_t kind){
+    switch (kind){
+        case VEHICLE_MODEL: return set.car != nullptr;
+        case LP_MODEL: return set.lpd != nullptr;
+        case OCR_MODEL: return set.lpr != nullptr;
+        default: return false;
+    }
+}
+
+static int file_state(const std::string &path, time_t *mtime, off_t *size){
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0){
+        return 0;
+    }
+    *mtime = st.st_mtime;
+    *size = st.st_size;
+    return 1;
+}
+
+ModelRegistry::ModelRegistry(int id, int batch_size)
+    : batch_size(batch_size)
+{
+    const char *paths[NMODELS] = {VEHICLE_MODEL_PATH, LPD_MODEL_PATH, LPR_MODEL_PATH};
+    const char *prefix[NMODELS] = {"car", "lpd", "lpr"};
+    for (int k = 0; k < NMODELS; k++){
+        slots[k].name = std::string(prefix[k]) + "-" + std::to_string(id);
+        slots[k].path = paths[k];
+    }
+}
+
+ModelRegistry::~ModelRegistry(){
+    stop_watch();
+}
+
+ModelSet ModelRegistry::build(model_t kind, const std::string &path, std::string &err){
+    ModelSet set;
+    const char *name = slots[kind].name.c_str();
+    try{
+        switch (kind){
+            case VEHICLE_MODEL:
+                set.car = std::make_shared<OnnxRTDetector>(name, path.c_str(),
+                                VEHICLE_DET_CONFIDENCE_THRESHOLD, batch_size);
+                break;
+            case LP_MODEL:
+                set.lpd = std::make_shared<OnnxDetector>(name, path.c_str(),
+                                LPD_BATCH_SIZE, LPLATE_DET_CONFIDENCE_THRESHOLD);
+                break;
+            case OCR_MODEL:
+                set.lpr = std::make_shared<LPRNetDetector>(name, path.c_str(), LPR_BATCH_SIZE);
+                break;
+            default:
+                err = "unknown model";
+                return set;
+        }
+    } catch (const Ort::Exception &e){
+        err = e.what();
+    }
+    return set;
+}
+
+void ModelRegistry::load_all(void){
+    /* sessions are independent, graph optimization of the three models
+       runs concurrently */
+    StopWatch st_load;
+    std::future<ModelSet> loads[NMODELS];
+    for (int k = 0; k < NMODELS; k++){
+        loads[k] = std::async(std::launch::async, [this, k]{
+            set_thread_name(("dv-load-" + std::string(model_name((model_t)k))).c_str());
+            std::string err;
+            ModelSet set = build((model_t)k, slots[k].path, err);
+            if (!has_model(set, (model_t)k)){
+                throw std::runtime_error(std::string(model_name((model_t)k)) + " model: " + err);
+            }
+            return set;
+        });
+    }
+    ModelSet set;
+    for (int k = 0; k < NMODELS; k++){
+        set_model(set, loads[k].get(), (model_t)k);
+    }
+    std::cout << "Models loaded in " << st_load.stop() << " ms\n";
+    std::lock_guard<std::mutex> lk(lock);
+    cur = set;
+    for (int k = 0; k < NMODELS; k++){
+        Slot &s = slots[k];
+        s.version = 1;
+        cur.version[k] = 1;
+        s.loaded_ts = std::time(nullptr);
+        file_state(s.path, &s.mtime, &s.size);
+        s.seen_mtime = s.mtime;
+        s.seen_size = s.size;
+    }
+}
+
+ModelSet ModelRegistry::current(void) const {
+    std::lock_guard<std::mutex> lk(lock);
+    return cur;
+}
+
+int ModelRegistry::request_reload(model_t kind, const std::string &path){
+    if (kind < 0 || kind >= NMODELS){
+        return 0;
+    }
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        slots[kind].pending = true;
+        slots[kind].pending_path = path.empty() ? slots[kind].path : path;
+    }
+    cv.notify_one();
+    return 1;
+}
+
+int ModelRegistry::request_reload_all(void){
+    int n = 0;
+    for (int k = 0; k < NMODELS; k++){
+        n += request_reload((model_t)k);
+    }
+    return n;
+}
+
+/**
+ * @brief Builds, warms up and validates a model, swaps it in on success
+ * @return 1 - swapped in, 0 - rejected, the old model keeps running
+ */
+int ModelRegistry::reload(model_t kind, const std::string &path){
+    StopWatch st;
+    std::string err;
+    time_t mtime = 0;
+    off_t size = 0;
+    file_state(path, &mtime, &size);
+    ModelSet fresh = build(kind, path, err);
+    int ok = has_model(fresh, kind);
+    if (ok){
+        try{
+            switch (kind){
+                case VEHICLE_MODEL: ok = fresh.car->warmup(err); break;
+                case LP_MODEL: ok = fresh.lpd->warmup(err); break;
+                case OCR_MODEL: ok = fresh.lpr->warmup(err); break;
+                default: ok = 0; break;
+            }
+        } catch (const Ort::Exception &e){
+            err = e.what();
+            ok = 0;
+        }
+    }
+    std::lock_guard<std::mutex> lk(lock);
+    Slot &s = slots[kind];
+    if (!ok){
+        /* a rejected file is not retried until it changes again */
+        if (path == s.path){
+            s.mtime = mtime;
+            s.size = size;
+        }
+        s.failures++;
+        s.last_error = err;
+        std::cout << "Model " << model_name(kind) << " reload from " << path << " rejected, keeping v"
+                  << s.version << ": " << err << std::endl;
+        return 0;
+    }
+    /* the session replaced last time is released, the current one is kept
+       until the new one passes probation */
+    set_model(prev, cur, kind);
+    set_model(cur, fresh, kind);
+    s.prev_version = s.version;
+    s.prev_path = s.path;
+    s.swaps++;
+    s.version = s.swaps + 1;
+    cur.version[kind] = s.version;
+    s.path = path;
+    s.mtime = mtime;
+    s.size = size;
+    s.loaded_ts = std::time(nullptr);
+    s.probation = MODEL_PROBATION_BATCHES;
+    s.last_error.clear();
+    std::cout << "Model " << model_name(kind) << " v" << s.version << " from " << path
+              << " swapped in after " << st.stop() << " ms\n";
+    return 1;
+}
+
+void ModelRegistry::report_batch(const ModelSet &used, bool ok){
+    std::lock_guard<std::mutex> lk(lock);
+    for (int k = 0; k < NMODELS; k++){
+        Slot &s = slots[k];
+        if (s.probation == 0 || used.version[k] != s.version){
+            continue;
+        }
+        if (ok){
+            if (--s.probation == 0){
+                set_model(prev, ModelSet(), (model_t)k);
+            }
+            continue;
+        }
+        /* the batch can't tell which model failed, all new ones go back */
+        set_model(cur, prev, (model_t)k);
+        set_model(prev, ModelSet(), (model_t)k);
+        std::cout << "Model " << model_name((model_t)k) << " v" << s.version
+                  << " failed a batch, rolled back to v" << s.prev_version << std::endl;
+        s.version = s.prev_version;
+        if (s.path != s.prev_path){
+            /* watch the old file again, the failed one is not its state */
+            s.path = s.prev_path;
+            file_state(s.path, &s.mtime, &s.size);
+        }
+        cur.version[k] = s.version;
+        s.probation = 0;
+        s.failures++;
+        s.last_error = "failed a batch, rolled back";
+    }
+}
+
+int ModelRegistry::get_status(std::vector<ModelStatus> &st) const {
+    std::lock_guard<std::mutex> lk(lock);
+    st.clear();
+    for (int k = 0; k < NMODELS; k++){
+        const Slot &s = slots[k];
+        ModelStatus m;
+        m.name = model_name((model_t)k);
+        m.path = s.path;
+        m.version = s.version;
+        m.loaded_ts = s.loaded_ts;
+        m.probation = s.probation > 0;
+        m.swaps = s.swaps;
+        m.failures = s.failures;
+        m.last_error = s.last_error;
+        st.push_back(m);
+    }
+    return st.size();
+}
+
+/* queues a reload of every model file that changed and then stayed the
+   same for MODEL_SETTLE_MS, called with the lock held */
+void ModelRegistry::check_files(void){
+    uint64_t now = steady_ms();
+    for (int k = 0; k < NMODELS; k++){
+        Slot &s = slots[k];
+        time_t mtime;
+        off_t size;
+        if (s.pending || !file_state(s.path, &mtime, &size)){
+            continue;
+        }
+        if (mtime == s.mtime && size == s.size){
+            continue;
+        }
+        if (mtime != s.seen_mtime || size != s.seen_size){
+            s.seen_mtime = mtime;
+            s.seen_size = size;
+            s.seen_ms = now;
+            continue;
+        }
+        if (now - s.seen_ms >= MODEL_SETTLE_MS){
+            std::cout << "Model file " << s.path << " changed, reloading\n";
+            s.pending = true;
+            s.pending_path = s.path;
+        }
+    }
+}
+
+void ModelRegistry::watch_task(void){
+    set_thread_name("dv-models");
+    std::unique_lock<std::mutex> lk(lock);
+    while (running){
+        cv.wait_for(lk, std::chrono::milliseconds(MODEL_WATCH_PERIOD_MS), [this]{
+            bool pending = false;
+            for (int k = 0; k < NMODELS; k++){
+                pending |= slots[k].pending;
+            }
+            return !running || pending;
+        });
+        if (!running){
+            break;
+        }
+        check_files();
+        for (int k = 0; k < NMODELS && running; k++){
+            if (!slots[k].pending){
+                continue;
+            }
+            std::string path = slots[k].pending_path;
+            slots[k].pending = false;
+            /* the load takes seconds, batches keep running meanwhile */
+            lk.unlock();
+            reload((model_t)k, path);
+            lk.lock();
+        }
+    }
+}
+
+void ModelRegistry::start_watch(void){
+    std::lock_guard<std::mutex> lk(lock);
+    if (running){
+        return;
+    }
+    running = true;
+    worker = std::thread(&ModelRegistry::watch_task, this);
+}
+
+void ModelRegistry::stop_watch(void){
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        running = false;
+    }
+    cv.notify_one();
+    if (worker.joinable()){
+        worker.join();
+    }
+}
@@ -0,0 +1,124 @@
+#include "roi.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+static bool in_unit(float v){
+    return v >= 0.0f && v <= 1.0f;
+}
+
+/* reads "a,b" or "a,b,c,d" style lists of floats */
+static int parse_floats(const char *s, float *dst, int n, const char **end){
+    const char *p = s;
+    for (int i = 0; i < n; i++){
+        char *e;
+        dst[i] = strtof(p, &e);
+        if (e == p){
+            return 0;
+        }
+        p = e;
+        while (*p == ' '){
+            p++;
+        }
+        if (i < n - 1){
+            if (*p != ','){
+                return 0;
+            }
+            p++;
+        }
+    }
+    *end = p;
+    return 1;
+}
+
+int parse_roi(const char *rect, const char *polygon, StreamRoi &roi){
+    StreamRoi r;
+    if (rect != nullptr && rect[0] != '\0'){
+        float v[4];
+        const char *end;
+        if (!parse_floats(rect, v, 4, &end) || *end != '\0'){
+            roi = StreamRoi();
+            return 0;
+        }
+        r.x = v[0];
+        r.y = v[1];
+        r.w = v[2];
+        r.h = v[3];
+        if (!in_unit(r.x) || !in_unit(r.y) || r.w <= 0 || r.h <= 0 ||
+            r.x + r.w > 1.0f + 1e-4f || r.y + r.h > 1.0f + 1e-4f){
+            roi = StreamRoi();
+            return 0;
+        }
+    }
+    if (polygon != nullptr && polygon[0] != '\0'){
+        const char *p = polygon;
+        while (*p){
+            float v[2];
+            const char *end;
+            if (!parse_floats(p, v, 2, &end) || !in_unit(v[0]) || !in_unit(v[1]) ||
+                (*end != ';' && *end != '\0') || r.polygon.size() >= ROI_POLYGON_MAX){
+                roi = StreamRoi();
+                return 0;
+            }
+            r.polygon.emplace_back(v[0], v[1]);
+            p = *end == ';' ? end + 1 : end;
+        }
+        if (r.polygon.size() < 3){
+            roi = StreamRoi();
+            return 0;
+        }
+    }
+    roi = r;
+    return 1;
+}
+
+std::string format_roi_rect(const StreamRoi &roi){
+    if (roi.w <= 0 || roi.h <= 0){
+        return "";
+    }
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.3g,%.3g,%.3g,%.3g", roi.x, roi.y, roi.w, roi.h);
+    return buf;
+}
+
+cv::Rect StreamRoi::crop_rect(int frame_w, int frame_h) const {
+    cv::Rect full(0, 0, frame_w, frame_h);
+    float fx = x, fy = y, fw = w, fh = h;
+    if ((fw <= 0 || fh <= 0) && !polygon.empty()){
+        float x0 = 1, y0 = 1, x1 = 0, y1 = 0;
+        for (const auto &p : polygon){
+            x0 = std::min(x0, p.x);
+            y0 = std::min(y0, p.y);
+            x1 = std::max(x1, p.x);
+            y1 = std::max(y1, p.y);
+        }
+        fx = x0;
+        fy = y0;
+        fw = x1 - x0;
+        fh = y1 - y0;
+    }
+    if (fw <= 0 || fh <= 0){
+        return full;
+    }
+    cv::Rect r((int)(fx * frame_w), (int)(fy * frame_h),
+               (int)(fw * frame_w + 0.5f), (int)(fh * frame_h + 0.5f));
+    r &= full;
+    if (r.width < ROI_MIN_PIXELS || r.height < ROI_MIN_PIXELS){
+        return full;
+    }
+    return r;
+}
+
+void mask_roi_polygon(cv::Mat &img, const StreamRoi &roi, const cv::Rect &rect, int frame_w, int frame_h){
+    if (roi.polygon.empty() || img.empty()){
+        return;
+    }
+    std::vector<cv::Point> pts;
+    pts.reserve(roi.polygon.size());
+    for (const auto &p : roi.polygon){
+        pts.emplace_back((int)(p.x * frame_w + 0.5f) - rect.x, (int)(p.y * frame_h + 0.5f) - rect.y);
+    }
+    cv::Mat outside(img.size(), CV_8UC1, cv::Scalar(255));
+    cv::fillPoly(outside, std::vector<std::vector<cv::Point>>{pts}, cv::Scalar(0));
+    img.setTo(cv::Scalar::all(0), outside);
+}
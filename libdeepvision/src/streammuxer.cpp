@@ -1,4 +1,5 @@
 #include "streammuxer.h"
+#include <algorithm>
 #include <fstream>
 #include <string>
 #include <iostream>
@@ -20,7 +21,7 @@ size_t current_rss_kb() {
 }
 
 void log_mem(const char* tag) {
-    std::cout << tag << " VmRSS: " << current_rss_kb()/1024.0 << " MB\n";
+    DVLOG_INFO(LogFields(), "%s VmRSS: %.1f MB", tag, current_rss_kb()/1024.0);
 }
 
 
@@ -69,9 +70,9 @@ float StreamMuxer::get_fps(void){
     }
     fps = fpsa/(float)n;
     if (fps < 0.0){
-        std::cout << "PRINTING FPS FRAMES BUF\n";
+        DVLOG_WARN(LogFields(), "negative fps %.2f, frames buffer:", fps);
         for (int i = 0; i < len; i++){
-            std::cout << "i-" << i << " = " << fd[i] << std::endl;
+            DVLOG_WARN(LogFields(), "i-%d = %d", i, fd[i]);
         }
     }
     return fps; 
@@ -97,24 +98,23 @@ int print_sources_table(std::vector <GstChildWorker *> &vec){
     return 1;
 }
 
+/* sleeps until the next absolute tick, so an idle muxer wakes once per period */
 int StreamMuxer::periodic_tick(uint32_t period_ms){
-    static uint32_t tick = 0;
     try{
+    auto next = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(tick_lock);
     while(run){
-        tick++;
-        if (tick >= 1000){
-            //std::cout << "STREAMMUX: Tick Reached 1000\n";
-            tick = 0;
-            update_fd();
-            log_mem("prog-mem:");
-            //std::cout << "Streammux Running at: " << get_fps() << " fps" << std::endl;
+        next += std::chrono::milliseconds(period_ms);
+        if (tick_cv.wait_until(lock, next, [this](){return !run;})){
+            break;
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(period_ms));
+        update_fd();
+        //std::cout << "Streammux Running at: " << get_fps() << " fps" << std::endl;
     }
     } catch (const std::exception &e){
-        std::cerr << "periodic_tick exception: " << e.what() << '\n';
+        DVLOG_ERROR(LogFields(), "periodic_tick exception: %s", e.what());
     } catch (...){
-        std::cerr << "periodic_tick unknown exception\n";
+        DVLOG_ERROR(LogFields(), "periodic_tick unknown exception");
     }
     return 1;
 }
@@ -126,12 +126,12 @@ uint32_t delete_from_epoll(int epfd, GstChildWorker *worker){
         return 1;
     }
     if(epoll_ctl(epfd, EPOLL_CTL_DEL, worker->get_evfd(), nullptr) == 0){
-        printf("[%s] fd-%d deleted from epoll\n", worker->rtsp_url_, worker->get_evfd());
+        DVLOG_INFO(worker->log_fields(), "[%s] deleted from epoll", worker->rtsp_url_);
         worker->set_epoll_flag(false);
         return 1;
     }
     else{
-        printf("[%s] fd-%d could not delete from epoll\n", worker->rtsp_url_, worker->get_evfd());
+        DVLOG_ERROR(worker->log_fields(), "[%s] could not delete from epoll: %s", worker->rtsp_url_, strerror(errno));
         return 0;
     }
 }
@@ -139,9 +139,23 @@ uint32_t delete_from_epoll(int epfd, GstChildWorker *worker){
 
 int StreamMuxer::state_machine(void){
     
-    while(true){
+    while(run){
+        /* due restarts are claimed under mlock and spawned after it is released */
+        std::vector<std::pair<GstChildWorker *, uint32_t>> restarts;
         if(mlock.try_lock()){
             if (!sources.empty()){
+                /* restarts wait while too many workers are still connecting,
+                   a site wide outage then recovers without a spawn storm */
+                time_t now = time(nullptr);
+                int64_t now_ms = monotonic_ms();
+                int nstarting = 0;
+                for (auto & s:sources){
+                    nstarting += s->is_starting(now);
+                    HealthState prev;
+                    if (s->update_health(now_ms, &prev)){
+                        on_health_change(s, prev, now_ms);
+                    }
+                }
                 for (auto & s:sources){
                     switch(s->state){
                         case ALIVE:
@@ -168,105 +182,160 @@ int StreamMuxer::state_machine(void){
                             break;
 
                         case BURIED:
-                            if(s->reinit()){
-                                relink_stream(s);
+                            if(nstarting < RESTARTS_MAX_CONCURRENT && s->is_restart_due(now_ms)){
+                                restarts.emplace_back(s, s->prepare_restart());
+                                nstarting++;
                             }
                             break;
+
+                        case CREATION:
+                            /* worker being spawned by add_source() or a restart */
+                            break;
+
+                        case REPLAY:
+                            /* frames are pushed by the parent */
+                            break;
+
+                        case RETIRED:
+                            /* removed, slot waits for add_source() */
+                            break;
                     }
                 }
             }
             mlock.unlock();
         }
+        for (auto & r:restarts){
+            restart_source(r.first, r.second);
+        }
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
     return 1;
 }
 
+/**
+ * @brief Spawns the worker of a claimed restart, the wait for the zygote or
+ * fork/exec runs without mlock so frame pulls and the epoller go on
+ * @param gen claim returned by prepare_restart()
+ */
+void StreamMuxer::restart_source(GstChildWorker *src, uint32_t gen){
+    WorkerProc wp;
+    uint32_t ok = GstChildWorker::spawn_proc(src->get_id(), src->rtsp_url_, wp);
+    std::lock_guard<std::mutex> lock(mlock);
+    if (!src->is_start_current(gen)){
+        /* removed while its worker was started */
+        GstChildWorker::discard_proc(wp);
+        return;
+    }
+    if (!attach_worker(src, ok, wp)){
+        DVLOG_WARN(src->log_fields(), "[%s] restart failed", src->rtsp_url_);
+        return;
+    }
+    n_restarts++;
+    DVLOG_INFO(src->log_fields(), "[%s] restarted, %lu restarts so far", src->rtsp_url_, n_restarts.load());
+}
+
+
+/* logs and counts a health transition and passes it to the health callback, mlock held */
+void StreamMuxer::on_health_change(GstChildWorker *src, HealthState prev, int64_t now_ms){
+    StreamHealthInfo h = src->health_info();
+    HealthEvent ev{src->get_id(), prev, h.state, now_ms, h.interval_ms, h.silent_ms};
+    DVLOG(h.state == HEALTH_STALLED || h.state == HEALTH_DEAD ? DV_WARN : DV_INFO, src->log_fields(),
+          "[%s] health %s -> %s, interval %.0f ms, silent %ld ms", src->rtsp_url_,
+          health_name(prev), health_name(h.state), h.interval_ms, (long)h.silent_ms);
+    n_stalls += h.state == HEALTH_STALLED;
+    n_deaths += h.state == HEALTH_DEAD;
+    if (health_cb){
+        health_cb(ev);
+    }
+}
 
 int StreamMuxer::child_epoller(void){
 
-    uint64_t nfr=0;
-    uint64_t n_restarted = 0;
-    std::cout << "EPPOLLING INIT DONE\n";
+    DVLOG_INFO(LogFields(-1, -1, epfd), "epoll init done");
     
-    while (true){
-        
-    if(!sources.empty()){
-        if(mlock.try_lock()){
-            printf("Program has restarted streams - %lu times\n", n_restarted);
-            bool epoll_del = false;
-            //print_sources_table(sources);
-            epoll_event events[MAX_EVENTS];
-            int n;
-
-            do {
-                n = epoll_wait(epfd, events, MAX_EVENTS, 1000);
-            } while (n < 0 && errno == EINTR);
-
-            if(n < 0){
-                std::cout << "epoll error\n";
+    while (run){
+        bool idle;
+        {
+            /* add_source() grows sources while this thread runs */
+            std::lock_guard<std::mutex> lock(mlock);
+            idle = sources.empty();
+        }
+        if (idle){
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        /* wait outside of mlock, otherwise frame pulls stall for the whole timeout */
+        epoll_event events[MAX_EVENTS];
+        int n;
+        do {
+            n = epoll_wait(epfd, events, MAX_EVENTS, 100);
+        } while (n < 0 && errno == EINTR);
+
+        if(n < 0){
+            DVLOG_ERROR(LogFields(-1, -1, epfd), "epoll error: %s", strerror(errno));
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        if(n == 0){
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mlock);
+        for (int e = 0; e < n; e++) {
+            auto* src = static_cast<GstChildWorker*>(events[e].data.ptr);
+            /* evfd may have been closed by the state machine in the meantime */
+            if(!src->is_registered()){
+                DVLOG_DEBUG(src->log_fields(), "[src-%s] received events after deletion", src->rtsp_url_);
                 continue;
             }
-            
-            for (int e = 0; e < n; e++) {
-                //size_t i = events[e].data.u32;
-                auto* src = static_cast<GstChildWorker*>(events[e].data.ptr);
-                std::cout << "Reading event from fd = " << src->get_evfd() << std::endl;
-                printf("[%s] - evfd [%d] received new event\n", src->rtsp_url_, src->get_evfd());
-                if(src->get_evfd() <= 0){
-                    std::cout << "invalid evfd\n";
-                    continue;
-                }
-                uint64_t sig;   
-                ssize_t s = read(src->get_evfd(), &sig, sizeof(sig));
-                if (s == -1) {
-                    if (errno == EAGAIN) continue;
-                    perror("read evfd failed");
-                    continue;
-                }
-                if (s != sizeof(sig)) continue;
+            if(src->get_evfd() <= 0){
+                DVLOG_WARN(src->log_fields(), "[%s] invalid evfd", src->rtsp_url_);
+                continue;
+            }
+            uint64_t sig;   
+            ssize_t s = read(src->get_evfd(), &sig, sizeof(sig));
+            if (s == -1) {
+                if (errno == EAGAIN) continue;
+                DVLOG_ERROR(src->log_fields(), "[%s] read evfd failed: %s", src->rtsp_url_, strerror(errno));
+                continue;
+            }
+            if (s != sizeof(sig)) continue;
 
-                /* clear the epoll events with deleted evfds */
-                if(!src->is_registered()){
-                    printf("[src-%s] received events after deletion\n", src->rtsp_url_);
-                    continue; //
-                }
-                auto evt = signal_parser(sig);
-                if(evt == EVT_PIPELINE_EXIT){
-                    printf("[%s] adding to infected\n", src->rtsp_url_);
-                    src->state = ZOMBIE;
-                    continue;
-                }
+            DVLOG_DEBUG(src->log_fields(), "[%s] evfd event 0x%lx", src->rtsp_url_, sig);
+            auto evt = signal_parser(sig);
+            if(evt == EVT_PIPELINE_EXIT){
+                DVLOG_INFO(src->log_fields(), "[%s] pipeline exited, adding to infected", src->rtsp_url_);
+                src->state = ZOMBIE;
+                continue;
+            }
 
-                src->handle_event(evt); 
-                if ((sig & EVT_FRAME_WAITING) == EVT_FRAME_WAITING) {
-                    src->set_frame_waiting(true);
-                }
+            src->handle_event(evt); 
+            if ((sig & EVT_FRAME_WAITING) == EVT_FRAME_WAITING) {
+                src->set_frame_waiting(true);
             }
-            mlock.unlock();
         }
     }
-    else{
-            
-    }
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
     return 1;
 }
 
 int StreamMuxer::frame_reader(void){
-    uint64_t nfr = 0;
-    while(true){
+    while(run){
         if (mlock.try_lock()){
         for (int i = 0; i < sources.size(); i++){
             if(sources[i]->is_frame_waiting() && !frames[i].ready){
                 //printf("Reading Frame from [%d] in sources [%d]\n", i, sources[i]->get_id());
-                if(sources[i]->read_frame(&frames[i].idata, &frames[i].nbytes)){
+                uint64_t nbytes = sources[i]->frame_nbytes();
+                if(nbytes != 0 && frame_buffer(frames[i], nbytes) != nullptr &&
+                   sources[i]->read_frame(frames[i].idata, nbytes)){
                     frames[i].width  = sources[i]->header()->w;
                     frames[i].height = sources[i]->header()->h;
+                    frames[i].format = sources[i]->header()->format;
+                    frames[i].matrix = sources[i]->header()->matrix;
+                    frames[i].range  = sources[i]->header()->range;
                     frames[i].ready  = true;
                     frames[i].read   = false;
                     frames[i].fid = nfr;
+                    frames[i].ready_ms = steady_ms();
                     nfr++;
                     sources[i]->set_frame_waiting(false);
                 }
@@ -276,6 +345,241 @@ int StreamMuxer::frame_reader(void){
     }
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
+    return 1;
+}
+
+
+/**
+ * @brief Takes over a worker spawned for a claimed source, mlock held. A
+ * failed spawn or epoll registration is retried with the restart backoff.
+ * @param spawned result of spawn_proc()
+ * @return 1 - the source is ALIVE, 0 - it is BURIED until its next start
+ */
+int StreamMuxer::attach_worker(GstChildWorker *src, uint32_t spawned, const WorkerProc &wp){
+    if (spawned && src->attach(wp) && relink_stream(src)){
+        return 1;
+    }
+    if (spawned){
+        delete_from_epoll(epfd, src);
+        src->shutdown();
+    }
+    src->restart_failed();
+    return 0;
+}
+
+/**
+ * @brief Starts a gst_worker for a camera while the muxer is running. The
+ * slot of a removed source is reused once the engine released its frame.
+ * A worker that fails to start is retried by the state machine.
+ * @return source id, STREAMMUX_RET_ERROR if the index is already a source
+ * or no slot is free
+ */
+uint32_t StreamMuxer::add_source(int index, std::string rtsp, const StreamSched &s, const StreamRoi &roi){
+    std::unique_lock<std::mutex> lock(mlock);
+    uint32_t slot = STREAMMUX_RET_ERROR;
+    for (size_t i = 0; i < sources.size(); i++){
+        if (sources[i]->state == RETIRED){
+            if (slot == STREAMMUX_RET_ERROR && !frames[i].in_use){
+                slot = i;
+            }
+        }
+        else if (sources[i]->get_id() == index){
+            DVLOG_ERROR(LogFields(index), "Source with index %d already exists", index);
+            return STREAMMUX_RET_ERROR;
+        }
+    }
+    if (slot == STREAMMUX_RET_ERROR){
+        if (sources.size() >= MAX_STREAMS){
+            DVLOG_ERROR(LogFields(index), "Maximal amount of streams reached");
+            return STREAMMUX_RET_ERROR;
+        }
+        slot = sources.size();
+        frames.push_back(FrameInfo{});
+        sources.push_back(&childs[slot]);
+    }
+    else{
+        frames[slot] = FrameInfo{};
+    }
+    DVLOG_INFO(LogFields(index), "Creating source with index- %d in slot %u", index, slot);
+    sched.reset_slot(slot, s);
+    set_slot_roi(slot, roi);
+    GstChildWorker *src = sources[slot];
+    src->set_frame_waiting(false);
+    uint32_t gen = src->prepare(index, rtsp.c_str());
+
+    /* the slot is claimed, wait for the zygote or fork/exec without mlock */
+    lock.unlock();
+    WorkerProc wp;
+    uint32_t ok = GstChildWorker::spawn_proc(index, rtsp.c_str(), wp);
+    lock.lock();
+    if (!src->is_start_current(gen)){
+        DVLOG_WARN(LogFields(index), "Source %d removed while it was started", index);
+        GstChildWorker::discard_proc(wp);
+        return STREAMMUX_RET_ERROR;
+    }
+    if (!attach_worker(src, ok, wp)){
+        DVLOG_WARN(LogFields(index), "Failed to start source %d, retrying", index);
+    }
+    return slot;
+}
+
+/**
+ * @brief Stops the source of a camera and frees its slot. A frame the
+ * engine is still processing is freed by reset_frame().
+ * @return 1 - removed, 0 - no such source
+ */
+int StreamMuxer::remove_source(int index){
+    std::lock_guard<std::mutex> lock(mlock);
+    for (size_t i = 0; i < sources.size(); i++){
+        GstChildWorker *src = sources[i];
+        if (src->state == RETIRED || src->get_id() != index){
+            continue;
+        }
+        if (src->state != REPLAY){
+            delete_from_epoll(epfd, src);
+            src->shutdown();
+        }
+        src->set_frame_waiting(false);
+        src->state = RETIRED;
+        FrameInfo &f = frames[i];
+        if (f.in_use){
+            f.ready = false;
+            f.read = true;
+        }
+        else{
+            release_frame_buffer(f);
+            f = FrameInfo{};
+        }
+        DVLOG_INFO(LogFields(index), "Source with index- %d removed from slot %zu", index, i);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Number of sources that can deliver frames
+ */
+int StreamMuxer::active_sources(void){
+    std::lock_guard<std::mutex> lock(mlock);
+    int n = 0;
+    for (const auto & src:sources){
+        if (src->state != RETIRED){
+            n++;
+        }
+    }
+    return n;
+}
+
+/* a live worker counts as streaming once it delivered a frame since its (re)start */
+static bool delivers_frames(GstChildWorker *src){
+    return src->state == REPLAY || (src->state == ALIVE && src->get_ts() != 0);
+}
+
+/**
+ * @brief Camera readiness, true once the source of index delivered a frame
+ */
+bool StreamMuxer::is_streaming(int index){
+    std::lock_guard<std::mutex> lock(mlock);
+    for (const auto & src:sources){
+        if (src->state != RETIRED && src->get_id() == index){
+            return delivers_frames(src);
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Returns a pulled frame to its source, its buffer goes back to the
+ * pool as is, the next read overwrites it whole.
+ */
+int StreamMuxer::reset_frame(uint32_t id){
+    std::lock_guard<std::mutex> lock(mlock);
+    if (id >= frames.size()){
+        return 0;
+    }
+    FrameInfo &f = frames[id];
+    f.in_use = false;
+    release_frame_buffer(f);
+    if (sources[id]->state == RETIRED){
+        f = FrameInfo{};
+        return 1;
+    }
+    f.fid = (uint64_t)-1;
+    f.ready = false;
+    f.read = true;
+    sources[id]->allow_new_frame();
+    return 1;
+}
+
+
+/**
+ * @brief Pushes a frame into a replay source, same path as a frame read from
+ * a gst_worker. A frame is dropped if the previous one was not consumed yet,
+ * like a live camera overwriting its shared buffer.
+ * @param src_id id returned by create_replay_source
+ * @param format PixFormat of data, nbytes must match it
+ * @return 1 - frame accepted, 0 - dropped or invalid source
+ */
+int StreamMuxer::push_frame(uint32_t src_id, const uchar *data, uint64_t nbytes, uint32_t w, uint32_t h,
+                            uint32_t format){
+    std::lock_guard<std::mutex> lock(mlock);
+    if (src_id >= sources.size() || sources[src_id]->state != REPLAY){
+        return 0;
+    }
+    FrameInfo &f = frames[src_id];
+    if (f.ready || nbytes != pix_fmt_nbytes(format, w, h)){
+        return 0;
+    }
+    if (frame_buffer(f, nbytes) == nullptr){
+        return 0;
+    }
+    memcpy(f.idata, data, nbytes);
+    f.width  = w;
+    f.height = h;
+    f.format = format;
+    f.matrix = PIX_MATRIX_BT601;
+    f.range  = PIX_RANGE_LIMITED;
+    f.ready  = true;
+    f.read   = false;
+    f.fid = nfr;
+    f.ready_ms = steady_ms();
+    nfr++;
+    sources[src_id]->touch_ts();
+    return 1;
+}
+
+
+/**
+ * @brief Stops muxer threads, kills and reaps all children and frees frame
+ * buffers. Safe to call more than once.
+ */
+void StreamMuxer::stop(void){
+    if (!run.exchange(false)){
+        return;
+    }
+    {
+        /* the tick thread checks run under tick_lock, no lost wakeup */
+        std::lock_guard<std::mutex> lock(tick_lock);
+    }
+    tick_cv.notify_all();
+    for (auto *th : {&th_frame_reader, &mux_thread, &state_machine_th, &tick_thread}){
+        if (th->joinable()){
+            th->join();
+        }
+    }
+    std::lock_guard<std::mutex> lock(mlock);
+    for (size_t i = 0; i < sources.size(); i++){
+        if (sources[i]->state != REPLAY && sources[i]->state != RETIRED){
+            delete_from_epoll(epfd, sources[i]);
+            sources[i]->shutdown();
+        }
+        release_frame_buffer(frames[i]);
+        frames[i].ready = false;
+    }
+    if (epfd >= 0){
+        close(epfd);
+        epfd = -1;
+    }
 }
 
 
@@ -309,45 +613,37 @@ int StreamMuxer::copy_frame(int id, uchar **data, uint64_t *nbytes, uint32_t *w,
 uint32_t StreamMuxer::pull_frames_batch(std::vector<ImgData> &batch_data,  uint32_t batch_size){
 
     std::lock_guard<std::mutex> lock(mlock);
-    /* Find frames with smallest nfr */
-    uint32_t nready = 0;
-    std::vector<uint32_t> ids;
-    //std::cout << "Available ids:\n[";
+    uint32_t nlive = 0;
+    std::vector<SchedFrame> ready;
     for (int i = 0; i < frames.size(); i++){
-        if (frames[i].ready == true && frames[i].read == false){
-            nready++;
-            ids.push_back(i);
-            //std::cout << i << ", ";
+        if (delivers_frames(sources[i])){
+            nlive++;
+        }
+        if (frames[i].ready == true && frames[i].read == false && !frames[i].in_use){
+            ready.push_back(SchedFrame{(uint32_t)i, frames[i].ready_ms, frames[i].fid});
         }
     }
-    //std::cout << "]\n";
-
+    uint32_t nready = ready.size();
+    uint64_t now = steady_ms();
+    uint32_t nurgent = sched.order(ready, now);
+
+    /* fewer streaming sources than the batch size gives a partial batch, so
+       inference starts with the first camera during bring-up */
+    batch_size = std::min(batch_size, std::max(nlive, nready));
+    if (batch_size == 0){
+        return 0;
+    }
     if (nready < batch_size){
-        //std::cout << "Not enough frames ready\n";
-        return 0; //Not enough frames are ready 
-    }
-
-    /* pull oldest frames */
-    for (int b = 0; b < batch_size; b++){
-        uint64_t nfr_min = (uint64_t)-1;
-        uint32_t i_erase = (uint32_t)-1;
-        uint32_t rid = (uint32_t)-1;
-        //std::cout << "ids_size = " << i_erase << std::endl;
-        for (int i = 0; i < ids.size(); i++){
-            if(frames[ids[i]].fid <= nfr_min){
-                nfr_min = frames[ids[i]].fid;
-                i_erase = i;
-            }
-        }
-        if(i_erase < ids.size()){
-            rid = ids[i_erase];
-            ids.erase(ids.begin() + i_erase);
-        }
-        else{
-            std::cout << "Failed to find oldest frames\n";
+        /* a frame about to miss its SLO does not wait for a full batch */
+        if (nurgent == 0){
             return 0;
         }
-        /* @todo: copy the frame to return vector */
+        batch_size = nready;
+    }
+
+    /* urgent frames by deadline, then weighted fair */
+    for (uint32_t b = 0; b < batch_size; b++){
+        uint32_t rid = ready[b].slot;
         uint64_t size;
         uchar *pdata = nullptr;
         uint32_t w, h;
@@ -355,7 +651,11 @@ uint32_t StreamMuxer::pull_frames_batch(std::vector<ImgData> &batch_data,  uint3
         int ret = copy_frame(rid, &pdata, &size, &w, &h);
         if (ret){
             uint32_t index = get_src_index(rid);
-            ImgData data = {pdata, size, w, h, rid, index};
+            ImgData data = {pdata, size, w, h, rid, index, frames[rid].ready_ms};
+            data.format = frames[rid].format;
+            data.matrix = frames[rid].matrix;
+            data.range = frames[rid].range;
+            data.roi = rois[rid];
             batch_data.push_back(data);
         }
         else{
@@ -363,20 +663,125 @@ uint32_t StreamMuxer::pull_frames_batch(std::vector<ImgData> &batch_data,  uint3
         }
     }
 
-    if (batch_data.size() == batch_size)
+    if (batch_data.size() == batch_size){
+        for (const auto & d:batch_data){
+            frames[d.id].in_use = true;
+        }
+        ready.resize(batch_size);
+        sched.on_batch(ready, now);
         return 1;
+    }
     else{
+        batch_data.clear();
         return 0;
     }
 }
 
+/**
+ * @brief Queueing delay and SLO misses per priority class, the max delay is
+ * reset by each call
+ */
+int StreamMuxer::get_sched_stats(std::vector<SchedClassStats> &stats){
+    std::lock_guard<std::mutex> lock(mlock);
+    sched.get_stats(stats);
+    return stats.size();
+}
+
+/**
+ * @brief Changes the scheduling of a running camera without restarting it
+ * @return 0 if the index is not a source
+ */
+int StreamMuxer::set_source_sched(int index, const StreamSched &s){
+    std::lock_guard<std::mutex> lock(mlock);
+    for (size_t i = 0; i < sources.size(); i++){
+        if (sources[i]->state != RETIRED && sources[i]->get_id() == index){
+            sched.set_sched(i, s);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Changes the ROI of a running camera, frames already pulled keep
+ * the ROI they were pulled with
+ * @return 0 if the index is not a source
+ */
+int StreamMuxer::set_source_roi(int index, const StreamRoi &roi){
+    std::lock_guard<std::mutex> lock(mlock);
+    for (size_t i = 0; i < sources.size(); i++){
+        if (sources[i]->state != RETIRED && sources[i]->get_id() == index){
+            set_slot_roi(i, roi);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Number of sources currently in given state
+ */
+int StreamMuxer::count_sources(ChildState state){
+    std::lock_guard<std::mutex> lock(mlock);
+    int n = 0;
+    for (const auto & src:sources){
+        if (src->state == state){
+            n++;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Per camera memory: mapped shm, parent frame copy and child RSS
+ * @return number of sources reported
+ */
+int StreamMuxer::get_mem_stats(std::vector<CameraMemStats> &cams){
+    std::lock_guard<std::mutex> lock(mlock);
+    cams.clear();
+    cams.reserve(sources.size());
+    for (size_t i = 0; i < sources.size(); i++){
+        if (sources[i]->state == RETIRED){
+            continue;
+        }
+        CameraMemStats c;
+        c.index = sources[i]->get_id();
+        c.pid = sources[i]->pid();
+        if (sources[i]->is_shm_mapped()){
+            c.shm_bytes = sources[i]->shm_size();
+        }
+        if (frames[i].idata != nullptr){
+            c.frame_bytes = frames[i].nbytes;
+        }
+        c.child_rss_kb = memstats::child_rss_kb(c.pid);
+        cams.push_back(c);
+    }
+    return cams.size();
+}
+
+/**
+ * @brief Health of a camera stream
+ * @return 0 if the index is not a source
+ */
+int StreamMuxer::get_stream_health(int index, StreamHealthInfo &info){
+    std::lock_guard<std::mutex> lock(mlock);
+    for (const auto & src:sources){
+        if (src->state != RETIRED && src->state != REPLAY && src->get_id() == index){
+            info = src->health_info();
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /**
  * @param index - camera/stream index
  * @return time_t - timestamp of last frame
  */
 time_t StreamMuxer::get_stream_ts(int index){
+    std::lock_guard<std::mutex> lock(mlock);
     for(const auto & src:sources){
-        if (src->get_id() == index){
+        if (src->state != RETIRED && src->get_id() == index){
             return src->get_ts();
         }
     }
@@ -384,10 +789,10 @@ time_t StreamMuxer::get_stream_ts(int index){
 };
 
 time_t StreamMuxer::get_stream_td(int index){
+    std::lock_guard<std::mutex> lock(mlock);
     time_t tn = std::time(nullptr);
-    time_t td;
     for (const auto & src:sources){
-        if (src->get_id() == index){
+        if (src->state != RETIRED && src->get_id() == index){
             return  tn - src->get_ts();
         }
     }
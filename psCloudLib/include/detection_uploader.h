@@ -0,0 +1,80 @@
+#ifndef DETECTION_UPLOADER_H
+#define DETECTION_UPLOADER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define DETUP_BATCH_EVENTS   1000        // a batch is closed at this many events...
+#define DETUP_FLUSH_SEC      5           // ...or this long after its first event
+#define DETUP_QUEUE_MAX      20000       // events held in memory before the sender spools them
+#define DETUP_SPOOL_MAX_MB   512         // oldest batches are deleted above this
+#define DETUP_RETRY_SEC      30          // wait after a failed upload before the next try
+#define DETUP_SPOOL_EXT      ".json.gz"
+
+
+/* Compact detection event, one per detected vehicle */
+struct DetectionEvent {
+    int cam = -1;               // camera index
+    int64_t ts_ms = 0;          // unix time in ms
+    float x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+    float conf = 0;
+    std::string plate;          // empty when no plate was read
+    float plate_conf = 0;
+};
+
+struct DetectionUploadStats {
+    uint64_t queued = 0;        // events in memory
+    uint64_t spooled = 0;       // batches waiting on disk
+    uint64_t sent = 0;          // events acknowledged by the cloud
+    uint64_t dropped = 0;       // events lost to a full queue or spool
+};
+
+/**
+ * @brief Uploads detection events in gzip batches with at-least-once delivery.
+ * push() only appends to a bounded in-memory queue and never blocks on IO.
+ * A sender thread closes batches by size or age, writes every batch to the
+ * spool directory first and deletes it only after the cloud accepted it, so
+ * batches survive outages and restarts. Each batch carries a unique id for
+ * deduplication on the cloud side.
+ */
+class DetectionUploader {
+    public:
+        DetectionUploader(const std::string &url, const std::string &host,
+                          const std::string &facility, const std::string &spool_dir);
+        ~DetectionUploader();
+
+        void push(std::vector<DetectionEvent> &&events);
+        void stop(void);
+        DetectionUploadStats get_stats(void);
+
+    private:
+        std::string url;
+        std::string host;
+        std::string facility;
+        std::string spool_dir;
+
+        std::mutex qlock;
+        std::condition_variable qcv;
+        std::vector<DetectionEvent> queue;
+        uint64_t first_ms = 0;          // push time of the oldest queued event
+
+        std::atomic<bool> run{true};
+        std::atomic<uint64_t> sent{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> nspooled{0};
+        uint64_t seq = 0;
+        std::thread sender;
+
+        void sender_loop(void);
+        bool spool_batch(std::vector<DetectionEvent> &batch);
+        int upload_spool(void);
+        void enforce_spool_limit(void);
+        std::vector<std::string> list_spool(void);
+};
+
+#endif
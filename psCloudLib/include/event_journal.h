@@ -0,0 +1,74 @@
+#ifndef EVENT_JOURNAL_H
+#define EVENT_JOURNAL_H
+
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "lot.h"
+#include "sqlite3.h"
+
+#define EVENT_JOURNAL_PATH      "events_journal.db"
+#define EVENT_UPLOAD_CHUNK      500     // events per UPLOAD_EVENTS request
+#define EVENT_UPLOAD_GZIP       false   // gzip upload bodies (cloud must accept Content-Encoding: gzip)
+#define EVENT_JOURNAL_KEEP_DAYS 90      // uploaded events older than this are pruned
+
+/**
+ * @brief Local journal of gate events (SQLite, WAL).
+ * Events are keyed by (gateid, eventTS, body), eventTS has second resolution
+ * and two vehicles can share it, so refetching a gate-day only adds new rows.
+ * Per gate-day it keeps the high-water mark (latest eventTS) and whether the
+ * day is closed, i.e. was fetched after it ended, so closed days are never
+ * requested from the gate controller again. Every configured gate gets an
+ * open row before its first fetch, a gate that does not answer keeps the date
+ * open. Rows stay pending until the cloud accepts the chunk they were uploaded
+ * in.
+ */
+class EventJournal {
+    public:
+        struct Chunk {
+            std::string date;
+            nlohmann::json payload;         // {"date":..., "lots":[{"name","id","in","out"}]}
+            std::vector<int64_t> rowids;
+        };
+
+        EventJournal(const char *path);
+        ~EventJournal();
+        bool is_open(void) const { return db != nullptr; }
+
+        bool gate_day_closed(int gateid, const std::string &date);
+        /* adds open rows for gate-days not journaled yet, false on error */
+        bool open_gate_days(const std::vector<int> &gateids, const std::string &date);
+        /**
+         * @brief Journals events of one gate-day
+         * @param closed the day had ended when the events were fetched
+         * @return number of new events, -1 on error
+         */
+        int add_events(const Lot &lot, const Gate &gate, const std::string &date,
+                       const nlohmann::json &events, bool closed);
+        /* oldest pending events of a single date, false when nothing is pending */
+        bool next_chunk(int limit, Chunk &chunk);
+        int ack(const std::vector<int64_t> &rowids);
+        /* the cloud reports the date missing, upload journaled events again */
+        int reopen_date(const std::string &date);
+        int64_t pending(void);
+        /* dates with a gate-day that was not fetched after the day ended */
+        std::vector<std::string> open_dates(void);
+        int prune(int keep_days);
+
+        EventJournal(const EventJournal &) = delete;
+        EventJournal &operator=(const EventJournal &) = delete;
+
+    private:
+        sqlite3 *db = nullptr;
+        bool exec(const char *sql);
+};
+
+/**
+ * @brief One sync cycle: fetches open gate-days (today and dates the cloud is
+ * missing) into the journal and uploads pending events in chunks
+ * @return number of events acknowledged by the cloud, -1 on error
+ */
+int sync_events(EventJournal &journal, const char *url, char *host, const char *facility,
+                const std::vector<Lot> &lots, bool *run);
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+#include <curl/curl.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define HTTP_CONNECT_TIMEOUT_MS  5000
+#define HTTP_TOTAL_TIMEOUT_MS    15000
+#define HTTP_RETRIES             2       // extra attempts after the first one
+#define HTTP_BACKOFF_MS          500     // first retry delay, doubled every retry
+#define HTTP_BACKOFF_MAX_MS      8000
+#define HTTP_POOL_SIZE           4       // idle easy handles kept with their connections
+#define HTTP_KEEPALIVE_IDLE_S    60
+#define HTTP_GZIP_MIN_BYTES      1024    // smaller bodies are sent uncompressed
+#define HTTP_FANOUT_PARALLEL     8       // concurrent transfers in fetch_all()
+
+
+struct HttpOptions {
+    long connect_timeout_ms = HTTP_CONNECT_TIMEOUT_MS;
+    long timeout_ms = HTTP_TOTAL_TIMEOUT_MS;
+    int retries = HTTP_RETRIES;
+    bool gzip = false;  // gzip request body, endpoint must accept Content-Encoding: gzip
+    bool gzipped = false;   // request body is already gzip compressed
+    bool idempotent = false;    // POST may be resent after it reached the server
+};
+
+struct HttpResponse {
+    long status = 0;            // HTTP status, 0 if no response
+    CURLcode code = CURLE_OK;   // transport result of the last attempt
+    bool sent = false;          // request bytes of the last attempt went out
+    int attempts = 0;
+    std::string body;
+    std::string error;
+
+    bool ok(void) const { return code == CURLE_OK && status >= 200 && status < 300; }
+};
+
+/* One GET of a fan-out. on_data receives the body as it arrives and returns
+   false to abort the transfer, without it the body is collected in resp.body */
+struct HttpFetch {
+    std::string url;
+    std::function<bool(const char *, size_t)> on_data;
+    HttpResponse resp;
+};
+
+/**
+ * @brief Process wide HTTP client. Easy handles are pooled so their
+ * connections stay open between calls (keep-alive, HTTP/2 over TLS), DNS,
+ * TLS sessions and connections are shared between handles. Every request has
+ * connect and total timeouts and is retried with backoff on transport errors,
+ * 429 and 5xx. A POST is only retried when it never left, unless it is marked
+ * idempotent, a timeout or 5xx after sending may mean it was processed.
+ */
+class HttpClient {
+    public:
+        static HttpClient &instance(void);
+
+        HttpResponse get(const std::string &url, const HttpOptions &opt = HttpOptions());
+        HttpResponse post_json(const std::string &url, const std::string &body,
+                               const HttpOptions &opt = HttpOptions());
+
+        /**
+         * @brief Runs all GETs concurrently on one curl_multi, at most
+         * max_parallel at a time, each bounded by opt timeouts. Failed requests
+         * are not retried, their resp tells why.
+         * @return number of successful requests
+         */
+        int fetch_all(std::vector<HttpFetch> &reqs, int max_parallel = HTTP_FANOUT_PARALLEL,
+                      const HttpOptions &opt = HttpOptions());
+
+        HttpClient(const HttpClient &) = delete;
+        HttpClient &operator=(const HttpClient &) = delete;
+
+    private:
+        std::mutex pool_lock;
+        std::vector<CURL *> pool;
+        CURLSH *share = nullptr;
+        std::mutex share_locks[CURL_LOCK_DATA_LAST];
+
+        HttpClient();
+        ~HttpClient();
+
+        CURL *acquire(void);
+        void release(CURL *curl);
+        void setup(CURL *curl, const std::string &url, const HttpOptions &opt, char *errbuf);
+        HttpResponse perform(const char *method, const std::string &url,
+                             const std::string *body, const HttpOptions &opt);
+        CURLcode perform_once(CURL *curl, const char *method, const std::string &url,
+                              const std::string *body, bool gzipped, const HttpOptions &opt,
+                              HttpResponse &resp);
+
+        static void lock_cb(CURL *, curl_lock_data data, curl_lock_access, void *userp);
+        static void unlock_cb(CURL *, curl_lock_data data, void *userp);
+};
+
+/* gzip (RFC 1952) compression of a request body */
+bool gzip_compress(const std::string &in, std::string &out);
+
+#endif
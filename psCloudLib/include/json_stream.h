@@ -0,0 +1,125 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <cctype>
+#include <string>
+#include "json.hpp"
+
+/**
+ * @brief Incremental parser for a top-level JSON array received in chunks.
+ * Each element is parsed as soon as it is complete, so only one element is
+ * buffered at a time. A body that is not an array (e.g. an error object) is
+ * buffered and parsed whole in finish().
+ */
+class JsonArrayStream {
+    public:
+        nlohmann::json items = nlohmann::json::array();
+        std::string error;
+
+        /* @return false if the stream is malformed, further data is ignored */
+        bool feed(const char *data, size_t n){
+            for (size_t i = 0; i < n && error.empty(); i++){
+                char c = data[i];
+                switch (state){
+                    case START:
+                        if (std::isspace((unsigned char)c)){
+                            break;
+                        }
+                        if (c == '['){
+                            state = IN_ARRAY;
+                            break;
+                        }
+                        state = RAW;
+                        raw.append(data + i, n - i);
+                        return true;
+                    case RAW:
+                        raw.append(data + i, n - i);
+                        return true;
+                    case IN_ARRAY:
+                        in_array(c);
+                        break;
+                    case DONE:
+                        if (!std::isspace((unsigned char)c)){
+                            error = "trailing data after array";
+                        }
+                        break;
+                }
+            }
+            return error.empty();
+        }
+
+        /* @return true when a complete document was parsed */
+        bool finish(void){
+            if (!error.empty()){
+                return false;
+            }
+            if (state == RAW){
+                try{
+                    items = nlohmann::json::parse(raw);
+                } catch (const nlohmann::json::parse_error &e){
+                    error = e.what();
+                    return false;
+                }
+                return true;
+            }
+            if (state != DONE){
+                error = state == START ? "empty body" : "truncated array";
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        enum {START, IN_ARRAY, DONE, RAW} state = START;
+        std::string elem;
+        std::string raw;
+        int depth = 0;
+        bool in_str = false;
+        bool esc = false;
+
+        void in_array(char c){
+            if (!in_str && depth == 0 && (c == ',' || c == ']')){
+                if (!elem.empty()){
+                    flush();
+                }
+                else if (c == ',' || items.size() != 0){
+                    error = "empty array element";
+                }
+                if (c == ']'){
+                    state = DONE;
+                }
+                return;
+            }
+            if (elem.empty() && std::isspace((unsigned char)c)){
+                return;
+            }
+            elem.push_back(c);
+            if (in_str){
+                if (esc)            esc = false;
+                else if (c == '\\') esc = true;
+                else if (c == '"')  in_str = false;
+            }
+            else if (c == '"'){
+                in_str = true;
+            }
+            else if (c == '{' || c == '['){
+                depth++;
+            }
+            else if (c == '}' || c == ']'){
+                if (--depth < 0){
+                    error = "unbalanced brackets";
+                }
+            }
+        }
+
+        void flush(void){
+            try{
+                items.push_back(nlohmann::json::parse(elem));
+            } catch (const nlohmann::json::parse_error &e){
+                error = e.what();
+            }
+            elem.clear();
+        }
+};
+
+#endif
@@ -5,12 +5,16 @@
 #include <string>
 #include <vector>
 #include <json.hpp>
+#include "json_stream.h"
 
 
 using json = nlohmann::json;
 
 #define GATE_SERVER_SETTINGS_PATH "C:/ProgramData/ParksolUSA/Parksol Gate Server/settings.cams"
 #define PARKCTAPI_PORT 8080
+#define GATE_FANOUT_PARALLEL     8      // gate controllers queried at once
+#define GATE_CONNECT_TIMEOUT_MS  3000
+#define GATE_REQUEST_TIMEOUT_MS  20000  // per gate, slow controllers don't hold the others
 
 class Gate {
 private:
@@ -94,6 +98,13 @@ public:
     }
 };
 
+/* One gate request of a fan-out, events are parsed while they arrive */
+struct GateFetch {
+    const Lot *lot;
+    const Gate *gate;
+    JsonArrayStream events;
+};
+
 std::vector <Lot> ReadLotsfromJSON(json lotsData);
 std::vector<Lot> read_lots_settings(const char * path);
 std::string get_datetime(void);
@@ -101,6 +112,8 @@ std::string get_datetime_utc(void);
 std::string get_date(void);
 // void get_lots_data(const char * gate_serv_settings_path, std::vector<Server> servers);
 json get_lots_data(std::vector<Lot> lots, std::string date);
+json parkctapi_get_lot_events_async(std::string date, const Lot &lot);
+int fetch_gate_events(std::vector<GateFetch> &gates, const std::string &date);
 json ReadGateServerSettings(std::string path);
 
 #endif // LOT_HPP
\ No newline at end of file
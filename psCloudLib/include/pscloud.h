@@ -7,6 +7,7 @@
 #include <vector>
 
 
+#define API_APP_ROUTE "/api"    // cloud app endpoint, appended to gatedataURL
 
 class Cloud {
     public:
@@ -27,7 +28,9 @@ class Cloud {
         }
 };
 
-// int get_missing_event_dates(const char *url, char *host, const char *facility, nlohmann::json resp);
+int get_missing_event_dates(const char *url, char *host, const char *facility, nlohmann::json& resp);
+int upload_lots_events(const char *url, char *host, const char *facility, nlohmann::json events,
+                       nlohmann::json& resp, bool gzip = false);
 int upload_function(const char *url, char *host, const char *facility, std::vector<Lot> lots);
 void upload_events_threaded(int timeout,bool *run,  const char *url, char *host, const char *facility, std::vector<Lot> lots);
 int send_outages_log(const char *url, char *host, const char *facility, const char *log_path, nlohmann::json& resp);
@@ -17,7 +17,7 @@ struct server_data_t {
 };
 
 json SendRequest(std::string date, std::string ip, int port, int gateId);
-json SendRequest(const char * url, json data);
+json SendRequest(const char * url, json data, bool gzip = false);
 json send_heartbeat(const char * url, char *host, const char *facility, const char* servertype, const char * boottime);
 
 json send_heartbeat_leds(const char *dest_url, server_data_t data, json disp_data);
@@ -0,0 +1,298 @@
+#include "detection_uploader.h"
+#include "http_client.h"
+#include "pscloud.h"
+#include "measure_time.h"
+#include "json.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static int64_t wall_ms(void){
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/* spool file name "<unix ms>-<seq>-<nevents>.json.gz", sorts oldest first */
+static std::string batch_name(int64_t ms, uint64_t seq, size_t n){
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%013lld-%06llu-%zu", (long long)ms, (unsigned long long)seq, n);
+    return std::string(buf) + DETUP_SPOOL_EXT;
+}
+
+static size_t batch_events(const std::string &name){
+    size_t end = name.size() - strlen(DETUP_SPOOL_EXT);
+    size_t dash = name.rfind('-', end);
+    if (dash == std::string::npos){
+        return 0;
+    }
+    return std::strtoull(name.c_str() + dash + 1, nullptr, 10);
+}
+
+DetectionUploader::DetectionUploader(const std::string &url, const std::string &host,
+                                     const std::string &facility, const std::string &spool_dir)
+    : url(url), host(host), facility(facility), spool_dir(spool_dir){
+    std::error_code ec;
+    fs::create_directories(spool_dir, ec);
+    if (ec){
+        std::cerr << "Detection spool " << spool_dir << ": " << ec.message() << std::endl;
+    }
+    nspooled = list_spool().size();
+    if (nspooled > 0){
+        std::cout << nspooled << " detection batches spooled from the last run\n";
+    }
+    queue.reserve(DETUP_BATCH_EVENTS);
+    sender = std::thread(&DetectionUploader::sender_loop, this);
+}
+
+DetectionUploader::~DetectionUploader(){
+    stop();
+}
+
+void DetectionUploader::push(std::vector<DetectionEvent> &&events){
+    if (events.empty()){
+        return;
+    }
+    size_t ndrop = 0;
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lk(qlock);
+        size_t room = DETUP_QUEUE_MAX - std::min(queue.size(), (size_t)DETUP_QUEUE_MAX);
+        size_t n = std::min(room, events.size());
+        ndrop = events.size() - n;
+        if (queue.empty() && n > 0){
+            first_ms = steady_ms();
+        }
+        queue.insert(queue.end(), std::make_move_iterator(events.begin()),
+                     std::make_move_iterator(events.begin() + n));
+        wake = queue.size() >= DETUP_BATCH_EVENTS;
+    }
+    if (ndrop > 0){
+        dropped += ndrop;
+    }
+    if (wake){
+        qcv.notify_one();
+    }
+}
+
+void DetectionUploader::stop(void){
+    if (!run.exchange(false)){
+        return;
+    }
+    qcv.notify_one();
+    if (sender.joinable()){
+        sender.join();
+    }
+}
+
+DetectionUploadStats DetectionUploader::get_stats(void){
+    DetectionUploadStats st;
+    {
+        std::lock_guard<std::mutex> lk(qlock);
+        st.queued = queue.size();
+    }
+    st.spooled = nspooled;
+    st.sent = sent;
+    st.dropped = dropped;
+    return st;
+}
+
+void DetectionUploader::sender_loop(void){
+#ifndef _WIN32
+    pthread_setname_np(pthread_self(), "det-uploader");
+#endif
+    uint64_t next_upload = 0;
+    while (true){
+        std::vector<std::vector<DetectionEvent>> batches;
+        bool running;
+        {
+            std::unique_lock<std::mutex> lk(qlock);
+            auto ready = [this]{
+                return queue.size() >= DETUP_BATCH_EVENTS ||
+                       (!queue.empty() && steady_ms() - first_ms >= DETUP_FLUSH_SEC * 1000);
+            };
+            qcv.wait_for(lk, std::chrono::seconds(1), [&]{ return !run || ready(); });
+            running = run;
+            // on stop everything left is spooled for the next run
+            while (!queue.empty() && (!running || ready())){
+                if (queue.size() <= DETUP_BATCH_EVENTS){
+                    batches.emplace_back();
+                    batches.back().swap(queue);
+                    queue.reserve(DETUP_BATCH_EVENTS);
+                }
+                else{
+                    auto end = queue.begin() + DETUP_BATCH_EVENTS;
+                    batches.emplace_back(std::make_move_iterator(queue.begin()), std::make_move_iterator(end));
+                    queue.erase(queue.begin(), end);
+                }
+                first_ms = steady_ms();
+            }
+        }
+
+        for (auto &b : batches){
+            if (!spool_batch(b)){
+                dropped += b.size();
+            }
+        }
+        if (!batches.empty()){
+            enforce_spool_limit();
+        }
+        if (!running){
+            break;
+        }
+        if (nspooled > 0 && steady_ms() >= next_upload){
+            if (upload_spool() < 0){
+                next_upload = steady_ms() + DETUP_RETRY_SEC * 1000;
+            }
+        }
+    }
+    if (nspooled > 0){
+        std::cout << nspooled << " detection batches left in " << spool_dir << std::endl;
+    }
+}
+
+bool DetectionUploader::spool_batch(std::vector<DetectionEvent> &batch){
+    std::string name = batch_name(wall_ms(), seq++, batch.size());
+
+    nlohmann::json rows = nlohmann::json::array();
+    for (const DetectionEvent &e : batch){
+        rows.push_back({e.cam, e.ts_ms, e.x1, e.y1, e.x2, e.y2, e.conf, e.plate, e.plate_conf});
+    }
+    nlohmann::json method;
+    method["command"] = "UPLOAD_DETECTIONS";
+    method["params"] = {facility, host};
+    method["batch"] = host + "/" + name.substr(0, name.size() - strlen(DETUP_SPOOL_EXT));
+    method["fields"] = {"cam", "ts", "x1", "y1", "x2", "y2", "conf", "plate", "plate_conf"};
+    method["events"] = std::move(rows);
+    nlohmann::json request;
+    request["method"] = std::move(method);
+
+    std::string packed;
+    if (!gzip_compress(request.dump(), packed)){
+        std::cerr << "Failed to compress detection batch\n";
+        return false;
+    }
+    // written under a temporary name so a crash never leaves a partial batch
+    fs::path dst = fs::path(spool_dir) / name;
+    fs::path tmp = dst;
+    tmp += ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+        f.write(packed.data(), packed.size());
+        if (!f){
+            std::cerr << "Failed to write " << tmp << std::endl;
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp, dst, ec);
+    if (ec){
+        std::cerr << "Failed to spool " << dst << ": " << ec.message() << std::endl;
+        fs::remove(tmp, ec);
+        return false;
+    }
+    nspooled++;
+    return true;
+}
+
+/**
+ * @brief Uploads spooled batches oldest first, a batch is deleted only after
+ * the cloud accepted it, so it is resent after a failure or restart
+ * @return number of batches sent, -1 when stopped by a failed upload
+ */
+int DetectionUploader::upload_spool(void){
+    std::string dest = url + API_APP_ROUTE;
+    HttpOptions opt;
+    opt.gzipped = true;
+
+    int nsent = 0;
+    std::vector<std::string> files = list_spool();
+    nspooled = files.size();
+    for (const std::string &name : files){
+        fs::path path = fs::path(spool_dir) / name;
+        std::ifstream f(path, std::ios::binary);
+        std::stringstream ss;
+        ss << f.rdbuf();
+        if (!f){
+            std::cerr << "Failed to read " << path << std::endl;
+            continue;
+        }
+
+        HttpResponse resp = HttpClient::instance().post_json(dest, ss.str(), opt);
+        size_t n = batch_events(name);
+        std::error_code ec;
+        if (resp.ok()){
+            sent += n;
+            nsent++;
+        }
+        else if (resp.status >= 400 && resp.status < 500 && resp.status != 408 && resp.status != 429){
+            // rejected, resending the same batch can not succeed
+            std::cerr << "Detection batch " << name << " rejected (" << resp.status << "), dropped\n";
+            dropped += n;
+        }
+        else{
+            return -1;
+        }
+        fs::remove(path, ec);
+        nspooled--;
+        if (!run){
+            break;
+        }
+        // a long backlog must not hold back spooling of new events
+        std::lock_guard<std::mutex> lk(qlock);
+        if (queue.size() >= DETUP_BATCH_EVENTS){
+            break;
+        }
+    }
+    return nsent;
+}
+
+/* drops the oldest batches while the spool is over DETUP_SPOOL_MAX_MB */
+void DetectionUploader::enforce_spool_limit(void){
+    std::vector<std::string> files = list_spool();
+    std::vector<uintmax_t> sizes(files.size());
+    uintmax_t total = 0;
+    std::error_code ec;
+    for (size_t i = 0; i < files.size(); i++){
+        sizes[i] = fs::file_size(fs::path(spool_dir) / files[i], ec);
+        total += ec ? 0 : sizes[i];
+    }
+    const uintmax_t limit = (uintmax_t)DETUP_SPOOL_MAX_MB * 1024 * 1024;
+    size_t ndel = 0;
+    for (size_t i = 0; i < files.size() && total > limit; i++){
+        if (fs::remove(fs::path(spool_dir) / files[i], ec)){
+            dropped += batch_events(files[i]);
+            total -= sizes[i];
+            ndel++;
+        }
+    }
+    if (ndel > 0){
+        std::cerr << "Detection spool full, " << ndel << " oldest batches dropped\n";
+    }
+    nspooled = files.size() - ndel;
+}
+
+std::vector<std::string> DetectionUploader::list_spool(void){
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (fs::directory_iterator it(spool_dir, ec), end; !ec && it != end; it.increment(ec)){
+        std::string name = it->path().filename().string();
+        const size_t ext = strlen(DETUP_SPOOL_EXT);
+        if (name.size() > ext && name.compare(name.size() - ext, ext, DETUP_SPOOL_EXT) == 0){
+            files.push_back(name);
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
@@ -0,0 +1,393 @@
+#include "event_journal.h"
+#include "pscloud.h"
+#include <iostream>
+#include <map>
+#include <set>
+
+
+EventJournal::EventJournal(const char *path){
+    if (sqlite3_open(path, &db) != SQLITE_OK){
+        std::cerr << "Error opening event journal: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        db = nullptr;
+        return;
+    }
+    sqlite3_busy_timeout(db, 5000);
+    const char *schema = R"(
+        PRAGMA journal_mode=WAL;
+        PRAGMA synchronous=NORMAL;
+        CREATE TABLE IF NOT EXISTS events (
+            gateid INTEGER NOT NULL,
+            ts TEXT NOT NULL,
+            date TEXT NOT NULL,
+            lot_id INTEGER NOT NULL,
+            lot_name TEXT NOT NULL,
+            gate_add INTEGER NOT NULL,
+            body TEXT NOT NULL,
+            uploaded INTEGER NOT NULL DEFAULT 0,
+            PRIMARY KEY (gateid, ts, body)
+        );
+        CREATE INDEX IF NOT EXISTS events_pending ON events (uploaded, date);
+        CREATE TABLE IF NOT EXISTS gate_days (
+            gateid INTEGER NOT NULL,
+            date TEXT NOT NULL,
+            last_ts TEXT NOT NULL DEFAULT '',
+            nevents INTEGER NOT NULL DEFAULT 0,
+            nskipped INTEGER NOT NULL DEFAULT 0,
+            closed INTEGER NOT NULL DEFAULT 0,
+            PRIMARY KEY (gateid, date)
+        );
+    )";
+    if (!exec(schema)){
+        sqlite3_close(db);
+        db = nullptr;
+    }
+}
+
+EventJournal::~EventJournal(){
+    if (db){
+        sqlite3_close(db);
+    }
+}
+
+bool EventJournal::exec(const char *sql){
+    char *err_msg = nullptr;
+    if (sqlite3_exec(db, sql, 0, 0, &err_msg) != SQLITE_OK){
+        std::cerr << "Event journal error: " << err_msg << std::endl;
+        sqlite3_free(err_msg);
+        return false;
+    }
+    return true;
+}
+
+bool EventJournal::gate_day_closed(int gateid, const std::string &date){
+    sqlite3_stmt *stmt;
+    bool closed = false;
+    if (sqlite3_prepare_v2(db, "SELECT closed FROM gate_days WHERE gateid = ? AND date = ?;", -1, &stmt, nullptr) != SQLITE_OK){
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, gateid);
+    sqlite3_bind_text(stmt, 2, date.c_str(), -1, SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) == SQLITE_ROW){
+        closed = sqlite3_column_int(stmt, 0) != 0;
+    }
+    sqlite3_finalize(stmt);
+    return closed;
+}
+
+bool EventJournal::open_gate_days(const std::vector<int> &gateids, const std::string &date){
+    sqlite3_stmt *stmt;
+    if (!db || sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO gate_days (gateid, date) VALUES (?, ?);", -1, &stmt, nullptr) != SQLITE_OK){
+        return false;
+    }
+    if (!exec("BEGIN;")){
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    bool ok = true;
+    for (int gateid : gateids){
+        sqlite3_bind_int(stmt, 1, gateid);
+        sqlite3_bind_text(stmt, 2, date.c_str(), -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) != SQLITE_DONE){
+            std::cerr << "Error opening gate-day " << gateid << " " << date << ": " << sqlite3_errmsg(db) << std::endl;
+            ok = false;
+            break;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    if (!ok || !exec("COMMIT;")){
+        exec("ROLLBACK;");
+        return false;
+    }
+    return true;
+}
+
+int EventJournal::add_events(const Lot &lot, const Gate &gate, const std::string &date,
+                             const nlohmann::json &events, bool closed){
+    if (!db || !events.is_array()){
+        return -1;
+    }
+    const char *insert_sql = R"(
+        INSERT OR IGNORE INTO events (gateid, ts, date, lot_id, lot_name, gate_add, body)
+        VALUES (?, ?, ?, ?, ?, ?, ?);
+    )";
+    const char *mark_sql = R"(
+        INSERT INTO gate_days (gateid, date, last_ts, nevents, nskipped, closed) VALUES (?, ?, ?, ?, ?, ?)
+        ON CONFLICT (gateid, date) DO UPDATE SET
+            last_ts = MAX(last_ts, excluded.last_ts),
+            nevents = nevents + excluded.nevents,
+            nskipped = nskipped + excluded.nskipped,
+            closed = MAX(closed, excluded.closed);
+    )";
+    sqlite3_stmt *ins = nullptr, *mark = nullptr;
+    if (sqlite3_prepare_v2(db, insert_sql, -1, &ins, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, mark_sql, -1, &mark, nullptr) != SQLITE_OK){
+        std::cerr << "Error preparing journal statements: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_finalize(ins);
+        sqlite3_finalize(mark);
+        return -1;
+    }
+    if (!exec("BEGIN;")){
+        sqlite3_finalize(ins);
+        sqlite3_finalize(mark);
+        return -1;
+    }
+    int nnew = 0;
+    int nskipped = 0;
+    std::string skipped;
+    bool ok = true;
+    std::string last_ts;
+    for (const auto &ev : events){
+        if (!ev.is_object() || !ev.contains("eventTS") || !ev["eventTS"].is_string()){
+            if (nskipped++ == 0){
+                skipped = ev.dump().substr(0, 200);
+            }
+            continue;
+        }
+        std::string ts = ev["eventTS"];
+        std::string body = ev.dump();
+        sqlite3_bind_int(ins, 1, gate.gateid);
+        sqlite3_bind_text(ins, 2, ts.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(ins, 3, date.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(ins, 4, lot.id);
+        sqlite3_bind_text(ins, 5, lot.name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(ins, 6, gate.add);
+        sqlite3_bind_text(ins, 7, body.c_str(), -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(ins) != SQLITE_DONE){
+            std::cerr << "Error journaling event: " << sqlite3_errmsg(db) << std::endl;
+            ok = false;
+            break;
+        }
+        nnew += sqlite3_changes(db);
+        sqlite3_reset(ins);
+        if (ts > last_ts){
+            last_ts = ts;
+        }
+    }
+    sqlite3_bind_int(mark, 1, gate.gateid);
+    sqlite3_bind_text(mark, 2, date.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(mark, 3, last_ts.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(mark, 4, nnew);
+    sqlite3_bind_int(mark, 5, nskipped);
+    sqlite3_bind_int(mark, 6, closed ? 1 : 0);
+    if (ok && sqlite3_step(mark) != SQLITE_DONE){
+        std::cerr << "Error updating gate-day: " << sqlite3_errmsg(db) << std::endl;
+        ok = false;
+    }
+    sqlite3_finalize(ins);
+    sqlite3_finalize(mark);
+    if (!ok || !exec("COMMIT;")){
+        exec("ROLLBACK;");
+        return -1;
+    }
+    if (nskipped > 0){
+        std::cerr << "Gate " << gate.gateid << " " << date << ": " << nskipped
+                  << " events without eventTS skipped, first: " << skipped << std::endl;
+    }
+    return nnew;
+}
+
+bool EventJournal::next_chunk(int limit, Chunk &chunk){
+    chunk.rowids.clear();
+    chunk.payload = nlohmann::json();
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT date FROM events WHERE uploaded = 0 ORDER BY date LIMIT 1;", -1, &stmt, nullptr) != SQLITE_OK){
+        return false;
+    }
+    bool found = sqlite3_step(stmt) == SQLITE_ROW;
+    if (found){
+        chunk.date = (const char *)sqlite3_column_text(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    if (!found){
+        return false;
+    }
+
+    const char *select_sql = R"(
+        SELECT rowid, lot_id, lot_name, gate_add, body FROM events
+        WHERE uploaded = 0 AND date = ? ORDER BY rowid LIMIT ?;
+    )";
+    if (sqlite3_prepare_v2(db, select_sql, -1, &stmt, nullptr) != SQLITE_OK){
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, chunk.date.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 2, limit);
+    std::map<int, nlohmann::json> lots;
+    while (sqlite3_step(stmt) == SQLITE_ROW){
+        int lot_id = sqlite3_column_int(stmt, 1);
+        nlohmann::json &jlot = lots[lot_id];
+        if (jlot.is_null()){
+            jlot["name"] = (const char *)sqlite3_column_text(stmt, 2);
+            jlot["id"] = lot_id;
+            jlot["in"] = nlohmann::json::array();
+            jlot["out"] = nlohmann::json::array();
+        }
+        nlohmann::json ev = nlohmann::json::parse((const char *)sqlite3_column_text(stmt, 4), nullptr, false);
+        if (!ev.is_discarded()){
+            jlot[sqlite3_column_int(stmt, 3) == 1 ? "in" : "out"].push_back(ev);
+        }
+        chunk.rowids.push_back(sqlite3_column_int64(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+
+    chunk.payload["date"] = chunk.date;
+    chunk.payload["lots"] = nlohmann::json::array();
+    for (auto &l : lots){
+        chunk.payload["lots"].push_back(l.second);
+    }
+    return !chunk.rowids.empty();
+}
+
+int EventJournal::ack(const std::vector<int64_t> &rowids){
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "UPDATE events SET uploaded = 1 WHERE rowid = ?;", -1, &stmt, nullptr) != SQLITE_OK){
+        return 0;
+    }
+    if (!exec("BEGIN;")){
+        sqlite3_finalize(stmt);
+        return 0;
+    }
+    bool ok = true;
+    for (auto id : rowids){
+        sqlite3_bind_int64(stmt, 1, id);
+        if (sqlite3_step(stmt) != SQLITE_DONE){
+            std::cerr << "Error acking journaled event: " << sqlite3_errmsg(db) << std::endl;
+            ok = false;
+            break;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    if (!ok || !exec("COMMIT;")){
+        exec("ROLLBACK;");
+        return 0;
+    }
+    return rowids.size();
+}
+
+int EventJournal::reopen_date(const std::string &date){
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "UPDATE events SET uploaded = 0 WHERE uploaded = 1 AND date = ?;", -1, &stmt, nullptr) != SQLITE_OK){
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, date.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return sqlite3_changes(db);
+}
+
+int64_t EventJournal::pending(void){
+    sqlite3_stmt *stmt;
+    int64_t n = 0;
+    if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM events WHERE uploaded = 0;", -1, &stmt, nullptr) != SQLITE_OK){
+        return 0;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW){
+        n = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return n;
+}
+
+std::vector<std::string> EventJournal::open_dates(void){
+    std::vector<std::string> dates;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT DISTINCT date FROM gate_days WHERE closed = 0;", -1, &stmt, nullptr) != SQLITE_OK){
+        return dates;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW){
+        dates.push_back((const char *)sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    return dates;
+}
+
+int EventJournal::prune(int keep_days){
+    // dates are local (get_date), so is the cutoff
+    std::string cutoff = "date('now', 'localtime', '-" + std::to_string(keep_days) + " days')";
+    std::string sql = "DELETE FROM events WHERE uploaded = 1 AND date < " + cutoff + ";"
+                      "DELETE FROM gate_days WHERE date < " + cutoff + ";";
+    return exec(sql.c_str());
+}
+
+
+int sync_events(EventJournal &journal, const char *url, char *host, const char *facility,
+                const std::vector<Lot> &lots, bool *run){
+    if (!journal.is_open()){
+        return -1;
+    }
+    std::string today = get_date();
+    std::set<std::string> dates = {today};
+    /* days that ended since their last fetch are fetched once more and closed */
+    for (const auto &d : journal.open_dates()){
+        dates.insert(d);
+    }
+    nlohmann::json missing;
+    if (get_missing_event_dates(url, host, facility, missing) == 1 && missing.is_array()){
+        for (const auto &d : missing){
+            if (!d.is_string()){
+                continue;
+            }
+            std::string date = d.get<std::string>();
+            dates.insert(date);
+            int n = journal.reopen_date(date);
+            if (n > 0){
+                std::cout << "Cloud is missing " << date << ", re-sending " << n << " journaled events\n";
+            }
+        }
+    }
+
+    /* gate controllers are asked only for gate-days that are still open */
+    for (const auto &date : dates){
+        std::vector<int> gateids;
+        for (const auto &lot : lots){
+            if (lot.cloudenabled != -1){
+                continue;
+            }
+            for (const auto &gate : lot.gates){
+                gateids.push_back(gate.gateid);
+            }
+        }
+        /* a gate that never answers keeps the date open for all gates */
+        journal.open_gate_days(gateids, date);
+        std::vector<GateFetch> gates;
+        for (const auto &lot : lots){
+            if (lot.cloudenabled != -1){
+                continue;
+            }
+            for (const auto &gate : lot.gates){
+                if (!journal.gate_day_closed(gate.gateid, date)){
+                    gates.push_back(GateFetch{&lot, &gate, JsonArrayStream()});
+                }
+            }
+        }
+        if (gates.empty()){
+            continue;
+        }
+        fetch_gate_events(gates, date);
+        int nnew = 0;
+        for (auto &g : gates){
+            if (g.events.error.empty()){
+                int n = journal.add_events(*g.lot, *g.gate, date, g.events.items, date < today);
+                nnew += n > 0 ? n : 0;
+            }
+        }
+        std::cout << date << ": " << nnew << " new events from " << gates.size() << " open gate-days\n";
+    }
+
+    int nacked = 0;
+    EventJournal::Chunk chunk;
+    while (*run && journal.next_chunk(EVENT_UPLOAD_CHUNK, chunk)){
+        nlohmann::json resp;
+        int ok = upload_lots_events(url, host, facility, chunk.payload, resp, EVENT_UPLOAD_GZIP);
+        if (ok != 1 || (resp.is_object() && resp.contains("error"))){
+            std::cout << "Upload of " << chunk.rowids.size() << " events for " << chunk.date
+                      << " not accepted, " << journal.pending() << " events stay pending\n";
+            break;
+        }
+        nacked += journal.ack(chunk.rowids);
+    }
+    journal.prune(EVENT_JOURNAL_KEEP_DAYS);
+    return nacked;
+}
@@ -0,0 +1,311 @@
+#include "http_client.h"
+#include <zlib.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+
+
+static size_t write_cb(void *contents, size_t size, size_t nmemb, void *userp){
+    ((std::string *)userp)->append((char *)contents, size * nmemb);
+    return size * nmemb;
+}
+
+bool gzip_compress(const std::string &in, std::string &out){
+    z_stream zs{};
+    // 15 window bits + 16 selects the gzip wrapper instead of zlib
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK){
+        return false;
+    }
+    out.resize(deflateBound(&zs, in.size()) + 32);
+    zs.next_in = (Bytef *)in.data();
+    zs.avail_in = in.size();
+    zs.next_out = (Bytef *)&out[0];
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+void HttpClient::lock_cb(CURL *, curl_lock_data data, curl_lock_access, void *userp){
+    ((HttpClient *)userp)->share_locks[data].lock();
+}
+
+void HttpClient::unlock_cb(CURL *, curl_lock_data data, void *userp){
+    ((HttpClient *)userp)->share_locks[data].unlock();
+}
+
+HttpClient &HttpClient::instance(void){
+    static HttpClient client;
+    return client;
+}
+
+HttpClient::HttpClient(){
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    share = curl_share_init();
+    if (share){
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock_cb);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock_cb);
+        curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    }
+}
+
+HttpClient::~HttpClient(){
+    for (auto curl:pool){
+        curl_easy_cleanup(curl);
+    }
+    pool.clear();
+    if (share){
+        curl_share_cleanup(share);
+    }
+    curl_global_cleanup();
+}
+
+CURL *HttpClient::acquire(void){
+    {
+        std::lock_guard<std::mutex> lock(pool_lock);
+        if (!pool.empty()){
+            CURL *curl = pool.back();
+            pool.pop_back();
+            // reset keeps the live connections, DNS and TLS session caches
+            curl_easy_reset(curl);
+            return curl;
+        }
+    }
+    return curl_easy_init();
+}
+
+void HttpClient::release(CURL *curl){
+    std::lock_guard<std::mutex> lock(pool_lock);
+    if (pool.size() < HTTP_POOL_SIZE){
+        pool.push_back(curl);
+        return;
+    }
+    curl_easy_cleanup(curl);
+}
+
+/* options common to every transfer */
+void HttpClient::setup(CURL *curl, const std::string &url, const HttpOptions &opt, char *errbuf){
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, opt.connect_timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, opt.timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, (long)HTTP_KEEPALIVE_IDLE_S);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, (long)HTTP_KEEPALIVE_IDLE_S);
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");  // any encoding curl can decode
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
+    if (share){
+        curl_easy_setopt(curl, CURLOPT_SHARE, share);
+    }
+}
+
+CURLcode HttpClient::perform_once(CURL *curl, const char *method, const std::string &url,
+                                  const std::string *body, bool gzipped, const HttpOptions &opt,
+                                  HttpResponse &resp){
+    char errbuf[CURL_ERROR_SIZE] = {0};
+    struct curl_slist *headers = NULL;
+    resp.body.clear();
+    resp.status = 0;
+
+    setup(curl, url, opt, errbuf);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &resp.body);
+
+    if (body != nullptr){
+        headers = curl_slist_append(headers, "Content-Type: application/json");
+        if (gzipped){
+            headers = curl_slist_append(headers, "Content-Encoding: gzip");
+        }
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->data());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)body->size());
+    }
+    else if (strcmp(method, "GET") != 0){
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+    }
+    // no 100-continue round trip on large posts
+    headers = curl_slist_append(headers, "Expect:");
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+    CURLcode res = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &resp.status);
+    long request_size = 0;
+    curl_easy_getinfo(curl, CURLINFO_REQUEST_SIZE, &request_size);
+    resp.sent = request_size > 0;
+    if (res != CURLE_OK){
+        resp.error = errbuf[0] ? errbuf : curl_easy_strerror(res);
+    }
+    else if (resp.status < 200 || resp.status >= 300){
+        resp.error = "HTTP " + std::to_string(resp.status);
+    }
+    else{
+        resp.error.clear();
+    }
+    // header list and error buffer live for this transfer only, the handle goes back to the pool
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, NULL);
+    curl_slist_free_all(headers);
+    return res;
+}
+
+static bool should_retry(const char *method, const HttpResponse &resp, const HttpOptions &opt){
+    if (resp.ok()){
+        return false;
+    }
+    // resolve or connect failures, nothing reached the server
+    if (resp.code != CURLE_OK && !resp.sent){
+        return true;
+    }
+    // a timed out or failed POST may still have been applied
+    if (strcmp(method, "GET") != 0 && !opt.idempotent){
+        return false;
+    }
+    if (resp.code != CURLE_OK){
+        return true;
+    }
+    return resp.status == 429 || resp.status >= 500;
+}
+
+HttpResponse HttpClient::perform(const char *method, const std::string &url,
+                                 const std::string *body, const HttpOptions &opt){
+    HttpResponse resp;
+    std::string packed;
+    bool gzipped = body != nullptr && opt.gzipped;
+    if (body != nullptr && !gzipped && opt.gzip && body->size() >= HTTP_GZIP_MIN_BYTES){
+        if (gzip_compress(*body, packed)){
+            body = &packed;
+            gzipped = true;
+        }
+    }
+
+    CURL *curl = acquire();
+    if (curl == nullptr){
+        resp.code = CURLE_FAILED_INIT;
+        resp.error = "Failed to initialize CURL";
+        std::cerr << resp.error << std::endl;
+        return resp;
+    }
+
+    static thread_local std::minstd_rand rng(std::random_device{}());
+    long backoff_ms = HTTP_BACKOFF_MS;
+    for (int attempt = 0; attempt <= opt.retries; attempt++){
+        resp.attempts = attempt + 1;
+        resp.code = perform_once(curl, method, url, body, gzipped, opt, resp);
+        if (!should_retry(method, resp, opt) || attempt == opt.retries){
+            break;
+        }
+        // jitter keeps many servers from retrying in lockstep
+        long delay = backoff_ms / 2 + (long)(rng() % (backoff_ms / 2 + 1));
+        std::cerr << method << " " << url << " failed (" << resp.error << "), retry in "
+                  << delay << " ms\n";
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+        backoff_ms = std::min(backoff_ms * 2, (long)HTTP_BACKOFF_MAX_MS);
+    }
+    if (!resp.ok()){
+        std::cerr << method << " " << url << " failed after " << resp.attempts
+                  << " attempts: " << resp.error << std::endl;
+    }
+    release(curl);
+    return resp;
+}
+
+HttpResponse HttpClient::get(const std::string &url, const HttpOptions &opt){
+    return perform("GET", url, nullptr, opt);
+}
+
+HttpResponse HttpClient::post_json(const std::string &url, const std::string &body, const HttpOptions &opt){
+    return perform("POST", url, &body, opt);
+}
+
+static size_t fetch_cb(void *contents, size_t size, size_t nmemb, void *userp){
+    HttpFetch *f = (HttpFetch *)userp;
+    size_t n = size * nmemb;
+    if (!f->on_data){
+        f->resp.body.append((char *)contents, n);
+        return n;
+    }
+    // returning less than n makes curl abort with CURLE_WRITE_ERROR
+    return f->on_data((const char *)contents, n) ? n : 0;
+}
+
+int HttpClient::fetch_all(std::vector<HttpFetch> &reqs, int max_parallel, const HttpOptions &opt){
+    CURLM *multi = curl_multi_init();
+    if (multi == nullptr){
+        std::cerr << "Failed to initialize CURL multi" << std::endl;
+        return 0;
+    }
+    std::vector<std::array<char, CURL_ERROR_SIZE>> errbufs(reqs.size());
+    std::deque<size_t> pending;
+    for (size_t i = 0; i < reqs.size(); i++){
+        reqs[i].resp = HttpResponse();
+        pending.push_back(i);
+    }
+    int active = 0;
+    int nok = 0;
+    while (!pending.empty() || active > 0){
+        while (active < max_parallel && !pending.empty()){
+            size_t i = pending.front();
+            pending.pop_front();
+            CURL *curl = acquire();
+            if (curl == nullptr){
+                reqs[i].resp.code = CURLE_FAILED_INIT;
+                reqs[i].resp.error = "Failed to initialize CURL";
+                continue;
+            }
+            errbufs[i][0] = 0;
+            setup(curl, reqs[i].url, opt, errbufs[i].data());
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, fetch_cb);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &reqs[i]);
+            curl_easy_setopt(curl, CURLOPT_PRIVATE, (void *)&reqs[i]);
+            reqs[i].resp.attempts = 1;
+            curl_multi_add_handle(multi, curl);
+            active++;
+        }
+
+        int running = 0;
+        curl_multi_perform(multi, &running);
+        CURLMsg *msg;
+        int left = 0;
+        while ((msg = curl_multi_info_read(multi, &left)) != nullptr){
+            if (msg->msg != CURLMSG_DONE){
+                continue;
+            }
+            CURL *curl = msg->easy_handle;
+            HttpFetch *f = nullptr;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&f);
+            size_t i = f - reqs.data();
+            f->resp.code = msg->data.result;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &f->resp.status);
+            if (f->resp.code != CURLE_OK){
+                f->resp.error = errbufs[i][0] ? errbufs[i].data() : curl_easy_strerror(f->resp.code);
+            }
+            else if (!f->resp.ok()){
+                f->resp.error = "HTTP " + std::to_string(f->resp.status);
+            }
+            else{
+                nok++;
+            }
+            if (!f->resp.ok()){
+                std::cerr << "GET " << f->url << " failed: " << f->resp.error << std::endl;
+            }
+            curl_multi_remove_handle(multi, curl);
+            curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, NULL);
+            release(curl);
+            active--;
+        }
+        if (active > 0){
+            curl_multi_poll(multi, nullptr, 0, 100, nullptr);
+        }
+    }
+    curl_multi_cleanup(multi);
+    return nok;
+}
@@ -1,5 +1,6 @@
 #include "lot.h"
 #include "requests.h"
+#include "http_client.h"
 #include "date/date.h"
 #include "date/tz.h"
 #include <fstream>
@@ -106,11 +107,63 @@ std::string getServerIp(std::vector<Server> servers, int sourceId){
 //     }
 // }
 
+static std::string gate_events_url(const Gate &gate, const std::string &date){
+    return "http://" + std::string(gate.ipaddr) + ":" + std::to_string(PARKCTAPI_PORT) +
+           "/events?date=" + date + "&gateId=" + std::to_string(gate.gateid);
+}
+
+/**
+ * @brief Requests events of all gates concurrently
+ * @param gates filled with lot/gate pointers, parsed events per gate on return
+ * @return number of gates whose events were received complete
+ */
+int fetch_gate_events(std::vector<GateFetch> &gates, const std::string &date){
+    std::vector<HttpFetch> reqs(gates.size());
+    for (size_t i = 0; i < gates.size(); i++){
+        JsonArrayStream *stream = &gates[i].events;
+        reqs[i].url = gate_events_url(*gates[i].gate, date);
+        reqs[i].on_data = [stream](const char *data, size_t n){ return stream->feed(data, n); };
+    }
+    HttpOptions opt;
+    opt.connect_timeout_ms = GATE_CONNECT_TIMEOUT_MS;
+    opt.timeout_ms = GATE_REQUEST_TIMEOUT_MS;
+    HttpClient::instance().fetch_all(reqs, GATE_FANOUT_PARALLEL, opt);
+
+    int nok = 0;
+    for (size_t i = 0; i < gates.size(); i++){
+        JsonArrayStream &ev = gates[i].events;
+        if (!reqs[i].resp.ok()){
+            ev.error = reqs[i].resp.error;
+        }
+        else if (ev.finish() && !ev.items.is_array()){
+            ev.error = "response is not an array";
+        }
+        if (!ev.error.empty()){
+            std::cerr << "Gate " << gates[i].gate->gateid << " (" << gates[i].gate->ipaddr
+                      << "): " << ev.error << std::endl;
+            continue;
+        }
+        nok++;
+    }
+    return nok;
+}
+
 json get_lots_data(std::vector<Lot> lots, std::string date){
     json ret;
     ret["date"] = date;
     ret["lots"] = json::array();
-    
+
+    std::vector<GateFetch> gates;
+    for (const auto& lot : lots){
+        if (lot.cloudenabled == -1){
+            for (const auto& gate : lot.gates){
+                gates.push_back(GateFetch{&lot, &gate, JsonArrayStream()});
+            }
+        }
+    }
+    int nok = fetch_gate_events(gates, date);
+    std::cout << date << ": events received from " << nok << "/" << gates.size() << " gates\n";
+
     for (const auto& lot : lots){
         if (lot.cloudenabled == -1){
             json jlot;
@@ -118,20 +171,27 @@ json get_lots_data(std::vector<Lot> lots, std::string date){
             jlot["id"] = lot.id;
             jlot["in"] = json::array();
             jlot["out"] = json::array();
-            for (auto& gate : lot.gates){
-                std::string ipaddr = gate.ipaddr;
-                json gateData;
-                //std::string date = get_date();
-                gateData = SendRequest(date, ipaddr, PARKCTAPI_PORT, gate.gateid);
-
-                if (!gateData.empty() && gateData.is_array()){
-                    if (gate.add == 1) {
-                        jlot["in"].insert(jlot["in"].end(), gateData.begin(), gateData.end());
-
-                    } else if (gate.add == 0) {
-                        jlot["out"].insert(jlot["out"].end(), gateData.begin(), gateData.end());
-                    }
+            bool complete = true;
+            for (auto& g : gates){
+                if (g.lot != &lot){
+                    continue;
+                }
+                if (!g.events.error.empty()){
+                    complete = false;
+                    continue;
                 }
+                json &gateData = g.events.items;
+                if (g.gate->add == 1) {
+                    jlot["in"].insert(jlot["in"].end(), gateData.begin(), gateData.end());
+                } else if (g.gate->add == 0) {
+                    jlot["out"].insert(jlot["out"].end(), gateData.begin(), gateData.end());
+                }
+            }
+            /* a partial lot would be stored as the whole day, the date stays
+               missing in the cloud and is requested again next cycle */
+            if (!complete){
+                std::cout << "Lot " << lot.name << " skipped for " << date << ", not all gates answered\n";
+                continue;
             }
             if (jlot["in"].size() != 0 && jlot["out"] != 0){
                 ret["lots"].push_back(jlot);
@@ -144,11 +204,21 @@ json get_lots_data(std::vector<Lot> lots, std::string date){
     return ret;
 }
 
-void parkctapi_get_lot_events_async(std::string date, Lot lot){
-    json events;
-    std::thread th;
+/**
+ * @brief Requests events of all gates of the lot concurrently
+ * @return events of all gates that answered, in gate order
+ */
+json parkctapi_get_lot_events_async(std::string date, const Lot &lot){
+    json events = json::array();
+    std::vector<GateFetch> gates;
     for (const auto & gate:lot.gates){
-        events = SendRequest(date, gate.ipaddr, PARKCTAPI_PORT, gate.gateid);
+        gates.push_back(GateFetch{&lot, &gate, JsonArrayStream()});
     }
-    std::cout << events.dump(4) << std::endl;
-}
\ No newline at end of file
+    fetch_gate_events(gates, date);
+    for (auto & g:gates){
+        if (g.events.error.empty()){
+            events.insert(events.end(), g.events.items.begin(), g.events.items.end());
+        }
+    }
+    return events;
+}
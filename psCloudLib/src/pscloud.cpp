@@ -2,16 +2,16 @@
 #include "requests.h"
 #include "lot.h"
 #include "logs.h"
+#include "event_journal.h"
 #include <string>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <thread>
 #include <chrono>
-
-
-#define API_APP_ROUTE "/api"
-
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 
 
@@ -40,7 +40,7 @@ int get_missing_event_dates(const char *url, char *host, const char *facility, n
     }
 }
 
-int upload_lots_events(const char *url, char *host, const char *facility, nlohmann::json events, nlohmann::json& resp){
+int upload_lots_events(const char *url, char *host, const char *facility, nlohmann::json events, nlohmann::json& resp, bool gzip){
     nlohmann::json request, response;
     json method;
     std::string dest = url;
@@ -51,7 +51,7 @@ int upload_lots_events(const char *url, char *host, const char *facility, nlohma
     method["events"] = events;
     request["method"] = method;
     std::cout << dest << " UPLOAD_EVENTS\n";
-    response = SendRequest(dest.c_str(), request);
+    response = SendRequest(dest.c_str(), request, gzip);
     if (response != NULL){
         //std::cout<< response.dump() << std::endl;
         resp = response["resp"];
@@ -64,33 +64,18 @@ int upload_lots_events(const char *url, char *host, const char *facility, nlohma
 }
 
 void upload_events_threaded(int timeout, bool *run, const char *url, char *host, const char *facility, std::vector<Lot> lots){
-    nlohmann::json dates;
-    nlohmann:: json lotsdata;
-    nlohmann::json response;
+#ifndef _WIN32
+    pthread_setname_np(pthread_self(), "upload-events");
+#endif
     int tick = timeout * 10;
-    int success;
+    EventJournal journal(EVENT_JOURNAL_PATH);
 
     while (*run){
         if (tick >= timeout*10){
-            dates = nlohmann::json();
-            //dates.clear();
-            lotsdata = nlohmann::json();
-            //lotsdata.clear();
-            response = nlohmann::json();
-            //response.clear();
-            success = 0;
-            //Check if need to update:
-            success = get_missing_event_dates(url, host, facility, dates);
-            if (dates.is_array() && dates.size() != 0){
-                for(size_t i=0; i < dates.size(); i++ ){
-                    std::cout << "Date: " << dates[i] << std::endl;
-                    lotsdata = get_lots_data(lots, dates[i]);
-                    if (!lotsdata.empty()){
-                        success = upload_lots_events(url, host, facility, lotsdata, response);
-                    }
-                }
+            int nacked = sync_events(journal, url, host, facility, lots, run);
+            if (nacked > 0){
+                std::cout << nacked << " events uploaded\n";
             }
-
             tick = 0;
         }
         tick ++;
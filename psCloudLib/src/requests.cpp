@@ -1,5 +1,5 @@
 #include "requests.h"
-#include <curl/curl.h>
+#include "http_client.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -9,12 +9,6 @@
 
 using json = nlohmann::json;
 
-// Callback function to handle the response data
-size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-    ((std::string*)userp)->append((char*)contents, size * nmemb);
-    return size * nmemb;
-}
-
 static std::string get_datetime(void){
     time_t now;
     time(&now);
@@ -36,148 +30,40 @@ static std::string get_datetime_utc(void){
 }
 
 json SendRequest(std::string date, std::string ip, int port, int gateId){
-    // Initialize CURL
-    CURL* curl;
-    CURLcode res;
-    std::string readBuffer;
     json RetData;
-    json error = {{"error", "Failed to initialize CURL"}};
-
-    curl = curl_easy_init();
-    if (!curl) {
-        std::cerr << "Failed to initialize CURL" << std::endl;
-        return error;
-    }
-    
     std::string url = "http://" + ip + ":"+ std::to_string(port) + "/events?date=" + date + "&gateId=" + std::to_string(gateId); 
     std::cout << "Sending Request to: " << url << std::endl;
 
-    // Set the URL for the GET request
-    res = curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    if (res != CURLE_OK) {
-        std::cerr << "curl_easy_setopt(CURLOPT_URL) failed: " << curl_easy_strerror(res) << std::endl;
-        curl_easy_cleanup(curl);
-        return error;
-    }
-    // Set the callback function to handle the response data
-    res = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    if (res != CURLE_OK) {
-        std::cerr << "curl_easy_setopt(CURLOPT_WRITEFUNCTION) failed: " << curl_easy_strerror(res) << std::endl;
-        curl_easy_cleanup(curl);
-        return error;
-    }
-
-    res = curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-    if (res != CURLE_OK) {
-        std::cerr << "curl_easy_setopt(CURLOPT_WRITEDATA) failed: " << curl_easy_strerror(res) << std::endl;
-        curl_easy_cleanup(curl);
-        return error;
+    HttpResponse resp = HttpClient::instance().get(url);
+    if (!resp.ok()) {
+        return RetData;
     }
-
-    // Perform the request
-    res = curl_easy_perform(curl);
-
-
-    // Check for errors and return
-    if (res != CURLE_OK) {
-        std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(res) << std::endl;
-        json empty;
-        curl_easy_cleanup(curl);
-        return empty;
-    } else {
-        // Parse the response data as JSON
-        try {
-            json jsonData = json::parse(readBuffer);
-            RetData = jsonData;
-            // std::cout << jsonData.dump(4) << std::endl;
-        } catch (const json::parse_error& e) {
-            std::cerr << "JSON parse error: " << e.what() << std::endl;
-        }
+    // Parse the response data as JSON
+    try {
+        RetData = json::parse(resp.body);
+    } catch (const json::parse_error& e) {
+        std::cerr << "JSON parse error: " << e.what() << std::endl;
     }
-    // Clean up curl
-    curl_easy_cleanup(curl);
     return RetData;
 }
 
 
-json SendRequest(const char * url, json data){
-    // Initialize CURL
-    CURL* curl;
-    CURLcode res;
-    std::string readBuffer;
+json SendRequest(const char * url, json data, bool gzip){
     json RetData;
-    json error = {{"error", "Failed to initialize CURL"}};
-
-    curl = curl_easy_init();
-    if (!curl) {
-        std::cerr << "Failed to initialize CURL" << std::endl;
-        return error;
-    }
-
     // std::cout << "Sending Request to: " << url << std::endl;
 
-    std::string jsonData = data.dump();
-
-    res = curl_easy_setopt(curl, CURLOPT_URL, url);
-    if (res != CURLE_OK) {
-        std::cerr << "curl_easy_setopt(CURLOPT_URL) failed: " << curl_easy_strerror(res) << std::endl;
-        curl_easy_cleanup(curl);
-        return error;
-    }
-
-    // Set the POST data
-    res = curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonData.c_str());
-    if (res != CURLE_OK) {
-        std::cerr << "curl_easy_setopt(CURLOPT_POSTFIELDS) failed: " << curl_easy_strerror(res) << std::endl;
-        curl_easy_cleanup(curl);
-        return error;
-    }
-
-    // Set the Content-Type header to application/json
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    res = curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    if (res != CURLE_OK) {
-        std::cerr << "curl_easy_setopt(CURLOPT_HTTPHEADER) failed: " << curl_easy_strerror(res) << std::endl;
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
-        return error;
-    }
-
-    // Set the callback function to handle the response data
-    res = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    if (res != CURLE_OK) {
-        std::cerr << "curl_easy_setopt(CURLOPT_WRITEFUNCTION) failed: " << curl_easy_strerror(res) << std::endl;
-        curl_easy_cleanup(curl);
-        return error;
+    HttpOptions opt;
+    opt.gzip = gzip;
+    HttpResponse resp = HttpClient::instance().post_json(url, data.dump(), opt);
+    if (resp.code != CURLE_OK) {
+        return RetData;
     }
-
-    res = curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-    if (res != CURLE_OK) {
-        std::cerr << "curl_easy_setopt(CURLOPT_WRITEDATA) failed: " << curl_easy_strerror(res) << std::endl;
-        curl_easy_cleanup(curl);
-        return error;
-    }
-
-    // Perform the request
-    res = curl_easy_perform(curl);
-
-
-    // Check for errors and return
-    if (res != CURLE_OK) {
-        std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(res) << std::endl;
-    } else {
-        // Parse the response data as JSON
-        try {
-            json jsonData = json::parse(readBuffer);
-            RetData = jsonData;
-            // std::cout << jsonData.dump(4) << std::endl;
-        } catch (const json::parse_error& e) {
-            std::cerr << "JSON parse error: " << e.what() << std::endl;
-        }
+    // Parse the response data as JSON, error statuses may carry a json body too
+    try {
+        RetData = json::parse(resp.body);
+    } catch (const json::parse_error& e) {
+        std::cerr << "JSON parse error: " << e.what() << std::endl;
     }
-    // Clean up curl
-    curl_easy_cleanup(curl);
     return RetData;
 }
 
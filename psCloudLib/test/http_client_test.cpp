@@ -0,0 +1,248 @@
+/* HttpClient against a loopback stub server: timeouts, retry policy and
+   connection reuse. Exit code is the number of failed checks. */
+#include "http_client.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int nfailed = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)){ \
+            std::cerr << __FILE__ << ":" << __LINE__ << " check failed: " #cond << std::endl; \
+            nfailed++; \
+        } \
+    } while (0)
+
+
+struct StubReply {
+    int status;
+    int delay_ms;   // sleep before answering
+};
+
+/* HTTP/1.1 server on 127.0.0.1, answers requests from a script in order,
+   200 once the script is used up, and keeps connections open */
+class StubServer {
+    public:
+        StubServer(std::vector<StubReply> script) : script(script.begin(), script.end()){
+            lfd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = 0;
+            bind(lfd, (sockaddr *)&addr, sizeof(addr));
+            listen(lfd, 16);
+            socklen_t len = sizeof(addr);
+            getsockname(lfd, (sockaddr *)&addr, &len);
+            port = ntohs(addr.sin_port);
+            acceptor = std::thread(&StubServer::accept_loop, this);
+        }
+
+        ~StubServer(){
+            run = false;
+            acceptor.join();
+            for (auto &th : conns){
+                th.join();
+            }
+            close(lfd);
+        }
+
+        std::string url(const char *path = "/") const {
+            return "http://127.0.0.1:" + std::to_string(port) + path;
+        }
+
+        std::atomic<int> accepted{0};
+        std::atomic<int> nrequests{0};
+
+    private:
+        int lfd = -1;
+        int port = 0;
+        std::atomic<bool> run{true};
+        std::mutex lock;
+        std::deque<StubReply> script;
+        std::thread acceptor;
+        std::vector<std::thread> conns;
+
+        StubReply next(void){
+            std::lock_guard<std::mutex> lk(lock);
+            if (script.empty()){
+                return {200, 0};
+            }
+            StubReply r = script.front();
+            script.pop_front();
+            return r;
+        }
+
+        void accept_loop(void){
+            while (run){
+                pollfd p = {lfd, POLLIN, 0};
+                if (poll(&p, 1, 50) <= 0){
+                    continue;
+                }
+                int fd = accept(lfd, nullptr, nullptr);
+                if (fd < 0){
+                    continue;
+                }
+                accepted++;
+                conns.emplace_back(&StubServer::serve, this, fd);
+            }
+        }
+
+        /* one request, headers and a Content-Length body, 0 on eof */
+        int read_request(int fd, std::string &buf){
+            size_t hdr_end;
+            while ((hdr_end = buf.find("\r\n\r\n")) == std::string::npos){
+                if (!fill(fd, buf)){
+                    return 0;
+                }
+            }
+            size_t body = 0;
+            size_t cl = buf.find("Content-Length:");
+            if (cl != std::string::npos && cl < hdr_end){
+                body = std::stoul(buf.substr(cl + 15));
+            }
+            while (buf.size() < hdr_end + 4 + body){
+                if (!fill(fd, buf)){
+                    return 0;
+                }
+            }
+            buf.erase(0, hdr_end + 4 + body);
+            return 1;
+        }
+
+        int fill(int fd, std::string &buf){
+            char tmp[4096];
+            while (run){
+                pollfd p = {fd, POLLIN, 0};
+                if (poll(&p, 1, 50) <= 0){
+                    continue;
+                }
+                ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+                if (n <= 0){
+                    return 0;
+                }
+                buf.append(tmp, n);
+                return 1;
+            }
+            return 0;
+        }
+
+        void serve(int fd){
+            std::string buf;
+            while (run && read_request(fd, buf)){
+                nrequests++;
+                StubReply r = next();
+                std::this_thread::sleep_for(std::chrono::milliseconds(r.delay_ms));
+                char out[128];
+                int n = snprintf(out, sizeof(out), "HTTP/1.1 %d Stub\r\nContent-Type: application/json\r\n"
+                                 "Content-Length: 2\r\n\r\n{}", r.status);
+                if (send(fd, out, n, MSG_NOSIGNAL) != n){
+                    break;
+                }
+            }
+            close(fd);
+        }
+};
+
+
+static void test_keepalive(void){
+    StubServer srv({});
+    HttpResponse a = HttpClient::instance().get(srv.url());
+    HttpResponse b = HttpClient::instance().get(srv.url());
+    CHECK(a.ok() && b.ok());
+    CHECK(b.body == "{}");
+    CHECK(srv.nrequests == 2);
+    // the pooled handle kept its connection open
+    CHECK(srv.accepted == 1);
+}
+
+static void test_get_5xx_retry(void){
+    StubServer srv({{503, 0}, {500, 0}});
+    HttpOptions opt;
+    opt.retries = 2;
+    HttpResponse r = HttpClient::instance().get(srv.url(), opt);
+    CHECK(r.ok());
+    CHECK(r.attempts == 3);
+    CHECK(srv.nrequests == 3);
+}
+
+static void test_post_5xx(void){
+    StubServer srv({{503, 0}});
+    HttpOptions opt;
+    opt.retries = 2;
+    HttpResponse r = HttpClient::instance().post_json(srv.url(), "{\"a\":1}", opt);
+    // the server saw the body, resending could apply it twice
+    CHECK(!r.ok() && r.status == 503);
+    CHECK(r.attempts == 1);
+    CHECK(srv.nrequests == 1);
+
+    StubServer idem({{503, 0}});
+    opt.idempotent = true;
+    r = HttpClient::instance().post_json(idem.url(), "{\"a\":1}", opt);
+    CHECK(r.ok());
+    CHECK(r.attempts == 2);
+}
+
+static void test_timeout(void){
+    StubServer srv({{200, 1000}, {200, 1000}});
+    HttpOptions opt;
+    opt.timeout_ms = 200;
+    opt.retries = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    HttpResponse r = HttpClient::instance().get(srv.url(), opt);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+    CHECK(r.code == CURLE_OPERATION_TIMEDOUT);
+    CHECK(ms < 900);
+
+    opt.retries = 2;
+    r = HttpClient::instance().post_json(srv.url(), "{}", opt);
+    CHECK(r.code == CURLE_OPERATION_TIMEDOUT);
+    CHECK(r.sent);
+    CHECK(r.attempts == 1);
+}
+
+static void test_connect_retry(void){
+    // a port nobody listens on
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, (sockaddr *)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (sockaddr *)&addr, &len);
+    close(fd);
+    std::string url = "http://127.0.0.1:" + std::to_string(ntohs(addr.sin_port)) + "/";
+
+    HttpOptions opt;
+    opt.retries = 1;
+    HttpResponse r = HttpClient::instance().post_json(url, "{}", opt);
+    // nothing was sent, so even a POST is retried
+    CHECK(r.code == CURLE_COULDNT_CONNECT);
+    CHECK(!r.sent);
+    CHECK(r.attempts == 2);
+}
+
+
+int main(void){
+    test_keepalive();
+    test_get_5xx_retry();
+    test_post_5xx();
+    test_timeout();
+    test_connect_retry();
+    if (nfailed == 0){
+        std::cout << "http_client_test passed\n";
+    }
+    return nfailed;
+}
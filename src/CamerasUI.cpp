@@ -1,4 +1,5 @@
 #include "CamerasUI.h"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -142,6 +143,11 @@ int button_add_camera(std::vector<Camera_t> &camList){
         selected = 0;
         memset(cam.ipaddr, 0, sizeof(cam.ipaddr));
         memset(cam.rtsp, 0, sizeof(cam.rtsp));
+        cam.priority = PRIO_NORMAL;
+        cam.weight = 1;
+        cam.slo_ms = 0;
+        memset(cam.roi, 0, sizeof(cam.roi));
+        memset(cam.roi_mask, 0, sizeof(cam.roi_mask));
         ImGui::OpenPopup("Add Camera");
         cam.index = c_index;
     }
@@ -166,13 +172,30 @@ int button_add_camera(std::vector<Camera_t> &camList){
             cam.type = PARKSOL;
         }
         ImGui::Text("You picked: %d", cam.type);
+        ImGui::Text("Priority:");
+        for (int p = 0; p < PRIO_NCLASSES; p++){
+            ImGui::SameLine();
+            if (ImGui::RadioButton(priority_name((StreamPriority)p), cam.priority == p)){
+                cam.priority = (StreamPriority)p;
+            }
+        }
+        ImGui::InputInt("Weight", &cam.weight);
+        ImGui::InputInt("SLO, ms (0 - priority default)", &cam.slo_ms, 100, 1000);
+        cam.weight = std::min(std::max(cam.weight, 1), SCHED_WEIGHT_MAX);
+        cam.slo_ms = std::max(cam.slo_ms, 0);
+        ImGui::InputText("ROI x,y,w,h (0..1)", cam.roi, IM_ARRAYSIZE(cam.roi));
+        ImGui::InputText("ROI mask x,y;x,y;..", cam.roi_mask, IM_ARRAYSIZE(cam.roi_mask));
+        StreamRoi roi;
+        bool roi_ok = parse_roi(cam.roi, cam.roi_mask, roi);
+        if (!roi_ok){
+            ImGui::Text("Invalid ROI, use fractions of the frame 0..1");
+        }
         if (ImGui::Button("Cancel")) {
             ImGui::CloseCurrentPopup();
         }
-        if (ImGui::Button("Save")) {
+        if (roi_ok && ImGui::Button("Save")) {
             std::cout << "Saving Camera "<< std::endl;
             std::cout << "IP: " << cam.ipaddr << "\n rtsp: " << cam.rtsp  << "\n type: " << cam.type << std::endl;
-            open_database("cams.db");
             insert_camera_db("cams.db", cam);
             get_all_cameras_db("cams.db", camList);
             
@@ -308,9 +331,9 @@ void imgui_popup_enter_pods_interval(std::vector<Pod> pods, std::vector<Pod> &lo
         ImGui::InputInt("Pod End Index", &endIndex, 1, 10, 0);
         if(ImGui::Button("Load")){
             if (startIndex <= endIndex && startIndex>=0 && endIndex<pods.size()){
-                delete_all_cams(CAMERAS_LIST_DB);
                 std::cout << "Loading Pods from " << startIndex << " to " << endIndex << std::endl;
                 loaded.assign(pods.begin()+startIndex, pods.begin()+endIndex+1);
+                std::vector<Camera_t> cams;
                 for (const auto & pd: loaded){
                     std::cout << "pod " << pd.ip1 << ", " << pd.ip2 << std::endl;
                     Camera_t cam;
@@ -318,16 +341,17 @@ void imgui_popup_enter_pods_interval(std::vector<Pod> pods, std::vector<Pod> &lo
                     cam.type = PARKSOL;
                     sprintf(cam.rtsp, "rtsp://admin:1234@%s:554/h.264", cam.ipaddr);
                     cam.index = pd.cid1;
-                    insert_camera_db(CAMERAS_LIST_DB, cam);
+                    cams.push_back(cam);
                     if(pd.ip2[0]){
                         Camera_t cam;
                         strcpy(cam.ipaddr, pd.ip2);
                         cam.type = PARKSOL;
                         sprintf(cam.rtsp, "rtsp://admin:1234@%s:554/h.264", cam.ipaddr);
                         cam.index = pd.cid2;
-                        insert_camera_db(CAMERAS_LIST_DB, cam);
+                        cams.push_back(cam);
                     }
                 }
+                camera_store(CAMERAS_LIST_DB)->replace_all(cams);
                 ImGui::CloseCurrentPopup();
             }
             else if(startIndex > endIndex){
@@ -11,18 +11,27 @@
 #include "rlImGuiColors.h"
 #include "app_settings.h"
 #include "requests.h"
+#include "detection_uploader.h"
 #include "hostname.h"
 #include "logs.h"
 #include <algorithm>
+#include <deque>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <mutex>
 #include <thread>
 #include <chrono>
+#include <csignal>
+#include <cstring>
+#include <pthread.h>
+#include <pwd.h>
+#include <unistd.h>
 
 #include "json.hpp"
 #include "detector.h"
+#include "autotune.h"
 #include "CamerasUI.h"
 #include "db_manage.h"
 #include "camstream.h"
@@ -33,6 +42,11 @@ bool enable_url_edit;
 const unsigned long maxlen = 128;
 char hostname[maxlen];
 AppSettings app_settings; //global var for app_settings
+DetectionUploader *det_uploader = nullptr; // set while the detection uploader runs
+std::mutex streams_lock; // streams list is replaced by the GUI and read by the heartbeat
+std::mutex health_lock;
+std::deque<HealthEvent> health_events; // stream health transitions since the last heartbeat
+#define HEALTH_EVENTS_MAX 512
 
 bool run_heartbeat = true;
 
@@ -41,6 +55,50 @@ std::thread get_gates_thread;
 std::vector<Lot> gateserver_lots;
 
 
+static const char *topology_keys[THREAD_ROLE_NROLES] = {"control", "inference", "ort", "io", "decode"};
+
+/* "cpu_topology": "auto" or {"inference": "0-15", "ort": "0-15", "io": "16-17", ...} */
+void cpu_topology_from_json(const nlohmann::json &j, AppSettings &settings){
+    if (j.is_string() && j == "auto"){
+        settings.cpu_topology_auto = true;
+        return;
+    }
+    if (!j.is_object()){
+        std::cout << "cpu_topology must be \"auto\" or an object, not pinning threads\n";
+        return;
+    }
+    for (int r = 0; r < THREAD_ROLE_NROLES; r++){
+        if (j.contains(topology_keys[r]) && j[topology_keys[r]].is_string()){
+            settings.cpu_topology.cpus[r] = j[topology_keys[r]];
+        }
+    }
+    if (j.contains("decode_nice") && j["decode_nice"].is_number_integer()){
+        settings.cpu_topology.decode_nice = std::min(std::max(j["decode_nice"].get<int>(), 0), 19);
+    }
+    if (j.contains("decode_sched_batch") && j["decode_sched_batch"].is_boolean()){
+        settings.cpu_topology.decode_batch = j["decode_sched_batch"];
+    }
+}
+
+/* null when the settings had no topology, it is then not written back */
+nlohmann::json cpu_topology_to_json(const AppSettings &settings){
+    if (settings.cpu_topology_auto){
+        return "auto";
+    }
+    const CpuTopology &t = settings.cpu_topology;
+    nlohmann::json j;
+    for (int r = 0; r < THREAD_ROLE_NROLES; r++){
+        if (!t.cpus[r].empty()){
+            j[topology_keys[r]] = t.cpus[r];
+        }
+    }
+    if (!j.is_null() || t.decode_nice != DECODE_NICE || t.decode_batch != DECODE_SCHED_BATCH){
+        j["decode_nice"] = t.decode_nice;
+        j["decode_sched_batch"] = t.decode_batch;
+    }
+    return j;
+}
+
 int save_app_settings(const char * path, AppSettings settings){
     std::ofstream outFile(path);
     if (!outFile.is_open()) {
@@ -55,6 +113,10 @@ int save_app_settings(const char * path, AppSettings settings){
         settingstofile["Servers"].push_back(server.to_json());
     }
     settingstofile["facility_name"] = app_settings.facility_name;
+    nlohmann::json topology = cpu_topology_to_json(app_settings);
+    if (!topology.is_null()){
+        settingstofile["cpu_topology"] = topology;
+    }
     
 
     // Write the JSON object to the file
@@ -92,11 +154,116 @@ AppSettings load_app_settings(const char * settings_json_path){
     if(jsonSources.contains("gatedataURL")&& jsonSources["gatedataURL"].is_string()){
         settings.cloud_settings.gatedataURL = jsonSources["gatedataURL"];
     }
+    if(jsonSources.contains("cpu_topology")){
+        cpu_topology_from_json(jsonSources["cpu_topology"], settings);
+    }
     printf("url: %s\n", settings.cloud_settings.gatedataURL.c_str());
     printf("facility: %s\n", settings.facility_name.c_str());
     return settings;
 }
 
+static nlohmann::json read_autotune(const char *path){
+    std::ifstream f(path);
+    if (!f.is_open()){
+        return nlohmann::json::object();
+    }
+    nlohmann::json j = nlohmann::json::parse(f, nullptr, false);
+    if (j.is_discarded() || !j.is_object()){
+        std::cout << "Ignoring malformed " << path << std::endl;
+        return nlohmann::json::object();
+    }
+    return j;
+}
+
+/**
+ * @brief Tuned config of this host and the current models
+ * @return 1 - found, 0 - not tuned or the models changed since
+ */
+int load_autotune(const char *path, const char *host, const std::string &hash, TuneConfig &cfg){
+    nlohmann::json j = read_autotune(path);
+    if (hash.empty() || !j.contains("entries") || !j["entries"].is_array()){
+        return 0;
+    }
+    for (const auto &e : j["entries"]){
+        if (!e.is_object() || e.value("host", "") != host || e.value("models", "") != hash){
+            continue;
+        }
+        cfg.batch = e.value("batch", 0);
+        cfg.intra_threads = e.value("intra_op_threads", 0);
+        return cfg.batch > 0;
+    }
+    return 0;
+}
+
+/* replaces the entry of this host and models, entries of other hosts are kept
+   so one file can be shared across a fleet */
+int save_autotune(const char *path, const char *host, const std::string &hash, const TuneResult &best){
+    nlohmann::json j = read_autotune(path);
+    nlohmann::json entries = nlohmann::json::array();
+    if (j.contains("entries") && j["entries"].is_array()){
+        for (const auto &e : j["entries"]){
+            if (e.is_object() && (e.value("host", "") != host || e.value("models", "") != hash)){
+                entries.push_back(e);
+            }
+        }
+    }
+    nlohmann::json e;
+    e["host"] = host;
+    e["cpus"] = std::thread::hardware_concurrency();
+    e["models"] = hash;
+    e["batch"] = best.cfg.batch;
+    e["intra_op_threads"] = best.cfg.intra_threads;
+    e["throughput_fps"] = best.throughput_fps;
+    e["p99_ms"] = best.p99_ms;
+    e["ts"] = std::time(nullptr);
+    entries.push_back(e);
+    j["entries"] = entries;
+    std::ofstream outFile(path);
+    if (!outFile.is_open()){
+        std::cerr << "Could not open " << path << std::endl;
+        return 0;
+    }
+    outFile << j.dump(4);
+    std::cout << "Autotune result saved to: " << path << std::endl;
+    return 1;
+}
+
+/* --autotune, measures the grid and stores the best point for this host */
+/**
+ * @brief /home/$USER/shared/. USER is often unset under systemd and cron,
+ * then the home directory of the process user is used.
+ */
+static std::string shared_dir(void){
+    const char *user = std::getenv("USER");
+    if (user != nullptr && user[0] != '\0'){
+        return "/home/" + std::string(user) + "/shared/";
+    }
+    struct passwd *pw = getpwuid(getuid());
+    if (pw != nullptr && pw->pw_dir != nullptr){
+        return std::string(pw->pw_dir) + "/shared/";
+    }
+    return "./shared/";
+}
+
+int run_autotune(void){
+    std::string hash = model_hash();
+    if (hash.empty()){
+        std::cout << "Autotune: model files can't be read\n";
+        return 0;
+    }
+    std::vector<TuneResult> results;
+    TuneResult best;
+    if (!autotune(default_tune_grid(), results, best)){
+        std::cout << "Autotune: no configuration could be measured\n";
+        return 0;
+    }
+    if (best.p99_ms > AUTOTUNE_P99_MAX_MS){
+        std::cout << "Autotune: no configuration meets p99 " << AUTOTUNE_P99_MAX_MS
+                  << " ms, keeping the lowest latency one\n";
+    }
+    return save_autotune(AUTOTUNE_JSON_PATH, hostname, hash, best);
+}
+
 int init_application(void){
 
     if(!get_host_name(hostname, maxlen)){
@@ -104,6 +271,9 @@ int init_application(void){
         return -1;
     }
     app_settings = load_app_settings(SETTINGS_JSON_PATH); // load contents from sources.json
+    /* before any runtime thread starts, threads inherit the cpus of the one that creates them */
+    set_cpu_topology(app_settings.cpu_topology_auto ? CpuTopology::detect() : app_settings.cpu_topology);
+    set_thread_role(THREAD_ROLE_CONTROL, "parkai-main");
     // Clear URL Buffer
     memset(url_buf, 0, sizeof(url_buf));
     memset(facility_name_buf, 0, sizeof(facility_name_buf));
@@ -272,15 +442,6 @@ void get_events_button(void){
 
 
 
-void generate_tick(bool *run, int interval_ms, uint64_t *tick){
-    auto next_tick_time = std::chrono::steady_clock::now();
-    while (*run) {
-        (*tick) ++;
-        next_tick_time += std::chrono::milliseconds(interval_ms);
-        std::this_thread::sleep_until(next_tick_time);
-    } 
-}
-
 void periodic_upload_outages(bool *run){
     static int tick = UPLOAD_OUTAGES_PERIOD_SEC * 10; //send on boot
     static int repeat_in = UPLOAD_OUTAGES_PERIOD_SEC * 10;
@@ -315,19 +476,211 @@ json format_sensor_data(std::vector <stream_info> &sensors){
         sj["index"] = s.index;
         sj["ts"] = s.ts;
         sj["ip"] = s.ip;
+        sj["ready"] = s.ready;
+        sj["health"] = health_name(s.health.state);
+        sj["frame-interval-ms"] = s.health.interval_ms;
+        sj["silent-ms"] = s.health.silent_ms;
+        sj["stalls"] = s.health.nstalls;
+        sj["deaths"] = s.health.ndeaths;
+        sj["priority"] = priority_name(s.sched.priority);
+        sj["slo-ms"] = s.sched.get_slo_ms();
+        sj["roi"] = format_roi_rect(s.roi);
+        sj["roi-mask"] = !s.roi.polygon.empty();
         ret.push_back(sj);
     }
 
     return ret;
 }
 
+/* health transitions since the last call, the oldest are dropped past HEALTH_EVENTS_MAX */
+json take_health_events(void){
+    std::lock_guard<std::mutex> lock(health_lock);
+    json ret = json::array();
+    for (const auto & e:health_events){
+        json ej;
+        ej["index"] = e.index;
+        ej["from"] = health_name(e.from);
+        ej["to"] = health_name(e.to);
+        ej["ts"] = std::time(nullptr) - (monotonic_ms() - e.ts_ms) / 1000;
+        ej["frame-interval-ms"] = e.interval_ms;
+        ej["silent-ms"] = e.silent_ms;
+        ret.push_back(ej);
+    }
+    health_events.clear();
+    return ret;
+}
+
+void record_health_event(const HealthEvent &e){
+    std::lock_guard<std::mutex> lock(health_lock);
+    if (health_events.size() >= HEALTH_EVENTS_MAX){
+        health_events.pop_front();
+    }
+    health_events.push_back(e);
+}
+
+/* Streams for the detector, cameras with a placeholder ip are skipped */
+std::vector<stream_info> make_streams(const std::vector<Camera_t> &camList){
+    std::vector <stream_info> streams;
+    for (const auto & cam:camList){
+        std::string ip = cam.ipaddr;
+        if(ip.find('X') != std::string::npos){
+            std::cout << "Skipping " << cam.ipaddr <<std::endl;
+            continue;
+        }
+        else{
+            //time_t ts = std::time(nullptr);
+            stream_info str = {cam.rtsp, cam.ipaddr, 0, cam.index, cam.id};
+            str.sched.priority = cam.priority;
+            str.sched.weight = std::min(std::max(cam.weight, 1), SCHED_WEIGHT_MAX);
+            str.sched.slo_ms = std::max(cam.slo_ms, 0);
+            if (!parse_roi(cam.roi, cam.roi_mask, str.roi)){
+                std::cout << "Camera " << cam.index << " has an invalid ROI \"" << cam.roi << "\" / \""
+                          << cam.roi_mask << "\", using the full frame\n";
+            }
+            streams.push_back(str);
+        }
+    }
+    return streams;
+}
+
+/**
+ * @brief Reloads the camera list if cams.db changed and applies it to the
+ * running detector
+ * @return 1 if the camera list changed
+ */
+int sync_cameras(Detector &det, std::vector<Camera_t> &camList, std::vector<stream_info> &streams){
+    if (reload_cameras_db(CAMERAS_LIST_DB, camList) != 1){
+        return 0;
+    }
+    std::vector<stream_info> next = make_streams(camList);
+    det.apply_camera_list(next);
+    std::lock_guard<std::mutex> lock(streams_lock);
+    streams = next;
+    return 1;
+}
+
+json format_sched_stats(Detector *detector){
+    std::vector<SchedClassStats> stats;
+    detector->get_sched_stats(stats);
+    json ret = json::array();
+    for (const auto & c:stats){
+        json cj;
+        cj["class"] = c.name;
+        cj["slo-ms"] = c.slo_ms;
+        cj["frames"] = c.frames;
+        cj["slo-misses"] = c.slo_misses;
+        cj["queue-ms-avg"] = c.queue_ms_avg;
+        cj["queue-ms-max"] = c.queue_ms_max;
+        ret.push_back(cj);
+    }
+    return ret;
+}
+
+json format_model_status(Detector *detector){
+    std::vector<ModelStatus> st;
+    detector->get_model_status(st);
+    json ret = json::array();
+    for (const auto & m:st){
+        json mj;
+        mj["name"] = m.name;
+        mj["path"] = m.path;
+        mj["version"] = m.version;
+        mj["loaded-ts"] = m.loaded_ts;
+        mj["probation"] = m.probation;
+        mj["swaps"] = m.swaps;
+        mj["failures"] = m.failures;
+        mj["last-error"] = m.last_error;
+        ret.push_back(mj);
+    }
+    return ret;
+}
+
+json format_upload_stats(const DetectionUploadStats &st){
+    json ret;
+    ret["queued"] = st.queued;
+    ret["spooled"] = st.spooled;
+    ret["sent"] = st.sent;
+    ret["dropped"] = st.dropped;
+    return ret;
+}
+
+/* Converts the detections of one frame to compact upload events */
+std::vector<DetectionEvent> to_detection_events(uint32_t index, const std::vector<parknetDet> &dets){
+    int64_t ts_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::vector<DetectionEvent> events;
+    events.reserve(dets.size());
+    for (const auto & d:dets){
+        DetectionEvent e;
+        e.cam = index;
+        e.ts_ms = ts_ms;
+        e.x1 = d.car.x1;
+        e.y1 = d.car.y1;
+        e.x2 = d.car.x2;
+        e.y2 = d.car.y2;
+        e.conf = d.car.conf;
+        if (d.lpr_found){
+            e.plate = d.plText;
+            e.plate_conf = d.lplate.conf;
+        }
+        events.push_back(std::move(e));
+    }
+    return events;
+}
+
+json format_mem_stats(const MemStats &ms){
+    json ret;
+    ret["rss-kb"] = ms.rss_kb;
+    ret["hwm-kb"] = ms.hwm_kb;
+    ret["rss-anon-kb"] = ms.rss_anon_kb;
+    ret["rss-shmem-kb"] = ms.rss_shmem_kb;
+    ret["heap-in-use"] = ms.heap_in_use;
+    ret["heap-free"] = ms.heap_free;
+    ret["writer-pending"] = ms.writer_pending;
+    ret["writer-bytes"] = ms.writer_bytes;
+    ret["shm-bytes"] = ms.shm_bytes;
+    ret["frame-bytes"] = ms.frame_bytes;
+    ret["children-rss-kb"] = ms.child_rss_kb;
+    ret["ort-in-use"] = ms.ort_in_use;
+    ret["ort-reserved"] = ms.ort_reserved;
+    json pool;
+    pool["hits"] = ms.frame_pool.hits;
+    pool["misses"] = ms.frame_pool.misses;
+    pool["outstanding-bytes"] = ms.frame_pool.outstanding_bytes;
+    pool["idle-bytes"] = ms.frame_pool.idle_bytes;
+    pool["trimmed"] = ms.frame_pool.trimmed;
+    ret["frame-pool"] = pool;
+    json sessions = json::array();
+    for (const auto & s:ms.sessions){
+        json sj;
+        sj["name"] = s.name;
+        sj["in-use"] = s.in_use;
+        sj["reserved"] = s.reserved;
+        sj["max-in-use"] = s.max_in_use;
+        sessions.push_back(sj);
+    }
+    ret["sessions"] = sessions;
+    json cams = json::array();
+    for (const auto & c:ms.cams){
+        json cj;
+        cj["index"] = c.index;
+        cj["shm-bytes"] = c.shm_bytes;
+        cj["frame-bytes"] = c.frame_bytes;
+        cj["rss-kb"] = c.child_rss_kb;
+        cams.push_back(cj);
+    }
+    ret["cams"] = cams;
+    return ret;
+}
+
 void send_periodic_hb(AppSettings *app_settings, Detector *detector, char *host, int timeout_s, bool *run, std::vector<stream_info> *sensors){
     static int tick = timeout_s * 10;
     std::string route;
     route = "/heartbeat";
     std::string hb_url;
     hb_url = app_settings->cloud_settings.gatedataURL + route;
-    
+    set_thread_role(THREAD_ROLE_CONTROL, "heartbeat");
+
     while (*run){
         if (tick >= timeout_s * 10){
             json perf_data;
@@ -336,7 +689,20 @@ void send_periodic_hb(AppSettings *app_settings, Detector *detector, char *host,
             perf_data["running"] = detector->is_running();
             perf_data["start-ts"] = detector->get_start_time();
             perf_data["fps"] = detector->get_fps();
-            perf_data["sensors"] = format_sensor_data(*sensors);
+            perf_data["models-ready"] = detector->is_models_ready();
+            {
+                std::lock_guard<std::mutex> lock(streams_lock);
+                perf_data["sensors"] = format_sensor_data(*sensors);
+            }
+            perf_data["health-events"] = take_health_events();
+            perf_data["scheduling"] = format_sched_stats(detector);
+            perf_data["models"] = format_model_status(detector);
+            MemStats ms;
+            detector->get_mem_stats(ms);
+            perf_data["memory"] = format_mem_stats(ms);
+            if (det_uploader){
+                perf_data["detections"] = format_upload_stats(det_uploader->get_stats());
+            }
             send_heartbeat_ai(hb_url.c_str(), s_data, perf_data);
             tick = 0;
         }
@@ -356,82 +722,29 @@ void send_heartbeat_debug(AppSettings *app_settings, char *host, Detector *detec
     perf_data["running"] = detector->is_running();
     perf_data["fps"] = detector->get_fps();
     perf_data["start-ts"] = detector->get_start_time();
+    perf_data["models-ready"] = detector->is_models_ready();
     perf_data["sensors"] = format_sensor_data(data);
+    perf_data["health-events"] = take_health_events();
+    perf_data["scheduling"] = format_sched_stats(detector);
+    perf_data["models"] = format_model_status(detector);
+    MemStats ms;
+    detector->get_mem_stats(ms);
+    perf_data["memory"] = format_mem_stats(ms);
+    if (det_uploader){
+        perf_data["detections"] = format_upload_stats(det_uploader->get_stats());
+    }
     send_heartbeat_ai(hb_url.c_str(), s_data, perf_data);
 }
 
 
-#if !CONSOLE_ENABLED
-#ifdef _WIN32
-#pragma comment(linker, "/SUBSYSTEM:windows /ENTRY:mainCRTStartup")
-#endif
-#endif
-int main(int argc, char* argv[]) {
-
-    uint64_t uptime_ms = 0;
-    int show = 0;
-    float fps_perf = 0.0;
-    if (!init_application()){
-        return 0;
-    }
-    if(!create_cameras_table("cams.db")){
-        return 0;
-    }
-
-    uint64_t app_tick = 0;
-    uint64_t *tick_ptr = &app_tick;
-    std::vector<Camera_t> camList;
+/**
+ * @brief Runs the raylib/ImGui window until it is closed or Quit is selected
+ * @param start_ms steady_ms() at application start, used for uptime display
+ */
+void run_gui(Detector &det, std::vector<Camera_t> &camList, std::vector<stream_info> &streams, uint64_t start_ms){
     std::vector<Pod> pods;
-    get_all_cameras_db("cams.db", camList);
-    bool run = true;
-    bool run_heartbeat = true;
-
-    std::thread tick_generator = std::thread(generate_tick, &run, TICK_INTERVAL_MS, tick_ptr);
-    //std::thread runtime_ts_thread = std::thread(runtime_ts, &run);
-
-
-    std::thread uploadData = std::thread(upload_events_threaded, DATA_UPLOAD_CHECK_TIMEOUT, &run,
-                                                app_settings.cloud_settings.gatedataURL.c_str(),
-                                                hostname, app_settings.facility_name.c_str(), 
-                                                app_settings.gate_server_lots);
-
-    //std::thread th_upload_outages= std::thread(periodic_upload_outages, &run);
-
-
-    std::vector <stream_info> streams;
-    for (const auto & cam:camList){
-        std::string ip = cam.ipaddr;
-        if(ip.find('X') != std::string::npos){
-            std::cout << "Skipping " << cam.ipaddr <<std::endl;
-            continue;
-        }
-        else{
-            //time_t ts = std::time(nullptr);
-            stream_info str = {cam.rtsp, cam.ipaddr, 0, cam.index, cam.id};
-            streams.push_back(str);
-        }
-    }
-    
+    float fps_perf = 0.0;
     uchar *img = nullptr;
-    uint64_t im_size = 0;
-
-    const char* user = std::getenv("USER");
-    std::string path = "/home/" + std::string(user) + "/shared/";
-    if (!wdet::dir_exists(path)){
-        wdet::create_dirs(path);
-    }
-    path = path + "output/";
-    if (!wdet::dir_exists(path)){
-        wdet::create_dirs(path);
-    }
-    std::cout << "Workdir is " << path << std::endl;
-
-
-    Detector det(BATCH_SIZE, VISUALIZE_DETECTIONS, streams, path);
-    det.start();
-
-    std::thread th_heartbeat = std::thread(send_periodic_hb, &app_settings, &det,
-                                        hostname, HEARTBEAT_PERIOD_SEC, &run_heartbeat, &streams);
     // Initialization
     int screenWidth = 1024;
     int screenHeight = 256;
@@ -486,6 +799,9 @@ int main(int argc, char* argv[]) {
                 if (ImGui::MenuItem("Send Heartbeat")){
                     send_heartbeat_debug(&app_settings, hostname, &det, streams);
                 }
+                if (ImGui::MenuItem("Reload Models", nullptr, false, det.is_models_ready())){
+                    det.reload_models();
+                }
                 ImGui::EndMenu();
             }
 			ImGui::EndMainMenuBar();
@@ -514,14 +830,14 @@ int main(int argc, char* argv[]) {
             edit_settings_button();
             ImGui::NewLine();
             ImGui::Text("OS Boot TS: %s", app_settings.sys_boot.c_str());
-            display_app_uptime(app_tick);
+            display_app_uptime(steady_ms() - start_ms);
             display_fps_data(det.is_running(), fps_perf );
             button_add_camera(camList);
             ImGui::SameLine();
             imgui_AddCamerasFromFacilityPopup(pods);
             if (nframe == 0){
-                // load camera list here
-                get_all_cameras_db("cams.db",camList);
+                // reload camera list only if the table changed
+                sync_cameras(det, camList, streams);
             }
             ImGui::Text("Cameras in list: %ld", camList.size());
             imgui_cams_table(camList, streams);
@@ -546,6 +862,7 @@ int main(int argc, char* argv[]) {
         if(nframe >= TARGET_IMGUI_FPS){ // update this every 1s
             fps_perf = det.get_fps();
             nframe = 0;
+            std::lock_guard<std::mutex> lock(streams_lock);
             det.read_timestamps(streams);
         }
         EndDrawing();
@@ -553,7 +870,6 @@ int main(int argc, char* argv[]) {
     rlImGuiShutdown();
 
     // Cleanup
-    rlImGuiShutdown();
     //UnloadTexture(image);
     if (tex.id > 0) {
         UnloadTexture(tex);
@@ -561,6 +877,125 @@ int main(int argc, char* argv[]) {
     
     
     CloseWindow();
+}
+
+#if !CONSOLE_ENABLED
+#ifdef _WIN32
+#pragma comment(linker, "/SUBSYSTEM:windows /ENTRY:mainCRTStartup")
+#endif
+#endif
+int main(int argc, char* argv[]) {
+
+    bool headless = false;
+    bool tune = false;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--headless") == 0){
+            headless = true;
+        }
+        else if (strcmp(argv[i], "--autotune") == 0){
+            tune = true;
+        }
+        else{
+            std::cout << "Unknown argument " << argv[i] << std::endl;
+            std::cout << "Usage: " << argv[0] << " [--headless] [--autotune]\n";
+            return EXIT_FAILURE;
+        }
+    }
+    /* Stop signals are blocked before any thread is started so every thread
+       inherits the mask and only sigwait() below receives them. SIGHUP
+       reloads the models. */
+    sigset_t stop_sigs;
+    sigemptyset(&stop_sigs);
+    sigaddset(&stop_sigs, SIGINT);
+    sigaddset(&stop_sigs, SIGTERM);
+    sigaddset(&stop_sigs, SIGHUP);
+    if (headless){
+        pthread_sigmask(SIG_BLOCK, &stop_sigs, nullptr);
+    }
+
+    uint64_t start_ms = steady_ms();
+    if (!init_application()){
+        return 0;
+    }
+    if (tune){
+        return run_autotune() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if(!create_cameras_table("cams.db")){
+        return 0;
+    }
+
+    std::vector<Camera_t> camList;
+    get_all_cameras_db("cams.db", camList);
+    bool run = true;
+    bool run_heartbeat = true;
+
+    std::thread uploadData = std::thread(upload_events_threaded, DATA_UPLOAD_CHECK_TIMEOUT, &run,
+                                                app_settings.cloud_settings.gatedataURL.c_str(),
+                                                hostname, app_settings.facility_name.c_str(), 
+                                                app_settings.gate_server_lots);
+
+    //std::thread th_upload_outages= std::thread(periodic_upload_outages, &run);
+
+
+    std::vector <stream_info> streams = make_streams(camList);
+
+    std::string path = shared_dir();
+    if (!wdet::dir_exists(path)){
+        wdet::create_dirs(path);
+    }
+    path = path + "output/";
+    if (!wdet::dir_exists(path)){
+        wdet::create_dirs(path);
+    }
+    std::cout << "Workdir is " << path << std::endl;
+
+
+    DetectionUploader uploader(app_settings.cloud_settings.gatedataURL, hostname,
+                               app_settings.facility_name, path + "spool/");
+    det_uploader = &uploader;
+
+    int batch_size = BATCH_SIZE;
+    TuneConfig tuned;
+    if (load_autotune(AUTOTUNE_JSON_PATH, hostname, model_hash(), tuned)){
+        batch_size = tuned.batch;
+        detector::set_intra_op_limit(tuned.intra_threads);
+        std::cout << "Using tuned batch " << tuned.batch << ", " << tuned.intra_threads << " ort threads\n";
+    }
+    else{
+        std::cout << "No autotune result for this host and models, run with --autotune\n";
+    }
+    Detector det(batch_size, VISUALIZE_DETECTIONS, streams, path);
+    det.set_detection_callback([&uploader](uint32_t index, const std::vector<parknetDet> &dets){
+        uploader.push(to_detection_events(index, dets));
+    });
+    det.set_health_callback(record_health_event);
+    det.start();
+
+    std::thread th_heartbeat = std::thread(send_periodic_hb, &app_settings, &det,
+                                        hostname, HEARTBEAT_PERIOD_SEC, &run_heartbeat, &streams);
+
+    if (headless){
+        std::cout << "Running headless, send SIGINT or SIGTERM to stop, SIGHUP to reload the models\n";
+        int sig = -1;
+        const timespec poll_period = {1, 0};
+        while (sig < 0){
+            /* pick up camera changes made to cams.db by other tools */
+            sync_cameras(det, camList, streams);
+            {
+                std::lock_guard<std::mutex> lock(streams_lock);
+                det.read_timestamps(streams);
+            }
+            sig = sigtimedwait(&stop_sigs, nullptr, &poll_period);
+            if (sig == SIGHUP){
+                std::cout << (det.reload_models() ? "Reloading models\n" : "Models are still loading\n");
+                sig = -1;
+            }
+        }
+        std::cout << "Received " << strsignal(sig) << " after " << (steady_ms() - start_ms) / 1000 << " s, shutting down\n";
+    }
+    else{
+        run_gui(det, camList, streams, start_ms);
+    }
 
     /* Close running threads*/
     run = false;
@@ -576,27 +1011,15 @@ int main(int argc, char* argv[]) {
         std::cout << "HeartBeat Thread Closed\n";
     }
 
-    if(tick_generator.joinable()){
-        tick_generator.join();
-        std::cout << "Tick Generator Thread Closed\n";
-    }
     det.stop();
-    // if(runtime_ts_thread.joinable()){
-    //     runtime_ts_thread.join();
-    //     std::cout << "Runtime TS Thread Closed\n";
-    // }
-    
+    std::cout << "Detector Stopped\n";
+    uploader.stop();
+    det_uploader = nullptr;
+    std::cout << "Detection Uploader Stopped\n";
     // if (th_upload_outages.joinable()){
     //     th_upload_outages.join();
     //     std::cout << "Upload Outages Thread Closed\n";
     // }
-    
-
-    // if(detections.joinable()){
-    //     detections.join();
-    //     std::cout << "Detections thread Closed\n";
-    // }
-    //free(img);
 
     return EXIT_SUCCESS;
-} 
\ No newline at end of file
+}
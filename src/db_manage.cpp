@@ -2,25 +2,64 @@
 #include "sqlite3.h"
 #include "CamerasUI.h"
 #include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
 #include <vector>
 
 
 
-// Function to open the database
-sqlite3* open_database(const char* db_path) {
-    sqlite3* db;
-    if (sqlite3_open(db_path, &db)) {
+CameraStore::CameraStore(const char *db_path) : path(db_path){
+    open();
+}
+
+CameraStore::~CameraStore(){
+    close_locked();
+}
+
+bool CameraStore::open(void){
+    std::lock_guard<std::mutex> lk(lock);
+    return db != nullptr || open_locked();
+}
+
+bool CameraStore::open_locked(void){
+    if (sqlite3_open(path.c_str(), &db) != SQLITE_OK){
         std::cerr << "Error opening database: " << sqlite3_errmsg(db) << std::endl;
-        return nullptr;
+        close_locked();
+        return false;
     }
-    return db;
+    sqlite3_busy_timeout(db, 2000);
+    exec("PRAGMA journal_mode=WAL;");
+    exec("PRAGMA synchronous=NORMAL;");
+    if (!create_table() || !migrate() || !prepare()){
+        close_locked();
+        return false;
+    }
+    loaded = false;
+    return true;
 }
 
-int create_cameras_table(const char* db_path){
-    sqlite3* db = open_database(db_path);
-    if (!db){
-        return 0;
+void CameraStore::close_locked(void){
+    for (sqlite3_stmt **st : {&st_insert, &st_delete, &st_select, &st_version}){
+        sqlite3_finalize(*st);
+        *st = nullptr;
+    }
+    sqlite3_close(db);
+    db = nullptr;
+}
+
+bool CameraStore::exec(const char *sql){
+    char *err = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &err) != SQLITE_OK){
+        std::cerr << "SQL error: " << (err ? err : sqlite3_errmsg(db)) << std::endl;
+        sqlite3_free(err);
+        return false;
     }
+    return true;
+}
+
+bool CameraStore::create_table(void){
     const char* create_cameras_table_sql = R"(
         CREATE TABLE IF NOT EXISTS cameras (
             id INTEGER PRIMARY KEY AUTOINCREMENT,
@@ -28,129 +67,261 @@ int create_cameras_table(const char* db_path){
             ip TEXT NOT NULL,
             rtsp_url TEXT,
             type INTEGER NOT NULL,
-            serialno TEXT
+            serialno TEXT,
+            priority INTEGER NOT NULL DEFAULT 1,
+            weight INTEGER NOT NULL DEFAULT 1,
+            slo_ms INTEGER NOT NULL DEFAULT 0,
+            roi TEXT NOT NULL DEFAULT '',
+            roi_mask TEXT NOT NULL DEFAULT ''
         );
     )";
-    char* err_msg = nullptr;
-
-    if (sqlite3_exec(db, create_cameras_table_sql, 0, 0, &err_msg) != SQLITE_OK) {
-        std::cerr << "Error creating cameras table: " << err_msg << std::endl;
-        sqlite3_free(err_msg);
-    } else {
-        std::cout << "Cameras table created successfully." << std::endl;
+    if (!exec(create_cameras_table_sql)){
+        std::cerr << "Error creating cameras table\n";
+        return false;
     }
-    sqlite3_close(db);
-    return 1;
+    return true;
 }
 
-// Function to insert a camera into the database
-void insert_camera_db(const char* db_path, Camera_t cam) {
-    sqlite3* db = open_database(db_path);
-    if (!db){
-        return;
+/* adds columns missing in databases created by older versions */
+bool CameraStore::migrate(void){
+    struct {const char *name; const char *sql;} cols[] = {
+        {"priority", "ALTER TABLE cameras ADD COLUMN priority INTEGER NOT NULL DEFAULT 1;"},
+        {"weight",   "ALTER TABLE cameras ADD COLUMN weight INTEGER NOT NULL DEFAULT 1;"},
+        {"slo_ms",   "ALTER TABLE cameras ADD COLUMN slo_ms INTEGER NOT NULL DEFAULT 0;"},
+        {"roi",      "ALTER TABLE cameras ADD COLUMN roi TEXT NOT NULL DEFAULT '';"},
+        {"roi_mask", "ALTER TABLE cameras ADD COLUMN roi_mask TEXT NOT NULL DEFAULT '';"},
+    };
+    std::set<std::string> have;
+    sqlite3_stmt *st = nullptr;
+    if (sqlite3_prepare_v2(db, "PRAGMA table_info(cameras);", -1, &st, nullptr) != SQLITE_OK){
+        std::cerr << "Error reading cameras table: " << sqlite3_errmsg(db) << std::endl;
+        return false;
     }
-    const char* insert_camera_sql = R"(
-        INSERT INTO cameras (ip, rtsp_url, type, cindex) VALUES (?, ?, ?, ?);
-    )";
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, insert_camera_sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, cam.ipaddr, -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 2, cam.rtsp, -1, SQLITE_STATIC);
-        sqlite3_bind_int(stmt, 3, (int)cam.type);
-        sqlite3_bind_int(stmt, 4, cam.index);
-        if (sqlite3_step(stmt) == SQLITE_DONE) {
-            std::cout << "Camera inserted successfully: IP = " << cam.ipaddr << ", RTSP URL = " << cam.rtsp << std::endl;
-        } else {
-            std::cerr << "Error inserting camera: " << sqlite3_errmsg(db) << std::endl;
+    while (sqlite3_step(st) == SQLITE_ROW){
+        have.insert((const char*)sqlite3_column_text(st, 1));
+    }
+    sqlite3_finalize(st);
+    for (auto &c : cols){
+        if (have.count(c.name) == 0){
+            if (!exec(c.sql)){
+                return false;
+            }
+            std::cout << "Cameras table: added column " << c.name << std::endl;
         }
-        sqlite3_finalize(stmt);
-    } else {
-        std::cerr << "Error preparing insert statement: " << sqlite3_errmsg(db) << std::endl;
     }
-    sqlite3_close(db);
+    return true;
 }
 
-int delete_camera_db(const char* db_path, int cam_id){
-    const char * prompt = R"(DELETE FROM cameras WHERE id = ?;)";
-    sqlite3* db = open_database(db_path);
-    if (!db){
-        return 0;
-    }
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, prompt, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_int(stmt, 1, cam_id);
-        if (sqlite3_step(stmt) == SQLITE_DONE) {
-            std::cout << "Camera deleted successfully: ID = " << cam_id << std::endl;
-        } else {
-            std::cerr << "Error deleting camera: " << sqlite3_errmsg(db) << std::endl;
+bool CameraStore::prepare(void){
+    struct {sqlite3_stmt **stmt; const char *sql;} stmts[] = {
+        {&st_insert,  "INSERT INTO cameras (ip, rtsp_url, type, cindex, priority, weight, slo_ms, roi, roi_mask) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);"},
+        {&st_delete,  "DELETE FROM cameras WHERE id = ?;"},
+        {&st_select,  "SELECT id, ip, rtsp_url, type, cindex, priority, weight, slo_ms, roi, roi_mask FROM cameras;"},
+        {&st_version, "PRAGMA data_version;"},
+    };
+    for (auto &s : stmts){
+        if (sqlite3_prepare_v3(db, s.sql, -1, SQLITE_PREPARE_PERSISTENT, s.stmt, nullptr) != SQLITE_OK){
+            std::cerr << "Error preparing \"" << s.sql << "\": " << sqlite3_errmsg(db) << std::endl;
+            return false;
         }
-        sqlite3_finalize(stmt);
-    } else {
-        std::cerr << "Error preparing delete statement: " << sqlite3_errmsg(db) << std::endl;
     }
-    sqlite3_close(db);
+    return true;
+}
+
+int CameraStore::insert_locked(const Camera_t &cam){
+    sqlite3_bind_text(st_insert, 1, cam.ipaddr, -1, SQLITE_STATIC);
+    sqlite3_bind_text(st_insert, 2, cam.rtsp, -1, SQLITE_STATIC);
+    sqlite3_bind_int(st_insert, 3, (int)cam.type);
+    sqlite3_bind_int(st_insert, 4, cam.index);
+    sqlite3_bind_int(st_insert, 5, (int)cam.priority);
+    sqlite3_bind_int(st_insert, 6, cam.weight);
+    sqlite3_bind_int(st_insert, 7, cam.slo_ms);
+    sqlite3_bind_text(st_insert, 8, cam.roi, -1, SQLITE_STATIC);
+    sqlite3_bind_text(st_insert, 9, cam.roi_mask, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(st_insert);
+    sqlite3_reset(st_insert);
+    sqlite3_clear_bindings(st_insert);
+    if (rc != SQLITE_DONE){
+        std::cerr << "Error inserting camera: " << sqlite3_errmsg(db) << std::endl;
+        return 0;
+    }
+    std::cout << "Camera inserted successfully: IP = " << cam.ipaddr << ", RTSP URL = " << cam.rtsp << std::endl;
     return 1;
 }
 
-int delete_all_cams(const char * db_path){
-    char* err = nullptr;
-    sqlite3* db = open_database(db_path);
+int CameraStore::insert(const Camera_t &cam){
+    std::lock_guard<std::mutex> lk(lock);
     if (!db){
         return 0;
     }
-    const char* prompt_sql = R"(
-        DELETE FROM cameras;
-    )";
-    if (sqlite3_exec(db, prompt_sql, nullptr, nullptr, &err) != SQLITE_OK){
-        std::cerr << "Error deleting all cameras: " << err << std::endl;
-        sqlite3_free(err);
-        sqlite3_close(db);
+    return insert_locked(cam);
+}
+
+int CameraStore::remove(int cam_id){
+    std::lock_guard<std::mutex> lk(lock);
+    if (!db){
         return 0;
     }
-    int rc = sqlite3_exec(db, "DELETE FROM sqlite_sequence WHERE name='cameras';", nullptr, nullptr, &err);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Warning resetting sequence: " << err << std::endl;
-        sqlite3_free(err);
-        // continue
+    sqlite3_bind_int(st_delete, 1, cam_id);
+    int rc = sqlite3_step(st_delete);
+    sqlite3_reset(st_delete);
+    if (rc != SQLITE_DONE){
+        std::cerr << "Error deleting camera: " << sqlite3_errmsg(db) << std::endl;
+        return 0;
+    }
+    std::cout << "Camera deleted successfully: ID = " << cam_id << std::endl;
+    return 1;
+}
+
+int CameraStore::remove_all(void){
+    std::lock_guard<std::mutex> lk(lock);
+    if (!db || !exec("DELETE FROM cameras;")){
+        std::cerr << "Error deleting all cameras\n";
+        return 0;
     }
     int removed = sqlite3_changes(db);
+    if (!exec("DELETE FROM sqlite_sequence WHERE name='cameras';")){
+        std::cerr << "Warning resetting sequence\n";
+        // continue
+    }
     std::cout << "Deleted " << removed << " cameras." << std::endl;
-    sqlite3_close(db);
     return removed;
 }
 
-// Function to get all cameras from the database
-int get_all_cameras_db(const char* db_path, std::vector<Camera_t> &dst) {
-    std::vector <Camera_t> cams;
-    sqlite3* db = open_database(db_path);
+int CameraStore::replace_all(const std::vector<Camera_t> &cams){
+    std::lock_guard<std::mutex> lk(lock);
+    if (!db || !exec("BEGIN IMMEDIATE;")){
+        return 0;
+    }
+    bool ok = exec("DELETE FROM cameras;") &&
+              exec("DELETE FROM sqlite_sequence WHERE name='cameras';");
+    for (size_t i = 0; ok && i < cams.size(); i++){
+        ok = insert_locked(cams[i]);
+    }
+    if (!ok){
+        exec("ROLLBACK;");
+        std::cerr << "Failed to replace camera list\n";
+        return 0;
+    }
+    return exec("COMMIT;") ? 1 : 0;
+}
+
+static void copy_text(char *dst, size_t n, const unsigned char *src){
+    snprintf(dst, n, "%s", src ? (const char*)src : "");
+}
+
+int CameraStore::load(std::vector<Camera_t> &dst){
+    std::lock_guard<std::mutex> lk(lock);
     if (!db){
         return 0;
     }
+    // version first, a commit racing the select is then seen by the next check
+    int64_t version = data_version();
+    int changes = sqlite3_total_changes(db);
+    std::vector <Camera_t> cams;
+    int rc;
+    while ((rc = sqlite3_step(st_select)) == SQLITE_ROW) {
+        Camera_t cam;
+        cam.id = sqlite3_column_int(st_select, 0);
+        copy_text(cam.ipaddr, sizeof(cam.ipaddr), sqlite3_column_text(st_select, 1));
+        copy_text(cam.rtsp, sizeof(cam.rtsp), sqlite3_column_text(st_select, 2));
+        cam.type = get_by_val(sqlite3_column_int(st_select, 3));
+        cam.index = sqlite3_column_int(st_select, 4);
+        cam.priority = priority_by_val(sqlite3_column_int(st_select, 5));
+        cam.weight = sqlite3_column_int(st_select, 6);
+        cam.slo_ms = sqlite3_column_int(st_select, 7);
+        copy_text(cam.roi, sizeof(cam.roi), sqlite3_column_text(st_select, 8));
+        copy_text(cam.roi_mask, sizeof(cam.roi_mask), sqlite3_column_text(st_select, 9));
+        cams.push_back(cam);
+    }
+    sqlite3_reset(st_select);
+    if (rc != SQLITE_DONE){
+        std::cerr << "Error reading cameras: " << sqlite3_errmsg(db) << std::endl;
+        return 0;
+    }
+    dst = cams;
+    loaded = true;
+    seen_version = version;
+    seen_changes = changes;
+    return 1;
+}
 
-    const char* select_cameras_sql = R"(
-        SELECT id, ip, rtsp_url, type, cindex FROM cameras;
-    )";
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, select_cameras_sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            int id = sqlite3_column_int(stmt, 0);
-            const unsigned char* ip = sqlite3_column_text(stmt, 1);
-            const unsigned char* rtsp_url = sqlite3_column_text(stmt, 2);
-            int camt = sqlite3_column_int(stmt, 3);
-            int index = sqlite3_column_int(stmt, 4);
-            Camera_t cam;
-            strcpy(cam.ipaddr, (const char*)ip);
-            strcpy(cam.rtsp, (const char*)rtsp_url);
-            cam.id = id;
-            cam.type = get_by_val(camt);
-            cam.index = index;
-            cams.push_back(cam);
+int CameraStore::reload_if_changed(std::vector<Camera_t> &dst){
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        if (!db){
+            return -1;
+        }
+        if (loaded && data_version() == seen_version && sqlite3_total_changes(db) == seen_changes){
+            return 0;
         }
-        sqlite3_finalize(stmt);
-    } else {
-        std::cerr << "Error preparing select statement: " << sqlite3_errmsg(db) << std::endl;
     }
-    dst = cams;
-    sqlite3_close(db);
+    return load(dst) ? 1 : -1;
+}
+
+/* PRAGMA data_version changes when another connection commits, it is read from
+   the WAL index in shared memory */
+int64_t CameraStore::data_version(void){
+    int64_t v = -1;
+    if (sqlite3_step(st_version) == SQLITE_ROW){
+        v = sqlite3_column_int64(st_version, 0);
+    }
+    sqlite3_reset(st_version);
+    return v;
+}
+
+CameraStore *camera_store(const char *db_path){
+    static std::mutex stores_lock;
+    static std::map<std::string, std::unique_ptr<CameraStore>> stores;
+    std::lock_guard<std::mutex> lk(stores_lock);
+    std::unique_ptr<CameraStore> &store = stores[db_path];
+    if (!store){
+        store.reset(new CameraStore(db_path));
+    }
+    else {
+        // other threads may hold the pointer, a failed store is reopened in place
+        store->open();
+    }
+    return store.get();
+}
+
+// Function to open the database
+sqlite3* open_database(const char* db_path) {
+    sqlite3* db;
+    if (sqlite3_open(db_path, &db)) {
+        std::cerr << "Error opening database: " << sqlite3_errmsg(db) << std::endl;
+        return nullptr;
+    }
+    return db;
+}
+
+int create_cameras_table(const char* db_path){
+    if (!camera_store(db_path)->is_open()){
+        return 0;
+    }
+    std::cout << "Cameras table created successfully." << std::endl;
     return 1;
-}
\ No newline at end of file
+}
+
+// Function to insert a camera into the database
+void insert_camera_db(const char* db_path, Camera_t cam) {
+    camera_store(db_path)->insert(cam);
+}
+
+int delete_camera_db(const char* db_path, int cam_id){
+    return camera_store(db_path)->remove(cam_id);
+}
+
+int delete_all_cams(const char * db_path){
+    return camera_store(db_path)->remove_all();
+}
+
+// Function to get all cameras from the database
+int get_all_cameras_db(const char* db_path, std::vector<Camera_t> &dst) {
+    return camera_store(db_path)->load(dst);
+}
+
+/* reloads dst only when the camera table changed, returns 1 if it did */
+int reload_cameras_db(const char* db_path, std::vector<Camera_t> &dst){
+    return camera_store(db_path)->reload_if_changed(dst);
+}